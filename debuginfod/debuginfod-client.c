@@ -43,6 +43,7 @@
 #include "debuginfod.h"
 #include "system.h"
 #include <ctype.h>
+#include <inttypes.h>
 #include <errno.h>
 #include <stdlib.h>
 #include <gelf.h>
@@ -71,8 +72,19 @@ int debuginfod_find_source (debuginfod_client *c, const unsigned char *b,
 int debuginfod_find_section (debuginfod_client *c, const unsigned char *b,
 			     int s, const char *scn, char **p)
 			      { return -ENOSYS; }
+int debuginfod_find_debuginfo_range (debuginfod_client *c,
+				     const unsigned char *b, int s,
+				     int64_t o, int64_t l, int64_t *z,
+				     char **p) { return -ENOSYS; }
 int debuginfod_find_metadata (debuginfod_client *c,
                               const char *k, const char *v, char **p) { return -ENOSYS; }
+debuginfod_prefetch *debuginfod_prefetch_begin (debuginfod_client *c,
+						const unsigned char **b,
+						const int *s, const char **t,
+						int n, debuginfod_prefetch_cb_t f)
+						{ errno = ENOSYS; return NULL; }
+int debuginfod_prefetch_take (debuginfod_prefetch *p, int i) { return 1; }
+int debuginfod_prefetch_end (debuginfod_prefetch *p, int c) { return -ENOSYS; }
 void debuginfod_set_progressfn(debuginfod_client *c,
 			       debuginfod_progressfn_t fn) { }
 void debuginfod_set_verbose_fd(debuginfod_client *c, int fd) { }
@@ -100,6 +112,7 @@ void debuginfod_end (debuginfod_client *c) { }
 #include <linux/limits.h>
 #include <time.h>
 #include <utime.h>
+#include <sys/file.h>
 #include <sys/syscall.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -214,6 +227,27 @@ static const char *cache_miss_filename = "cache_miss_s";
 static const char *cache_max_unused_age_filename = "max_unused_age_s";
 static const long cache_default_max_unused_age_s = 604800; /* 1 week */
 
+/* The max_size_mb file within the debuginfod cache specifies the size
+   in megabytes the cache is trimmed to when cleaning, least recently
+   used files first.  0 means no limit.  */
+static const char *cache_max_size_filename = "max_size_mb";
+static const long cache_default_max_size_mb = 0;
+
+/* The cache_index file within the debuginfod cache lists the cached
+   files with their access time and size, so cleaning doesn't need to
+   walk the whole cache.  Each access appends a line "ATIME SIZE FILE",
+   with SIZE the disk space used, split between the hard links to the
+   file, and FILE relative to the cache directory, and the last line
+   for a file wins.  The first line "walked TIME OTHER" gives the time
+   of the last full walk and the disk space it found used by the
+   directories, symlinks and files of the cache not in the index.  The
+   index is rebuilt by a walk after cache_index_max_walk_age_s to pick
+   up files it missed, or cache_index_max_walk_age_sized_s if the cache
+   has a max_size_mb, to keep OTHER from getting too stale.  */
+static const char *cache_index_filename = "cache_index";
+static const time_t cache_index_max_walk_age_s = 2592000; /* 30 days */
+static const time_t cache_index_max_walk_age_sized_s = 604800; /* 1 week */
+
 /* The metadata_retention_default_s file within the debuginfod cache
    specifies how long metadata query results should be cached. */
 static const long metadata_retention_default_s = 3600; /* 1 hour */
@@ -230,6 +264,9 @@ static const char *url_delim =  " ";
 /* Timeout for debuginfods, in seconds (to get at least 100K). */
 static const long default_timeout = 90;
 
+/* Number of files a prefetch downloads at the same time.  */
+static const long prefetch_default_concurrency = 8;
+
 /* Default retry count for download error. */
 static const long default_retry_limit = 2;
 
@@ -527,66 +564,285 @@ debuginfod_config_cache(debuginfod_client *c, char *config_path,
   return cache_config;
 }
 
-/* Delete any files that have been unmodied for a period
-   longer than $DEBUGINFOD_CACHE_CLEAN_INTERVAL_S.  */
+/* One file in the cache index.  */
+struct cache_index_entry
+{
+  char *file;			/* Relative to the cache directory.  */
+  time_t atime;
+  off_t size;
+  size_t seq;			/* Line in the index, later lines win.  */
+};
+
+struct cache_index
+{
+  struct cache_index_entry *entries;
+  size_t n;
+  size_t alloc;
+};
+
 static int
-debuginfod_clean_cache(debuginfod_client *c,
-		       char *cache_path, char *interval_path,
-		       char *max_unused_path)
+cache_index_push (struct cache_index *idx, const char *file,
+		  time_t atime, off_t size)
 {
-  time_t clean_interval, max_unused_age;
-  int rc = -1;
-  struct stat st;
+  if (idx->n == idx->alloc)
+    {
+      size_t alloc = idx->alloc * 2 + 64;
+      struct cache_index_entry *entries
+	= reallocarray (idx->entries, alloc, sizeof *entries);
+      if (entries == NULL)
+	return -ENOMEM;
+      idx->entries = entries;
+      idx->alloc = alloc;
+    }
 
-  /* Create new interval file.  */
-  rc = debuginfod_config_cache(c, interval_path,
-			       cache_clean_default_interval_s, &st);
-  if (rc < 0)
-    return rc;
-  clean_interval = (time_t)rc;
+  char *copy = strdup (file);
+  if (copy == NULL)
+    return -ENOMEM;
+  idx->entries[idx->n] = (struct cache_index_entry)
+    { .file = copy, .atime = atime, .size = size, .seq = idx->n };
+  idx->n++;
+  return 0;
+}
 
-  /* Check timestamp of interval file to see whether cleaning is necessary.  */
-  if (time(NULL) - st.st_mtime < clean_interval)
-    /* Interval has not passed, skip cleaning.  */
-    return 0;
+static void
+cache_index_free (struct cache_index *idx)
+{
+  for (size_t i = 0; i < idx->n; i++)
+    free (idx->entries[i].file);
+  free (idx->entries);
+  idx->entries = NULL;
+  idx->n = idx->alloc = 0;
+}
 
-  /* Update timestamp representing when the cache was last cleaned.
-     Do it at the start to reduce the number of threads trying to do a
-     cleanup simultaneously.  */
-  utime (interval_path, NULL);
+static int
+cache_index_compare_file (const void *a, const void *b)
+{
+  const struct cache_index_entry *e1 = a;
+  const struct cache_index_entry *e2 = b;
+  int cmp = strcmp (e1->file, e2->file);
+  if (cmp != 0)
+    return cmp;
+  return e1->seq < e2->seq ? -1 : e1->seq > e2->seq;
+}
 
-  /* Read max unused age value from config file.  */
-  rc = debuginfod_config_cache(c, max_unused_path,
-			       cache_default_max_unused_age_s, &st);
-  if (rc < 0)
+static int
+cache_index_compare_atime (const void *a, const void *b)
+{
+  const struct cache_index_entry *e1 = a;
+  const struct cache_index_entry *e2 = b;
+  if (e1->atime != e2->atime)
+    return e1->atime < e2->atime ? -1 : 1;
+  return strcmp (e1->file, e2->file);
+}
+
+/* Return the part of the cache file PATH relative to the cache
+   directory, that is its last two components, or NULL.  */
+static const char *
+cache_relative_path (const char *path)
+{
+  const char *slash = strrchr (path, '/');
+  if (slash == NULL)
+    return NULL;
+  while (slash > path && slash[-1] != '/')
+    slash--;
+  return slash > path ? slash : NULL;
+}
+
+/* Read the index from FD into IDX, keeping only the last line of each
+   file.  Sets WALKED to the time of the last full walk of the cache,
+   and OTHER to the space it found used outside the index.  */
+static int
+cache_index_read (int fd, struct cache_index *idx, time_t *walked,
+		  off_t *other)
+{
+  /* Keep FD open for the lock, fclose closes the dup.  */
+  int fd2 = dup (fd);
+  if (fd2 < 0)
+    return -errno;
+  FILE *f = fdopen (fd2, "r");
+  if (f == NULL)
+    {
+      int rc = -errno;
+      close (fd2);
+      return rc;
+    }
+
+  int rc = 0;
+  char *line = NULL;
+  size_t linelen = 0;
+  long long when, used = 0;
+  if (getline (&line, &linelen, f) < 0
+      || sscanf (line, "walked %lld %lld", &when, &used) < 1)
+    rc = -EINVAL;
+  else
+    {
+      *walked = (time_t) when;
+      *other = (off_t) used;
+    }
+
+  while (rc == 0 && getline (&line, &linelen, f) > 0)
+    {
+      /* Skip a line cut short, e.g. by a full disk.  */
+      char *nl = strchr (line, '\n');
+      if (nl == NULL)
+	continue;
+      *nl = '\0';
+
+      long long atime, size;
+      int pos = 0;
+      if (sscanf (line, "%lld %lld %n", &atime, &size, &pos) == 2
+	  && pos > 0 && line[pos] != '\0')
+	rc = cache_index_push (idx, line + pos, (time_t) atime, (off_t) size);
+    }
+  free (line);
+  fclose (f);
+  if (rc != 0)
     return rc;
-  max_unused_age = (time_t)rc;
 
+  qsort (idx->entries, idx->n, sizeof idx->entries[0],
+	 cache_index_compare_file);
+  size_t n = 0;
+  for (size_t i = 0; i < idx->n; i++)
+    if (i + 1 < idx->n
+	&& strcmp (idx->entries[i].file, idx->entries[i + 1].file) == 0)
+      free (idx->entries[i].file);
+    else
+      idx->entries[n++] = idx->entries[i];
+  idx->n = n;
+  return 0;
+}
+
+/* Replace the index at INDEX_PATH with the files in IDX.  Best effort,
+   without an index the next cleaning walks the cache.  */
+static void
+cache_index_write (const char *index_path, const struct cache_index *idx,
+		   time_t walked, off_t other)
+{
+  char *tmp_path;
+  if (asprintf (&tmp_path, "%s.XXXXXX", index_path) < 0)
+    return;
+
+  int fd = mkstemp (tmp_path);
+  if (fd >= 0)
+    {
+      FILE *f = fdopen (fd, "w");
+      bool ok = (f != NULL
+		 && fprintf (f, "walked %lld %lld\n", (long long) walked,
+			     (long long) other) > 0);
+      for (size_t i = 0; ok && i < idx->n; i++)
+	ok = fprintf (f, "%lld %lld %s\n", (long long) idx->entries[i].atime,
+		      (long long) idx->entries[i].size,
+		      idx->entries[i].file) > 0;
+      if (f == NULL)
+	close (fd);
+      else if (fclose (f) != 0)
+	ok = false;
+      if (! ok || rename (tmp_path, index_path) != 0)
+	(void) unlink (tmp_path);
+    }
+  free (tmp_path);
+}
+
+/* Record an access to the cache file PATH, open as FD or -1, in the
+   cache index.  Best effort, a missing line only makes the file look
+   older to the next cleaning.  */
+static void
+cache_index_add (const char *path, int fd)
+{
+  const char *file = cache_relative_path (path);
+  struct stat st;
+  if (file == NULL || (fd >= 0 ? fstat (fd, &st) : stat (path, &st)) != 0)
+    return;
+
+  char *index_path, *line;
+  if (asprintf (&index_path, "%.*s%s", (int) (file - path), path,
+		cache_index_filename) < 0)
+    return;
+  if (asprintf (&line, "%lld %lld %s\n", (long long) time (NULL),
+		(long long) (st.st_blocks * 512 / (st.st_nlink ?: 1)),
+		file) < 0)
+    {
+      free (index_path);
+      return;
+    }
+
+  /* Cleaning replaces the index while holding an exclusive lock on it,
+     make sure the line goes into the current one.  No index yet means
+     the next cleaning walks the cache anyway.  */
+  for (int tries = 0; tries < 2; tries++)
+    {
+      int ifd = open (index_path, O_WRONLY | O_APPEND | O_CLOEXEC);
+      if (ifd < 0)
+	break;
+      struct stat ist, pst;
+      bool current = (flock (ifd, LOCK_SH) == 0
+		      && fstat (ifd, &ist) == 0
+		      && stat (index_path, &pst) == 0
+		      && ist.st_dev == pst.st_dev
+		      && ist.st_ino == pst.st_ino);
+      if (current)
+	(void) write_retry (ifd, line, strlen (line));
+      close (ifd);
+      if (current)
+	break;
+    }
+
+  free (line);
+  free (index_path);
+}
+
+/* Record the files libdwfl keeps next to the cached ELF files in the
+   build-id directory DIR.  They are used together with the ELF files,
+   so they are recorded whenever those are.  */
+static void
+cache_index_add_companions (const char *dir)
+{
+  static const char *const companions[] =
+    { "addrsym-index", "addrinfo-index" };
+  for (size_t i = 0; i < sizeof companions / sizeof companions[0]; i++)
+    {
+      char *path;
+      if (asprintf (&path, "%s/%s", dir, companions[i]) < 0)
+	continue;
+      cache_index_add (path, -1);
+      free (path);
+    }
+}
+
+/* Walk the whole cache, delete the files matching RE that haven't
+   been accessed in MAX_UNUSED_AGE and the newly empty directories,
+   and put the remaining files into IDX.  Sets *OTHER to the space used
+   by the rest matching RE, which the index doesn't track.  Returns 1
+   if the progress callback cancelled the walk.  */
+static int
+cache_walk (debuginfod_client *c, char *cache_path, regex_t *re,
+	    time_t max_unused_age, struct cache_index *idx, off_t *other)
+{
   char * const dirs[] = { cache_path, NULL, };
 
   FTS *fts = fts_open(dirs, 0, NULL);
   if (fts == NULL)
     return -errno;
 
-  regex_t re;
-  const char * pattern = ".*/(metadata.*|[a-f0-9]+(/hdr.*|/debuginfo|/executable|/source.*|))$"; /* include dirs */
-  /* NB: also matches .../section/ subdirs, so extracted section files also get cleaned. */
-  if (regcomp (&re, pattern, REG_EXTENDED | REG_NOSUB) != 0)
-    return -ENOMEM;
-
   FTSENT *f;
+  struct stat st;
   long files = 0;
+  int rc = 0;
   time_t now = time(NULL);
-  while ((f = fts_read(fts)) != NULL)
+  *other = 0;
+  while (rc == 0 && (f = fts_read(fts)) != NULL)
     {
       /* ignore any files that do not match the pattern.  */
-      if (regexec (&re, f->fts_path, 0, NULL, 0) != 0)
+      if (regexec (re, f->fts_path, 0, NULL, 0) != 0)
         continue;
 
       files++;
       if (c->progressfn) /* inform/check progress callback */
         if ((c->progressfn) (c, files, 0))
-          break;
+          {
+            rc = 1;
+            break;
+          }
 
       switch (f->fts_info)
         {
@@ -594,13 +850,30 @@ debuginfod_clean_cache(debuginfod_client *c,
           /* delete file if max_unused_age has been met or exceeded w.r.t. atime.  */
           if (now - f->fts_statp->st_atime >= max_unused_age)
             (void) unlink (f->fts_path);
+          else if (f->fts_level == 2)
+            rc = cache_index_push (idx, cache_relative_path (f->fts_path),
+                                   f->fts_statp->st_atime,
+                                   (f->fts_statp->st_blocks * 512
+                                    / f->fts_statp->st_nlink));
+          else
+            *other += (f->fts_statp->st_blocks * 512
+                       / f->fts_statp->st_nlink);
+          break;
+
+        case FTS_SL:
+          /* delete content symlinks whose cache files are all gone.  */
+          if (stat (f->fts_path, &st) != 0)
+            (void) unlink (f->fts_path);
+          else
+            *other += f->fts_statp->st_blocks * 512;
           break;
 
         case FTS_DP:
           /* Remove if old & empty.  Weaken race against concurrent creation by 
              checking mtime. */
-          if (now - f->fts_statp->st_mtime >= max_unused_age)
-            (void) rmdir (f->fts_path);
+          if (now - f->fts_statp->st_mtime < max_unused_age
+              || rmdir (f->fts_path) != 0)
+            *other += f->fts_statp->st_blocks * 512;
           break;
 
         default:
@@ -608,9 +881,233 @@ debuginfod_clean_cache(debuginfod_client *c,
         }
     }
   fts_close (fts);
+
+  return rc;
+}
+
+/* Delete the files in IDX that haven't been accessed in
+   MAX_UNUSED_AGE, then the least recently used ones until the rest
+   take no more than MAX_SIZE bytes, if MAX_SIZE is not 0.  The caller
+   takes the space used outside the index off MAX_SIZE.  Newly empty
+   directories are left to the next full walk.  */
+static void
+cache_index_evict (debuginfod_client *c, const char *cache_path,
+		   regex_t *re, struct cache_index *idx,
+		   time_t max_unused_age, off_t max_size)
+{
+  /* Drop anything that doesn't look like a cache file, the index is
+     just a text file in the cache directory.  */
+  size_t n = 0;
+  off_t total = 0;
+  for (size_t i = 0; i < idx->n; i++)
+    {
+      struct cache_index_entry *e = &idx->entries[i];
+      char *path;
+      bool ok = (e->file[0] != '/'
+		 && strstr (e->file, "..") == NULL
+		 && cache_relative_path (e->file) == NULL
+		 && strchr (e->file, '/') != NULL
+		 && asprintf (&path, "%s/%s", cache_path, e->file) >= 0);
+      if (ok)
+	{
+	  ok = regexec (re, path, 0, NULL, 0) == 0;
+	  free (path);
+	}
+      if (ok)
+	{
+	  total += e->size;
+	  idx->entries[n++] = *e;
+	}
+      else
+	free (e->file);
+    }
+  idx->n = n;
+
+  qsort (idx->entries, idx->n, sizeof idx->entries[0],
+	 cache_index_compare_atime);
+
+  time_t now = time (NULL);
+  n = 0;
+  size_t i = 0;
+  while (i < idx->n)
+    {
+      struct cache_index_entry *e = &idx->entries[i];
+      if (c->progressfn && (c->progressfn) (c, i + 1, idx->n))
+	{
+	  /* Keep the rest.  */
+	  memmove (&idx->entries[n], e, (idx->n - i) * sizeof *e);
+	  n += idx->n - i;
+	  break;
+	}
+
+      if (now - e->atime < max_unused_age
+	  && (max_size == 0 || total <= max_size))
+	{
+	  idx->entries[n++] = *e;
+	  i++;
+	  continue;
+	}
+
+      char *path;
+      if (asprintf (&path, "%s/%s", cache_path, e->file) >= 0)
+	{
+	  /* The index only has the atime and size of its last walk or
+	     download.  The file may have been used since, and shared
+	     with another cache file or no longer, changing its part of
+	     the blocks.  If it was used, move it to its place by its
+	     real atime and look at it again there.  */
+	  struct stat st;
+	  if (stat (path, &st) == 0)
+	    {
+	      off_t size = st.st_blocks * 512 / (st.st_nlink ?: 1);
+	      total += size - e->size;
+	      e->size = size;
+	      if (st.st_atime > e->atime)
+		{
+		  struct cache_index_entry fresh = *e;
+		  fresh.atime = st.st_atime;
+		  size_t j = i + 1;
+		  while (j < idx->n && idx->entries[j].atime <= fresh.atime)
+		    j++;
+		  memmove (e, e + 1, (j - i - 1) * sizeof *e);
+		  idx->entries[j - 1] = fresh;
+		  free (path);
+		  continue;
+		}
+	      if (now - e->atime < max_unused_age
+		  && (max_size == 0 || total <= max_size))
+		{
+		  idx->entries[n++] = *e;
+		  free (path);
+		  i++;
+		  continue;
+		}
+	    }
+	  (void) unlink (path);
+	  free (path);
+	}
+      total -= e->size;
+      free (e->file);
+      i++;
+    }
+  idx->n = n;
+}
+
+/* Delete any files that have been unmodied for a period
+   longer than $DEBUGINFOD_CACHE_CLEAN_INTERVAL_S, and the least
+   recently used ones if the cache is bigger than max_size_mb.  */
+static int
+debuginfod_clean_cache(debuginfod_client *c,
+		       char *cache_path, char *interval_path,
+		       char *max_unused_path)
+{
+  time_t clean_interval, max_unused_age;
+  off_t max_size;
+  int rc = -1;
+  struct stat st;
+
+  /* Create new interval file.  */
+  rc = debuginfod_config_cache(c, interval_path,
+			       cache_clean_default_interval_s, &st);
+  if (rc < 0)
+    return rc;
+  clean_interval = (time_t)rc;
+
+  /* Check timestamp of interval file to see whether cleaning is necessary.  */
+  if (time(NULL) - st.st_mtime < clean_interval)
+    /* Interval has not passed, skip cleaning.  */
+    return 0;
+
+  /* Update timestamp representing when the cache was last cleaned.
+     Do it at the start to reduce the number of threads trying to do a
+     cleanup simultaneously.  */
+  utime (interval_path, NULL);
+
+  /* Read max unused age value from config file.  */
+  rc = debuginfod_config_cache(c, max_unused_path,
+			       cache_default_max_unused_age_s, &st);
+  if (rc < 0)
+    return rc;
+  max_unused_age = (time_t)rc;
+
+  /* Read max size value from config file.  */
+  char *max_size_path = NULL;
+  char *index_path = NULL;
+  if (asprintf (&max_size_path, "%s/%s", cache_path,
+		cache_max_size_filename) < 0
+      || asprintf (&index_path, "%s/%s", cache_path,
+		   cache_index_filename) < 0)
+    {
+      free (max_size_path);
+      return -ENOMEM;
+    }
+  rc = debuginfod_config_cache(c, max_size_path,
+			       cache_default_max_size_mb, &st);
+  free (max_size_path);
+  if (rc < 0)
+    {
+      free (index_path);
+      return rc;
+    }
+  max_size = (off_t)rc * 1024 * 1024;
+
+  regex_t re;
+  const char * pattern = ".*/(metadata.*|content(/[a-f0-9]+(/[a-f0-9]+-[0-9]+)?)?|[a-f0-9]+(/hdr.*|/debuginfo(-partial(-map)?)?|/executable|/source.*|/section-.*|/addr(sym|info)-index|/[^/]*\\.lock|))$"; /* include dirs */
+  if (regcomp (&re, pattern, REG_EXTENDED | REG_NOSUB) != 0)
+    {
+      free (index_path);
+      return -ENOMEM;
+    }
+
+  /* Use the index unless it is time for a full walk.  Holding the
+     exclusive lock keeps new lines from getting lost until the
+     compacted index replaces it.  The walk is done without the lock,
+     it picks up the atimes of the files themselves.  */
+  struct cache_index idx = { NULL, 0, 0 };
+  time_t walked = 0;
+  off_t other = 0;
+  time_t max_walk_age = (max_size == 0 ? cache_index_max_walk_age_s
+			 : cache_index_max_walk_age_sized_s);
+  int ifd = open (index_path, O_RDONLY | O_CLOEXEC);
+  if (ifd >= 0
+      && (flock (ifd, LOCK_EX) != 0
+	  || cache_index_read (ifd, &idx, &walked, &other) != 0
+	  || time (NULL) - walked >= max_walk_age))
+    {
+      cache_index_free (&idx);
+      close (ifd);
+      ifd = -1;
+    }
+
+  rc = 0;
+  if (ifd < 0)
+    {
+      walked = time (NULL);
+      rc = cache_walk (c, cache_path, &re, max_unused_age, &idx, &other);
+    }
+
+  /* An incomplete walk would make an incomplete index.  If the space
+     used outside the index already takes all of MAX_SIZE, make the
+     indexed files fit in one byte, i.e. evict all of them.  */
+  if (rc == 0)
+    {
+      off_t index_max_size = max_size;
+      if (max_size != 0)
+	index_max_size = max_size > other ? max_size - other : 1;
+      cache_index_evict (c, cache_path, &re, &idx, max_unused_age,
+			 index_max_size);
+      cache_index_write (index_path, &idx, walked, other);
+    }
+  else if (rc > 0)
+    rc = 0;
+
+  if (ifd >= 0)
+    close (ifd);
+  cache_index_free (&idx);
   regfree (&re);
+  free (index_path);
 
-  return 0;
+  return rc;
 }
 
 
@@ -1024,6 +1521,74 @@ init_handle(debuginfod_client *client,
 }
 
 
+/* Take the lock on downloading TARGET_CACHE_PATH, so that processes
+   asking for the same file at the same time download it only once.
+   The lock is a flock on LOCK_PATH, TARGET_CACHE_PATH.lock, which goes
+   away with the process holding it.  The holder unlinks LOCK_PATH
+   before it lets go, so a lock on a file no longer at LOCK_PATH is
+   taken again on the new one.  If another process holds the lock, wait
+   for it, checking the progressfn for cancellation.  On success
+   *LOCK_FD is the locked file, or -1 if the lock file can't be used,
+   then we just download without it.  Returns 1 if we waited, so the
+   target may be in the cache now, 0 if not, or a negative error
+   code.  */
+static int
+cache_lock (debuginfod_client *c, const char *lock_path,
+	    const char *target_cache_path, int *lock_fd)
+{
+  int vfd = c->verbose_fd;
+  *lock_fd = -1;
+
+  int waited = 0;
+  while (1)
+    {
+      int fd = open (lock_path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+      if (fd < 0)
+	return waited;
+
+      while (flock (fd, LOCK_EX | LOCK_NB) != 0)
+	{
+	  if (errno != EWOULDBLOCK && errno != EINTR)
+	    {
+	      close (fd);
+	      return waited;
+	    }
+	  if (! waited && vfd >= 0)
+	    dprintf (vfd, "waiting for another download of %s\n",
+		     target_cache_path);
+	  waited = 1;
+	  if (c->progressfn && (*c->progressfn) (c, 0, 0))
+	    {
+	      c->progressfn_cancel = true;
+	      close (fd);
+	      return -ECANCELED;
+	    }
+	  struct timespec ts = { .tv_sec = 0, .tv_nsec = 50 * 1000 * 1000 };
+	  nanosleep (&ts, NULL);
+	}
+
+      struct stat fst, pst;
+      if (fstat (fd, &fst) == 0 && stat (lock_path, &pst) == 0
+	  && fst.st_dev == pst.st_dev && fst.st_ino == pst.st_ino)
+	{
+	  *lock_fd = fd;
+	  return waited;
+	}
+      close (fd);
+    }
+}
+
+/* Let go of the lock taken by cache_lock, if any.  */
+static void
+cache_unlock (const char *lock_path, int lock_fd)
+{
+  if (lock_fd < 0)
+    return;
+  (void) unlink (lock_path);
+  close (lock_fd);
+}
+
+
 /*
  * This function busy-waits on one or more curl queries to complete. This can
  * be controlled via only_one, which, if true, will find the first winner and exit
@@ -1111,36 +1676,42 @@ perform_queries(CURLM *curlm, CURL **target_handle, struct handle_data *data, de
       long dl_size = -1;
       if (target_handle && *target_handle && (c->progressfn || maxsize > 0))
         {
-          /* Get size of file being downloaded. NB: If going through
-             deflate-compressing proxies, this number is likely to be
-             unavailable, so -1 may show. */
-          CURLcode curl_res;
-#if CURL_AT_LEAST_VERSION(7, 55, 0)
-          curl_off_t cl;
-          curl_res = curl_easy_getinfo(*target_handle,
-                                       CURLINFO_CONTENT_LENGTH_DOWNLOAD_T,
-                                       &cl);
-          if (curl_res == CURLE_OK && cl >= 0)
-            dl_size = (cl > LONG_MAX ? LONG_MAX : (long)cl);
-#else
-          double cl;
-          curl_res = curl_easy_getinfo(*target_handle,
-                                       CURLINFO_CONTENT_LENGTH_DOWNLOAD,
-                                       &cl);
-          if (curl_res == CURLE_OK && cl >= 0)
-            dl_size = (cl >= (double)(LONG_MAX+1UL) ? LONG_MAX : (long)cl);
-#endif
-          /* If Content-Length is -1, try to get the size from
-             X-Debuginfod-Size */
-          if (dl_size == -1 && c->winning_headers != NULL)
+          /* Get size of file being downloaded.  Prefer X-Debuginfod-Size,
+             which is the size of the decoded content as it lands in the
+             cache, even if the server or a proxy compressed the response
+             with some Content-Encoding.  */
+          if (c->winning_headers != NULL)
             {
               long xdl;
               char *hdr = strcasestr(c->winning_headers, "x-debuginfod-size");
               size_t off = strlen("x-debuginfod-size:");
-              
+
               if (hdr != NULL && sscanf(hdr + off, "%ld", &xdl) == 1)
                 dl_size = xdl;
             }
+
+          /* Otherwise fall back to Content-Length.  NB: If going
+             through deflate-compressing proxies, this number is likely
+             to be unavailable, so -1 may show. */
+          if (dl_size == -1)
+            {
+              CURLcode curl_res;
+#if CURL_AT_LEAST_VERSION(7, 55, 0)
+              curl_off_t cl;
+              curl_res = curl_easy_getinfo(*target_handle,
+                                           CURLINFO_CONTENT_LENGTH_DOWNLOAD_T,
+                                           &cl);
+              if (curl_res == CURLE_OK && cl >= 0)
+                dl_size = (cl > LONG_MAX ? LONG_MAX : (long)cl);
+#else
+              double cl;
+              curl_res = curl_easy_getinfo(*target_handle,
+                                           CURLINFO_CONTENT_LENGTH_DOWNLOAD,
+                                           &cl);
+              if (curl_res == CURLE_OK && cl >= 0)
+                dl_size = (cl >= (double)(LONG_MAX+1UL) ? LONG_MAX : (long)cl);
+#endif
+            }
         }
       
       if (c->progressfn) /* inform/check progress callback */
@@ -1279,16 +1850,202 @@ update_atime (int fd)
   (void) futimens (fd, tvs);  /* best effort */
 }
 
-/* Attempt to read an ELF/DWARF section with name SECTION from FD and write
-   it to a separate file in the debuginfod cache.  If successful the absolute
-   path of the separate file containing SECTION will be stored in USR_PATH.
-   FD_PATH is the absolute path for FD.
-
-   If the section cannot be extracted, then return a negative error code.
-   -ENOENT indicates that the parent file was able to be read but the
-   section name was not found.  -EEXIST indicates that the section was
-   found but had type SHT_NOBITS.  */
-
+/* Compute a hash of the SIZE bytes of FD.  It only has to find the
+   candidates for sharing, those are compared byte by byte before
+   sharing anything.  */
+static int
+content_hash (int fd, off_t size, uint64_t *hash)
+{
+  uint64_t buf[8192];
+  uint64_t h = (uint64_t) size;
+  for (off_t pos = 0; pos < size; )
+    {
+      ssize_t n = pread_retry (fd, buf, sizeof buf, pos);
+      if (n <= 0)
+	return -EIO;
+      /* Zero pad the last partial word.  */
+      size_t words = (n + sizeof buf[0] - 1) / sizeof buf[0];
+      memset ((char *) buf + n, 0, words * sizeof buf[0] - n);
+      for (size_t i = 0; i < words; i++)
+	{
+	  h = (h ^ buf[i]) * 0x9e3779b97f4a7c15ULL;
+	  h ^= h >> 32;
+	}
+      pos += n;
+    }
+  *hash = h;
+  return 0;
+}
+
+/* Whether the SIZE bytes of FD1 and FD2 are the same.  */
+static bool
+content_equal (int fd1, int fd2, off_t size)
+{
+  char buf1[32768], buf2[32768];
+  for (off_t pos = 0; pos < size; )
+    {
+      ssize_t n = pread_retry (fd1, buf1, sizeof buf1, pos);
+      if (n <= 0 || pread_retry (fd2, buf2, n, pos) != n
+	  || memcmp (buf1, buf2, n) != 0)
+	return false;
+      pos += n;
+    }
+  return true;
+}
+
+/* Replace the cache file PATH, open as FD with status ST, with a hard
+   link to the cache file OTHER if that has the same content.  */
+static bool
+cache_share (debuginfod_client *c, const char *path, int fd,
+	     const struct stat *st, const char *other)
+{
+  int other_fd = open (other, O_RDONLY | O_CLOEXEC);
+  if (other_fd < 0)
+    return false;
+
+  struct stat other_st;
+  bool same = (fstat (other_fd, &other_st) == 0
+	       && other_st.st_dev == st->st_dev
+	       && other_st.st_ino != st->st_ino
+	       && other_st.st_size == st->st_size
+	       && content_equal (fd, other_fd, st->st_size));
+  close (other_fd);
+  if (! same)
+    return false;
+
+  /* Link under a fresh temporary name and rename that over PATH, so
+     PATH is complete all the time.  */
+  char *tmp_path;
+  if (asprintf (&tmp_path, "%s.XXXXXX", path) < 0)
+    return false;
+  bool shared = false;
+  int tmp_fd = mkstemp (tmp_path);
+  if (tmp_fd >= 0)
+    {
+      close (tmp_fd);
+      (void) unlink (tmp_path);
+      shared = link (other, tmp_path) == 0 && rename (tmp_path, path) == 0;
+      if (! shared)
+	(void) unlink (tmp_path);
+    }
+  free (tmp_path);
+
+  if (shared)
+    {
+      /* OTHER's index line still has all the blocks.  */
+      cache_index_add (other, -1);
+      if (c->verbose_fd >= 0)
+	dprintf (c->verbose_fd, "shared %s with %s\n", path, other);
+    }
+  return shared;
+}
+
+/* If $DEBUGINFOD_CACHE_DEDUP is set, replace the cache file PATH, just
+   downloaded into CACHE_PATH and open as FD, with a hard link to an
+   earlier cache file with the same content.  Distros ship the same
+   sources, and sometimes the same debuginfo, under many build-ids.
+
+   The earlier file is found through CACHE_PATH/content/XX/HASH-SIZE, a
+   symlink to the last cache file with that content.  It is relative,
+   so the cache can be moved.  When all cache files with the content
+   are cleaned the symlink dangles until the next file with the
+   content replaces it, or the next full walk of the cache removes it.
+   Best effort, without sharing PATH just keeps its own copy.  */
+static void
+cache_dedup (debuginfod_client *c, const char *cache_path,
+	     const char *path, int fd)
+{
+  const char *dedup_envvar = getenv (DEBUGINFOD_CACHE_DEDUP_ENV_VAR);
+  if (dedup_envvar == NULL || atoi (dedup_envvar) <= 0)
+    return;
+
+  struct stat st;
+  uint64_t hash;
+  const char *file = cache_relative_path (path);
+  if (file == NULL || fstat (fd, &st) != 0 || st.st_size == 0
+      || content_hash (fd, st.st_size, &hash) != 0)
+    return;
+
+  char *content_dir = NULL;
+  char *dir = NULL;
+  char *link_path = NULL;
+  char *link_target = NULL;
+  char *tmp_path = NULL;
+  if (asprintf (&content_dir, "%s/content", cache_path) < 0)
+    {
+      content_dir = NULL;
+      goto out;
+    }
+  if (asprintf (&dir, "%s/%02x", content_dir, (unsigned int) (hash >> 56)) < 0)
+    {
+      dir = NULL;
+      goto out;
+    }
+  if (asprintf (&link_path, "%s/%016" PRIx64 "-%" PRId64, dir, hash,
+		(int64_t) st.st_size) < 0)
+    {
+      link_path = NULL;
+      goto out;
+    }
+  if (asprintf (&link_target, "../../%s", file) < 0)
+    {
+      link_target = NULL;
+      goto out;
+    }
+
+  char target[PATH_MAX];
+  ssize_t len = readlink (link_path, target, sizeof target - 1);
+  if (len > 0)
+    {
+      target[len] = '\0';
+      if (strcmp (target, link_target) == 0)
+	goto out;
+
+      char *other;
+      if (asprintf (&other, "%s/%s", dir, target) < 0)
+	goto out;
+      bool shared = cache_share (c, path, fd, &st, other);
+      free (other);
+      if (shared)
+	goto out;
+    }
+
+  /* Point the symlink at PATH for the next file with this content.  */
+  (void) mkdir (content_dir, 0700);
+  (void) mkdir (dir, 0700);
+  if (asprintf (&tmp_path, "%s.XXXXXX", link_path) < 0)
+    {
+      tmp_path = NULL;
+      goto out;
+    }
+  int tmp_fd = mkstemp (tmp_path);
+  if (tmp_fd >= 0)
+    {
+      close (tmp_fd);
+      (void) unlink (tmp_path);
+      if (symlink (link_target, tmp_path) != 0
+	  || rename (tmp_path, link_path) != 0)
+	(void) unlink (tmp_path);
+    }
+
+ out:
+  free (tmp_path);
+  free (link_target);
+  free (link_path);
+  free (dir);
+  free (content_dir);
+}
+
+/* Attempt to read an ELF/DWARF section with name SECTION from FD and write
+   it to a separate file in the debuginfod cache.  If successful the absolute
+   path of the separate file containing SECTION will be stored in USR_PATH.
+   FD_PATH is the absolute path for FD.
+
+   If the section cannot be extracted, then return a negative error code.
+   -ENOENT indicates that the parent file was able to be read but the
+   section name was not found.  -EEXIST indicates that the section was
+   found but had type SHT_NOBITS.  */
+
 static int
 extract_section (int fd, const char *section, char *fd_path, char **usr_path)
 {
@@ -1411,6 +2168,7 @@ extract_section (int fd, const char *section, char *fd_path, char **usr_path)
 	      goto out3;
 	    }
 
+	  cache_index_add (sec_path, sec_fd);
 	  if (usr_path != NULL)
 	    *usr_path = sec_path;
 	  else
@@ -1780,9 +2538,11 @@ debuginfod_query_server_by_buildid (debuginfod_client *c,
   char *target_cachehdr_path = NULL;
   char *target_cache_tmppath = NULL;
   char *target_cachehdr_tmppath = NULL;
+  char *lock_path = NULL;
   char suffix[NAME_MAX];
   char build_id_bytes[MAX_BUILD_ID_BYTES * 2 + 1];
   int vfd = c->verbose_fd;
+  int lock_fd = -1;
   int rc, r;
 
   c->progressfn_cancel = false;
@@ -1936,6 +2696,7 @@ debuginfod_query_server_by_buildid (debuginfod_client *c,
   }
   xalloc_str (target_cache_tmppath, "%s.XXXXXX", target_cache_path);
   xalloc_str (target_cachehdr_tmppath, "%s.XXXXXX", target_cachehdr_path);  
+  xalloc_str (lock_path, "%s.lock", target_cache_path);
 
   /* XXX combine these */
   xalloc_str (interval_path, "%s/%s", cache_path, cache_clean_interval_filename);
@@ -1958,6 +2719,7 @@ debuginfod_query_server_by_buildid (debuginfod_client *c,
   if (rc != 0)
     goto out;
 
+ check_cache: ;
   /* Check if the target is already in the cache. */
   int fd = open(target_cache_path, O_RDONLY);
   if (fd >= 0)
@@ -1985,6 +2747,10 @@ debuginfod_query_server_by_buildid (debuginfod_client *c,
             }
           /* Success!!!! */
           update_atime(fd);
+          cache_index_add (target_cache_path, fd);
+          if (strcmp (type, "debuginfo") == 0
+              || strcmp (type, "executable") == 0)
+            cache_index_add_companions (target_cache_dir);
           rc = fd;
 
           /* Attempt to transcribe saved headers. */
@@ -2009,6 +2775,7 @@ debuginfod_query_server_by_buildid (debuginfod_client *c,
                 }
 
               update_atime (fdh);
+              cache_index_add (target_cachehdr_path, fdh);
               close (fdh);
             }
  
@@ -2057,6 +2824,18 @@ debuginfod_query_server_by_buildid (debuginfod_client *c,
 	goto out;
     }
 
+  /* Download the file only once, if other processes want it at the
+     same time.  If one of them had the lock, it may have found it
+     or found it missing by now.  */
+  if (lock_fd < 0)
+    {
+      rc = cache_lock (c, lock_path, target_cache_path, &lock_fd);
+      if (rc < 0)
+	goto out;
+      if (rc > 0)
+	goto check_cache;
+    }
+
   long timeout = default_timeout;
   const char* timeout_envvar = getenv(DEBUGINFOD_TIMEOUT_ENV_VAR);
   if (timeout_envvar != NULL)
@@ -2350,7 +3129,10 @@ debuginfod_query_server_by_buildid (debuginfod_client *c,
     {
       int efd = open (target_cache_path, O_CREAT|O_EXCL, DEFFILEMODE);
       if (efd >= 0)
-        close(efd);
+        {
+          cache_index_add (target_cache_path, efd);
+          close(efd);
+        }
     }
   else if (rc == -EFBIG)
     goto out2;
@@ -2442,6 +3224,8 @@ debuginfod_query_server_by_buildid (debuginfod_client *c,
       goto out2;
       /* Perhaps we need not give up right away; could retry or something ... */
     }
+  cache_dedup (c, cache_path, target_cache_path, fd);
+  cache_index_add (target_cache_path, -1);
 
   /* write out the headers, best effort basis */
   if (c->winning_headers) {
@@ -2451,7 +3235,10 @@ debuginfod_query_server_by_buildid (debuginfod_client *c,
       size_t bytes = pwrite_retry (fdh, c->winning_headers, bytes_to_write, 0);
       (void) close (fdh);
       if (bytes == bytes_to_write)
-        (void) rename (target_cachehdr_tmppath, target_cachehdr_path);
+        {
+          if (rename (target_cachehdr_tmppath, target_cachehdr_path) == 0)
+            cache_index_add (target_cachehdr_path, -1);
+        }
       else
         (void) unlink (target_cachehdr_tmppath);
       if (vfd >= 0)
@@ -2544,6 +3331,8 @@ debuginfod_query_server_by_buildid (debuginfod_client *c,
     (void)unlink (target_cachehdr_tmppath);
   free (target_cachehdr_tmppath);
   free (target_cachehdr_path);
+  cache_unlock (lock_path, lock_fd);
+  free (lock_path);
     
   return rc;
 }
@@ -2719,6 +3508,781 @@ debuginfod_find_section (debuginfod_client *client,
   return rc;
 }
 
+/* The state of each file of a prefetch.  */
+enum prefetch_item_state
+{
+  prefetch_queued,
+  prefetch_running,
+  prefetch_done,
+  prefetch_taken		/* by debuginfod_prefetch_take */
+};
+
+/* Shared by the worker threads of a prefetch.  */
+struct debuginfod_prefetch
+{
+  debuginfod_client *client;
+  unsigned char **build_ids;
+  int *build_id_lens;
+  char **types;
+  int n;
+  debuginfod_prefetch_cb_t callback;
+
+  pthread_mutex_t lock;
+  pthread_cond_t cond;	/* signalled as each item is done */
+  /* Held while calling the callback and the caller's progressfn, so
+     that only one worker calls them at a time, without LOCK.  */
+  pthread_mutex_t callback_lock;
+  enum prefetch_item_state *state;
+  int next;   /* no item before this one is still queued */
+  int done;   /* items finished or taken */
+  int found;  /* items found */
+  bool cancel;
+
+  long nworkers;
+  debuginfod_client **workers;
+  pthread_t *threads;
+};
+
+/* Call the callback of P for item I, unless I is -1, and the caller's
+   progressfn with DONE, one worker at a time.  The callbacks run
+   without P->lock, so they may not block the other workers for long,
+   but must not call the prefetch functions either.  Returns whether
+   the progressfn asked to cancel, and then cancels P.  */
+static bool
+prefetch_report (debuginfod_prefetch *p, int i, int rc, const char *path,
+		 int done)
+{
+  pthread_mutex_lock (&p->callback_lock);
+  if (i >= 0 && p->callback)
+    (*p->callback) (p->client, i, rc, path);
+  bool cancel = (p->client->progressfn
+		 && (*p->client->progressfn) (p->client, done, p->n));
+  pthread_mutex_unlock (&p->callback_lock);
+
+  if (cancel)
+    {
+      pthread_mutex_lock (&p->lock);
+      p->cancel = true;
+      pthread_mutex_unlock (&p->lock);
+    }
+  return cancel;
+}
+
+/* The progressfn of the worker clients.  It passes the progress of the
+   whole prefetch on to the caller's progressfn while files are being
+   downloaded, and stops the transfers when the prefetch is cancelled,
+   by that or by debuginfod_prefetch_end.  */
+static int
+prefetch_progressfn (debuginfod_client *c, long a __attribute__ ((unused)),
+		     long b __attribute__ ((unused)))
+{
+  debuginfod_prefetch *p = c->user_data;
+  pthread_mutex_lock (&p->lock);
+  bool cancel = p->cancel;
+  int done = p->done;
+  pthread_mutex_unlock (&p->lock);
+  if (! cancel && p->client->progressfn
+      && prefetch_report (p, -1, 0, NULL, done))
+    cancel = true;
+  return cancel;
+}
+
+static void *
+prefetch_worker (void *arg)
+{
+  debuginfod_client *c = arg;
+  debuginfod_prefetch *p = c->user_data;
+
+  pthread_mutex_lock (&p->lock);
+  while (! p->cancel)
+    {
+      while (p->next < p->n && p->state[p->next] != prefetch_queued)
+	p->next++;
+      if (p->next == p->n)
+	break;
+      int i = p->next++;
+      p->state[i] = prefetch_running;
+      pthread_mutex_unlock (&p->lock);
+
+      char *path = NULL;
+      int rc;
+      const char *type = p->types[i];
+      if (strcmp (type, "debuginfo") == 0 || strcmp (type, "executable") == 0)
+	rc = debuginfod_query_server_by_buildid (c, p->build_ids[i],
+						 p->build_id_lens[i],
+						 type, NULL, &path);
+      else
+	rc = -EINVAL;
+      if (rc >= 0)
+	{
+	  close (rc);
+	  rc = 0;
+	}
+
+      pthread_mutex_lock (&p->lock);
+      p->state[i] = prefetch_done;
+      p->done++;
+      if (rc == 0)
+	p->found++;
+      pthread_cond_broadcast (&p->cond);
+      int done = p->done;
+      pthread_mutex_unlock (&p->lock);
+
+      prefetch_report (p, i, rc, path, done);
+      free (path);
+      pthread_mutex_lock (&p->lock);
+    }
+  pthread_mutex_unlock (&p->lock);
+  return NULL;
+}
+
+static void
+prefetch_free (debuginfod_prefetch *p)
+{
+  if (p->workers != NULL)
+    for (long i = 0; i < p->nworkers; i++)
+      debuginfod_end (p->workers[i]);
+  if (p->build_ids != NULL)
+    for (int i = 0; i < p->n; i++)
+      free (p->build_ids[i]);
+  free (p->build_ids);
+  free (p->build_id_lens);
+  if (p->types != NULL)
+    for (int i = 0; i < p->n; i++)
+      free (p->types[i]);
+  free (p->types);
+  free (p->state);
+  free (p->workers);
+  free (p->threads);
+  pthread_mutex_destroy (&p->lock);
+  pthread_mutex_destroy (&p->callback_lock);
+  pthread_cond_destroy (&p->cond);
+  free (p);
+}
+
+debuginfod_prefetch *
+debuginfod_prefetch_begin (debuginfod_client *client,
+			   const unsigned char **build_ids,
+			   const int *build_id_lens,
+			   const char **types,
+			   int n,
+			   debuginfod_prefetch_cb_t callback)
+{
+  if (n < 0)
+    {
+      errno = EINVAL;
+      return NULL;
+    }
+
+  const char *urls_envvar = getenv(DEBUGINFOD_URLS_ENV_VAR);
+  if (urls_envvar == NULL || urls_envvar[0] == '\0')
+    {
+      errno = ENOSYS;
+      return NULL;
+    }
+
+  long concurrency = prefetch_default_concurrency;
+  const char *concurrency_envvar = getenv(DEBUGINFOD_PREFETCH_CONCURRENCY_ENV_VAR);
+  if (concurrency_envvar != NULL)
+    concurrency = atol (concurrency_envvar);
+  if (concurrency < 1)
+    concurrency = 1;
+  if (concurrency > n)
+    concurrency = n;
+
+  debuginfod_prefetch *p = calloc (1, sizeof *p);
+  if (p == NULL)
+    {
+      errno = ENOMEM;
+      return NULL;
+    }
+  p->client = client;
+  p->callback = callback;
+  pthread_mutex_init (&p->lock, NULL);
+  pthread_mutex_init (&p->callback_lock, NULL);
+  pthread_cond_init (&p->cond, NULL);
+
+  /* The caller may free the arrays and build ids once we return.  */
+  p->build_ids = calloc (n, sizeof p->build_ids[0]);
+  p->build_id_lens = calloc (n, sizeof p->build_id_lens[0]);
+  p->types = calloc (n, sizeof p->types[0]);
+  p->state = calloc (n, sizeof p->state[0]);
+  p->workers = calloc (concurrency, sizeof p->workers[0]);
+  p->threads = calloc (concurrency, sizeof p->threads[0]);
+  if (n > 0 && (p->build_ids == NULL || p->build_id_lens == NULL
+		|| p->types == NULL || p->state == NULL
+		|| p->workers == NULL || p->threads == NULL))
+    goto nomem;
+  for (; p->n < n; p->n++)
+    {
+      int i = p->n;
+      /* As for debuginfod_query_server_by_buildid: 0 means a
+	 hexadecimal string.  */
+      size_t len = (build_id_lens[i] > 0 ? (size_t) build_id_lens[i]
+		    : strlen ((const char *) build_ids[i]) + 1);
+      p->build_ids[i] = malloc (len);
+      p->types[i] = strdup (types[i]);
+      if (p->build_ids[i] == NULL || p->types[i] == NULL)
+	{
+	  p->n++;
+	  goto nomem;
+	}
+      memcpy (p->build_ids[i], build_ids[i], len);
+      p->build_id_lens[i] = build_id_lens[i];
+    }
+
+  if (client->verbose_fd >= 0)
+    dprintf (client->verbose_fd, "prefetching %d files with %ld threads\n",
+	     n, concurrency);
+
+  /* Each worker has its own client, and so its own curl multi handle,
+     with the headers and verbosity of the caller's.  */
+  for (long i = 0; i < concurrency; i++)
+    {
+      debuginfod_client *c = debuginfod_begin ();
+      if (c == NULL)
+	break;
+      c->user_data = p;
+      c->progressfn = prefetch_progressfn;
+      c->verbose_fd = client->verbose_fd;
+      c->user_agent_set_p = client->user_agent_set_p;
+      for (struct curl_slist *h = client->headers; h != NULL; h = h->next)
+	{
+	  struct curl_slist *temp = curl_slist_append (c->headers, h->data);
+	  if (temp != NULL)
+	    c->headers = temp;
+	}
+      if (pthread_create (&p->threads[i], NULL, prefetch_worker, c) != 0)
+	{
+	  debuginfod_end (c);
+	  break;
+	}
+      p->workers[p->nworkers++] = c;
+    }
+
+  if (n > 0 && p->nworkers == 0)
+    {
+      prefetch_free (p);
+      errno = EAGAIN;
+      return NULL;
+    }
+  return p;
+
+ nomem:
+  prefetch_free (p);
+  errno = ENOMEM;
+  return NULL;
+}
+
+int
+debuginfod_prefetch_take (debuginfod_prefetch *p, int index)
+{
+  if (index < 0 || index >= p->n)
+    return -EINVAL;
+
+  int rc = 0;
+  pthread_mutex_lock (&p->lock);
+  if (p->state[index] == prefetch_queued)
+    {
+      p->state[index] = prefetch_taken;
+      p->done++;
+      rc = 1;
+    }
+  else
+    while (p->state[index] == prefetch_running)
+      pthread_cond_wait (&p->cond, &p->lock);
+  pthread_mutex_unlock (&p->lock);
+  return rc;
+}
+
+int
+debuginfod_prefetch_end (debuginfod_prefetch *p, int cancel)
+{
+  if (p == NULL)
+    return -EINVAL;
+
+  if (cancel)
+    {
+      pthread_mutex_lock (&p->lock);
+      p->cancel = true;
+      pthread_mutex_unlock (&p->lock);
+    }
+  for (long i = 0; i < p->nworkers; i++)
+    pthread_join (p->threads[i], NULL);
+
+  int rc = p->done == p->n ? p->found : -ECANCELED;
+  prefetch_free (p);
+  return rc;
+}
+
+
+/* The debuginfo file fetched piecewise by debuginfod_find_debuginfo_range
+   is a sparse file in the cache, next to which a map file has one byte
+   per block, set once the block has been fetched.  */
+#define RANGE_BLOCK_SIZE (64 * 1024)
+
+struct range_data
+{
+  /* Must be first, the curl callbacks get a pointer to it.  */
+  struct handle_data data;
+
+  /* The map file.  */
+  int map_fd;
+
+  /* The range asked for, and where the next byte received goes.  */
+  int64_t first, last;
+  int64_t start, pos;
+  bool pos_known, started, done;
+
+  /* Total size of the file, from Content-Range or X-Debuginfod-Size.  */
+  int64_t size;
+
+  /* DEBUGINFOD_MAXSIZE and DEBUGINFOD_MAXTIME, if positive, and when
+     the call started.  */
+  long maxsize, maxtime;
+  struct timespec start_time;
+
+  /* Error in a callback.  */
+  int err;
+};
+
+
+static size_t
+range_header_callback (char *buffer, size_t size, size_t numitems,
+		       void *userdata)
+{
+  struct range_data *d = (struct range_data *) userdata;
+  if (size != 1)
+    return 0;
+
+  long long first, last, total;
+  if (strncasecmp (buffer, "HTTP/", 5) == 0) /* new response, maybe a redirect */
+    {
+      d->pos_known = false;
+      d->size = -1;
+    }
+  else if (sscanf (buffer, "%*[Cc]ontent-%*[Rr]ange: bytes %lld-%lld/%lld",
+		   &first, &last, &total) == 3)
+    {
+      d->pos = first;
+      d->pos_known = true;
+      d->size = total;
+    }
+  else if (strncasecmp (buffer, "x-debuginfod-size:", 18) == 0
+	   && sscanf (buffer + 18, "%lld", &total) == 1
+	   && d->size < 0)
+    d->size = total;
+  return numitems;
+}
+
+
+static size_t
+range_write_callback (char *ptr, size_t size, size_t nmemb, void *userdata)
+{
+  struct range_data *d = (struct range_data *) userdata;
+  size_t n = size * nmemb;
+
+  if (! d->started)
+    {
+      long code = 0;
+      curl_easy_getinfo (d->data.handle, CURLINFO_RESPONSE_CODE, &code);
+      if (code == 200) /* the whole file, we'll just take what we need */
+	d->pos = 0;
+      else if (code != 206 || ! d->pos_known)
+	{
+	  d->err = -EPROTO;
+	  return 0;
+	}
+      if (d->size <= 0)
+	{
+	  d->err = -EPROTO;
+	  return 0;
+	}
+      if (d->maxsize > 0 && d->size > d->maxsize)
+	{
+	  d->err = -EFBIG;
+	  return 0;
+	}
+
+      /* Size the sparse file, starting over if we had some other file
+	 of another size.  */
+      struct stat st;
+      if (fstat (d->data.fd, &st) != 0)
+	{
+	  d->err = -errno;
+	  return 0;
+	}
+      if (st.st_size != d->size
+	  && (ftruncate (d->map_fd, 0) != 0
+	      || ftruncate (d->data.fd, 0) != 0
+	      || ftruncate (d->data.fd, d->size) != 0))
+	{
+	  d->err = -errno;
+	  return 0;
+	}
+      d->start = d->pos;
+      d->started = true;
+    }
+
+  if (d->pos + (int64_t) n > d->size)
+    {
+      d->err = -EPROTO;
+      return 0;
+    }
+  if (pwrite_retry (d->data.fd, ptr, n, d->pos) != (ssize_t) n)
+    {
+      d->err = -errno;
+      return 0;
+    }
+  d->pos += n;
+
+  /* Stop a server that ignored the range once we have it all.  */
+  if (d->pos > d->last)
+    {
+      d->done = true;
+      return 0;
+    }
+
+  struct timespec cur_time;
+  if (d->maxtime > 0
+      && clock_gettime (CLOCK_MONOTONIC_RAW, &cur_time) == 0
+      && cur_time.tv_sec - d->start_time.tv_sec > d->maxtime)
+    {
+      d->err = -ETIME;
+      return 0;
+    }
+
+  debuginfod_client *c = d->data.client;
+  if (c->progressfn
+      && (*c->progressfn) (c, d->pos - d->start, d->last + 1 - d->start))
+    {
+      c->progressfn_cancel = true;
+      d->err = -ECANCELED;
+      return 0;
+    }
+  return n;
+}
+
+
+/* Find the first and last blocks between FIRST and LAST which are not
+   marked in the map file yet.  Returns false if there are none.  */
+static bool
+range_missing (int map_fd, int64_t first, int64_t last,
+	       int64_t *missing_first, int64_t *missing_last)
+{
+  bool any = false;
+  char map[4096];
+  for (int64_t b = first; b <= last; )
+    {
+      size_t want = sizeof map;
+      if (last - b + 1 < (int64_t) want)
+	want = last - b + 1;
+      ssize_t got = pread_retry (map_fd, map, want, b);
+      if (got <= 0)
+	{
+	  /* Nothing past the end of the map has been fetched.  */
+	  if (! any)
+	    *missing_first = b;
+	  *missing_last = last;
+	  return true;
+	}
+      for (ssize_t i = 0; i < got; i++)
+	if (map[i] == 0)
+	  {
+	    if (! any)
+	      *missing_first = b + i;
+	    *missing_last = b + i;
+	    any = true;
+	  }
+      b += got;
+    }
+  return any;
+}
+
+
+int
+debuginfod_find_debuginfo_range (debuginfod_client *client,
+				 const unsigned char *build_id,
+				 int build_id_len,
+				 int64_t offset, int64_t length,
+				 int64_t *size, char **path)
+{
+  char *server_urls = NULL;
+  char *cache_path = NULL;
+  char *target_cache_dir = NULL;
+  char *target_cache_path = NULL;
+  char *partial_path = NULL;
+  char *map_path = NULL;
+  char **server_url_list = NULL;
+  ima_policy_t *url_ima_policies = NULL;
+  int num_urls = 0;
+  char build_id_bytes[MAX_BUILD_ID_BYTES * 2 + 1];
+  int vfd = client->verbose_fd;
+  int fd = -1, map_fd = -1;
+  int rc;
+
+  if (offset < 0 || length <= 0)
+    return -EINVAL;
+  if (length > INT64_MAX - offset)
+    length = INT64_MAX - offset;
+
+  if (vfd >= 0)
+    dprintf (vfd, "debuginfod_find_debuginfo_range %" PRId64 "+%" PRId64 "\n",
+	     offset, length);
+
+  const char *urls_envvar = getenv(DEBUGINFOD_URLS_ENV_VAR);
+  if (urls_envvar == NULL || urls_envvar[0] == '\0')
+    return -ENOSYS;
+
+  if ((build_id_len >= MAX_BUILD_ID_BYTES) ||
+      (build_id_len == 0 &&
+       strlen ((const char *) build_id) > MAX_BUILD_ID_BYTES*2))
+    return -EINVAL;
+  if (build_id_len == 0) /* expect clean hexadecimal */
+    strcpy (build_id_bytes, (const char *) build_id);
+  else
+    for (int i = 0; i < build_id_len; i++)
+      sprintf(build_id_bytes + (i * 2), "%02x", build_id[i]);
+
+  cache_path = make_cache_path();
+  if (!cache_path)
+    {
+      rc = -ENOMEM;
+      goto out;
+    }
+  xalloc_str (target_cache_dir, "%s/%s", cache_path, build_id_bytes);
+  xalloc_str (target_cache_path, "%s/debuginfo", target_cache_dir);
+  xalloc_str (partial_path, "%s/debuginfo-partial", target_cache_dir);
+  xalloc_str (map_path, "%s/debuginfo-partial-map", target_cache_dir);
+  if (mkdir (cache_path, ACCESSPERMS) != 0 && errno != EEXIST)
+    {
+      rc = -errno;
+      goto out;
+    }
+  (void) mkdir (target_cache_dir, 0700);
+
+  /* The whole file may be in the cache already.  */
+  fd = open (target_cache_path, O_RDONLY);
+  if (fd >= 0)
+    {
+      struct stat st;
+      if (fstat (fd, &st) == 0 && st.st_size > 0)
+	{
+	  update_atime (fd);
+	  cache_index_add (target_cache_path, fd);
+	  if (size != NULL)
+	    *size = st.st_size;
+	  if (path != NULL)
+	    *path = strdup (target_cache_path);
+	  rc = fd;
+	  fd = -1;
+	  goto out;
+	}
+      close (fd);
+    }
+
+  fd = open (partial_path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+  map_fd = open (map_path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+  if (fd < 0 || map_fd < 0)
+    {
+      rc = -errno;
+      goto out;
+    }
+
+  struct stat st;
+  if (fstat (fd, &st) != 0)
+    {
+      rc = -errno;
+      goto out;
+    }
+  if (st.st_size == 0 && ftruncate (map_fd, 0) != 0) /* a new file */
+    {
+      rc = -errno;
+      goto out;
+    }
+
+  /* Clip to the file, if we know its size already.  */
+  int64_t end = offset + length;
+  if (st.st_size > 0)
+    {
+      if (offset >= st.st_size)
+	{
+	  rc = -EINVAL;
+	  goto out;
+	}
+      if (end > st.st_size)
+	end = st.st_size;
+    }
+  int64_t first_block = offset / RANGE_BLOCK_SIZE;
+  int64_t last_block = (end - 1) / RANGE_BLOCK_SIZE;
+  int64_t missing_first, missing_last;
+
+  if (range_missing (map_fd, first_block, last_block,
+		     &missing_first, &missing_last))
+    {
+      long timeout = default_timeout;
+      const char* timeout_envvar = getenv(DEBUGINFOD_TIMEOUT_ENV_VAR);
+      if (timeout_envvar != NULL)
+	timeout = atoi (timeout_envvar);
+
+      /* DEBUGINFOD_MAXSIZE limits the size of the whole file, as for
+	 debuginfod_find_debuginfo, even though only part is fetched.  */
+      long maxsize = 0;
+      const char *maxsize_envvar = getenv(DEBUGINFOD_MAXSIZE_ENV_VAR);
+      if (maxsize_envvar != NULL)
+	maxsize = atol (maxsize_envvar);
+      if (maxsize > 0 && vfd >= 0)
+	dprintf (vfd, "using max size %ldB\n", maxsize);
+      if (maxsize > 0 && st.st_size > maxsize)
+	{
+	  rc = -EFBIG;
+	  goto out;
+	}
+
+      long maxtime = 0;
+      const char *maxtime_envvar = getenv(DEBUGINFOD_MAXTIME_ENV_VAR);
+      if (maxtime_envvar != NULL)
+	maxtime = atol (maxtime_envvar);
+      if (maxtime > 0 && vfd >= 0)
+	dprintf (vfd, "using max time %lds\n", maxtime);
+      struct timespec start_time = { 0, 0 };
+      if (maxtime > 0 && clock_gettime (CLOCK_MONOTONIC_RAW, &start_time) != 0)
+	{
+	  rc = -errno;
+	  goto out;
+	}
+
+      add_default_headers(client);
+
+      server_urls = strdup (urls_envvar);
+      if (server_urls == NULL)
+	{
+	  rc = -ENOMEM;
+	  goto out;
+	}
+      /* A range can't be checked against the IMA signature of the
+	 whole file, so treat it as a section query: servers in
+	 enforcing mode are skipped, and other modes don't verify.  */
+      rc = init_server_urls ("buildid", "section", server_urls,
+			     &server_url_list, &url_ima_policies, &num_urls, vfd);
+      if (rc != 0)
+	goto out;
+
+      rc = -ENOENT;
+      for (int i = 0; i < num_urls; i++)
+	{
+	  struct range_data d;
+	  memset (&d, 0, sizeof d);
+	  d.data.fd = fd;
+	  d.data.client = client;
+	  d.map_fd = map_fd;
+	  d.first = missing_first * RANGE_BLOCK_SIZE;
+	  d.last = (missing_last + 1) * RANGE_BLOCK_SIZE - 1;
+	  if (st.st_size > 0 && d.last >= st.st_size)
+	    d.last = st.st_size - 1;
+	  d.size = -1;
+	  d.maxsize = maxsize;
+	  d.maxtime = maxtime;
+	  d.start_time = start_time;
+	  snprintf (d.data.url, PATH_MAX, "%s/%s/debuginfo",
+		    server_url_list[i], build_id_bytes);
+
+	  int r = init_handle (client, range_write_callback,
+			       range_header_callback, &d.data, i, timeout, vfd);
+	  if (r != 0)
+	    {
+	      if (d.data.handle != NULL)
+		curl_easy_cleanup (d.data.handle);
+	      rc = r;
+	      continue;
+	    }
+	  char range[64];
+	  snprintf (range, sizeof range, "%" PRId64 "-%" PRId64, d.first, d.last);
+	  curl_easy_setopt (d.data.handle, CURLOPT_RANGE, range);
+	  /* Ranges are of the file itself.  */
+	  curl_easy_setopt (d.data.handle, CURLOPT_ACCEPT_ENCODING, NULL);
+
+	  CURLcode cr = curl_easy_perform (d.data.handle);
+	  if (vfd >= 0)
+	    dprintf (vfd, "range %s from %s: %s\n", range, d.data.url,
+		     d.done ? "done" : curl_easy_strerror (cr));
+	  curl_easy_cleanup (d.data.handle);
+
+	  /* Mark the blocks we got in full, even if we didn't get all.  */
+	  if (d.started)
+	    {
+	      char present = 1;
+	      for (int64_t b = (d.start + RANGE_BLOCK_SIZE - 1) / RANGE_BLOCK_SIZE;
+		   b * RANGE_BLOCK_SIZE < d.pos; b++)
+		if (b * RANGE_BLOCK_SIZE + RANGE_BLOCK_SIZE <= d.pos
+		    || d.pos == d.size)
+		  (void) pwrite_retry (map_fd, &present, 1, b);
+	      st.st_size = d.size;
+	    }
+
+	  if (cr == CURLE_OK || d.done)
+	    {
+	      rc = 0;
+	      break;
+	    }
+	  if (d.err != 0)
+	    rc = d.err;
+	  /* These limits are the caller's, not the server's.  */
+	  if (rc == -EFBIG || rc == -ETIME || rc == -ECANCELED)
+	    break;
+	}
+      if (rc != 0)
+	goto out;
+
+      if (offset >= st.st_size)
+	{
+	  rc = -EINVAL;
+	  goto out;
+	}
+      if (end > st.st_size)
+	end = st.st_size;
+      last_block = (end - 1) / RANGE_BLOCK_SIZE;
+      if (range_missing (map_fd, first_block, last_block,
+			 &missing_first, &missing_last))
+	{
+	  rc = -ENOENT;
+	  goto out;
+	}
+    }
+  else
+    update_atime (fd);
+  cache_index_add (partial_path, fd);
+  cache_index_add (map_path, map_fd);
+
+  rc = open (partial_path, O_RDONLY | O_CLOEXEC);
+  if (rc < 0)
+    {
+      rc = -errno;
+      goto out;
+    }
+  if (size != NULL)
+    *size = st.st_size;
+  if (path != NULL)
+    *path = strdup (partial_path);
+
+ out:
+  if (fd >= 0)
+    close (fd);
+  if (map_fd >= 0)
+    close (map_fd);
+  for (int i = 0; i < num_urls; i++)
+    free (server_url_list[i]);
+  free (server_url_list);
+  free (url_ima_policies);
+  free (server_urls);
+  free (map_path);
+  free (partial_path);
+  free (target_cache_path);
+  free (target_cache_dir);
+  free (cache_path);
+  return rc;
+}
+
 
 int debuginfod_find_metadata (debuginfod_client *client,
                               const char* key, const char* value, char **path)
@@ -3043,6 +4607,7 @@ int debuginfod_find_metadata (debuginfod_client *client,
       goto out1;
       /* Perhaps we need not give up right away; could retry or something ... */
     }
+  cache_index_add (target_cache_path, fd);
   
   /* don't close fd - we're returning it */
   /* don't unlink the tmppath; it's already been renamed. */
@@ -53,7 +53,10 @@ static const char args_doc[] = N_("debuginfo BUILDID\n"
                                   "source PATH /FILENAME\n"
                                   "section BUILDID SECTION-NAME\n"
                                   "section PATH SECTION-NAME\n"
+                                  "debuginfo-range BUILDID OFFSET LENGTH\n"
+                                  "debuginfo-range PATH OFFSET LENGTH\n"
                                   "metadata (glob|file|KEY) (GLOB|FILENAME|VALUE)\n"
+                                  "prefetch (debuginfo|executable) BUILDID...\n"
                                   );
 
 /* Definitions of arguments for argp functions.  */
@@ -121,6 +124,17 @@ static struct argp argp =
 
 
 
+/* Print the names of the files prefetched.  */
+static void
+prefetch_callback (debuginfod_client *c __attribute__((__unused__)),
+		   int index __attribute__((__unused__)),
+		   int rc __attribute__((__unused__)), const char *path)
+{
+  if (path != NULL)
+    printf("%s\n", path);
+}
+
+
 int
 main(int argc, char** argv)
 {
@@ -154,7 +168,8 @@ main(int argc, char** argv)
   if (strcmp(argv[remaining], "debuginfo") == 0
       || strcmp(argv[remaining], "executable") == 0
       || strcmp(argv[remaining], "source") == 0
-      || strcmp(argv[remaining], "section") == 0)
+      || strcmp(argv[remaining], "section") == 0
+      || strcmp(argv[remaining], "debuginfo-range") == 0)
     {
       int any_non_hex = 0;
       int i;
@@ -202,6 +217,8 @@ main(int argc, char** argv)
      Some requests (ex. metadata query may instead choose to do a different output,
      in that case a stringified json object) */
   bool print_cached_file = true;
+  /* And the result is a file descriptor to close.  */
+  bool rc_is_fd = true;
   /* Check whether FILETYPE is valid and call the appropriate
      debuginfod_find_* function. If FILETYPE is "source"
      then ensure a FILENAME was also supplied as an argument.  */
@@ -235,6 +252,55 @@ main(int argc, char** argv)
       rc = debuginfod_find_section(client, build_id, build_id_len,
 				   argv[remaining+2], &cache_name);
     }
+  else if (strcmp(argv[remaining], "debuginfo-range") == 0)
+    {
+      if (remaining+3 >= argc)
+	{
+	  fprintf(stderr,
+		  "If FILETYPE is \"debuginfo-range\" then OFFSET and LENGTH must be given\n");
+	  return 1;
+	}
+      int64_t size;
+      rc = debuginfod_find_debuginfo_range(client, build_id, build_id_len,
+					   strtoll(argv[remaining+2], NULL, 0),
+					   strtoll(argv[remaining+3], NULL, 0),
+					   &size, &cache_name);
+    }
+  else if (strcmp(argv[remaining], "prefetch") == 0)
+    {
+      if (remaining+2 >= argc)
+        {
+          fprintf(stderr, "Require FILETYPE and BUILDIDs for \"prefetch\"\n");
+          return 1;
+        }
+      int n = argc - (remaining+2);
+      const unsigned char **build_ids = calloc (n, sizeof build_ids[0]);
+      int *build_id_lens = calloc (n, sizeof build_id_lens[0]);
+      const char **types = calloc (n, sizeof types[0]);
+      if (build_ids == NULL || build_id_lens == NULL || types == NULL)
+        {
+          fprintf(stderr, "Out of memory\n");
+          return 1;
+        }
+      for (int i = 0; i < n; i++)
+        {
+          build_ids[i] = (const unsigned char *) argv[remaining+2+i];
+          types[i] = argv[remaining+1];
+        }
+      debuginfod_prefetch *prefetch
+        = debuginfod_prefetch_begin (client, build_ids, build_id_lens,
+                                     types, n, & prefetch_callback);
+      rc = prefetch != NULL ? debuginfod_prefetch_end (prefetch, 0) : -errno;
+      print_cached_file = false;
+      cache_name = NULL;
+      /* Not a file descriptor, but the number of files found.  */
+      rc_is_fd = false;
+      if (rc >= 0)
+        rc = rc == n ? 0 : -ENOENT;
+      free (build_ids);
+      free (build_id_lens);
+      free (types);
+    }
   else if (strcmp(argv[remaining], "metadata") == 0) /* no buildid! */
     {
       if (remaining+2 == argc)
@@ -294,7 +360,7 @@ main(int argc, char** argv)
       fprintf(stderr, "Server query failed: %s\n", strerror(-rc));
       return 1;
     }
-  else
+  else if (rc_is_fd)
     close (rc);
 
   if(print_cached_file) printf("%s\n", cache_name);
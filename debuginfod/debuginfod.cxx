@@ -67,6 +67,11 @@ extern "C" {
 #include <lzma.h>
 #endif
 
+#include <zlib.h>
+#ifdef USE_ZSTD_COMPRESS
+#include <zstd.h>
+#endif
+
 #include <unistd.h>
 #include <stdlib.h>
 #include <locale.h>
@@ -100,7 +105,9 @@ extern "C" {
 #include <vector>
 #include <set>
 #include <unordered_set>
+#include <unordered_map>
 #include <map>
+#include <algorithm>
 #include <string>
 #include <iostream>
 #include <iomanip>
@@ -108,6 +115,8 @@ extern "C" {
 #include <sstream>
 #include <mutex>
 #include <deque>
+#include <list>
+#include <memory>
 #include <condition_variable>
 #include <exception>
 #include <thread>
@@ -484,6 +493,19 @@ static const struct argp_option options[] =
      "Number of seconds to limit metadata query run time, 0=unlimited.", 0 },
 #define ARGP_KEY_HTTP_ADDR 0x100D
    { "listen-address", ARGP_KEY_HTTP_ADDR, "ADDR", 0, "HTTP address to listen on.", 0 },
+#define ARGP_KEY_LOOKUP_CACHE 0x100E
+   { "lookup-cache", ARGP_KEY_LOOKUP_CACHE, "NUM", 0, "Number of buildid lookups to cache, 0=none.", 0 },
+#define ARGP_KEY_LOOKUP_CACHE_TTL 0x100F
+   { "lookup-cache-ttl", ARGP_KEY_LOOKUP_CACHE_TTL, "SECONDS", 0,
+     "Number of seconds to cache not-found buildid lookups, default 60.", 0 },
+#define ARGP_KEY_SCAN_BATCH 0x1010
+   { "scan-batch", ARGP_KEY_SCAN_BATCH, "NUM", 0, "Number of files scanned per database transaction.", 0 },
+#define ARGP_KEY_SCAN_MEMORY 0x1011
+   { "scan-memory", ARGP_KEY_SCAN_MEMORY, "MB", 0,
+     "Megabytes of archive contents to classify in memory, larger files use $TMPDIR.", 0 },
+#define ARGP_KEY_HTTP_COMPRESS 0x1012
+   { "http-compress", ARGP_KEY_HTTP_COMPRESS, "ENCODINGS", 0,
+     "Comma-separated Content-Encodings to offer, in order of preference, or none.", 0 },
    { NULL, 0, NULL, 0, NULL, 0 },
   };
 
@@ -507,7 +529,8 @@ static struct argp argp =
 
 static string db_path;
 static sqlite3 *db;  // single connection, serialized across all our threads!
-static sqlite3 *dbq; // webapi query-servicing readonly connection, serialized ditto!
+class sqlite_query_pool;
+static sqlite_query_pool *dbq_pool; // webapi query-servicing readonly connections
 static unsigned verbose;
 static volatile sig_atomic_t interrupted = 0;
 static volatile sig_atomic_t forced_rescan_count = 0;
@@ -539,10 +562,15 @@ static bool scan_source_info = true;
 static string tmpdir;
 static bool passive_p = false;
 static long scan_checkpoint = 256;
+static long scan_batch = 256;
+static long scan_memory_mbs = 256;
+static vector<string> http_encodings; // none unless --http-compress
 #ifdef ENABLE_IMA_VERIFICATION
 static bool requires_koji_sigcache_mapping = false;
 #endif
 static unsigned metadata_maxtime_s = 5;
+static long lookup_cache_size = 65536;
+static unsigned lookup_cache_ttl_s = 60;
 
 static void set_metric(const string& key, double value);
 static void inc_metric(const string& key);
@@ -750,9 +778,51 @@ parse_opt (int key, char *arg,
       if (scan_checkpoint < 0)
         argp_failure(state, 1, EINVAL, "scan checkpoint");
       break;
+    case ARGP_KEY_SCAN_BATCH:
+      scan_batch = atol (arg);
+      if (scan_batch < 0)
+        argp_failure(state, 1, EINVAL, "scan batch");
+      break;
+    case ARGP_KEY_SCAN_MEMORY:
+      scan_memory_mbs = atol (arg);
+      if (scan_memory_mbs < 0)
+        argp_failure(state, 1, EINVAL, "scan memory");
+      break;
+    case ARGP_KEY_HTTP_COMPRESS:
+      {
+        http_encodings.clear();
+        string list = arg;
+        size_t pos = 0;
+        while (pos < list.size())
+          {
+            size_t comma = list.find(',', pos);
+            if (comma == string::npos)
+              comma = list.size();
+            string e = list.substr(pos, comma-pos);
+            pos = comma+1;
+            if (e == "none" || e == "")
+              continue;
+#ifdef USE_ZSTD_COMPRESS
+            if (e != "zstd" && e != "gzip")
+#else
+            if (e != "gzip")
+#endif
+              argp_failure(state, 1, EINVAL, "unsupported http compression %s", e.c_str());
+            http_encodings.push_back(e);
+          }
+      }
+      break;
     case ARGP_KEY_METADATA_MAXTIME:
       metadata_maxtime_s = (unsigned) atoi(arg);
       break;
+    case ARGP_KEY_LOOKUP_CACHE:
+      lookup_cache_size = atol (arg);
+      if (lookup_cache_size < 0)
+        argp_failure(state, 1, EINVAL, "lookup cache");
+      break;
+    case ARGP_KEY_LOOKUP_CACHE_TTL:
+      lookup_cache_ttl_s = (unsigned) atoi(arg);
+      break;
 #ifdef ENABLE_IMA_VERIFICATION
     case ARGP_KEY_KOJI_SIGCACHE:
       requires_koji_sigcache_mapping = true;
@@ -907,6 +977,13 @@ public:
       }
   }
 
+  // is there no more work to hand out right now?
+  bool empty ()
+  {
+    unique_lock<mutex> lock(mtx);
+    return q.size() == 0;
+  }
+
   // notify waitq that scanner thread is done with that last item
   void done_front ()
   {
@@ -1138,6 +1215,51 @@ void reportable_exception::report(ostream& o) const {
 ////////////////////////////////////////////////////////////////////////
 
 
+// A cache of prepared statements for one connection, so that hot
+// queries are only parsed and planned once.  Not locked: just like its
+// connection, it is used by one thread at a time.
+
+class sqlite_stmt_cache
+{
+private:
+  struct entry
+  {
+    sqlite3_stmt *pp;
+    bool busy;
+  };
+  unordered_map<string, entry> stmts; // by sql
+
+public:
+  ~sqlite_stmt_cache()
+  {
+    for (auto&& s : stmts)
+      sqlite3_finalize (s.second.pp);
+  }
+
+  sqlite3_stmt* take(const string& sql)
+  {
+    auto it = stmts.find(sql);
+    if (it == stmts.end() || it->second.busy) // NB: a nested user prepares its own
+      return 0;
+    it->second.busy = true;
+    return it->second.pp;
+  }
+
+  void give(const string& sql, sqlite3_stmt* pp)
+  {
+    (void) sqlite3_reset (pp);
+    (void) sqlite3_clear_bindings (pp);
+    auto it = stmts.find(sql);
+    if (it == stmts.end())
+      stmts[sql] = entry { pp, false };
+    else if (it->second.pp == pp)
+      it->second.busy = false;
+    else
+      sqlite3_finalize (pp);
+  }
+};
+
+
 // RAII style sqlite prepared-statement holder that matches { } block lifetime
 
 struct sqlite_ps
@@ -1147,6 +1269,7 @@ private:
   const string nickname;
   const string sql;
   sqlite3_stmt *pp;
+  sqlite_stmt_cache *cache;
   // for step_timeout()/callback
   struct timespec ts_start;
   double ts_timeout;
@@ -1155,13 +1278,20 @@ private:
   sqlite_ps& operator=(const sqlite_ps &); // make unassignable
 
 public:
-  sqlite_ps (sqlite3* d, const string& n, const string& s): db(d), nickname(n), sql(s) {
-    // tmp_ms_metric tick("sqlite3","prep",nickname);
-    if (verbose > 4)
-      obatched(clog) << nickname << " prep " << sql << endl;
-    int rc = sqlite3_prepare_v2 (db, sql.c_str(), -1 /* to \0 */, & this->pp, NULL);
-    if (rc != SQLITE_OK)
-      throw sqlite_exception(rc, "prepare " + sql);
+  sqlite_ps (sqlite3* d, const string& n, const string& s,
+             sqlite_stmt_cache* c = 0): db(d), nickname(n), sql(s), cache(c) {
+    this->pp = cache ? cache->take(sql) : 0;
+    if (cache)
+      inc_metric("sqlite3_stmt_cache_op_count","op",(this->pp ? "hit" : "miss"));
+    if (this->pp == 0)
+      {
+        tmp_ms_metric tick("sqlite3","prep",nickname);
+        if (verbose > 4)
+          obatched(clog) << nickname << " prep " << sql << endl;
+        int rc = sqlite3_prepare_v2 (db, sql.c_str(), -1 /* to \0 */, & this->pp, NULL);
+        if (rc != SQLITE_OK)
+          throw sqlite_exception(rc, "prepare " + sql);
+      }
     this->reset_timeout(0.0);
   }
 
@@ -1262,7 +1392,13 @@ public:
   }
 
   
-  ~sqlite_ps () { sqlite3_finalize (this->pp); }
+  ~sqlite_ps ()
+  {
+    if (cache)
+      cache->give (sql, this->pp);
+    else
+      sqlite3_finalize (this->pp);
+  }
   operator sqlite3_stmt* () { return this->pp; }
 };
 
@@ -1270,6 +1406,137 @@ public:
 ////////////////////////////////////////////////////////////////////////
 
 
+// A pool of readonly connections for the webapi query threads.  With
+// just one connection, all concurrent queries would queue on its
+// mutex.  Instead each request checks out a connection of its own, so
+// the connections are opened NOMUTEX.
+
+class sqlite_query_pool
+{
+private:
+  mutex mtx;
+  condition_variable cv;
+  vector<sqlite3*> conns; // all of them, for interrupt(); never reallocated
+  volatile sig_atomic_t nconns;
+  vector<sqlite3*> idle;
+  map<sqlite3*,sqlite_stmt_cache*> caches; // fixed after startup
+
+  sqlite_query_pool(const sqlite_query_pool&); // make uncopyable
+  sqlite_query_pool& operator=(const sqlite_query_pool &); // make unassignable
+
+public:
+  sqlite_query_pool(unsigned n): nconns(0)
+  {
+    conns.reserve(n);
+    idle.reserve(n);
+    set_metric("sqlite3_pool_size", n);
+  }
+
+  ~sqlite_query_pool()
+  {
+    nconns = 0; // for signal_handler not to freak
+    for (auto&& c : caches)
+      delete c.second; // finalize statements before closing
+    for (auto&& d : conns)
+      (void) sqlite3_close (d);
+  }
+
+  void add(sqlite3* d) // during startup only
+  {
+    unique_lock<mutex> lock(mtx);
+    conns.push_back(d);
+    caches[d] = new sqlite_stmt_cache;
+    nconns = conns.size();
+    idle.push_back(d);
+    set_metric("sqlite3_pool_idle", idle.size());
+  }
+
+  sqlite3* get()
+  {
+    tmp_ms_metric tick("sqlite3_pool","op","wait");
+    unique_lock<mutex> lock(mtx);
+    if (idle.empty())
+      inc_metric("sqlite3_pool_op_count","op","blocked");
+    while (idle.empty())
+      cv.wait(lock);
+    sqlite3* d = idle.back();
+    idle.pop_back();
+    set_metric("sqlite3_pool_idle", idle.size());
+    return d;
+  }
+
+  void put(sqlite3* d)
+  {
+    unique_lock<mutex> lock(mtx);
+    idle.push_back(d);
+    set_metric("sqlite3_pool_idle", idle.size());
+    cv.notify_one();
+  }
+
+  sqlite_stmt_cache* stmt_cache(sqlite3* d)
+  {
+    return caches.at(d);
+  }
+
+  void interrupt() // from signal_handler
+  {
+    for (sig_atomic_t i = 0; i < nconns; i++)
+      sqlite3_interrupt (conns[i]);
+  }
+
+  void release_memory()
+  {
+    // NB: only the idle ones, the others are in use by their threads
+    unique_lock<mutex> lock(mtx);
+    for (auto&& d : idle)
+      sqlite3_db_release_memory (d);
+  }
+};
+
+
+// RAII style checkout of a pooled query connection for the calling
+// thread.  A nested checkout in the same thread reuses the outer one,
+// so a request never waits for a second connection while holding one.
+
+class sqlite_query_conn
+{
+private:
+  static thread_local sqlite3* held;
+  bool owner;
+
+  sqlite_query_conn(const sqlite_query_conn&); // make uncopyable
+  sqlite_query_conn& operator=(const sqlite_query_conn &); // make unassignable
+
+public:
+  sqlite_query_conn(bool needed = true): owner(needed && held == 0)
+  {
+    if (owner)
+      held = dbq_pool->get();
+  }
+
+  ~sqlite_query_conn()
+  {
+    if (owner)
+      {
+        dbq_pool->put(held);
+        held = 0;
+      }
+  }
+
+  operator sqlite3* () { return held; }
+
+  // only for the checked out connection
+  sqlite_stmt_cache* stmt_cache() { return held ? dbq_pool->stmt_cache(held) : 0; }
+};
+
+thread_local sqlite3* sqlite_query_conn::held = 0;
+
+
+////////////////////////////////////////////////////////////////////////
+
+
+static void scan_transaction_commit() noexcept; // defined with the scanner
+
 struct sqlite_checkpoint_pb: public periodic_barrier
 {
   // NB: don't use sqlite_ps since it can throw exceptions during ctor etc.
@@ -1278,6 +1545,7 @@ struct sqlite_checkpoint_pb: public periodic_barrier
   
   void periodic_barrier_work() noexcept
   {
+    scan_transaction_commit(); // all scanners are between files now
     (void) sqlite3_exec (db, "pragma wal_checkpoint(truncate);", NULL, NULL, NULL);
   }
 };
@@ -1814,48 +2082,22 @@ public:
 static libarchive_fdcache fdcache;
 
 /* Search ELF_FD for an ELF/DWARF section with name SECTION.
-   If found copy the section to a temporary file and return
-   its file descriptor, otherwise return -1.
+   If found return true and set OFFSET and SIZE to where its
+   contents are in the file, so they can be sent straight from
+   ELF_FD without copying them anywhere first.
 
-   The temporary file's mtime will be set to PARENT_MTIME.
-   B_SOURCE should be a description of the parent file suitable
-   for printing to the log.  */
+   B_SOURCE should be a description of the file suitable for
+   printing to the log.  */
 
-static int
-extract_section (int elf_fd, int64_t parent_mtime,
-		 const string& b_source, const string& section,
-                 const timespec& extract_begin)
+static bool
+find_section (int elf_fd, const string& b_source, const string& section,
+              off_t& offset, uint64_t& size)
 {
-  /* Search the fdcache.  */
-  struct stat fs;
-  int fd = fdcache.lookup (b_source, section);
-  if (fd >= 0)
-    {
-      if (fstat (fd, &fs) != 0)
-	{
-	  if (verbose)
-	    obatched (clog) << "cannot fstate fdcache "
-			    << b_source << " " << section << endl;
-	  close (fd);
-	  return -1;
-	}
-      if ((int64_t) fs.st_mtime != parent_mtime)
-	{
-	  if (verbose)
-	    obatched(clog) << "mtime mismatch for "
-			   << b_source << " " << section << endl;
-	  close (fd);
-	  return -1;
-	}
-      /* Success.  */
-      return fd;
-    }
-
   Elf *elf = elf_begin (elf_fd, ELF_C_READ_MMAP_PRIVATE, NULL);
   if (elf == NULL)
-    return -1;
+    return false;
 
-  /* Try to find the section and copy the contents into a separate file.  */
+  bool found = false;
   try
     {
       size_t shstrndx;
@@ -1879,56 +2121,27 @@ extract_section (int elf_fd, int64_t parent_mtime,
 	    break;
 	  if (scn_name == section)
 	    {
-	      Elf_Data *data = NULL;
-
-	      /* We found the desired section.  */
-	      data = elf_rawdata (scn, NULL);
-	      if (data == NULL)
-		throw elfutils_exception (elf_errno (), "elfraw_data");
-	      if (data->d_buf == NULL)
+	      /* We found the desired section.  Its raw data is the
+	         file contents at sh_offset, as the old copying
+	         extraction through elf_rawdata would have written.  */
+	      if (shdr->sh_type == SHT_NOBITS || shdr->sh_size == 0)
 		{
 		  obatched(clog) << "section " << section
 				 << " is empty" << endl;
 		  break;
 		}
 
-	      /* Create temporary file containing the section.  */
-	      char *tmppath = NULL;
-	      rc = asprintf (&tmppath, "%s/debuginfod-section.XXXXXX", tmpdir.c_str());
-	      if (rc < 0)
-		throw libc_exception (ENOMEM, "cannot allocate tmppath");
-	      defer_dtor<void*,void> tmmpath_freer (tmppath, free);
-	      fd = mkstemp (tmppath);
-	      if (fd < 0)
-		throw libc_exception (errno, "cannot create temporary file");
-
-	      ssize_t res = write_retry (fd, data->d_buf, data->d_size);
-	      if (res < 0 || (size_t) res != data->d_size) {
-                close (fd);
-                unlink (tmppath);
-		throw libc_exception (errno, "cannot write to temporary file");
-              }
-
-	      /* Set mtime to be the same as the parent file's mtime.  */
-	      struct timespec tvs[2];
-	      if (fstat (elf_fd, &fs) != 0) {
-                close (fd);
-                unlink (tmppath);
+	      struct stat fs;
+	      if (fstat (elf_fd, &fs) != 0)
 		throw libc_exception (errno, "cannot fstat file");
-              }
-              
-	      tvs[0].tv_sec = 0;
-	      tvs[0].tv_nsec = UTIME_OMIT;
-	      tvs[1] = fs.st_mtim;
-	      (void) futimens (fd, tvs);
-
-              struct timespec extract_end;
-              clock_gettime (CLOCK_MONOTONIC, &extract_end);
-              double extract_time = (extract_end.tv_sec - extract_begin.tv_sec)
-                + (extract_end.tv_nsec - extract_begin.tv_nsec)/1.e9;
-              
-	      /* Add to fdcache.  */
-	      fdcache.intern (b_source, section, tmppath, data->d_size, true, extract_time);
+	      if (shdr->sh_offset > (uint64_t) fs.st_size
+	          || shdr->sh_size > (uint64_t) fs.st_size - shdr->sh_offset)
+		throw reportable_exception ("section " + section + " of "
+					    + b_source + " is truncated");
+
+	      offset = shdr->sh_offset;
+	      size = shdr->sh_size;
+	      found = true;
 	      break;
 	    }
 	}
@@ -1936,142 +2149,486 @@ extract_section (int elf_fd, int64_t parent_mtime,
   catch (const reportable_exception &e)
     {
       e.report (clog);
-      close (fd);
-      fd = -1;
     }
 
   elf_end (elf);
-  return fd;
+  return found;
 }
 
+
+// MHD_create_response_from_fd_at_offset64 arrived in 0.9.37.
 static struct MHD_Response*
-handle_buildid_f_match (bool internal_req_t,
-                        int64_t b_mtime,
-                        const string& b_source0,
-                        const string& section,
-                        int *result_fd)
+create_response_from_fd_at_offset (uint64_t size, int fd, uint64_t offset)
 {
-  (void) internal_req_t; // ignored
+#if MHD_VERSION >= 0x00093700
+  return MHD_create_response_from_fd_at_offset64 (size, fd, offset);
+#else
+  return MHD_create_response_from_fd_at_offset ((size_t) size, fd, (off_t) offset);
+#endif
+}
 
-  struct timespec extract_begin;
-  clock_gettime (CLOCK_MONOTONIC, &extract_begin);
-  
-  int fd = open(b_source0.c_str(), O_RDONLY);
-  if (fd < 0)
-    throw libc_exception (errno, string("open ") + b_source0);
-  
-  // NB: use manual close(2) in error case instead of defer_dtor, because
-  // in the normal case, we want to hand the fd over to libmicrohttpd for
-  // file transfer.
 
-  struct stat s;
-  int rc = fstat(fd, &s);
-  if (rc < 0)
-    {
-      close(fd);
-      throw libc_exception (errno, string("fstat ") + b_source0);
-    }
+// What the client asked for beyond the artifact itself.
+struct http_negotiation
+{
+  string encoding; // Content-Encoding to use, or ""
 
-  if ((int64_t) s.st_mtime != b_mtime)
-    {
-      if (verbose)
-        obatched(clog) << "mtime mismatch for " << b_source0 << endl;
-      close(fd);
-      return 0;
-    }
+  // A single "Range: bytes=" range, if any.  first_p is false for a
+  // suffix range of the last LAST bytes, last_p is false for a range
+  // to the end.
+  bool range_p;
+  bool first_p, last_p;
+  uint64_t first, last;
 
-  if (!section.empty ())
-    {
-      int scn_fd = extract_section (fd, s.st_mtime, b_source0, section, extract_begin);
-      close (fd);
+  http_negotiation(): range_p(false), first_p(false), last_p(false), first(0), last(0) {}
+};
 
-      if (scn_fd >= 0)
-	fd = scn_fd;
-      else
-	{
-	  if (verbose)
-	    obatched (clog) << "cannot find section " << section
-			    << " for " << b_source0 << endl;
-	  return 0;
-	}
 
-      rc = fstat(fd, &s);
-      if (rc < 0)
-	{
-	  close (fd);
-	  throw libc_exception (errno, string ("fstat ") + b_source0
-				       + string (" ") + section);
-	}
-    }
+// Parse a single range "bytes=FIRST-LAST", "bytes=FIRST-" or
+// "bytes=-SUFFIX".  Multiple ranges, or anything else, are ignored and
+// the whole artifact gets sent, as RFC9110 allows.
+static void
+negotiate_range (const char *range, http_negotiation& n)
+{
+  string r = range;
+  r.erase(remove_if(r.begin(), r.end(), ::isspace), r.end());
+  if (r.compare(0, 6, "bytes=") != 0)
+    return;
+  r = r.substr(6);
+  size_t dash = r.find('-');
+  if (dash == string::npos || r.find_first_not_of("0123456789-") != string::npos
+      || r.find('-', dash+1) != string::npos)
+    return;
+  string first = r.substr(0, dash), last = r.substr(dash+1);
+  if (first.empty() && last.empty())
+    return;
+  n.first_p = ! first.empty();
+  n.last_p = ! last.empty();
+  n.first = n.first_p ? strtoull (first.c_str(), NULL, 10) : 0;
+  n.last = n.last_p ? strtoull (last.c_str(), NULL, 10) : 0;
+  if (n.first_p && n.last_p && n.last < n.first)
+    return;
+  n.range_p = true;
+}
 
-  struct MHD_Response* r = MHD_create_response_from_fd ((uint64_t) s.st_size, fd);
-  inc_metric ("http_responses_total","result","file");
-  if (r == 0)
-    {
-      if (verbose)
-	obatched(clog) << "cannot create fd-response for " << b_source0
-		       << " section=" << section << endl;
-      close(fd);
-    }
-  else
+
+// Pick the first of http_encodings that the client accepts, or "".
+static string
+negotiate_encoding (MHD_Connection *conn)
+{
+  if (conn == 0 || http_encodings.empty())
+    return "";
+  const char *ae = MHD_lookup_connection_value (conn, MHD_HEADER_KIND,
+                                                "Accept-Encoding");
+  if (ae == NULL)
+    return "";
+
+  set<string> accepted;
+  string list = ae;
+  size_t pos = 0;
+  while (pos < list.size())
     {
-      add_mhd_response_header (r, "Content-Type", "application/octet-stream");
-      add_mhd_response_header (r, "X-DEBUGINFOD-SIZE",
-			       to_string(s.st_size).c_str());
-      add_mhd_response_header (r, "X-DEBUGINFOD-FILE", b_source0.c_str());
-      add_mhd_last_modified (r, s.st_mtime);
-      if (verbose > 1)
-	obatched(clog) << "serving file " << b_source0 << " section=" << section << endl;
-      /* libmicrohttpd will close it. */
-      if (result_fd)
-        *result_fd = fd;
+      size_t comma = list.find(',', pos);
+      if (comma == string::npos)
+        comma = list.size();
+      string item = list.substr(pos, comma-pos);
+      pos = comma+1;
+
+      // "coding;q=value", where q=0 means not acceptable
+      string coding = item.substr(0, item.find(';'));
+      string params = item.substr(coding.size());
+      coding.erase(remove_if(coding.begin(), coding.end(), ::isspace), coding.end());
+      params.erase(remove_if(params.begin(), params.end(), ::isspace), params.end());
+      transform(coding.begin(), coding.end(), coding.begin(), ::tolower);
+      size_t q = params.find("q=");
+      if (q != string::npos && atof(params.c_str() + q + 2) <= 0.0)
+        continue;
+      accepted.insert(coding);
     }
 
-  return r;
+  for (auto&& e : http_encodings)
+    if (accepted.count(e) || accepted.count("*"))
+      return e;
+  return "";
 }
 
 
-#ifdef USE_LZMA
-struct lzma_exception: public reportable_exception
+static http_negotiation
+negotiate (MHD_Connection *conn)
 {
-  lzma_exception(int rc, const string& msg):
-    // liblzma doesn't have a lzma_ret -> string conversion function, so just
-    // report the value.
-    reportable_exception(string ("lzma error: ") + msg + ": error " + to_string(rc)) {
-      inc_metric("error_count","lzma",to_string(rc));
-    }
-};
+  http_negotiation n;
+  if (conn == 0)
+    return n;
+  const char *range = MHD_lookup_connection_value (conn, MHD_HEADER_KIND, "Range");
+  if (range)
+    negotiate_range (range, n);
+  // NB: ranges are of the artifact itself, not of some compressed variant
+  if (! n.range_p)
+    n.encoding = negotiate_encoding (conn);
+  return n;
+}
 
-// Neither RPM nor deb files support seeking to a specific file in the package.
-// Instead, to extract a specific file, we normally need to read the archive
-// sequentially until we find the file.  This is very slow for files at the end
-// of a large package with lots of files, like kernel debuginfo.
-//
-// However, if the compression format used in the archive supports seeking, we
-// can accelerate this.  As of July 2024, xz is the only widely-used format that
-// supports seeking, and usually only in multi-threaded mode.  Luckily, the
-// kernel-debuginfo package in Fedora and its downstreams, and the
-// linux-image-*-dbg package in Debian and its downstreams, all happen to use
-// this.
-//
-// The xz format [1] ends with an index of independently compressed blocks in
-// the stream.  In RPM and deb files, the xz stream is the last thing in the
-// file, so we assume that the xz Stream Footer is at the end of the package
-// file and do everything relative to that.  For each file in the archive, we
-// remember the size and offset of the file data in the uncompressed xz stream,
-// then we use the index to seek to that offset when we need that file.
-//
-// 1: https://xz.tukaani.org/format/xz-file-format.txt
 
-// Return whether an archive supports seeking.
-static bool
-is_seekable_archive (const string& rps, struct archive* a)
+// Don't bother compressing small files.
+static const size_t http_compress_min = 4096;
+
+// Compresses SIZE bytes at OFFSET of FD with ENCODING as
+// libmicrohttpd asks for the response body, so the first bytes go out
+// before the whole artifact has been read.  Owns FD.
+class http_encoder
 {
-  // Only xz supports seeking.
-  if (archive_filter_code (a, 0) != ARCHIVE_FILTER_XZ)
-    return false;
+private:
+  int fd;
+  off_t offset;
+  uint64_t size, done; // input bytes read so far
+  string encoding;
+  z_stream zs;
+#ifdef USE_ZSTD_COMPRESS
+  ZSTD_CCtx *cctx;
+#endif
+  static const size_t chunk = 256 * 1024;
+  vector<char> in, out;
+  size_t in_pos, in_len, out_pos, out_len;
+  bool finished;
+
+  // Compress more input into out, until there is some output or the
+  // stream is finished.
+  void refill()
+  {
+    out_pos = out_len = 0;
+    while (out_len == 0 && ! finished)
+      {
+        if (in_pos == in_len && done < size)
+          {
+            ssize_t n = pread_retry (fd, in.data(), min ((uint64_t) chunk, size - done),
+                                     offset + done);
+            if (n <= 0)
+              throw libc_exception (n < 0 ? errno : EIO, "cannot read file to compress");
+            done += n;
+            in_pos = 0;
+            in_len = n;
+          }
+        bool last = done == size;
+        if (encoding == "gzip")
+          {
+            zs.next_in = (Bytef *) in.data() + in_pos;
+            zs.avail_in = in_len - in_pos;
+            zs.next_out = (Bytef *) out.data();
+            zs.avail_out = chunk;
+            int rc = deflate (&zs, last ? Z_FINISH : Z_NO_FLUSH);
+            if (rc == Z_STREAM_ERROR)
+              throw reportable_exception ("gzip compression error");
+            in_pos = in_len - zs.avail_in;
+            out_len = chunk - zs.avail_out;
+            finished = rc == Z_STREAM_END;
+          }
+#ifdef USE_ZSTD_COMPRESS
+        else
+          {
+            ZSTD_inBuffer zin = { in.data(), in_len, in_pos };
+            ZSTD_outBuffer zout = { out.data(), chunk, 0 };
+            size_t remaining = ZSTD_compressStream2 (cctx, &zout, &zin,
+                                                     last ? ZSTD_e_end : ZSTD_e_continue);
+            if (ZSTD_isError (remaining))
+              throw reportable_exception (string ("zstd compression error: ")
+                                          + ZSTD_getErrorName (remaining));
+            in_pos = zin.pos;
+            out_len = zout.pos;
+            finished = last && remaining == 0;
+          }
+#endif
+      }
+  }
 
-  int fd = open (rps.c_str(), O_RDONLY);
+public:
+  http_encoder(int fd, off_t offset, uint64_t size, const string& encoding):
+    fd(fd), offset(offset), size(size), done(0), encoding(encoding),
+    in(chunk), out(chunk), in_pos(0), in_len(0), out_pos(0), out_len(0),
+    finished(false)
+  {
+    memset (&zs, 0, sizeof zs);
+    if (encoding == "gzip")
+      {
+        // windowBits 15+16 for the gzip rather than zlib wrapper
+        if (deflateInit2 (&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8,
+                          Z_DEFAULT_STRATEGY) != Z_OK)
+          throw reportable_exception ("cannot initialize gzip compression");
+      }
+#ifdef USE_ZSTD_COMPRESS
+    else if (encoding == "zstd")
+      {
+        cctx = ZSTD_createCCtx ();
+        if (cctx == NULL)
+          throw reportable_exception ("cannot initialize zstd compression");
+        ZSTD_CCtx_setPledgedSrcSize (cctx, size);
+      }
+#endif
+    else
+      throw reportable_exception ("unsupported http compression " + encoding);
+  }
+
+  ~http_encoder()
+  {
+    if (encoding == "gzip")
+      deflateEnd (&zs);
+#ifdef USE_ZSTD_COMPRESS
+    else
+      ZSTD_freeCCtx (cctx);
+#endif
+  }
+
+  // Give up FD, e.g. when no response could be made from this.
+  void release_fd() { fd = -1; }
+
+  static ssize_t reader (void *cls, uint64_t pos, char *buf, size_t max)
+  {
+    (void) pos;
+    http_encoder *e = (http_encoder *) cls;
+    try
+      {
+        if (e->out_pos == e->out_len)
+          e->refill();
+        if (e->out_pos == e->out_len)
+          return MHD_CONTENT_READER_END_OF_STREAM;
+        size_t n = min (max, e->out_len - e->out_pos);
+        memcpy (buf, e->out.data() + e->out_pos, n);
+        e->out_pos += n;
+        return n;
+      }
+    catch (const reportable_exception& ex)
+      {
+        ex.report (clog);
+        return MHD_CONTENT_READER_END_WITH_ERROR;
+      }
+  }
+
+  static void destroy (void *cls)
+  {
+    http_encoder *e = (http_encoder *) cls;
+    if (e->fd >= 0)
+      close (e->fd);
+    delete e;
+  }
+};
+
+
+// Whether SIZE bytes at OFFSET of FD look worth compressing, judged by
+// how well a quick deflate does on the first 64KB of them.
+static bool
+compressible_p (int fd, off_t offset, uint64_t size)
+{
+  vector<char> sample (min (size, (uint64_t) 64 * 1024));
+  if (pread_retry (fd, sample.data(), sample.size(), offset) != (ssize_t) sample.size())
+    return false;
+  uLongf packed_size = compressBound (sample.size());
+  vector<char> packed (packed_size);
+  if (compress2 ((Bytef *) packed.data(), &packed_size,
+                 (const Bytef *) sample.data(), sample.size(), 1) != Z_OK)
+    return false;
+  return packed_size < sample.size();
+}
+
+
+// Create a response for SIZE bytes at OFFSET of FD, or the requested
+// range of them, or compressed on the fly with the negotiated encoding
+// if that helps.  Takes ownership of, and may reassign, fd.
+static struct MHD_Response*
+create_encoded_response (int& fd, off_t offset, uint64_t size,
+                         const http_negotiation& negotiated)
+{
+  const string& encoding = negotiated.encoding;
+  struct MHD_Response* r;
+  if (negotiated.range_p)
+    {
+      uint64_t first, last;
+      if (! negotiated.first_p) // suffix
+        {
+          first = size - min (size, negotiated.last);
+          last = size - 1;
+        }
+      else
+        {
+          first = negotiated.first;
+          last = negotiated.last_p ? min (negotiated.last, size - 1) : size - 1;
+        }
+
+      if (size == 0 || first >= size || (! negotiated.first_p && negotiated.last == 0))
+        {
+          // Not satisfiable; the handler turns this into a 416.
+          close (fd);
+          fd = -1;
+          r = MHD_create_response_from_buffer (0, (void *) "", MHD_RESPMEM_PERSISTENT);
+          if (r)
+            add_mhd_response_header (r, "Content-Range", ("bytes */" + to_string(size)).c_str());
+        }
+      else
+        {
+          inc_metric ("http_responses_range_total");
+          r = create_response_from_fd_at_offset (last - first + 1, fd, offset + first);
+          if (r)
+            add_mhd_response_header (r, "Content-Range",
+                                     ("bytes " + to_string(first) + "-" + to_string(last)
+                                      + "/" + to_string(size)).c_str());
+        }
+      if (r)
+        add_mhd_response_header (r, "Accept-Ranges", "bytes");
+      return r;
+    }
+
+  http_encoder *e = NULL;
+  if (encoding != "" && size >= http_compress_min
+      && compressible_p (fd, offset, size))
+    try
+      {
+        e = new http_encoder (fd, offset, size, encoding);
+      }
+    catch (const reportable_exception& ex)
+      {
+        ex.report (clog);
+      }
+  if (e != NULL)
+    {
+      // The encoded size isn't known up front, so it goes out chunked.
+      r = MHD_create_response_from_callback (MHD_SIZE_UNKNOWN, 64 * 1024,
+                                             &http_encoder::reader, e,
+                                             &http_encoder::destroy);
+      if (r)
+        {
+          add_mhd_response_header (r, "Content-Encoding", encoding.c_str());
+          inc_metric ("http_responses_encoded_total", "encoding", encoding);
+        }
+      else
+        {
+          e->release_fd();
+          delete e;
+        }
+    }
+  else
+    r = create_response_from_fd_at_offset (size, fd, offset);
+
+  if (r && ! http_encodings.empty())
+    add_mhd_response_header (r, "Vary", "Accept-Encoding");
+  if (r)
+    add_mhd_response_header (r, "Accept-Ranges", "bytes");
+  return r;
+}
+
+static struct MHD_Response*
+handle_buildid_f_match (bool internal_req_t,
+                        int64_t b_mtime,
+                        const string& b_source0,
+                        const string& section,
+                        const http_negotiation& negotiated,
+                        int *result_fd)
+{
+  (void) internal_req_t; // ignored
+
+  int fd = open(b_source0.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw libc_exception (errno, string("open ") + b_source0);
+  
+  // NB: use manual close(2) in error case instead of defer_dtor, because
+  // in the normal case, we want to hand the fd over to libmicrohttpd for
+  // file transfer.
+
+  struct stat s;
+  int rc = fstat(fd, &s);
+  if (rc < 0)
+    {
+      close(fd);
+      throw libc_exception (errno, string("fstat ") + b_source0);
+    }
+
+  if ((int64_t) s.st_mtime != b_mtime)
+    {
+      if (verbose)
+        obatched(clog) << "mtime mismatch for " << b_source0 << endl;
+      close(fd);
+      return 0;
+    }
+
+  // Sections are sent straight out of the file, with sendfile(2)
+  // where libmicrohttpd can.
+  off_t offset = 0;
+  uint64_t size = s.st_size;
+  if (!section.empty ()
+      && ! find_section (fd, b_source0, section, offset, size))
+    {
+      if (verbose)
+        obatched (clog) << "cannot find section " << section
+                        << " for " << b_source0 << endl;
+      close (fd);
+      return 0;
+    }
+
+  struct MHD_Response* r = create_encoded_response (fd, offset, size, negotiated);
+  inc_metric ("http_responses_total","result","file");
+  if (r == 0)
+    {
+      if (verbose)
+	obatched(clog) << "cannot create fd-response for " << b_source0
+		       << " section=" << section << endl;
+      close(fd);
+    }
+  else
+    {
+      add_mhd_response_header (r, "Content-Type", "application/octet-stream");
+      add_mhd_response_header (r, "X-DEBUGINFOD-SIZE",
+			       to_string(size).c_str());
+      add_mhd_response_header (r, "X-DEBUGINFOD-FILE", b_source0.c_str());
+      add_mhd_last_modified (r, s.st_mtime);
+      if (verbose > 1)
+	obatched(clog) << "serving file " << b_source0 << " section=" << section << endl;
+      /* libmicrohttpd will close it. */
+      if (result_fd)
+        *result_fd = fd;
+    }
+
+  return r;
+}
+
+
+#ifdef USE_LZMA
+struct lzma_exception: public reportable_exception
+{
+  lzma_exception(int rc, const string& msg):
+    // liblzma doesn't have a lzma_ret -> string conversion function, so just
+    // report the value.
+    reportable_exception(string ("lzma error: ") + msg + ": error " + to_string(rc)) {
+      inc_metric("error_count","lzma",to_string(rc));
+    }
+};
+
+// Neither RPM nor deb files support seeking to a specific file in the package.
+// Instead, to extract a specific file, we normally need to read the archive
+// sequentially until we find the file.  This is very slow for files at the end
+// of a large package with lots of files, like kernel debuginfo.
+//
+// However, if the compression format used in the archive supports seeking, we
+// can accelerate this.  As of July 2024, xz is the only widely-used format that
+// supports seeking, and usually only in multi-threaded mode.  Luckily, the
+// kernel-debuginfo package in Fedora and its downstreams, and the
+// linux-image-*-dbg package in Debian and its downstreams, all happen to use
+// this.
+//
+// The xz format [1] ends with an index of independently compressed blocks in
+// the stream.  In RPM and deb files, the xz stream is the last thing in the
+// file, so we assume that the xz Stream Footer is at the end of the package
+// file and do everything relative to that.  For each file in the archive, we
+// remember the size and offset of the file data in the uncompressed xz stream,
+// then we use the index to seek to that offset when we need that file.
+//
+// 1: https://xz.tukaani.org/format/xz-file-format.txt
+
+// Return whether an archive supports seeking.
+static bool
+is_seekable_archive (const string& rps, struct archive* a)
+{
+  // Only xz supports seeking.
+  if (archive_filter_code (a, 0) != ARCHIVE_FILTER_XZ)
+    return false;
+
+  int fd = open (rps.c_str(), O_RDONLY);
   if (fd < 0)
     return false;
   defer_dtor<int,int> fd_closer (fd, close);
@@ -2246,6 +2803,80 @@ my_lzma_index_end (lzma_index* index)
   lzma_index_end (index, NULL);
 }
 
+// The decoded Indexes of recently used seekable archives, so serving
+// many files from one big archive doesn't read and decode its Index for
+// every request.  Entries are checked against the archive's identity and
+// mtime, and shared: lzma_index_iter only reads the index.
+class xz_index_cache
+{
+private:
+  struct entry
+  {
+    string path;
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+    shared_ptr<lzma_index> index;
+  };
+
+  mutex lock;
+  list<entry> entries; // most recently used first
+  static const unsigned max_entries = 64;
+
+  static bool same_file (const entry& e, const struct stat& st)
+  {
+    return (e.dev == st.st_dev && e.ino == st.st_ino && e.size == st.st_size
+            && e.mtime.tv_sec == st.st_mtim.tv_sec
+            && e.mtime.tv_nsec == st.st_mtim.tv_nsec);
+  }
+
+  void set_metrics ()
+  {
+    size_t bytes = 0;
+    for (auto& e : entries)
+      bytes += lzma_index_memused (e.index.get());
+    set_metric ("xz_index_cache_count", entries.size());
+    set_metric ("xz_index_cache_bytes", bytes);
+  }
+
+public:
+  shared_ptr<lzma_index> get (const string& path, int fd)
+  {
+    struct stat st;
+    if (fstat (fd, &st) != 0)
+      throw libc_exception (errno, "fstat");
+
+    {
+      unique_lock<mutex> l (lock);
+      for (auto i = entries.begin(); i != entries.end(); i++)
+        if (i->path == path && same_file (*i, st))
+          {
+            entries.splice (entries.begin(), entries, i);
+            inc_metric ("xz_index_cache_op_count","op","hit");
+            return i->index;
+          }
+    }
+
+    // Decode without holding the lock, other archives needn't wait.
+    shared_ptr<lzma_index> index (read_xz_index (fd), my_lzma_index_end);
+    inc_metric ("xz_index_cache_op_count","op","miss");
+
+    unique_lock<mutex> l (lock);
+    entries.remove_if ([&](const entry& e) { return e.path == path; });
+    entries.push_front (entry { path, st.st_dev, st.st_ino, st.st_size,
+                                st.st_mtim, index });
+    while (entries.size() > max_entries)
+      {
+        entries.pop_back();
+        inc_metric ("xz_index_cache_op_count","op","evict");
+      }
+    set_metrics ();
+    return index;
+  }
+};
+static xz_index_cache xz_indexes;
+
 static void
 free_lzma_block_filter_options (lzma_block* block)
 {
@@ -2459,12 +3090,11 @@ extract_from_seekable_archive (const string& srcpath,
         throw libc_exception (errno, string("open ") + srcpath);
       defer_dtor<int,int> src_closer (src, close);
 
-      lzma_index* index = read_xz_index (src);
-      defer_dtor<lzma_index*,void> index_ender (index, my_lzma_index_end);
+      shared_ptr<lzma_index> index = xz_indexes.get (srcpath, src);
 
       // Find the Block containing the offset.
       lzma_index_iter iter;
-      lzma_index_iter_init (&iter, index);
+      lzma_index_iter_init (&iter, index.get());
       if (lzma_index_iter_locate (&iter, offset))
         throw reportable_exception ("offset not found");
 
@@ -2538,10 +3168,10 @@ string canonicalized_archive_entry_pathname(struct archive_entry *e)
 
 // NB: takes ownership of, and may reassign, fd.
 static struct MHD_Response*
-create_buildid_r_response (int64_t b_mtime0,
-                           const string& b_source0,
+create_buildid_r_response (const string& b_source0,
                            const string& b_source1,
                            const string& section,
+                           const http_negotiation& negotiated,
                            const string& ima_sig,
                            const char* tmppath,
                            int& fd,
@@ -2559,34 +3189,23 @@ create_buildid_r_response (int64_t b_mtime0,
       fdcache.intern(b_source0, b_source1, tmppath, size, true, extract_time);
     }
 
-  if (!section.empty ())
+  // The section is sent straight out of the extracted file.
+  off_t offset = 0;
+  uint64_t section_size = size;
+  if (!section.empty ()
+      && ! find_section (fd, b_source0 + ":" + b_source1, section,
+                         offset, section_size))
     {
-      int scn_fd = extract_section (fd, b_mtime0,
-                                    b_source0 + ":" + b_source1,
-                                    section, extract_begin);
+      if (verbose)
+        obatched (clog) << "cannot find section " << section
+                        << " for archive " << b_source0
+                        << " file " << b_source1 << endl;
       close (fd);
-      if (scn_fd >= 0)
-        fd = scn_fd;
-      else
-        {
-          if (verbose)
-            obatched (clog) << "cannot find section " << section
-                            << " for archive " << b_source0
-                            << " file " << b_source1 << endl;
-          return 0;
-        }
-
-      struct stat fs;
-      if (fstat (fd, &fs) < 0)
-        {
-          close (fd);
-          throw libc_exception (errno,
-            string ("fstat ") + b_source0 + string (" ") + section);
-        }
-      size = fs.st_size;
+      return 0;
     }
+  size = section_size;
 
-  struct MHD_Response* r = MHD_create_response_from_fd (size, fd);
+  struct MHD_Response* r = create_encoded_response (fd, offset, size, negotiated);
   if (r == 0)
     {
       if (verbose)
@@ -2620,6 +3239,7 @@ handle_buildid_r_match (bool internal_req_p,
                         int64_t b_id0,
                         int64_t b_id1,
                         const string& section,
+                        const http_negotiation& negotiated,
                         int *result_fd)
 {
   struct timespec extract_begin;
@@ -2790,8 +3410,9 @@ handle_buildid_r_match (bool internal_req_p,
           break; // branch out of if "loop", to try new libarchive fetch attempt
         }
 
-      struct MHD_Response* r = create_buildid_r_response (b_mtime, b_source0,
+      struct MHD_Response* r = create_buildid_r_response (b_source0,
                                                           b_source1, section,
+                                                          negotiated,
                                                           ima_sig, NULL, fd,
                                                           fs.st_size,
                                                           fs.st_mtime,
@@ -2807,10 +3428,12 @@ handle_buildid_r_match (bool internal_req_p,
 
   // no match ... look for a seekable entry
   bool populate_seekable = ! passive_p;
-  unique_ptr<sqlite_ps> pp (new sqlite_ps (internal_req_p ? db : dbq,
+  sqlite_query_conn dbq (! internal_req_p);
+  unique_ptr<sqlite_ps> pp (new sqlite_ps (internal_req_p ? db : (sqlite3*) dbq,
                                            "rpm-seekable-query",
                                            "select type, size, offset, mtime from " BUILDIDS "_r_seekable "
-                                           "where file = ? and content = ?"));
+                                           "where file = ? and content = ?",
+                                           internal_req_p ? 0 : dbq.stmt_cache()));
   rc = pp->reset().bind(1, b_id0).bind(2, b_id1).step();
   if (rc != SQLITE_DONE)
     {
@@ -2843,10 +3466,10 @@ handle_buildid_r_match (bool internal_req_p,
               tvs[1].tv_sec = seekable_mtime;
               tvs[1].tv_nsec = 0;
               (void) futimens (fd, tvs);  /* best effort */
-              struct MHD_Response* r = create_buildid_r_response (b_mtime,
-                                                                  b_source0,
+              struct MHD_Response* r = create_buildid_r_response (b_source0,
                                                                   b_source1,
                                                                   section,
+                                                                  negotiated,
                                                                   ima_sig,
                                                                   tmppath, fd,
                                                                   seekable_size,
@@ -3045,7 +3668,7 @@ handle_buildid_r_match (bool internal_req_p,
           continue;
         }
 
-      r = create_buildid_r_response (b_mtime, b_source0, b_source1, section,
+      r = create_buildid_r_response (b_source0, b_source1, section, negotiated,
                                      ima_sig, tmppath, fd,
                                      archive_entry_size(e),
                                      archive_entry_mtime(e),
@@ -3123,17 +3746,18 @@ handle_buildid_match (bool internal_req_p,
                       int64_t b_id0,
                       int64_t b_id1,
                       const string& section,
+                      const http_negotiation& negotiated,
                       int *result_fd)
 {
   try
     {
       if (b_stype == "F")
         return handle_buildid_f_match(internal_req_p, b_mtime, b_source0,
-				      section, result_fd);
+				      section, negotiated, result_fd);
       else if (b_stype == "R")
         return handle_buildid_r_match(internal_req_p, b_mtime, b_source0,
 				      b_source1, b_id0, b_id1, section,
-				      result_fd);
+				      negotiated, result_fd);
     }
   catch (const reportable_exception &e)
     {
@@ -3196,53 +3820,172 @@ void debuginfod_pool_end(debuginfod_client* c)
 }
 
 
-static struct MHD_Response*
-handle_buildid (MHD_Connection* conn,
-                const string& buildid /* unsafe */,
-                string& artifacttype /* unsafe, cleanse on exception/return */,
-                const string& suffix /* unsafe */,
-                int *result_fd)
+////////////////////////////////////////////////////////////////////////
+
+
+// A cache of recent webapi buildid lookups in front of the database.
+// An entry holds the rows the database query returned, or is negative
+// for a lookup that ended in a 404, upstream included.  Negative
+// entries expire after lookup_cache_ttl_s, as do those that found no
+// rows, since the lookup will then go on to upstream servers.  So do
+// all entries in passive mode, since the database is then changed
+// behind our back.
+// Otherwise the scanner invalidates the buildids it records, and
+// groom() everything.
+//
+// The cache is sharded by buildid, each shard an LRU list.  An
+// invalidation bumps its shard's generation, so a lookup that read the
+// database before it doesn't put a stale entry afterwards.
+
+struct buildid_lookup_row
 {
-  // validate artifacttype
-  string atype_code;
-  if (artifacttype == "debuginfo") atype_code = "D";
-  else if (artifacttype == "executable") atype_code = "E";
-  else if (artifacttype == "source") atype_code = "S";
-  else if (artifacttype == "section") atype_code = "I";
-  else {
-    artifacttype = "invalid"; // PR28242 ensure http_resposes metrics don't propagate unclean user data 
-    throw reportable_exception("invalid artifacttype");
+  int64_t mtime;
+  string stype, source0, source1;
+  int64_t id0, id1;
+  int debug_p;
+};
+
+class buildid_lookup_cache
+{
+private:
+  struct entry
+  {
+    string key;
+    bool negative;
+    time_t expires; // 0 = never
+    vector<buildid_lookup_row> rows;
+  };
+  struct shard
+  {
+    mutex mtx;
+    list<entry> lru; // most recently used first
+    map<string,list<entry>::iterator> index; // by key, which starts with the buildid
+    uint64_t generation;
+    shard(): generation(0) {}
+  };
+  static const unsigned nshards = 16;
+  shard shards[nshards];
+
+  shard& shard_of(const string& buildid)
+  {
+    return shards[hash<string>()(buildid) % nshards];
   }
 
-  if (conn != 0)
-    inc_metric("http_requests_total", "type", artifacttype);
+public:
+  bool find(const string& buildid, const string& key,
+            bool& negative, vector<buildid_lookup_row>& rows,
+            uint64_t& generation)
+  {
+    shard& sh = shard_of(buildid);
+    unique_lock<mutex> lock(sh.mtx);
+    generation = sh.generation;
+    auto it = sh.index.find(key);
+    if (it == sh.index.end())
+      {
+        inc_metric("buildid_cache_op_count","op","miss");
+        return false;
+      }
+    auto e = it->second;
+    if (e->expires != 0 && e->expires <= time(NULL))
+      {
+        inc_metric("buildid_cache_op_count","op","expire");
+        add_metric("buildid_cache_count", -1);
+        sh.index.erase(it);
+        sh.lru.erase(e);
+        return false;
+      }
+    sh.lru.splice(sh.lru.begin(), sh.lru, e);
+    negative = e->negative;
+    rows = e->rows;
+    inc_metric("buildid_cache_op_count","op",(negative ? "negative_hit" : "hit"));
+    return true;
+  }
 
-  string section;
-  if (atype_code == "I")
-    {
-      if (suffix.size () < 2)
-	throw reportable_exception ("invalid section suffix");
+  void put(const string& buildid, const string& key,
+           bool negative, const vector<buildid_lookup_row>& rows,
+           uint64_t generation)
+  {
+    if (lookup_cache_size == 0)
+      return;
+    time_t expires = 0;
+    if (negative || rows.empty() || passive_p)
+      {
+        if (lookup_cache_ttl_s == 0)
+          return;
+        expires = time(NULL) + lookup_cache_ttl_s;
+      }
 
-      // Remove leading '/'
-      section = suffix.substr(1);
-    }
+    shard& sh = shard_of(buildid);
+    unique_lock<mutex> lock(sh.mtx);
+    if (sh.generation != generation) // invalidated since the lookup
+      return;
+    auto it = sh.index.find(key);
+    if (it != sh.index.end())
+      {
+        sh.lru.erase(it->second);
+        sh.index.erase(it);
+      }
+    else
+      add_metric("buildid_cache_count", 1);
+    sh.lru.push_front(entry { key, negative, expires, rows });
+    sh.index[key] = sh.lru.begin();
+    size_t max_entries = (lookup_cache_size + nshards - 1) / nshards;
+    while (sh.lru.size() > max_entries)
+      {
+        inc_metric("buildid_cache_op_count","op","evict");
+        add_metric("buildid_cache_count", -1);
+        sh.index.erase(sh.lru.back().key);
+        sh.lru.pop_back();
+      }
+  }
 
-  if (atype_code == "S" && suffix == "")
-     throw reportable_exception("invalid source suffix");
+  void invalidate(const string& buildid)
+  {
+    shard& sh = shard_of(buildid);
+    unique_lock<mutex> lock(sh.mtx);
+    sh.generation ++;
+    string prefix = buildid + "/";
+    auto it = sh.index.lower_bound(prefix);
+    while (it != sh.index.end()
+           && it->first.compare(0, prefix.size(), prefix) == 0)
+      {
+        inc_metric("buildid_cache_op_count","op","invalidate");
+        add_metric("buildid_cache_count", -1);
+        sh.lru.erase(it->second);
+        it = sh.index.erase(it);
+      }
+  }
 
-  // validate buildid
-  if ((buildid.size() < 2) || // not empty
-      (buildid.size() % 2) || // even number
-      (buildid.find_first_not_of("0123456789abcdef") != string::npos)) // pure tasty lowercase hex
-    throw reportable_exception("invalid buildid");
+  void clear()
+  {
+    for (auto&& sh : shards)
+      {
+        unique_lock<mutex> lock(sh.mtx);
+        sh.generation ++;
+        add_metric("buildid_cache_count", -(double) sh.lru.size());
+        sh.index.clear();
+        sh.lru.clear();
+      }
+  }
+};
 
-  if (verbose > 1)
-    obatched(clog) << "searching for buildid=" << buildid << " artifacttype=" << artifacttype
-         << " suffix=" << suffix << endl;
+static buildid_lookup_cache buildid_cache;
 
+
+// Query the database for the candidate files of a buildid lookup, in
+// order of preference.
+static void
+query_buildid_rows (MHD_Connection* conn,
+                    const string& atype_code,
+                    const string& buildid,
+                    const string& suffix,
+                    vector<buildid_lookup_row>& rows)
+{
   // If invoked from the scanner threads, use the scanners' read-write
-  // connection.  Otherwise use the web query threads' read-only connection.
-  sqlite3 *thisdb = (conn == 0) ? db : dbq;
+  // connection.  Otherwise use a read-only connection from the pool.
+  sqlite_query_conn dbq (conn != 0);
+  sqlite3 *thisdb = (conn == 0) ? db : (sqlite3*) dbq;
+  sqlite_stmt_cache *thiscache = (conn == 0) ? 0 : dbq.stmt_cache();
 
   sqlite_ps *pp = 0;
 
@@ -3250,7 +3993,8 @@ handle_buildid (MHD_Connection* conn,
     {
       pp = new sqlite_ps (thisdb, "mhd-query-d",
                           "select mtime, sourcetype, source0, source1, id0, id1 from " BUILDIDS "_query_d2 where buildid = ? "
-                          "order by mtime desc");
+                          "order by mtime desc",
+                          thiscache);
       pp->reset();
       pp->bind(1, buildid);
     }
@@ -3258,7 +4002,8 @@ handle_buildid (MHD_Connection* conn,
     {
       pp = new sqlite_ps (thisdb, "mhd-query-e",
                           "select mtime, sourcetype, source0, source1, id0, id1 from " BUILDIDS "_query_e2 where buildid = ? "
-                          "order by mtime desc");
+                          "order by mtime desc",
+                          thiscache);
       pp->reset();
       pp->bind(1, buildid);
     }
@@ -3270,7 +4015,8 @@ handle_buildid (MHD_Connection* conn,
 
       pp = new sqlite_ps (thisdb, "mhd-query-s",
                           "select mtime, sourcetype, source0, source1 from " BUILDIDS "_query_s where buildid = ? and artifactsrc in (?,?) "
-                          "order by sharedprefix(source0,source0ref) desc, mtime desc");
+                          "order by sharedprefix(source0,source0ref) desc, mtime desc",
+                          thiscache);
       pp->reset();
       pp->bind(1, buildid);
       // NB: we don't store the non-canonicalized path names any more, but old databases
@@ -3284,15 +4030,14 @@ handle_buildid (MHD_Connection* conn,
 	"select mtime, sourcetype, source0, source1, 1 as debug_p from " BUILDIDS "_query_d2 where buildid = ? "
 	"union all "
 	"select mtime, sourcetype, source0, source1, 0 as debug_p from " BUILDIDS "_query_e2 where buildid = ? "
-	"order by debug_p desc, mtime desc");
+	"order by debug_p desc, mtime desc",
+                          thiscache);
       pp->reset();
       pp->bind(1, buildid);
       pp->bind(2, buildid);
     }
   unique_ptr<sqlite_ps> ps_closer(pp); // release pp if exception or return
 
-  bool do_upstream_section_query = true;
-
   // consume all the rows
   while (1)
     {
@@ -3301,47 +4046,127 @@ handle_buildid (MHD_Connection* conn,
       if (rc != SQLITE_ROW)
         throw sqlite_exception(rc, "step");
 
-      int64_t b_mtime = sqlite3_column_int64 (*pp, 0);
-      string b_stype = string((const char*) sqlite3_column_text (*pp, 1) ?: ""); /* by DDL may not be NULL */
-      string b_source0 = string((const char*) sqlite3_column_text (*pp, 2) ?: ""); /* may be NULL */
-      string b_source1 = string((const char*) sqlite3_column_text (*pp, 3) ?: ""); /* may be NULL */
-      int64_t b_id0 = 0, b_id1 = 0;
+      buildid_lookup_row row;
+      row.mtime = sqlite3_column_int64 (*pp, 0);
+      row.stype = string((const char*) sqlite3_column_text (*pp, 1) ?: ""); /* by DDL may not be NULL */
+      row.source0 = string((const char*) sqlite3_column_text (*pp, 2) ?: ""); /* may be NULL */
+      row.source1 = string((const char*) sqlite3_column_text (*pp, 3) ?: ""); /* may be NULL */
+      row.id0 = row.id1 = 0;
       if (atype_code == "D" || atype_code == "E")
         {
-          b_id0 = sqlite3_column_int64 (*pp, 4);
-          b_id1 = sqlite3_column_int64 (*pp, 5);
+          row.id0 = sqlite3_column_int64 (*pp, 4);
+          row.id1 = sqlite3_column_int64 (*pp, 5);
         }
+      row.debug_p = (atype_code == "I") ? sqlite3_column_int (*pp, 4) : 0;
+      rows.push_back(row);
+    }
+  pp->reset();
+}
+
+
+static struct MHD_Response*
+handle_buildid (MHD_Connection* conn,
+                const string& buildid /* unsafe */,
+                string& artifacttype /* unsafe, cleanse on exception/return */,
+                const string& suffix /* unsafe */,
+                int *result_fd)
+{
+  // validate artifacttype
+  string atype_code;
+  if (artifacttype == "debuginfo") atype_code = "D";
+  else if (artifacttype == "executable") atype_code = "E";
+  else if (artifacttype == "source") atype_code = "S";
+  else if (artifacttype == "section") atype_code = "I";
+  else {
+    artifacttype = "invalid"; // PR28242 ensure http_resposes metrics don't propagate unclean user data 
+    throw reportable_exception("invalid artifacttype");
+  }
 
+  if (conn != 0)
+    inc_metric("http_requests_total", "type", artifacttype);
+
+  string section;
+  if (atype_code == "I")
+    {
+      if (suffix.size () < 2)
+	throw reportable_exception ("invalid section suffix");
+
+      // Remove leading '/'
+      section = suffix.substr(1);
+    }
+
+  if (atype_code == "S" && suffix == "")
+     throw reportable_exception("invalid source suffix");
+
+  // validate buildid
+  if ((buildid.size() < 2) || // not empty
+      (buildid.size() % 2) || // even number
+      (buildid.find_first_not_of("0123456789abcdef") != string::npos)) // pure tasty lowercase hex
+    throw reportable_exception("invalid buildid");
+
+  if (verbose > 1)
+    obatched(clog) << "searching for buildid=" << buildid << " artifacttype=" << artifacttype
+         << " suffix=" << suffix << endl;
+
+  // Look in the lookup cache first, then in the database.  The scanner
+  // threads always go to the database.
+  bool use_cache = (conn != 0 && lookup_cache_size > 0
+                    && ! (passive_p && lookup_cache_ttl_s == 0));
+  string cache_key = buildid + "/" + atype_code + suffix;
+  uint64_t cache_generation = 0;
+  bool negative = false;
+  vector<buildid_lookup_row> rows;
+  if (use_cache
+      && buildid_cache.find(buildid, cache_key, negative, rows, cache_generation))
+    {
+      if (negative)
+        throw reportable_exception(MHD_HTTP_NOT_FOUND, "not found");
+    }
+  else
+    {
+      query_buildid_rows (conn, atype_code, buildid, suffix, rows);
+      if (use_cache)
+        buildid_cache.put(buildid, cache_key, false, rows, cache_generation);
+    }
+
+  bool do_upstream_section_query = true;
+  http_negotiation negotiated = negotiate (conn);
+
+  for (auto&& row : rows)
+    {
       if (verbose > 1)
-        obatched(clog) << "found mtime=" << b_mtime << " stype=" << b_stype
-             << " source0=" << b_source0 << " source1=" << b_source1 << endl;
+        obatched(clog) << "found mtime=" << row.mtime << " stype=" << row.stype
+             << " source0=" << row.source0 << " source1=" << row.source1 << endl;
 
       // Try accessing the located match.
       // XXX: in case of multiple matches, attempt them in parallel?
       auto r = handle_buildid_match (conn ? false : true,
-                                     b_mtime, b_stype, b_source0, b_source1,
-				     b_id0, b_id1, section, result_fd);
+                                     row.mtime, row.stype, row.source0, row.source1,
+				     row.id0, row.id1, section, negotiated, result_fd);
       if (r)
         return r;
 
       // If a debuginfo file matching BUILDID was found but didn't contain
       // the desired section, then the section should not exist.  Don't
       // bother querying upstream servers.
-      if (!section.empty () && (sqlite3_column_int (*pp, 4) == 1))
+      if (!section.empty () && row.debug_p == 1)
 	{
 	  struct stat st;
 
 	  // For "F" sourcetype, check if the debuginfo exists. For "R"
 	  // sourcetype, check if the debuginfo was interned into the fdcache.
-	  if ((b_stype == "F" && (stat (b_source0.c_str (), &st) == 0))
-	      || (b_stype == "R" && fdcache.probe (b_source0, b_source1)))
+	  if ((row.stype == "F" && (stat (row.source0.c_str (), &st) == 0))
+	      || (row.stype == "R" && fdcache.probe (row.source0, row.source1)))
 	    do_upstream_section_query = false;
 	}
     }
-  pp->reset();
 
   if (!do_upstream_section_query)
-    throw reportable_exception(MHD_HTTP_NOT_FOUND, "not found");
+    {
+      if (use_cache)
+        buildid_cache.put(buildid, cache_key, true, {}, cache_generation);
+      throw reportable_exception(MHD_HTTP_NOT_FOUND, "not found");
+    }
 
   // We couldn't find it in the database.  Last ditch effort
   // is to defer to other debuginfo servers.
@@ -3423,8 +4248,9 @@ handle_buildid (MHD_Connection* conn,
     switch(fd)
       {
       case -ENOSYS:
-        break;
       case -ENOENT:
+        if (use_cache)
+          buildid_cache.put(buildid, cache_key, true, {}, cache_generation);
         break;
       default: // some more tricky error
         throw libc_exception(-fd, "upstream debuginfod query failed");
@@ -3570,17 +4396,12 @@ handle_metadata (MHD_Connection* conn,
 {
   MHD_Response* r;
   // Because this query can take on the order of many seconds, we need
-  // to prevent DoS against the other normal quick queries, so we use
-  // a dedicated database connection.
-  sqlite3 *thisdb = 0;
-  int rc = sqlite3_open_v2 (db_path.c_str(), &thisdb, (SQLITE_OPEN_READONLY
-                                                       |SQLITE_OPEN_URI
-                                                       |SQLITE_OPEN_PRIVATECACHE
-                                                       |SQLITE_OPEN_NOMUTEX), /* private to us */
-                            NULL);
-  if (rc)
-    throw sqlite_exception(rc, "cannot open database for metadata query");
-  defer_dtor<sqlite3*,int> sqlite_db_closer (thisdb, sqlite3_close_v2);
+  // to prevent DoS against the other normal quick queries.  The pooled
+  // connection is private to this thread while we hold it, so the
+  // others aren't held up.
+  int rc;
+  sqlite_query_conn dbq;
+  sqlite3 *thisdb = dbq;
                                            
   // Query locally for matching e, d files
   string op;
@@ -3649,7 +4470,8 @@ handle_metadata (MHD_Connection* conn,
   // table, which is already the largest part of a debuginfod index.  Adding that index
   // would nearly double the .sqlite db size.
                       
-  sqlite_ps *pp = new sqlite_ps (thisdb, "mhd-query-meta-glob", sql);
+  sqlite_ps *pp = new sqlite_ps (thisdb, "mhd-query-meta-glob", sql,
+                                 dbq.stmt_cache());
   pp->reset();
   pp->bind(1, dirname);
   pp->bind(2, bname);
@@ -3938,8 +4760,18 @@ handler_cb (void * /*cls*/,
           r = handle_buildid (connection, buildid, artifacttype, suffix, &fd);
           if (r)
             {
+              // NB: a section or range is just a part of the file
+              const char *size = MHD_get_response_header (r, "X-DEBUGINFOD-SIZE");
+              const char *range = MHD_get_response_header (r, "Content-Range");
+              unsigned long long first, last;
               struct stat fs;
-              if (fstat(fd, &fs) == 0)
+              if (range && sscanf (range, "bytes %llu-%llu/", &first, &last) == 2)
+                http_size = last - first + 1;
+              else if (range) // unsatisfiable
+                http_size = 0;
+              else if (size)
+                http_size = atoll (size);
+              else if (fstat(fd, &fs) == 0)
                 http_size = fs.st_size;
               // libmicrohttpd will close (fd);
             }
@@ -3985,8 +4817,16 @@ handler_cb (void * /*cls*/,
       if (webapi_cors)
         // add ACAO header for all successful requests
         add_mhd_response_header (r, "Access-Control-Allow-Origin", "*");
-      rc = MHD_queue_response (connection, MHD_HTTP_OK, r);
-      http_code = MHD_HTTP_OK;
+      // A Content-Range means a partial response, or "*/SIZE" for an
+      // unsatisfiable range request.
+      const char *content_range = MHD_get_response_header (r, "Content-Range");
+      if (content_range == NULL)
+        http_code = MHD_HTTP_OK;
+      else if (strstr (content_range, "*/") == NULL)
+        http_code = 206;
+      else
+        http_code = 416;
+      rc = MHD_queue_response (connection, http_code, r);
       MHD_destroy_response (r);
     }
   catch (const reportable_exception& e)
@@ -4202,27 +5042,17 @@ dwarf_extract_source_paths (Elf *elf, set<string>& debug_sourcefiles)
 
 
 static void
-elf_classify (int fd, bool &executable_p, bool &debuginfo_p, string &buildid, set<string>& debug_sourcefiles)
+elf_classify (Elf *elf, bool &executable_p, bool &debuginfo_p, string &buildid, set<string>& debug_sourcefiles)
 {
-  Elf *elf = elf_begin (fd, ELF_C_READ_MMAP_PRIVATE, NULL);
-  if (elf == NULL)
-    return;
-
-  try // catch our types of errors and clean up the Elf* object
+  try // catch our types of errors
     {
       if (elf_kind (elf) != ELF_K_ELF)
-        {
-          elf_end (elf);
-          return;
-        }
+        return;
 
       GElf_Ehdr ehdr_storage;
       GElf_Ehdr *ehdr = gelf_getehdr (elf, &ehdr_storage);
       if (ehdr == NULL)
-        {
-          elf_end (elf);
-          return;
-        }
+        return;
       auto elf_type = ehdr->e_type;
 
       const void *build_id; // elfutils-owned memory
@@ -4231,7 +5061,6 @@ elf_classify (int fd, bool &executable_p, bool &debuginfo_p, string &buildid, se
         {
           // It's not a diagnostic-worthy error for an elf file to lack build-id.
           // It might just be very old.
-          elf_end (elf);
           return;
         }
 
@@ -4334,6 +5163,28 @@ elf_classify (int fd, bool &executable_p, bool &debuginfo_p, string &buildid, se
     {
       e.report(clog);
     }
+}
+
+
+static void
+elf_classify (int fd, bool &executable_p, bool &debuginfo_p, string &buildid, set<string>& debug_sourcefiles)
+{
+  Elf *elf = elf_begin (fd, ELF_C_READ_MMAP_PRIVATE, NULL);
+  if (elf == NULL)
+    return;
+  elf_classify (elf, executable_p, debuginfo_p, buildid, debug_sourcefiles);
+  elf_end (elf);
+}
+
+
+// Same, for an ELF image in memory, which must stay alive meanwhile.
+static void
+elf_classify (char *image, size_t size, bool &executable_p, bool &debuginfo_p, string &buildid, set<string>& debug_sourcefiles)
+{
+  Elf *elf = elf_memory (image, size);
+  if (elf == NULL)
+    return;
+  elf_classify (elf, executable_p, debuginfo_p, buildid, debug_sourcefiles);
   elf_end (elf);
 }
 
@@ -4392,6 +5243,105 @@ register_file_name(sqlite_ps& ps_upsert_fileparts,
 
 
 
+// The scanner threads share the one read-write connection, so they
+// also share one transaction on it, instead of committing each row on
+// its own.  It is committed every scan_batch files, and whenever the
+// scan queue runs dry, so the webapi soon sees the new rows and the
+// groomer never finds a transaction open.  Lookup cache invalidations
+// wait for the commit, else a lookup could cache what the database
+// said just before it.
+
+class scan_transaction
+{
+private:
+  mutex mtx;
+  unsigned files; // scanned in the open transaction
+  set<string> buildids; // to invalidate at commit
+  bool all; // invalidate everything at commit
+
+  void commit_locked() noexcept
+  {
+    if (! sqlite3_get_autocommit (db))
+      {
+        tmp_ms_metric tick("sqlite3","step","scan-commit");
+        int rc = sqlite3_exec (db, "commit;", NULL, NULL, NULL);
+        if (rc != SQLITE_OK && rc != SQLITE_DONE)
+          {
+            sqlite_exception(rc, "scan commit").report(cerr);
+            if (! sqlite3_get_autocommit (db))
+              return; // still open, try again after the next file
+          }
+        inc_metric("scan_transaction_total");
+      }
+    files = 0;
+    flush_invalidations();
+  }
+
+  void flush_invalidations()
+  {
+    if (all)
+      buildid_cache.clear();
+    else
+      for (auto&& b : buildids)
+        buildid_cache.invalidate(b);
+    buildids.clear();
+    all = false;
+  }
+
+public:
+  scan_transaction(): files(0), all(false) {}
+
+  // before scanning a file
+  void begin()
+  {
+    if (scan_batch <= 1)
+      return;
+    unique_lock<mutex> lock(mtx);
+    if (! sqlite3_get_autocommit (db))
+      return;
+    int rc = sqlite3_exec (db, "begin immediate;", NULL, NULL, NULL);
+    if (rc != SQLITE_OK && rc != SQLITE_DONE) // just go on in autocommit mode
+      sqlite_exception(rc, "scan begin").report(cerr);
+  }
+
+  // after scanning a file; IDLE if the scan queue ran dry
+  void file_done(bool idle)
+  {
+    unique_lock<mutex> lock(mtx);
+    if (scan_batch <= 1)
+      flush_invalidations();
+    else if (++ files >= (unsigned long) scan_batch || idle)
+      commit_locked();
+  }
+
+  void commit() noexcept
+  {
+    unique_lock<mutex> lock(mtx);
+    commit_locked();
+  }
+
+  void invalidate(const string& buildid)
+  {
+    unique_lock<mutex> lock(mtx);
+    buildids.insert(buildid);
+  }
+
+  void invalidate_all()
+  {
+    unique_lock<mutex> lock(mtx);
+    all = true;
+  }
+};
+
+static scan_transaction scan_tx;
+
+static void
+scan_transaction_commit() noexcept
+{
+  scan_tx.commit();
+}
+
+
 static void
 scan_source_file (const string& rps, const stat_t& st,
                   sqlite_ps& ps_upsert_buildids,
@@ -4540,6 +5490,9 @@ scan_source_file (const string& rps, const stat_t& st,
     .bind(3, st.st_size)
     .step_ok_done();
 
+  if (buildid != "")
+    scan_tx.invalidate(buildid);
+
   if (verbose > 2)
     obatched(clog) << "recorded buildid=" << buildid << " file=" << rps
                    << " mtime=" << st.st_mtime << " atype="
@@ -4551,6 +5504,369 @@ scan_source_file (const string& rps, const stat_t& st,
 
 
 
+////////////////////////////////////////////////////////////////////////
+
+// Archive members are classified by a pool of threads shared by all
+// the scanners, so one giant archive doesn't keep its scanner busy for
+// minutes while the others sit idle.  The scanner only decompresses
+// the ELF members into memory, queues them, and records the results as
+// they come back.
+
+struct classify_job
+{
+  string fn; // canonicalized archive member name
+  vector<char> image; // the ELF file, while queued
+  int64_t seekable_size;
+  int64_t seekable_offset;
+  time_t seekable_mtime;
+
+  // results
+  bool executable_p;
+  bool debuginfo_p;
+  string buildid;
+  set<string> sourcefiles;
+
+  classify_job(): seekable_size(0), seekable_offset(0), seekable_mtime(0),
+                  executable_p(false), debuginfo_p(false) {}
+};
+
+
+// The jobs of one archive being classified, and those done so far.
+class classify_batch
+{
+private:
+  mutex mtx;
+  condition_variable cv;
+  unsigned pending;
+  deque<classify_job*> done;
+
+  classify_batch(const classify_batch&); // make uncopyable
+  classify_batch& operator=(const classify_batch &); // make unassignable
+
+public:
+  classify_batch(): pending(0) {}
+
+  ~classify_batch()
+  {
+    // NB: the classifier threads may still hold some of our jobs, if
+    // the scanner gave up on the archive midway
+    unique_lock<mutex> lock(mtx);
+    while (pending > 0)
+      cv.wait(lock);
+    for (auto&& j : done)
+      delete j;
+  }
+
+  void submit()
+  {
+    unique_lock<mutex> lock(mtx);
+    pending ++;
+  }
+
+  void finish(classify_job* j)
+  {
+    unique_lock<mutex> lock(mtx);
+    done.push_back(j);
+    pending --;
+    cv.notify_all();
+  }
+
+  // take over the jobs done so far, if ALL after waiting for the rest
+  void take(deque<classify_job*>& jobs, bool all)
+  {
+    unique_lock<mutex> lock(mtx);
+    while (all && pending > 0)
+      cv.wait(lock);
+    jobs.insert(jobs.end(), done.begin(), done.end());
+    done.clear();
+  }
+};
+
+
+// The queue feeding the classifier threads.  The images being read by
+// the scanners, waiting in the queue or being classified together take
+// at most scan_memory_mbs.
+
+class classify_queue
+{
+private:
+  mutex mtx;
+  condition_variable cv;
+  deque<pair<classify_batch*,classify_job*>> q;
+  size_t bytes;  // reserved by scanners, queued or being classified
+  size_t queued; // the part of that which classifiers will release
+  bool dead;
+
+public:
+  classify_queue(): bytes(0), queued(0), dead(false) {}
+
+  // Bigger archive members are classified from a tmpfile by the scanner.
+  static size_t max_bytes() { return (size_t) scan_memory_mbs * 1024 * 1024; }
+
+  // Reserve SIZE more bytes for an image being read.  Wait while the
+  // classifiers are about to free some, but fail rather than wait for
+  // other scanners, which may be waiting themselves.
+  bool reserve(size_t size)
+  {
+    unique_lock<mutex> lock(mtx);
+    while (!dead && bytes + size > max_bytes() && queued > 0)
+      cv.wait(lock);
+    if (dead || bytes + size > max_bytes())
+      return false;
+    bytes += size;
+    return true;
+  }
+
+  // the scanner gives back bytes it reserved without queueing them
+  void unreserve(size_t size)
+  {
+    unique_lock<mutex> lock(mtx);
+    bytes -= size;
+    cv.notify_all();
+  }
+
+  // queue the job, whose image was reserved
+  void push(classify_batch* b, classify_job* j)
+  {
+    b->submit();
+    unique_lock<mutex> lock(mtx);
+    if (dead)
+      {
+        bytes -= j->image.size();
+        lock.unlock();
+        vector<char>().swap(j->image);
+        b->finish(j); // unclassified
+        return;
+      }
+    queued += j->image.size();
+    q.push_back(make_pair(b, j));
+    set_metric("thread_work_pending","role","classify", q.size());
+    cv.notify_all();
+  }
+
+  // block this classifier thread until there is work to do
+  bool pop(classify_batch*& b, classify_job*& j)
+  {
+    unique_lock<mutex> lock(mtx);
+    while (!dead && q.empty())
+      cv.wait(lock);
+    if (dead)
+      return false;
+    b = q.front().first;
+    j = q.front().second;
+    q.pop_front();
+    set_metric("thread_work_pending","role","classify", q.size());
+    return true;
+  }
+
+  // the classifier thread is done with that many bytes
+  void release(size_t size)
+  {
+    unique_lock<mutex> lock(mtx);
+    bytes -= size;
+    queued -= size;
+    cv.notify_all();
+  }
+
+  // kill this queue, hand back the unclassified jobs
+  void nuke()
+  {
+    deque<pair<classify_batch*,classify_job*>> left;
+    {
+      unique_lock<mutex> lock(mtx);
+      dead = true;
+      left.swap(q);
+      for (auto&& x : left)
+        {
+          bytes -= x.second->image.size();
+          queued -= x.second->image.size();
+        }
+      cv.notify_all();
+    }
+    for (auto&& x : left)
+      x.first->finish(x.second);
+  }
+};
+
+static classify_queue classifyq;
+
+
+// The bytes a scanner has reserved in classifyq for the image of one
+// archive member, given back unless the image gets queued.
+class classify_reservation
+{
+private:
+  size_t bytes;
+
+public:
+  classify_reservation(): bytes(0) {}
+  ~classify_reservation() { if (bytes > 0) classifyq.unreserve(bytes); }
+
+  // make it at least SIZE bytes
+  bool grow(size_t size)
+  {
+    if (size <= bytes)
+      return true;
+    if (! classifyq.reserve(size - bytes))
+      return false;
+    bytes = size;
+    return true;
+  }
+
+  // queue the job with an image of at most the reserved size
+  void push(classify_batch* b, classify_job* j)
+  {
+    if (bytes > j->image.size())
+      classifyq.unreserve(bytes - j->image.size());
+    bytes = 0;
+    classifyq.push(b, j);
+  }
+};
+
+
+static void*
+thread_main_classify (void* arg)
+{
+  (void) arg;
+  add_metric("thread_count", "role", "classify", 1);
+
+  classify_batch *b;
+  classify_job *j;
+  while (classifyq.pop(b, j))
+    {
+      add_metric("thread_busy", "role", "classify", 1);
+      size_t size = j->image.size();
+      elf_classify (j->image.data(), size,
+                    j->executable_p, j->debuginfo_p, j->buildid, j->sourcefiles);
+      vector<char>().swap(j->image); // release it right now
+      classifyq.release(size);
+      b->finish(j);
+      inc_metric("thread_work_total", "role", "classify");
+      add_metric("thread_busy", "role", "classify", -1);
+    }
+  return 0;
+}
+
+
+// Record the classification of an archive member with the given
+// upsert statements.
+static void
+archive_classify_record (const classify_job& j, const string& rps, int64_t archiveid,
+                         sqlite_ps& ps_upsert_buildids, sqlite_ps& ps_upsert_fileparts, sqlite_ps& ps_upsert_file,
+                         sqlite_ps& ps_lookup_file,
+                         sqlite_ps& ps_upsert_de, sqlite_ps& ps_upsert_sref, sqlite_ps& ps_upsert_sdef,
+                         sqlite_ps& ps_upsert_seekable, bool seekable,
+                         time_t mtime,
+                         unsigned& fts_executable, unsigned& fts_debuginfo, unsigned& fts_sref, unsigned& fts_sdef,
+                         bool& fts_sref_complete_p)
+{
+  if (j.buildid != "") // intern buildid
+    {
+      ps_upsert_buildids
+        .reset()
+        .bind(1, j.buildid)
+        .step_ok_done();
+    }
+
+  int64_t fileid = register_file_name (ps_upsert_fileparts, ps_upsert_file, ps_lookup_file, j.fn);
+
+  if (j.sourcefiles.size() > 0) // sref records needed
+    {
+      // NB: we intern each source file once.  Once raw, as it
+      // appears in the DWARF file list coming back from
+      // elf_classify() - because it'll end up in the
+      // _norm.artifactsrc column.  We don't also put another
+      // version with a '.' at the front, even though that's
+      // how rpm/cpio packs names, because we hide that from
+      // the database for storage efficiency.
+
+      for (auto&& s : j.sourcefiles)
+        {
+          if (s == "")
+            {
+              fts_sref_complete_p = false;
+              continue;
+            }
+
+          // PR25548: store canonicalized source path
+          const string& dwarfsrc = s;
+          string dwarfsrc_canon = canon_pathname (dwarfsrc);
+          if (dwarfsrc_canon != dwarfsrc)
+            {
+              if (verbose > 3)
+                obatched(clog) << "canonicalized src=" << dwarfsrc << " alias=" << dwarfsrc_canon << endl;
+            }
+
+          int64_t srcfileid = register_file_name(ps_upsert_fileparts, ps_upsert_file, ps_lookup_file,
+                                                 dwarfsrc_canon);
+        
+          ps_upsert_sref
+            .reset()
+            .bind(1, j.buildid)
+            .bind(2, srcfileid)
+            .step_ok_done();
+
+          fts_sref ++;
+        }
+    }
+
+  if (j.executable_p)
+    fts_executable ++;
+  if (j.debuginfo_p)
+    fts_debuginfo ++;
+
+  if (j.executable_p || j.debuginfo_p)
+    {
+      ps_upsert_de
+        .reset()
+        .bind(1, j.buildid)
+        .bind(2, j.debuginfo_p ? 1 : 0)
+        .bind(3, j.executable_p ? 1 : 0)
+        .bind(4, archiveid)
+        .bind(5, mtime)
+        .bind(6, fileid)
+        .step_ok_done();
+      if (seekable)
+        ps_upsert_seekable
+          .reset()
+          .bind(1, archiveid)
+          .bind(2, fileid)
+          .bind(3, j.seekable_size)
+          .bind(4, j.seekable_offset)
+          .bind(5, j.seekable_mtime)
+          .step_ok_done();
+    }
+  else // potential source - sdef record
+    {
+      fts_sdef ++;
+      ps_upsert_sdef
+        .reset()
+        .bind(1, archiveid)
+        .bind(2, mtime)
+        .bind(3, fileid)
+        .step_ok_done();
+    }
+
+  if (j.buildid != "")
+    scan_tx.invalidate(j.buildid);
+
+  if ((verbose > 2) && (j.executable_p || j.debuginfo_p))
+    {
+      obatched ob(clog);
+      auto& o = ob << "recorded buildid=" << j.buildid << " rpm=" << rps << " file=" << j.fn
+                   << " mtime=" << mtime << " atype="
+                   << (j.executable_p ? "E" : "")
+                   << (j.debuginfo_p ? "D" : "")
+                   << " sourcefiles=" << j.sourcefiles.size();
+      if (seekable)
+        o << " seekable size=" << j.seekable_size
+          << " offset=" << j.seekable_offset
+          << " mtime=" << j.seekable_mtime;
+      o << endl;
+    }
+}
+
+
 // Analyze given archive file of given age; record buildids / exec/debuginfo-ness of its
 // constituent files with given upsert statements.
 static void
@@ -4618,6 +5934,33 @@ archive_classify (const string& rps, string& archive_extension, int64_t archivei
     obatched(clog) << rps << " is seekable" << endl;
 
   bool any_exceptions = false;
+  classify_batch batch;
+
+  // record the jobs classified so far, if ALL after waiting for the rest
+  auto record_classified = [&](bool all)
+    {
+      deque<classify_job*> jobs;
+      batch.take(jobs, all);
+      while (! jobs.empty())
+        {
+          unique_ptr<classify_job> j (jobs.front());
+          jobs.pop_front();
+          try
+            {
+              archive_classify_record (*j, rps, archiveid,
+                                       ps_upsert_buildids, ps_upsert_fileparts, ps_upsert_file, ps_lookup_file,
+                                       ps_upsert_de, ps_upsert_sref, ps_upsert_sdef, ps_upsert_seekable, seekable,
+                                       mtime, fts_executable, fts_debuginfo, fts_sref, fts_sdef,
+                                       fts_sref_complete_p);
+            }
+          catch (const reportable_exception& e)
+            {
+              e.report(clog);
+              any_exceptions = true;
+            }
+        }
+    };
+
   while(1) // parse archive entries
     {
     if (interrupted)
@@ -4633,142 +5976,117 @@ archive_classify (const string& rps, string& archive_extension, int64_t archivei
           if (! S_ISREG(archive_entry_mode (e))) // skip non-files completely
             continue;
 
-          string fn = canonicalized_archive_entry_pathname (e);
+          unique_ptr<classify_job> j (new classify_job);
+          j->fn = canonicalized_archive_entry_pathname (e);
 
           if (verbose > 3)
-            obatched(clog) << "libarchive checking " << fn << endl;
-
-          int64_t seekable_size = archive_entry_size (e);
-          int64_t seekable_offset = archive_filter_bytes (a, 0);
-          time_t seekable_mtime = archive_entry_mtime (e);
-
-          // extract this file to a temporary file
-          char* tmppath = NULL;
-          rc = asprintf (&tmppath, "%s/debuginfod-classify.XXXXXX", tmpdir.c_str());
-          if (rc < 0)
-            throw libc_exception (ENOMEM, "cannot allocate tmppath");
-          defer_dtor<void*,void> tmmpath_freer (tmppath, free);
-          int fd = mkstemp (tmppath);
-          if (fd < 0)
-            throw libc_exception (errno, "cannot create temporary file");
-          unlink (tmppath); // unlink now so OS will release the file as soon as we close the fd
-          defer_dtor<int,int> minifd_closer (fd, close);
-
-          rc = archive_read_data_into_fd (a, fd);
-          if (rc != ARCHIVE_OK) {
-            close (fd);
-            throw archive_exception(a, "cannot extract file");
-          }
-
-          // finally ... time to run elf_classify on this bad boy and update the database
-          bool executable_p = false, debuginfo_p = false;
-          string buildid;
-          set<string> sourcefiles;
-          elf_classify (fd, executable_p, debuginfo_p, buildid, sourcefiles);
-          // NB: might throw
-
-          if (buildid != "") // intern buildid
-            {
-              ps_upsert_buildids
-                .reset()
-                .bind(1, buildid)
-                .step_ok_done();
-            }
-
-          int64_t fileid = register_file_name (ps_upsert_fileparts, ps_upsert_file, ps_lookup_file, fn);
-
-          if (sourcefiles.size() > 0) // sref records needed
+            obatched(clog) << "libarchive checking " << j->fn << endl;
+
+          j->seekable_size = archive_entry_size (e);
+          j->seekable_offset = archive_filter_bytes (a, 0);
+          j->seekable_mtime = archive_entry_mtime (e);
+
+          // Decompress this file into memory straight from the
+          // libarchive blocks, as long as it looks like ELF and fits
+          // in what is left of the classifyq budget.  elf_classify()
+          // can then use it in place.
+          classify_reservation reservation;
+          bool elf_p = true, spill_p = false;
+          const void *block;
+          size_t block_size;
+          la_int64_t block_offset;
+          while (1)
             {
-              // NB: we intern each source file once.  Once raw, as it
-              // appears in the DWARF file list coming back from
-              // elf_classify() - because it'll end up in the
-              // _norm.artifactsrc column.  We don't also put another
-              // version with a '.' at the front, even though that's
-              // how rpm/cpio packs names, because we hide that from
-              // the database for storage efficiency.
-
-              for (auto&& s : sourcefiles)
+              rc = archive_read_data_block (a, &block, &block_size, &block_offset);
+              if (rc == ARCHIVE_EOF)
+                break;
+              if (rc != ARCHIVE_OK)
+                throw archive_exception(a, "cannot extract file");
+              if (block_offset < (la_int64_t) j->image.size())
+                throw reportable_exception("overlapping archive data block");
+              if (j->image.empty() && block_offset == 0 && block_size >= SELFMAG
+                  && memcmp (block, ELFMAG, SELFMAG) != 0)
                 {
-                  if (s == "")
-                    {
-                      fts_sref_complete_p = false;
-                      continue;
-                    }
-
-                  // PR25548: store canonicalized source path
-                  const string& dwarfsrc = s;
-                  string dwarfsrc_canon = canon_pathname (dwarfsrc);
-                  if (dwarfsrc_canon != dwarfsrc)
-                    {
-                      if (verbose > 3)
-                        obatched(clog) << "canonicalized src=" << dwarfsrc << " alias=" << dwarfsrc_canon << endl;
-                    }
-
-                  int64_t srcfileid = register_file_name(ps_upsert_fileparts, ps_upsert_file, ps_lookup_file,
-                                                         dwarfsrc_canon);
-                
-                  ps_upsert_sref
-                    .reset()
-                    .bind(1, buildid)
-                    .bind(2, srcfileid)
-                    .step_ok_done();
-
-                  fts_sref ++;
+                  elf_p = false;
+                  break;
+                }
+              // Reserve before growing the image, all of it at once
+              // if its size is known: a sparse member may put a block
+              // far beyond what has been read so far.
+              la_int64_t want = block_offset + (la_int64_t) block_size;
+              if (archive_entry_size_is_set (e))
+                want = max (want, (la_int64_t) archive_entry_size (e));
+              if ((uint64_t) want > classify_queue::max_bytes()
+                  || ! reservation.grow (want))
+                {
+                  spill_p = true; // this block goes to the temporary file
+                  break;
+                }
+              if (j->image.capacity() < (size_t) want)
+                j->image.reserve (want);
+              j->image.resize (block_offset); // sparse files have holes
+              j->image.insert (j->image.end(), (const char *) block, (const char *) block + block_size);
+              if (j->image.size() >= SELFMAG
+                  && memcmp (j->image.data(), ELFMAG, SELFMAG) != 0)
+                {
+                  elf_p = false; // NB: the rest gets skipped by the next header
+                  break;
                 }
             }
+          if (elf_p && ! spill_p && archive_entry_size_is_set (e)
+              && archive_entry_size (e) > (la_int64_t) j->image.size())
+            j->image.resize (archive_entry_size (e)); // trailing hole, reserved
+          if (! spill_p && j->image.size() < SELFMAG)
+            elf_p = false;
 
-          if (executable_p)
-            fts_executable ++;
-          if (debuginfo_p)
-            fts_debuginfo ++;
-
-          if (executable_p || debuginfo_p)
-            {
-              ps_upsert_de
-                .reset()
-                .bind(1, buildid)
-                .bind(2, debuginfo_p ? 1 : 0)
-                .bind(3, executable_p ? 1 : 0)
-                .bind(4, archiveid)
-                .bind(5, mtime)
-                .bind(6, fileid)
-                .step_ok_done();
-              if (seekable)
-                ps_upsert_seekable
-                  .reset()
-                  .bind(1, archiveid)
-                  .bind(2, fileid)
-                  .bind(3, seekable_size)
-                  .bind(4, seekable_offset)
-                  .bind(5, seekable_mtime)
-                  .step_ok_done();
-            }
-          else // potential source - sdef record
+          if (! elf_p) // potential source, no need to classify
             {
-              fts_sdef ++;
-              ps_upsert_sdef
-                .reset()
-                .bind(1, archiveid)
-                .bind(2, mtime)
-                .bind(3, fileid)
-                .step_ok_done();
+              vector<char>().swap(j->image);
+              batch.submit();
+              batch.finish(j.release());
             }
-
-          if ((verbose > 2) && (executable_p || debuginfo_p))
+          else if (spill_p)
             {
-              obatched ob(clog);
-              auto& o = ob << "recorded buildid=" << buildid << " rpm=" << rps << " file=" << fn
-                           << " mtime=" << mtime << " atype="
-                           << (executable_p ? "E" : "")
-                           << (debuginfo_p ? "D" : "")
-                           << " sourcefiles=" << sourcefiles.size();
-              if (seekable)
-                o << " seekable size=" << seekable_size
-                  << " offset=" << seekable_offset
-                  << " mtime=" << seekable_mtime;
-              o << endl;
+              // extract this file to a temporary file
+              char* tmppath = NULL;
+              rc = asprintf (&tmppath, "%s/debuginfod-classify.XXXXXX", tmpdir.c_str());
+              if (rc < 0)
+                throw libc_exception (ENOMEM, "cannot allocate tmppath");
+              defer_dtor<void*,void> tmmpath_freer (tmppath, free);
+              int fd = mkstemp (tmppath);
+              if (fd < 0)
+                throw libc_exception (errno, "cannot create temporary file");
+              unlink (tmppath); // unlink now so OS will release the file as soon as we close the fd
+              defer_dtor<int,int> minifd_closer (fd, close);
+
+              // what we have so far, then the block that did not fit
+              // and the rest of the blocks
+              if (! j->image.empty()
+                  && pwrite_retry (fd, j->image.data(), j->image.size(), 0) != (ssize_t) j->image.size())
+                throw libc_exception (errno, "cannot write temporary file");
+              la_int64_t end = j->image.size();
+              vector<char>().swap(j->image);
+              do
+                {
+                  if (pwrite_retry (fd, block, block_size, block_offset) != (ssize_t) block_size)
+                    throw libc_exception (errno, "cannot write temporary file");
+                  end = max (end, block_offset + (la_int64_t) block_size);
+                  rc = archive_read_data_block (a, &block, &block_size, &block_offset);
+                }
+              while (rc == ARCHIVE_OK);
+              if (rc != ARCHIVE_EOF)
+                throw archive_exception(a, "cannot extract file");
+              if (archive_entry_size_is_set (e) && archive_entry_size (e) > end
+                  && ftruncate (fd, archive_entry_size (e)) != 0) // trailing hole
+                throw libc_exception (errno, "cannot write temporary file");
+
+              elf_classify (fd, j->executable_p, j->debuginfo_p, j->buildid, j->sourcefiles);
+              // NB: might throw
+              batch.submit();
+              batch.finish(j.release());
             }
-
+          else
+            reservation.push(&batch, j.release());
         }
       catch (const reportable_exception& e)
         {
@@ -4780,8 +6098,14 @@ archive_classify (const string& rps, string& archive_extension, int64_t archivei
           // this archive is rescanned.  (Its vitals won't go into the
           // _file_mtime_scanned table until after a successful scan.)
         }
+
+    // record what has been classified meanwhile
+    record_classified(false);
     }
 
+  // ... and the rest
+  record_classified(true);
+
   if (any_exceptions)
     throw reportable_exception("exceptions encountered during archive scan");
 }
@@ -4856,6 +6180,10 @@ scan_archive_file (const string& rps, const stat_t& st,
       any_exceptions = true;
     }
 
+  // New source files may resolve any cached source lookup.
+  if (my_fts_sdef > 0)
+    scan_tx.invalidate_all();
+
   if (verbose > 2)
     obatched(clog) << "scanned archive=" << rps
                    << " mtime=" << st.st_mtime
@@ -4971,6 +6299,7 @@ scan ()
 
       if (! gotone) continue; // go back to waiting
 
+      scan_tx.begin();
       try
         {
           bool scan_archive = false;
@@ -5013,6 +6342,7 @@ scan ()
           e.report(cerr);
         }
 
+      scan_tx.file_done(scanq.empty()); // commit before idlers run
       scanq.done_front(); // let idlers run
       
       if (fts_cached || fts_executable || fts_debuginfo || fts_sourcefiles || fts_sref || fts_sdef)
@@ -5025,6 +6355,7 @@ scan ()
       inc_metric("thread_work_total","role","scan");
     }
 
+  scan_tx.commit();
   add_metric("thread_busy", "role", "scan", -1);
 }
 
@@ -5386,7 +6717,8 @@ void groom()
   (void) statfs_free_enough_p(db_path, "database"); // report sqlite filesystem size
 
   sqlite3_db_release_memory(db); // shrink the process if possible
-  sqlite3_db_release_memory(dbq); // ... for both connections
+  dbq_pool->release_memory(); // ... for all connections
+  buildid_cache.clear(); // the groomed files may have been in there
   debuginfod_pool_groom(); // and release any debuginfod_client objects we've been holding onto
 #if HAVE_MALLOC_TRIM
   malloc_trim(0); // PR31103: release memory allocated for temporary purposes
@@ -5463,8 +6795,8 @@ signal_handler (int /* sig */)
 
   if (db)
     sqlite3_interrupt (db);
-  if (dbq)
-    sqlite3_interrupt (dbq);
+  if (dbq_pool)
+    dbq_pool->interrupt ();
 
   // NB: don't do anything else in here
 }
@@ -5653,33 +6985,44 @@ main (int argc, char *argv[])
         }
     }
 
-  // open the readonly query variant
+  /* If '-C' wasn't given or was given with no arg, pick a reasonable default
+     for the number of worker threads.  */
+  if (connection_pool == 0)
+    connection_pool = default_concurrency();
+
+  // open the readonly query variants, one per webapi worker thread
   // NB: PRIVATECACHE allows web queries to operate in parallel with
   // much other grooming/scanning operation.
-  rc = sqlite3_open_v2 (db_path.c_str(), &dbq, (SQLITE_OPEN_READONLY
-                                                |SQLITE_OPEN_URI
-                                                |SQLITE_OPEN_PRIVATECACHE
-                                                |SQLITE_OPEN_FULLMUTEX), /* thread-safe */
-                        NULL);
-  if (rc)
+  dbq_pool = new sqlite_query_pool (connection_pool);
+  for (int i = 0; i < connection_pool; i++)
     {
-      error (EXIT_FAILURE, 0,
-             "cannot open %s, consider deleting database: %s", db_path.c_str(), sqlite3_errmsg(dbq));
-    }
+      sqlite3 *dbq = 0;
+      rc = sqlite3_open_v2 (db_path.c_str(), &dbq, (SQLITE_OPEN_READONLY
+                                                    |SQLITE_OPEN_URI
+                                                    |SQLITE_OPEN_PRIVATECACHE
+                                                    |SQLITE_OPEN_NOMUTEX), /* one thread at a time */
+                            NULL);
+      if (rc)
+        {
+          error (EXIT_FAILURE, 0,
+                 "cannot open %s, consider deleting database: %s", db_path.c_str(), sqlite3_errmsg(dbq));
+        }
 
+      // add special string-prefix-similarity function used in rpm sref/sdef resolution
+      rc = sqlite3_create_function(dbq, "sharedprefix", 2, SQLITE_UTF8, NULL,
+                                   & sqlite3_sharedprefix_fn, NULL, NULL);
+      if (rc != SQLITE_OK)
+        error (EXIT_FAILURE, 0,
+               "cannot create sharedprefix function: %s", sqlite3_errmsg(dbq));
+
+      dbq_pool->add (dbq);
+    }
 
   obatched(clog) << "opened database " << db_path
-                 << (db?" rw":"") << (dbq?" ro":"") << endl;
+                 << (db?" rw":"") << " ro*" << connection_pool << endl;
   obatched(clog) << "sqlite version " << sqlite3_version << endl;
   obatched(clog) << "service mode " << (passive_p ? "passive":"active") << endl;
 
-  // add special string-prefix-similarity function used in rpm sref/sdef resolution
-  rc = sqlite3_create_function(dbq, "sharedprefix", 2, SQLITE_UTF8, NULL,
-                               & sqlite3_sharedprefix_fn, NULL, NULL);
-  if (rc != SQLITE_OK)
-    error (EXIT_FAILURE, 0,
-           "cannot create sharedprefix function: %s", sqlite3_errmsg(dbq));
-
   if (! passive_p)
     {
       if (verbose > 3)
@@ -5693,11 +7036,6 @@ main (int argc, char *argv[])
     }
 
   obatched(clog) << "libmicrohttpd version " << MHD_get_version() << endl;
-  
-  /* If '-C' wasn't given or was given with no arg, pick a reasonable default
-     for the number of worker threads.  */
-  if (connection_pool == 0)
-    connection_pool = default_concurrency();
 
   /* Note that MHD_USE_EPOLL and MHD_USE_THREAD_PER_CONNECTION don't
      work together.  */
@@ -5775,9 +7113,9 @@ main (int argc, char *argv[])
   if (d4 == NULL && d46 == NULL && dsa == NULL)
     {
       sqlite3 *database = db;
-      sqlite3 *databaseq = dbq;
-      db = dbq = 0; // for signal_handler not to freak
-      sqlite3_close (databaseq);
+      sqlite_query_pool *databaseq = dbq_pool;
+      db = 0; dbq_pool = 0; // for signal_handler not to freak
+      delete databaseq;
       sqlite3_close (database);
       error (EXIT_FAILURE, 0, "cannot start http server on %s port %d",
 	     addr_info.c_str(), http_port);
@@ -5832,6 +7170,17 @@ main (int argc, char *argv[])
   if (! passive_p) {
     obatched(clog) << "rescan time " << rescan_s << endl;
     obatched(clog) << "scan checkpoint " << scan_checkpoint << endl;
+    obatched(clog) << "scan batch " << scan_batch << endl;
+    obatched(clog) << "scan memory mbs " << scan_memory_mbs << endl;
+  }
+  {
+    obatched ob(clog);
+    auto& o = ob << "http compression";
+    for (auto&& e : http_encodings)
+      o << " " << e;
+    if (http_encodings.empty())
+      o << " none";
+    o << endl;
   }
   obatched(clog) << "fdcache mbs " << fdcache_mbs << endl;
   obatched(clog) << "fdcache prefetch " << fdcache_prefetch << endl;
@@ -5840,6 +7189,8 @@ main (int argc, char *argv[])
   if (! passive_p)
     obatched(clog) << "groom time " << groom_s << endl;
   obatched(clog) << "forwarded ttl limit " << forwarded_ttl_limit << endl;
+  obatched(clog) << "lookup cache " << lookup_cache_size
+                 << " ttl " << lookup_cache_ttl_s << endl;
 
   if (scan_archives.size()>0)
     {
@@ -5892,6 +7243,18 @@ main (int argc, char *argv[])
 #endif
               all_threads.push_back(pt);
             }
+
+          if (scan_archives.size() > 0)
+            for (unsigned i=0; i<concurrency; i++)
+              {
+                rc = pthread_create (& pt, NULL, thread_main_classify, NULL);
+                if (rc)
+                  error (EXIT_FAILURE, rc, "cannot spawn thread to classify archive contents\n");
+#ifdef HAVE_PTHREAD_SETNAME_NP
+                (void) pthread_setname_np (pt, "classify");
+#endif
+                all_threads.push_back(pt);
+              }
         }
     }
   
@@ -5900,6 +7263,7 @@ main (int argc, char *argv[])
   while (! interrupted)
     pause ();
   scanq.nuke(); // wake up any remaining scanq-related threads, let them die
+  classifyq.nuke(); // ... and the archive member classifiers
   if (scan_barrier) scan_barrier->nuke(); // ... in case they're stuck in a barrier
   set_metric("ready", 0);
 
@@ -5934,9 +7298,9 @@ main (int argc, char *argv[])
   (void) regfree (& file_exclude_regex);
 
   sqlite3 *database = db;
-  sqlite3 *databaseq = dbq;
-  db = dbq = 0; // for signal_handler not to freak
-  (void) sqlite3_close (databaseq);
+  sqlite_query_pool *databaseq = dbq_pool;
+  db = 0; dbq_pool = 0; // for signal_handler not to freak
+  delete databaseq;
   if (! passive_p)
     (void) sqlite3_close (database);
 
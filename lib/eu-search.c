@@ -32,11 +32,143 @@
 
 #include "eu-search.h"
 
+#ifdef USE_LOCKS
+/* Binary search the snapshot of TREE for KEY.  Returns the slot
+   holding the key, which like a tfind node points to the key, or
+   NULL.  *COMPLETE is set if the snapshot holds all keys in the tree,
+   so that a NULL result means KEY isn't there.  */
+static void *
+snapshot_find (const void *key, search_tree *tree,
+	       int (*compare)(const void *, const void *), bool *complete)
+{
+  *complete = false;
+  struct eu_search_snapshot *snap
+    = atomic_load_explicit (&tree->snapshot, memory_order_acquire);
+  if (snap == NULL)
+    return NULL;
+
+  size_t l = 0;
+  size_t u = snap->nkeys;
+  while (l < u)
+    {
+      size_t idx = (l + u) / 2;
+      int cmp = compare (key, snap->keys[idx]);
+      if (cmp < 0)
+	u = idx;
+      else if (cmp > 0)
+	l = idx + 1;
+      else
+	return (void *) &snap->keys[idx];
+    }
+
+  *complete = (snap->changes
+	       == atomic_load_explicit (&tree->changes,
+					memory_order_acquire));
+  return NULL;
+}
+
+/* twalk has no argument for the action, so the snapshot being filled
+   is passed on the side.  */
+static __thread struct eu_search_snapshot *collecting;
+
+static void
+collect_key (const void *nodep, VISIT which,
+	     int depth __attribute__ ((unused)))
+{
+  if (which == postorder || which == leaf)
+    collecting->keys[collecting->nkeys++] = *(const void **) nodep;
+}
+
+/* Keep the current snapshot of TREE around until the tree is
+   destroyed.  Called with the write lock held.  */
+static void
+retire_snapshot (search_tree *tree)
+{
+  struct eu_search_snapshot *old
+    = atomic_load_explicit (&tree->snapshot, memory_order_relaxed);
+  if (old != NULL)
+    {
+      old->retired = tree->retired;
+      tree->retired = old;
+      tree->nretired += old->nkeys;
+      atomic_store_explicit (&tree->snapshot, NULL, memory_order_release);
+    }
+}
+
+/* Replace the snapshot of TREE by one with all its current keys.
+   Called with the write lock held.  */
+static void
+update_snapshot (search_tree *tree)
+{
+  size_t changes = atomic_load_explicit (&tree->changes,
+					 memory_order_relaxed);
+  struct eu_search_snapshot *old
+    = atomic_load_explicit (&tree->snapshot, memory_order_relaxed);
+  if (old != NULL && old->changes == changes)
+    return;
+
+  struct eu_search_snapshot *snap
+    = malloc (sizeof *snap + tree->nkeys * sizeof snap->keys[0]);
+  if (snap == NULL)
+    return;
+  snap->retired = NULL;
+  snap->changes = changes;
+  snap->nkeys = 0;
+  collecting = snap;
+  twalk (tree->root, collect_key);
+  collecting = NULL;
+
+  retire_snapshot (tree);
+  atomic_store_explicit (&tree->snapshot, snap, memory_order_release);
+  atomic_store_explicit (&tree->stale, 0, memory_order_relaxed);
+}
+
+static void
+free_snapshots (search_tree *tree)
+{
+  retire_snapshot (tree);
+  while (tree->retired != NULL)
+    {
+      struct eu_search_snapshot *snap = tree->retired;
+      tree->retired = snap->retired;
+      free (snap);
+    }
+  tree->nretired = 0;
+}
+#endif
+
 void *eu_tsearch (const void *key, search_tree *tree,
 		  int (*compare)(const void *, const void *))
 {
+#ifdef USE_LOCKS
+  if (tree->read_mostly)
+    {
+      bool complete;
+      void *found = snapshot_find (key, tree, compare, &complete);
+      if (found != NULL)
+	return found;
+    }
+#endif
+
   rwlock_wrlock (tree->lock);
+#ifdef USE_LOCKS
+  bool added = (tree->read_mostly
+		&& tfind (key, &tree->root, compare) == NULL);
+#endif
   void *ret = tsearch (key, &tree->root, compare);
+#ifdef USE_LOCKS
+  if (added && ret != NULL)
+    {
+      /* Added a new key.  Making a snapshot costs as much as
+	 copying all keys, so only do it when the tree doubled.  */
+      tree->nkeys++;
+      atomic_fetch_add_explicit (&tree->changes, 1, memory_order_release);
+      struct eu_search_snapshot *snap
+	= atomic_load_explicit (&tree->snapshot, memory_order_relaxed);
+      if (tree->nkeys >= 2 * (snap != NULL ? snap->nkeys : 0))
+	update_snapshot (tree);
+    }
+#endif
   rwlock_unlock (tree->lock);
 
   return ret;
@@ -45,10 +177,39 @@ void *eu_tsearch (const void *key, search_tree *tree,
 void *eu_tfind (const void *key, search_tree *tree,
 	        int (*compare)(const void *, const void *))
 {
+#ifdef USE_LOCKS
+  if (tree->read_mostly)
+    {
+      bool complete;
+      void *found = snapshot_find (key, tree, compare, &complete);
+      if (found != NULL || complete)
+	return found;
+    }
+#endif
+
   rwlock_rdlock (tree->lock);
   void *ret = tfind (key, &tree->root, compare);
+#ifdef USE_LOCKS
+  /* Found a key added after the snapshot was made.  Once there were
+     as many of those lookups as there are keys, making a new snapshot
+     pays off.  Unless the old ones take up too much memory already.  */
+  bool update = (tree->read_mostly && ret != NULL
+		 && (atomic_fetch_add_explicit (&tree->stale, 1,
+						memory_order_relaxed) + 1
+		     >= tree->nkeys)
+		 && tree->nretired <= 2 * tree->nkeys);
+#endif
   rwlock_unlock (tree->lock);
 
+#ifdef USE_LOCKS
+  if (update)
+    {
+      rwlock_wrlock (tree->lock);
+      update_snapshot (tree);
+      rwlock_unlock (tree->lock);
+    }
+#endif
+
   return ret;
 }
 
@@ -57,6 +218,15 @@ void *eu_tdelete (const void *key, search_tree *tree,
 {
   rwlock_wrlock (tree->lock);
   void *ret = tdelete (key, &tree->root, compare);
+#ifdef USE_LOCKS
+  if (tree->read_mostly && ret != NULL)
+    {
+      /* The snapshot would still have the key.  */
+      tree->nkeys--;
+      atomic_fetch_add_explicit (&tree->changes, 1, memory_order_release);
+      retire_snapshot (tree);
+    }
+#endif
   rwlock_unlock (tree->lock);
 
   return ret;
@@ -68,6 +238,11 @@ void eu_tdestroy (search_tree *tree, void (*free_node)(void *))
 
   tdestroy (tree->root, free_node);
   tree->root = NULL;
+#ifdef USE_LOCKS
+  free_snapshots (tree);
+  tree->nkeys = 0;
+  atomic_fetch_add_explicit (&tree->changes, 1, memory_order_release);
+#endif
 
   rwlock_unlock (tree->lock);
 }
@@ -76,6 +251,23 @@ void eu_search_tree_init (search_tree *tree)
 {
   tree->root = NULL;
   rwlock_init (tree->lock);
+#ifdef USE_LOCKS
+  tree->read_mostly = false;
+  atomic_init (&tree->snapshot, NULL);
+  tree->retired = NULL;
+  tree->nretired = 0;
+  tree->nkeys = 0;
+  atomic_init (&tree->changes, 0);
+  atomic_init (&tree->stale, 0);
+#endif
+}
+
+void eu_search_tree_init_read_mostly (search_tree *tree)
+{
+  eu_search_tree_init (tree);
+#ifdef USE_LOCKS
+  tree->read_mostly = true;
+#endif
 }
 
 void eu_search_tree_fini (search_tree *tree, void (*free_node)(void *))
@@ -29,14 +29,40 @@
 #ifndef EU_SEARCH_H
 #define EU_SEARCH_H 1
 
+#include <stdbool.h>
 #include <stdlib.h>
 #include <search.h>
 #include <locks.h>
+#ifdef USE_LOCKS
+# include <stdatomic.h>
+
+/* Sorted copy of the keys in a read-mostly search_tree.  */
+struct eu_search_snapshot
+{
+  struct eu_search_snapshot *retired; /* Next older snapshot.  */
+  size_t changes;		/* Tree changes when it was made.  */
+  size_t nkeys;
+  const void *keys[];
+};
+#endif
 
 typedef struct
 {
   void *root;
   rwlock_define (, lock);
+#ifdef USE_LOCKS
+  /* For read-mostly trees lookups first try a binary search in a
+     snapshot of the keys, without taking the lock.  Snapshots are
+     replaced under the write lock and the old ones are only freed
+     together with the tree, since readers might still use them.  */
+  bool read_mostly;
+  struct eu_search_snapshot *_Atomic snapshot;
+  struct eu_search_snapshot *retired;
+  size_t nretired;		/* Keys in all retired snapshots.  */
+  size_t nkeys;			/* Keys in ROOT.  */
+  atomic_size_t changes;	/* Number of inserts and deletes.  */
+  atomic_size_t stale;		/* Lookups that needed the lock.  */
+#endif
 } search_tree;
 
 /* Search TREE for KEY and add KEY if not found. Synchronized using
@@ -58,6 +84,11 @@ void eu_tdestroy (search_tree *tree, void (*free_node)(void *));
 /* Initialize TREE's root and lock.  */
 void eu_search_tree_init (search_tree *tree);
 
+/* Initialize TREE's root and lock, for a tree that is searched much
+   more often than it is changed.  eu_tfind, and eu_tsearch of a key
+   already in the tree, then mostly don't need the lock.  */
+void eu_search_tree_init_read_mostly (search_tree *tree);
+
 /* Free all nodes from TREE as well as TREE's lock.  */
 void eu_search_tree_fini (search_tree *tree, void (*free_node)(void *));
 
@@ -1048,6 +1048,25 @@ enum
   };
 
 
+/* DWARF5 name index (.debug_names) attribute encodings.  */
+enum
+  {
+    DW_IDX_compile_unit = 1,
+    DW_IDX_type_unit = 2,
+    DW_IDX_die_offset = 3,
+    DW_IDX_parent = 4,
+    DW_IDX_type_hash = 5,
+
+    DW_IDX_lo_user = 0x2000,
+    DW_IDX_GNU_internal = 0x2000,
+    DW_IDX_GNU_external = 0x2001,
+    DW_IDX_GNU_main = 0x2002,
+    DW_IDX_GNU_language = 0x2003,
+    DW_IDX_GNU_linkage_name = 0x2004,
+    DW_IDX_hi_user = 0x3fff
+  };
+
+
 /* DWARF call frame instruction encodings.  */
 enum
   {
@@ -61,6 +61,7 @@ static const char dwarf_scnnames[IDX_last][19] =
   [IDX_debug_loc] = ".debug_loc",
   [IDX_debug_loclists] = ".debug_loclists",
   [IDX_debug_pubnames] = ".debug_pubnames",
+  [IDX_debug_names] = ".debug_names",
   [IDX_debug_str] = ".debug_str",
   [IDX_debug_str_offsets] = ".debug_str_offsets",
   [IDX_debug_macinfo] = ".debug_macinfo",
@@ -88,6 +89,7 @@ static const enum string_section_index scn_to_string_section_idx[IDX_last] =
   [IDX_debug_loc] = STR_SCN_IDX_last,
   [IDX_debug_loclists] = STR_SCN_IDX_last,
   [IDX_debug_pubnames] = STR_SCN_IDX_last,
+  [IDX_debug_names] = STR_SCN_IDX_last,
   [IDX_debug_str] = STR_SCN_IDX_debug_str,
   [IDX_debug_str_offsets] = STR_SCN_IDX_last,
   [IDX_debug_macinfo] = STR_SCN_IDX_last,
@@ -358,7 +360,7 @@ valid_p (Dwarf *result)
 	  result->fake_loc_cu->offset_size = 4;
 	  result->fake_loc_cu->version = 4;
 	  result->fake_loc_cu->split = NULL;
-	  eu_search_tree_init (&result->fake_loc_cu->locs_tree);
+	  eu_search_tree_init_read_mostly (&result->fake_loc_cu->locs_tree);
 	}
     }
 
@@ -386,7 +388,7 @@ valid_p (Dwarf *result)
 	  result->fake_loclists_cu->offset_size = 4;
 	  result->fake_loclists_cu->version = 5;
 	  result->fake_loclists_cu->split = NULL;
-	  eu_search_tree_init (&result->fake_loclists_cu->locs_tree);
+	  eu_search_tree_init_read_mostly (&result->fake_loclists_cu->locs_tree);
 	}
     }
 
@@ -419,7 +421,7 @@ valid_p (Dwarf *result)
 	  result->fake_addr_cu->offset_size = 4;
 	  result->fake_addr_cu->version = 5;
 	  result->fake_addr_cu->split = NULL;
-	  eu_search_tree_init (&result->fake_addr_cu->locs_tree);
+	  eu_search_tree_init_read_mostly (&result->fake_addr_cu->locs_tree);
 	}
     }
 
@@ -581,11 +583,16 @@ dwarf_begin_elf (Elf *elf, Dwarf_Cmd cmd, Elf_Scn *scngrp)
     }
   mutex_init (result->dwarf_lock);
   mutex_init (result->macro_lock);
+  mutex_init (result->names_lock);
+  mutex_init (result->files_lines_lock);
+  /* Units are looked up without a lock in cu_vector and tu_vector,
+     the trees are only the fallback.  The other trees cache things
+     that are added once but looked up all the time.  */
   eu_search_tree_init (&result->cu_tree);
   eu_search_tree_init (&result->tu_tree);
-  eu_search_tree_init (&result->split_tree);
-  eu_search_tree_init (&result->macro_ops_tree);
-  eu_search_tree_init (&result->files_lines_tree);
+  eu_search_tree_init_read_mostly (&result->split_tree);
+  eu_search_tree_init_read_mostly (&result->macro_ops_tree);
+  eu_search_tree_init_read_mostly (&result->files_lines_tree);
 
   result->mem_stacks = 0;
   result->mem_tails = NULL;
@@ -57,6 +57,19 @@ noop_free (void *arg __attribute__ ((unused)))
 }
 
 
+static void
+cu_vector_free (Dwarf_CU_Vector *vec)
+{
+  struct Dwarf_CU_Array *array = atomic_load (&vec->array);
+  while (array != NULL)
+    {
+      struct Dwarf_CU_Array *retired = array->retired;
+      free (array);
+      array = retired;
+    }
+}
+
+
 static void
 cu_free (void *arg)
 {
@@ -107,6 +120,8 @@ dwarf_end (Dwarf *dwarf)
 	 to be handled.  */
       eu_search_tree_fini (&dwarf->cu_tree, cu_free);
       eu_search_tree_fini (&dwarf->tu_tree, cu_free);
+      cu_vector_free (&dwarf->cu_vector);
+      cu_vector_free (&dwarf->tu_vector);
 
       /* Search tree for macro opcode tables.  */
       eu_search_tree_fini (&dwarf->macro_ops_tree, noop_free);
@@ -133,10 +148,27 @@ dwarf_end (Dwarf *dwarf)
       pthread_rwlock_destroy (&dwarf->mem_rwl);
       mutex_fini (dwarf->dwarf_lock);
       mutex_fini (dwarf->macro_lock);
+      mutex_fini (dwarf->names_lock);
+      mutex_fini (dwarf->files_lines_lock);
 
       /* Free the pubnames helper structure.  */
       free (dwarf->pubnames_sets);
 
+      /* Free the decoded .debug_names indexes.  */
+      if (dwarf->debug_names != NULL && dwarf->debug_names != (void *) -1)
+	{
+	  for (size_t i = 0; i < dwarf->debug_names->nindexes; i++)
+	    free (dwarf->debug_names->index[i].abbrevs);
+	  free (dwarf->debug_names);
+	}
+      if (dwarf->name_cache != NULL && dwarf->name_cache != (void *) -1)
+	{
+	  free (dwarf->name_cache->units);
+	  free (dwarf->name_cache->funcs);
+	  free (dwarf->name_cache->scopes);
+	  free (dwarf->name_cache);
+	}
+
       /* Free the ELF descriptor if necessary.  */
       if (dwarf->free_elf)
 	elf_end (dwarf->elf);
@@ -72,11 +72,12 @@ search_range (Dwarf_Addr low, Dwarf_Addr high,
       while (l < u)
 	{
 	  size_t idx = (l + u) / 2;
-	  if (lines->info[idx].addr < low)
+	  Dwarf_Line *line = __libdw_line (lines, idx);
+	  if (line->addr < low)
 	    l = idx + 1;
-	  else if (lines->info[idx].addr > low)
+	  else if (line->addr > low)
 	    u = idx;
-	  else if (lines->info[idx].end_sequence)
+	  else if (line->end_sequence)
 	    l = idx + 1;
 	  else
 	    {
@@ -87,14 +88,24 @@ search_range (Dwarf_Addr low, Dwarf_Addr high,
       if (l < u)
 	{
 	  if (dwarf)
-	    for (size_t i = l; i < u && lines->info[i].addr < high; ++i)
-	      if (lines->info[i].prologue_end
-		  && add_bkpt (lines->info[i].addr, bkpts, pnbkpts) < 0)
-		return -1;
+	    for (size_t i = l; i < u; ++i)
+	      {
+		Dwarf_Line *line = __libdw_line (lines, i);
+		if (line->addr >= high)
+		  break;
+		if (line->prologue_end
+		    && add_bkpt (line->addr, bkpts, pnbkpts) < 0)
+		  return -1;
+	      }
 	  if (adhoc && *pnbkpts == 0)
-	    while (++l < nlines && lines->info[l].addr < high)
-	      if (!lines->info[l].end_sequence)
-		return add_bkpt (lines->info[l].addr, bkpts, pnbkpts);
+	    while (++l < nlines)
+	      {
+		Dwarf_Line *line = __libdw_line (lines, l);
+		if (line->addr >= high)
+		  break;
+		if (!line->end_sequence)
+		  return add_bkpt (line->addr, bkpts, pnbkpts);
+	      }
 	  return *pnbkpts;
 	}
       __libdw_seterrno (DWARF_E_INVALID_DWARF);
@@ -67,9 +67,9 @@ dwarf_getcfi (Dwarf *dbg)
 
       cfi->next_offset = 0;
 
-      eu_search_tree_init (&cfi->cie_tree);
-      eu_search_tree_init (&cfi->fde_tree);
-      eu_search_tree_init (&cfi->expr_tree);
+      eu_search_tree_init_read_mostly (&cfi->cie_tree);
+      eu_search_tree_init_read_mostly (&cfi->fde_tree);
+      eu_search_tree_init_read_mostly (&cfi->expr_tree);
 
       cfi->ebl = NULL;
 
@@ -68,6 +68,10 @@ allocate_cfi (Elf *elf, const GElf_Ehdr *ehdr, GElf_Addr vaddr)
   cfi->textrel = 0;		/* XXX ? */
   cfi->datarel = 0;		/* XXX ? */
 
+  eu_search_tree_init_read_mostly (&cfi->cie_tree);
+  eu_search_tree_init_read_mostly (&cfi->fde_tree);
+  eu_search_tree_init_read_mostly (&cfi->expr_tree);
+
   return cfi;
 }
 
@@ -32,6 +32,7 @@
 # include <config.h>
 #endif
 
+#include <stdlib.h>
 #include <dwarf.h>
 #include "libdwP.h"
 
@@ -94,13 +95,10 @@ tree_visitor (unsigned int depth __attribute__ ((unused)),
 }
 
 ptrdiff_t
-dwarf_getfuncs (Dwarf_Die *cudie, int (*callback) (Dwarf_Die *, void *),
-		void *arg, ptrdiff_t offset)
+internal_function
+__libdw_getfuncs_walk (Dwarf_Die *cudie, int (*callback) (Dwarf_Die *, void *),
+		       void *arg, ptrdiff_t offset)
 {
-  if (unlikely (cudie == NULL
-		|| INTUSE(dwarf_tag) (cudie) != DW_TAG_compile_unit))
-    return -1;
-
   Dwarf_Word lang;
   bool c_cu = (INTUSE(dwarf_language) (cudie, &lang, NULL) == 0
 	       && lang == DW_LNAME_C);
@@ -115,3 +113,57 @@ dwarf_getfuncs (Dwarf_Die *cudie, int (*callback) (Dwarf_Die *, void *),
   else
     return res;
 }
+
+static int
+unit_compare (const void *a, const void *b)
+{
+  const Dwarf_CU *cu = a;
+  const struct Dwarf_Name_Cache_Unit_s *unit = b;
+  if (cu->sec_idx != unit->cu->sec_idx)
+    return cu->sec_idx < unit->cu->sec_idx ? -1 : 1;
+  if (cu->start != unit->cu->start)
+    return cu->start < unit->cu->start ? -1 : 1;
+  return 0;
+}
+
+ptrdiff_t
+dwarf_getfuncs (Dwarf_Die *cudie, int (*callback) (Dwarf_Die *, void *),
+		void *arg, ptrdiff_t offset)
+{
+  if (unlikely (cudie == NULL
+		|| INTUSE(dwarf_tag) (cudie) != DW_TAG_compile_unit))
+    return -1;
+
+  /* Use the subprograms the name cache found in this unit, if any,
+     instead of walking its DIEs again.  Failing to build the cache is
+     not an error of ours.  */
+  int error = INTUSE(dwarf_errno) ();
+  Dwarf_Name_Cache *cache = __libdw_get_name_cache (cudie->cu->dbg);
+  __libdw_seterrno (error);
+  const struct Dwarf_Name_Cache_Unit_s *unit = NULL;
+  if (cache != NULL)
+    unit = bsearch (cudie->cu, cache->units, cache->nunits,
+		    sizeof (cache->units[0]), unit_compare);
+  if (unit == NULL || ! unit->funcs_p || unit->cu != cudie->cu)
+    return __libdw_getfuncs_walk (cudie, callback, arg, offset);
+
+  const struct Dwarf_Name_Cache_Func_s *funcs = &cache->funcs[unit->first];
+  size_t i = 0;
+  if (offset != 0)
+    {
+      while (i < unit->nfuncs && funcs[i].addr != (void *) offset)
+	i++;
+      if (i == unit->nfuncs)
+	return __libdw_getfuncs_walk (cudie, callback, arg, offset);
+      i++;
+    }
+
+  for (; i < unit->nfuncs; i++)
+    {
+      Dwarf_Die die = { .addr = funcs[i].addr, .cu = funcs[i].cu };
+      int res = (*callback) (&die, arg);
+      if (res != DWARF_CB_OK)
+	return res == DWARF_CB_ABORT ? (ptrdiff_t) funcs[i].addr : res;
+    }
+  return 0;
+}
\ No newline at end of file
@@ -179,6 +179,72 @@ pc_record (unsigned int depth, struct Dwarf_Die_Chain *die, void *arg)
 }
 
 
+static int
+scope_compare (const void *a, const void *b)
+{
+  const struct Dwarf_Name_Cache_Scope_s *scope_a = a;
+  const struct Dwarf_Name_Cache_Scope_s *scope_b = b;
+  if (scope_a->addr != scope_b->addr)
+    return scope_a->addr < scope_b->addr ? -1 : 1;
+  return 0;
+}
+
+/* The parent of the DIE at ADDR the name cache recorded, or NULL.  */
+static void *
+cached_parent (Dwarf_Name_Cache *cache, void *addr)
+{
+  struct Dwarf_Name_Cache_Scope_s key = { .addr = addr };
+  const struct Dwarf_Name_Cache_Scope_s *scope
+    = bsearch (&key, cache->scopes, cache->nscopes,
+	       sizeof (cache->scopes[0]), scope_compare);
+  return scope != NULL ? scope->parent : NULL;
+}
+
+/* Like the traversal with origin_match, but following the parents the
+   name cache recorded.  Returns 0 if the cache doesn't know the whole
+   way up from A->inlined_origin, to do the traversal instead.  */
+static int
+origin_from_cache (struct args *a)
+{
+  Dwarf_CU *cu = a->inlined_origin.cu;
+  int error = INTUSE(dwarf_errno) ();
+  Dwarf_Name_Cache *cache = __libdw_get_name_cache (cu->dbg);
+  __libdw_seterrno (error);
+  if (cache == NULL)
+    return 0;
+
+  Dwarf_Die cudie = CUDIE (cu);
+  unsigned int depth = 0;
+  void *addr = a->inlined_origin.addr;
+  do
+    {
+      addr = cached_parent (cache, addr);
+      if (addr == NULL)
+	return 0;
+      depth++;
+    }
+  while (addr != cudie.addr);
+
+  unsigned int nscopes = a->nscopes + depth;
+  Dwarf_Die *scopes = realloc (a->scopes, nscopes * sizeof scopes[0]);
+  if (scopes == NULL)
+    {
+      /* a->scopes will be freed by dwarf_getscopes on error.  */
+      __libdw_seterrno (DWARF_E_NOMEM);
+      return -1;
+    }
+
+  a->scopes = scopes;
+  addr = a->inlined_origin.addr;
+  while (a->nscopes < nscopes - 1)
+    {
+      addr = cached_parent (cache, addr);
+      scopes[a->nscopes++] = (Dwarf_Die) { .addr = addr, .cu = cu };
+    }
+  scopes[a->nscopes++] = cudie;
+  return a->nscopes;
+}
+
 int
 dwarf_getscopes (Dwarf_Die *cudie, Dwarf_Addr pc, Dwarf_Die **scopes)
 {
@@ -194,8 +260,13 @@ dwarf_getscopes (Dwarf_Die *cudie, Dwarf_Addr pc, Dwarf_Die **scopes)
     {
       /* We like the find the inline function's abstract definition
          scope, but that might be in a different CU.  */
-      cu.die = CUDIE (a.inlined_origin.cu);
-      result = __libdw_visit_scopes (0, &cu, NULL, &origin_match, NULL, &a);
+      result = origin_from_cache (&a);
+      if (result == 0)
+	{
+	  cu.die = CUDIE (a.inlined_origin.cu);
+	  result = __libdw_visit_scopes (0, &cu, NULL, &origin_match, NULL,
+					 &a);
+	}
     }
 
   if (result > 0)
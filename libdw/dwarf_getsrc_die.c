@@ -47,28 +47,20 @@ dwarf_getsrc_die (Dwarf_Die *cudie, Dwarf_Addr addr)
   /* The lines are sorted by address, so we can use binary search.  */
   if (nlines > 0)
     {
-      size_t l = 0, u = nlines - 1;
-      while (l < u)
-	{
-	  size_t idx = u - (u - l) / 2;
-	  Dwarf_Line *line = &lines->info[idx];
-	  if (addr < line->addr)
-	    u = idx - 1;
-	  else
-	    l = idx;
-	}
+      size_t l = __libdw_lines_find (lines, addr);
 
       /* This is guaranteed for us by libdw read_srclines.  */
-      assert (lines->info[nlines - 1].end_sequence);
+      assert (__libdw_line (lines, nlines - 1)->end_sequence);
 
       /* The last line which is less than or equal to addr is what we
 	 want, unless it is the end_sequence which is after the
 	 current line sequence.  */
-      Dwarf_Line *line = &lines->info[l];
+      Dwarf_Line *line = __libdw_line (lines, l);
       if (! line->end_sequence && line->addr <= addr)
-	return &lines->info[l];
+	return line;
     }
 
   __libdw_seterrno (DWARF_E_ADDR_OUTOFRANGE);
   return NULL;
 }
+INTDEF (dwarf_getsrc_die)
@@ -84,7 +84,7 @@ dwarf_getsrc_file (Dwarf *dbg, const char *fname, int lineno, int column,
       bool lastmatch = false;
       for (size_t cnt = 0; cnt < nlines; ++cnt)
 	{
-	  Dwarf_Line *line = &lines->info[cnt];
+	  Dwarf_Line *line = __libdw_line (lines, cnt);
 
 	  if (lastfile != line->file)
 	    {
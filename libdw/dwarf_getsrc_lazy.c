@@ -0,0 +1,165 @@
+/* Find line information for address, decoding only one sequence.
+   This file is part of elfutils.
+
+   This file is free software; you can redistribute it and/or modify
+   it under the terms of either
+
+     * the GNU Lesser General Public License as published by the Free
+       Software Foundation; either version 3 of the License, or (at
+       your option) any later version
+
+   or
+
+     * the GNU General Public License as published by the Free
+       Software Foundation; either version 2 of the License, or (at
+       your option) any later version
+
+   or both in parallel, as here.
+
+   elfutils is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received copies of the GNU General Public License and
+   the GNU Lesser General Public License along with this program.  If
+   not, see <http://www.gnu.org/licenses/>.  */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include "libdwP.h"
+
+
+/* The last row of a sequence at or before ADDR, sorted the same way
+   as all rows are for dwarf_getsrc_die.  */
+static Dwarf_Line *
+find_row (Dwarf_Lines *lines, Dwarf_Addr addr)
+{
+  size_t l = 0, u = lines->nlines;
+  while (l < u)
+    {
+      size_t idx = (l + u) / 2;
+      if (addr < lines->info[idx].addr)
+	u = idx;
+      else
+	l = idx + 1;
+    }
+  return l > 0 ? &lines->info[l - 1] : NULL;
+}
+
+Dwarf_Line *
+dwarf_getsrc_lazy (Dwarf_Die *cudie, Dwarf_Addr addr)
+{
+  if (cudie == NULL)
+    return NULL;
+  if (! is_cudie (cudie))
+    {
+      __libdw_seterrno (DWARF_E_NOT_CUDIE);
+      return NULL;
+    }
+
+  struct Dwarf_CU *const cu = cudie->cu;
+
+  /* For split units the lines are in the skeleton.  */
+  if (cu->unit_type == DW_UT_split_compile
+      || cu->unit_type == DW_UT_split_type)
+    {
+      Dwarf_CU *skel = __libdw_find_split_unit (cu);
+      if (skel == NULL)
+	{
+	  __libdw_seterrno (DWARF_E_NO_DEBUG_LINE);
+	  return NULL;
+	}
+      Dwarf_Die skeldie = CUDIE (skel);
+      return dwarf_getsrc_lazy (&skeldie, addr);
+    }
+
+  mutex_lock (cu->src_lock);
+
+  /* Once all lines are decoded there is no point in decoding any of
+     them again.  */
+  bool have_lines = cu->lines != NULL;
+  if (! have_lines && cu->sequences == NULL)
+    {
+      cu->sequences = __libdw_getsrcsequences (cudie);
+      if (cu->sequences == NULL)
+	cu->sequences = (void *) -1l;
+    }
+
+  Dwarf_Line_Sequences *seqs = cu->sequences;
+  if (have_lines || seqs == (void *) -1l)
+    {
+      mutex_unlock (cu->src_lock);
+      return INTUSE(dwarf_getsrc_die) (cudie, addr);
+    }
+
+  /* Find the last sequence starting at or before ADDR.  */
+  size_t l = 0, u = seqs->nseqs;
+  while (l < u)
+    {
+      size_t idx = (l + u) / 2;
+      if (addr < seqs->seqs[idx].low)
+	u = idx;
+      else
+	l = idx + 1;
+    }
+
+  /* dwarf_getsrc_die returns the last row at or before ADDR of all
+     sequences, unless it is an end_sequence.  Normally that is in the
+     last sequence starting at or before ADDR, but if sequences overlap
+     an earlier one may have a later row.  BEST_ADDR is the address of
+     the best row so far, which is NULL for an end_sequence.  */
+  Dwarf_Line *best = NULL;
+  Dwarf_Addr best_addr = 0;
+  bool found = false;
+  bool failed = false;
+  while (l-- > 0)
+    {
+      struct Dwarf_Line_Sequence_s *seq = &seqs->seqs[l];
+      if (found && seq->max_high <= best_addr)
+	break;
+
+      Dwarf_Line *row = NULL;
+      Dwarf_Addr row_addr = seq->high;
+
+      /* Past the end the last row is the end_sequence, unless a normal
+	 row sorts after it at the same address.  */
+      if (addr <= seq->high || seq->open_end)
+	{
+	  if (seq->lines == NULL)
+	    {
+	      seq->lines = __libdw_getsrcsequence_lines (cu->dbg, seqs, seq);
+	      if (seq->lines == NULL)
+		{
+		  failed = true;
+		  break;
+		}
+	    }
+
+	  row = find_row (seq->lines, addr);
+	  if (row == NULL)
+	    continue;
+	  row_addr = row->addr;
+	  if (row->end_sequence)
+	    row = NULL;
+	}
+
+      if (! found || row_addr > best_addr)
+	{
+	  best = row;
+	  best_addr = row_addr;
+	  found = true;
+	}
+    }
+
+  mutex_unlock (cu->src_lock);
+
+  /* When decoding failed the error is already set.  */
+  if (failed)
+    return NULL;
+  if (best == NULL)
+    __libdw_seterrno (DWARF_E_ADDR_OUTOFRANGE);
+  return best;
+}
@@ -756,12 +756,83 @@ out:
   return res;
 }
 
+/* The sequences found by read_srclines when it only indexes the line
+   program.  */
+struct seq_index
+{
+  struct Dwarf_Line_Sequence_s *seqs;
+  size_t nseqs;
+  size_t allocated;
+
+  /* The sequence being read.  */
+  const unsigned char *start;
+  Dwarf_Addr low;
+  Dwarf_Addr high;
+  Dwarf_Addr row_high;		/* Highest normal row.  */
+  size_t nrows;
+};
+
+/* Record the sequence that ends just before ENDP.  */
+static bool
+end_index_sequence (struct seq_index *index, const unsigned char *endp)
+{
+  if (index->nrows > 0)
+    {
+      if (index->nseqs == index->allocated)
+	{
+	  size_t n = index->allocated * 2 + 16;
+	  struct Dwarf_Line_Sequence_s *newp
+	    = realloc (index->seqs, n * sizeof *newp);
+	  if (newp == NULL)
+	    return false;
+	  index->seqs = newp;
+	  index->allocated = n;
+	}
+      index->seqs[index->nseqs++] = (struct Dwarf_Line_Sequence_s)
+	{
+	  .low = index->low,
+	  .high = index->high,
+	  .open_end = index->row_high >= index->high,
+	  .start = index->start,
+	  .end = endp,
+	  .lines = NULL
+	};
+    }
+
+  index->start = endp;
+  index->nrows = 0;
+  return true;
+}
+
+static bool
+index_row (struct seq_index *index, Dwarf_Addr addr, bool end_seq,
+	   const unsigned char *linep)
+{
+  if (index->nrows == 0 || addr < index->low)
+    index->low = addr;
+  if (index->nrows == 0 || addr > index->high)
+    index->high = addr;
+  if (index->nrows == 0)
+    index->row_high = 0;
+  if (! end_seq && addr > index->row_high)
+    index->row_high = addr;
+  index->nrows++;
+
+  return ! end_seq || end_index_sequence (index, linep);
+}
+
+/* Decode the line program.  If SEQP is not NULL only decode the
+   opcodes from SEQP to SEQENDP, which must be one whole sequence.  If
+   INDEX is not NULL no rows are created, only the sequences are
+   recorded in INDEX.  Then 1 is returned if the program cannot be
+   decoded per sequence because it has DW_LNE_define_file.  */
 static int
 read_srclines (Dwarf *dbg,
 	       const unsigned char *linep, const unsigned char *lineendp,
 	       const char *comp_dir, unsigned address_size,
 	       Dwarf_Lines **linesp, Dwarf_Files **filesp,
-	       bool use_cached_files)
+	       bool use_cached_files, const unsigned char *seqp,
+	       const unsigned char *seqendp, struct seq_index *index)
 {
   int res = -1;
   struct line_header lh;
@@ -813,6 +884,15 @@ read_srclines (Dwarf *dbg,
   struct linelist llstack[MAX_STACK_LINES];
 #define NEW_LINE(end_seq)						\
   do {								\
+    if (index != NULL)						\
+      {								\
+	if (unlikely (! index_row (index, state.addr, end_seq, linep))) \
+	  {							\
+	    __libdw_seterrno (DWARF_E_NOMEM);			\
+	    goto out;						\
+	  }							\
+	break;							\
+      }								\
     struct linelist *ll = (state.nlinelist < MAX_STACK_LINES	\
 			   ? &llstack[state.nlinelist]		\
 			   : malloc (sizeof (struct linelist)));	\
@@ -837,6 +917,16 @@ read_srclines (Dwarf *dbg,
   /* Set linep to the beginning of the line program.  */
   linep = lh.header_start + lh.header_length;
 
+  /* Or to just the one sequence asked for.  */
+  if (seqp != NULL)
+    {
+      linep = seqp;
+      lineendp = seqendp;
+    }
+
+  if (index != NULL)
+    index->start = linep;
+
   while (linep < lineendp)
     {
       unsigned int opcode;
@@ -926,6 +1016,14 @@ read_srclines (Dwarf *dbg,
 
 	    case DW_LNE_define_file:
 	      {
+		/* The sequences after this would see other files than
+		   the ones before.  */
+		if (index != NULL)
+		  {
+		    res = 1;
+		    goto out;
+		  }
+
 		char *fname = (char *) linep;
 		uint8_t *endp = memchr (linep, '\0', lineendp - linep);
 		if (endp == NULL)
@@ -1183,6 +1281,18 @@ read_srclines (Dwarf *dbg,
 	}
     }
 
+  if (index != NULL)
+    {
+      /* Rows after the last end_sequence.  */
+      if (index->nrows > 0 && ! end_index_sequence (index, lineendp))
+	{
+	  __libdw_seterrno (DWARF_E_NOMEM);
+	  goto out;
+	}
+      res = 0;
+      goto out;
+    }
+
   /* Merge filesp with the files from DW_LNE_define_file, if any.  */
   if (unlikely (filelist != NULL))
     {
@@ -1227,9 +1337,24 @@ read_srclines (Dwarf *dbg,
       *filesp = newfiles;
     }
 
+  /* A compact table is encoded from the sorted rows, so they just need
+     a temporary buffer.  Only whole tables are stored compactly.  */
+  bool compact = dbg->compact_lines && seqp == NULL;
   size_t buf_size = (sizeof (Dwarf_Lines)
 		     + (sizeof (Dwarf_Line) * state.nlinelist));
-  void *buf = libdw_alloc (dbg, Dwarf_Lines, buf_size, 1);
+  void *buf;
+  if (compact)
+    {
+      buf_size = sizeof (struct linelist *) * state.nlinelist;
+      buf = malloc (buf_size);
+      if (unlikely (buf == NULL && state.nlinelist > 0))
+	{
+	  __libdw_seterrno (DWARF_E_NOMEM);
+	  goto out;
+	}
+    }
+  else
+    buf = libdw_alloc (dbg, Dwarf_Lines, buf_size, 1);
 
   /* First use the buffer for the pointers, and sort the entries.
      We'll write the pointers in the end of the buffer, and then
@@ -1252,22 +1377,38 @@ read_srclines (Dwarf *dbg,
   /* Sort by ascending address.  */
   qsort (sortlines, state.nlinelist, sizeof sortlines[0], &compare_lines);
 
-  /* Now that they are sorted, put them in the final array.
-     The buffers overlap, so we've clobbered the early elements
-     of SORTLINES by the time we're reading the later ones.  */
-  Dwarf_Lines *lines = buf;
-  lines->nlines = state.nlinelist;
-  for (size_t i = 0; i < state.nlinelist; ++i)
-    {
-      lines->info[i] = sortlines[i]->line;
-      lines->info[i].files = *filesp;
-    }
-
   /* Make sure the highest address for the CU is marked as end_sequence.
      This is required by the DWARF spec, but some compilers forget and
-     dwfl_module_getsrc depends on it.  */
-  if (state.nlinelist > 0)
-    lines->info[state.nlinelist - 1].end_sequence = 1;
+     dwfl_module_getsrc depends on it.  A single sequence might not
+     have the highest address, see __libdw_getsrcsequence_lines.  */
+  if (state.nlinelist > 0 && seqp == NULL)
+    sortlines[state.nlinelist - 1]->line.end_sequence = 1;
+
+  Dwarf_Lines *lines;
+  if (compact)
+    {
+      /* The rows are encoded straight from the line list, the pointers
+	 to them are the same size as the pointers to the list entries.  */
+      Dwarf_Line **rows = buf;
+      for (size_t i = 0; i < state.nlinelist; ++i)
+	rows[i] = &sortlines[i]->line;
+      lines = __libdw_compact_lines (dbg, rows, state.nlinelist, *filesp);
+      free (buf);
+    }
+  else
+    {
+      /* Now that they are sorted, put them in the final array.
+	 The buffers overlap, so we've clobbered the early elements
+	 of SORTLINES by the time we're reading the later ones.  */
+      lines = buf;
+      lines->nlines = state.nlinelist;
+      lines->compact = NULL;
+      for (size_t i = 0; i < state.nlinelist; ++i)
+	{
+	  lines->info[i] = sortlines[i]->line;
+	  lines->info[i].files = *filesp;
+	}
+    }
 
   /* Pass the line structure back to the caller.  */
   if (linesp != NULL)
@@ -1319,9 +1460,25 @@ get_lines_or_files (Dwarf *dbg, Dwarf_Off debug_line_offset,
 		    const char *comp_dir, unsigned address_size,
 		    Dwarf_Lines **linesp, Dwarf_Files **filesp)
 {
+  /* Units are looked up concurrently, possibly several using the same
+     .debug_line offset.  The tables are read without holding any lock,
+     files_lines_lock only guards adding them to files_lines_tree.  */
   struct files_lines_s fake = { .debug_line_offset = debug_line_offset };
   struct files_lines_s **found = eu_tfind (&fake, &dbg->files_lines_tree,
 					   files_lines_compare);
+
+  /* Other threads may be publishing the tables of this node right now,
+     only look at them under the lock.  */
+  Dwarf_Files *found_files = NULL;
+  Dwarf_Lines *found_lines = NULL;
+  if (found != NULL)
+    {
+      mutex_lock (dbg->files_lines_lock);
+      found_files = (*found)->files;
+      found_lines = (*found)->lines;
+      mutex_unlock (dbg->files_lines_lock);
+    }
+
   if (found == NULL)
     {
       /* This .debug_line is being read for the first time.  */
@@ -1349,21 +1506,33 @@ get_lines_or_files (Dwarf *dbg, Dwarf_Off debug_line_offset,
 	    return -1;
 	}
       else if (read_srclines (dbg, linep, lineendp, comp_dir, address_size,
-			 &node->lines, &node->files, false) != 0)
+			      &node->lines, &node->files, false,
+			      NULL, NULL, NULL) != 0)
 	return -1;
 
       node->debug_line_offset = debug_line_offset;
 
+      mutex_lock (dbg->files_lines_lock);
       found = eu_tsearch (node, &dbg->files_lines_tree, files_lines_compare);
       if (found == NULL)
 	{
+	  mutex_unlock (dbg->files_lines_lock);
 	  __libdw_seterrno (DWARF_E_NOMEM);
 	  return -1;
 	}
+
+      /* Another thread might have added this .debug_line while we
+	 were reading it, but without the lines we have.  */
+      if (*found != node && (*found)->lines == NULL && node->lines != NULL)
+	{
+	  (*found)->files = node->files;
+	  (*found)->lines = node->lines;
+	}
+      mutex_unlock (dbg->files_lines_lock);
     }
-  else if (*found != NULL
-	   && (*found)->files != NULL
-	   && (*found)->lines == NULL)
+  else if (found_files != NULL
+	   && found_lines == NULL
+	   && linesp != NULL)
     {
       /* Srcfiles were already read from this .debug_line.  Now read
 	 srclines.  */
@@ -1377,25 +1546,37 @@ get_lines_or_files (Dwarf *dbg, Dwarf_Off debug_line_offset,
       const unsigned char *lineendp = data->d_buf + data->d_size;
 
       struct files_lines_s *node = *found;
+      Dwarf_Files *files = found_files;
+      Dwarf_Lines *lines = NULL;
 
       if (read_srclines (dbg, linep, lineendp, comp_dir, address_size,
-			 &node->lines, &node->files, true) != 0)
+			 &lines, &files, true, NULL, NULL, NULL) != 0)
 	return -1;
+
+      /* DW_LNE_define_file might have extended the files.  */
+      mutex_lock (dbg->files_lines_lock);
+      if (node->lines == NULL)
+	{
+	  node->files = files;
+	  node->lines = lines;
+	}
+      mutex_unlock (dbg->files_lines_lock);
     }
-  else if (*found != NULL
-	   && (*found)->files == NULL
-	   && (*found)->lines != NULL)
+  else if (found_files == NULL
+	   && found_lines != NULL)
     {
       /* If srclines were read then srcfiles should have also been read.  */
       __libdw_seterrno (DWARF_E_INVALID_DEBUG_LINE);
       return -1;
     }
 
+  mutex_lock (dbg->files_lines_lock);
   if (linesp != NULL)
     *linesp = (*found)->lines;
 
   if (filesp != NULL)
     *filesp = (*found)->files;
+  mutex_unlock (dbg->files_lines_lock);
 
   return 0;
 }
@@ -1420,6 +1601,100 @@ __libdw_getsrcfiles (Dwarf *dbg, Dwarf_Off debug_line_offset,
 			     address_size, NULL, filesp);
 }
 
+static int
+compare_sequences (const void *a, const void *b)
+{
+  const struct Dwarf_Line_Sequence_s *s1 = a;
+  const struct Dwarf_Line_Sequence_s *s2 = b;
+  if (s1->low != s2->low)
+    return s1->low < s2->low ? -1 : 1;
+  return s1->start < s2->start ? -1 : s1->start > s2->start;
+}
+
+Dwarf_Line_Sequences *
+internal_function
+__libdw_getsrcsequences (Dwarf_Die *cudie)
+{
+  struct Dwarf_CU *cu = cudie->cu;
+  Dwarf *dbg = cu->dbg;
+
+  Dwarf_Attribute stmt_list_mem;
+  Dwarf_Attribute *stmt_list = INTUSE(dwarf_attr) (cudie, DW_AT_stmt_list,
+						   &stmt_list_mem);
+  Dwarf_Off debug_line_offset;
+  if (__libdw_formptr (stmt_list, IDX_debug_line, DWARF_E_NO_DEBUG_LINE,
+		       NULL, &debug_line_offset) == NULL)
+    return NULL;
+
+  const char *comp_dir = __libdw_getcompdir (cudie);
+  Dwarf_Files *files;
+  if (__libdw_getsrcfiles (dbg, debug_line_offset, comp_dir,
+			   cu->address_size, &files) != 0)
+    return NULL;
+
+  Elf_Data *data = __libdw_checked_get_data (dbg, IDX_debug_line);
+  if (data == NULL)
+    return NULL;
+  const unsigned char *linep = data->d_buf + debug_line_offset;
+  const unsigned char *lineendp = data->d_buf + data->d_size;
+
+  struct seq_index index = { .seqs = NULL, .nseqs = 0, .allocated = 0 };
+  if (read_srclines (dbg, linep, lineendp, comp_dir, cu->address_size,
+		     NULL, &files, true, NULL, NULL, &index) != 0)
+    {
+      free (index.seqs);
+      return NULL;
+    }
+
+  qsort (index.seqs, index.nseqs, sizeof index.seqs[0], compare_sequences);
+
+  Dwarf_Line_Sequences *seqs
+    = libdw_alloc (dbg, Dwarf_Line_Sequences,
+		   sizeof (Dwarf_Line_Sequences)
+		   + index.nseqs * sizeof (struct Dwarf_Line_Sequence_s), 1);
+  seqs->linep = linep;
+  seqs->lineendp = lineendp;
+  seqs->comp_dir = comp_dir;
+  seqs->address_size = cu->address_size;
+  seqs->files = files;
+  seqs->nseqs = index.nseqs;
+  Dwarf_Addr max_high = 0;
+  for (size_t i = 0; i < index.nseqs; i++)
+    {
+      seqs->seqs[i] = index.seqs[i];
+      max_high = MAX (max_high, index.seqs[i].high);
+      seqs->seqs[i].max_high = max_high;
+    }
+  free (index.seqs);
+
+  return seqs;
+}
+
+Dwarf_Lines *
+internal_function
+__libdw_getsrcsequence_lines (Dwarf *dbg, Dwarf_Line_Sequences *seqs,
+			      struct Dwarf_Line_Sequence_s *seq)
+{
+  Dwarf_Files *files = seqs->files;
+  Dwarf_Lines *lines;
+  if (read_srclines (dbg, seqs->linep, seqs->lineendp, seqs->comp_dir,
+		     seqs->address_size, &lines, &files, true,
+		     seq->start, seq->end, NULL) != 0)
+    return NULL;
+
+  /* Like for the whole table, if this has the highest address of the
+     CU its last row is marked as end_sequence.  When several sequences
+     end there, that is the last row of the last one in the program.  */
+  Dwarf_Addr cu_high = seqs->seqs[seqs->nseqs - 1].max_high;
+  bool last = lines->nlines > 0 && seq->high == cu_high;
+  for (size_t i = 0; last && i < seqs->nseqs; i++)
+    if (seqs->seqs[i].high == cu_high && seqs->seqs[i].start > seq->start)
+      last = false;
+  if (last)
+    lines->info[lines->nlines - 1].end_sequence = 1;
+  return lines;
+}
+
 /* Get the compilation directory, if any is set.  */
 const char *
 __libdw_getcompdir (Dwarf_Die *cudie)
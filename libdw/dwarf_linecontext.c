@@ -41,5 +41,5 @@ dwarf_linecontext (Dwarf_Lines* lines, Dwarf_Line *line)
   if (line->context == 0 || line->context >= lines->nlines)
     return NULL;
 
-  return lines->info + (line->context - 1);
+  return __libdw_line (lines, line->context - 1);
 }
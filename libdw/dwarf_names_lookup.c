@@ -0,0 +1,1060 @@
+/* Look up names in the DWARF5 .debug_names accelerator table.
+   This file is part of elfutils.
+
+   This file is free software; you can redistribute it and/or modify
+   it under the terms of either
+
+     * the GNU Lesser General Public License as published by the Free
+       Software Foundation; either version 3 of the License, or (at
+       your option) any later version
+
+   or
+
+     * the GNU General Public License as published by the Free
+       Software Foundation; either version 2 of the License, or (at
+       your option) any later version
+
+   or both in parallel, as here.
+
+   elfutils is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received copies of the GNU General Public License and
+   the GNU Lesser General Public License along with this program.  If
+   not, see <http://www.gnu.org/licenses/>.  */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "libdwP.h"
+#include <system.h>
+
+
+/* The hash function used by the name index hash table, see DWARF5
+   section 7.33.  Names are hashed after (ASCII) case folding.  */
+static uint32_t
+names_hash (const char *name)
+{
+  uint32_t hash = 5381;
+  for (const unsigned char *p = (const unsigned char *) name; *p != '\0'; p++)
+    {
+      unsigned char c = *p;
+      if (c >= 'A' && c <= 'Z')
+	c += 'a' - 'A';
+      hash = hash * 33 + c;
+    }
+  return hash;
+}
+
+static int
+abbrev_compare (const void *a, const void *b)
+{
+  const struct Dwarf_Names_Abbrev_s *abbrev_a = a;
+  const struct Dwarf_Names_Abbrev_s *abbrev_b = b;
+  if (abbrev_a->code < abbrev_b->code)
+    return -1;
+  return abbrev_a->code > abbrev_b->code;
+}
+
+/* Read one DW_IDX_* attribute value with the given FORM.  Returns false
+   if the form is unknown or the data is truncated.  */
+static bool
+read_idx_value (Dwarf *dbg, unsigned int form, const unsigned char **readp,
+		const unsigned char *readend, Dwarf_Word *valuep)
+{
+  const unsigned char *p = *readp;
+  switch (form)
+    {
+    case DW_FORM_flag_present:
+      *valuep = 1;
+      break;
+    case DW_FORM_flag:
+    case DW_FORM_data1:
+    case DW_FORM_ref1:
+      if (readend - p < 1)
+	return false;
+      *valuep = *p++;
+      break;
+    case DW_FORM_data2:
+    case DW_FORM_ref2:
+      if (readend - p < 2)
+	return false;
+      *valuep = read_2ubyte_unaligned_inc (dbg, p);
+      break;
+    case DW_FORM_data4:
+    case DW_FORM_ref4:
+      if (readend - p < 4)
+	return false;
+      *valuep = read_4ubyte_unaligned_inc (dbg, p);
+      break;
+    case DW_FORM_data8:
+    case DW_FORM_ref8:
+    case DW_FORM_ref_sig8:
+      if (readend - p < 8)
+	return false;
+      *valuep = read_8ubyte_unaligned_inc (dbg, p);
+      break;
+    case DW_FORM_udata:
+    case DW_FORM_ref_udata:
+      if (p >= readend)
+	return false;
+      get_uleb128 (*valuep, p, readend);
+      break;
+    default:
+      return false;
+    }
+  *readp = p;
+  return true;
+}
+
+/* Decode the abbreviation table of one name index.  */
+static int
+read_abbrevs (Dwarf_Names_Index *index, const unsigned char *readp,
+	      const unsigned char *readend)
+{
+  size_t allocated = 0;
+  index->nabbrevs = 0;
+  index->abbrevs = NULL;
+
+  while (readp < readend)
+    {
+      Dwarf_Word code;
+      get_uleb128 (code, readp, readend);
+      if (code == 0)
+	break;
+
+      if (index->nabbrevs == allocated)
+	{
+	  allocated = MAX (16, 2 * allocated);
+	  struct Dwarf_Names_Abbrev_s *newp
+	    = realloc (index->abbrevs, allocated * sizeof (*newp));
+	  if (newp == NULL)
+	    {
+	      __libdw_seterrno (DWARF_E_NOMEM);
+	      return -1;
+	    }
+	  index->abbrevs = newp;
+	}
+
+      struct Dwarf_Names_Abbrev_s *abbrev = &index->abbrevs[index->nabbrevs++];
+      abbrev->code = code;
+      if (readp >= readend)
+	goto invalid;
+      get_uleb128 (abbrev->tag, readp, readend);
+      abbrev->attrs = readp;
+
+      /* Skip the index/form pairs up to the terminating 0, 0.  */
+      while (1)
+	{
+	  Dwarf_Word idx, form;
+	  if (readp >= readend)
+	    goto invalid;
+	  get_uleb128 (idx, readp, readend);
+	  if (readp >= readend)
+	    goto invalid;
+	  get_uleb128 (form, readp, readend);
+	  if (idx == 0 && form == 0)
+	    break;
+	}
+    }
+
+  if (index->nabbrevs > 1)
+    qsort (index->abbrevs, index->nabbrevs, sizeof (index->abbrevs[0]),
+	   abbrev_compare);
+  return 0;
+
+ invalid:
+  __libdw_seterrno (DWARF_E_INVALID_DWARF);
+  return -1;
+}
+
+/* Decode the header of the name index at *READP, advancing *READP
+   past it.  */
+static int
+read_names_index (Dwarf *dbg, Dwarf_Names_Index *index,
+		  const unsigned char **readp, const unsigned char *dataend)
+{
+  const unsigned char *p = *readp;
+  index->abbrevs = NULL;
+  if (dataend - p < 4)
+    goto invalid;
+  Dwarf_Word unit_length = read_4ubyte_unaligned_inc (dbg, p);
+  index->offset_size = 4;
+  if (unit_length == DWARF3_LENGTH_64_BIT)
+    {
+      if (dataend - p < 8)
+	goto invalid;
+      unit_length = read_8ubyte_unaligned_inc (dbg, p);
+      index->offset_size = 8;
+    }
+  else if (unlikely (unit_length >= DWARF3_LENGTH_MIN_ESCAPE_CODE
+		     && unit_length <= DWARF3_LENGTH_MAX_ESCAPE_CODE))
+    goto invalid;
+
+  if (unit_length > (Dwarf_Word) (dataend - p) || unit_length < 32)
+    goto invalid;
+  const unsigned char *unitend = p + unit_length;
+  *readp = unitend;
+
+  uint16_t version = read_2ubyte_unaligned_inc (dbg, p);
+  if (version != 5)
+    {
+      __libdw_seterrno (DWARF_E_VERSION);
+      return -1;
+    }
+  p += 2; /* Padding.  */
+  index->cu_count = read_4ubyte_unaligned_inc (dbg, p);
+  index->local_tu_count = read_4ubyte_unaligned_inc (dbg, p);
+  index->foreign_tu_count = read_4ubyte_unaligned_inc (dbg, p);
+  index->bucket_count = read_4ubyte_unaligned_inc (dbg, p);
+  index->name_count = read_4ubyte_unaligned_inc (dbg, p);
+  uint32_t abbrev_table_size = read_4ubyte_unaligned_inc (dbg, p);
+  uint32_t augmentation_size = read_4ubyte_unaligned_inc (dbg, p);
+
+  /* Lay out the arrays following the header, checking each against
+     the end of the unit.  Do the arithmetic in 64 bits to avoid
+     overflow of the counts.  */
+  uint64_t offset_size = index->offset_size;
+  uint64_t sizes[] =
+    {
+      augmentation_size,
+      (uint64_t) index->cu_count * offset_size,
+      (uint64_t) index->local_tu_count * offset_size,
+      (uint64_t) index->foreign_tu_count * 8,
+      (uint64_t) index->bucket_count * 4,
+      index->bucket_count > 0 ? (uint64_t) index->name_count * 4 : 0,
+      (uint64_t) index->name_count * offset_size,
+      (uint64_t) index->name_count * offset_size,
+      abbrev_table_size
+    };
+  const unsigned char *starts[sizeof sizes / sizeof sizes[0]];
+  for (size_t i = 0; i < sizeof sizes / sizeof sizes[0]; i++)
+    {
+      if (sizes[i] > (uint64_t) (unitend - p))
+	goto invalid;
+      starts[i] = p;
+      p += sizes[i];
+    }
+
+  index->cu_offsets = starts[1];
+  index->local_tu_offsets = starts[2];
+  index->foreign_tu_sigs = starts[3];
+  index->buckets = starts[4];
+  index->hashes = starts[5];
+  index->str_offsets = starts[6];
+  index->entry_offsets = starts[7];
+  index->entry_pool = p;
+  index->end = unitend;
+
+  return read_abbrevs (index, starts[8], starts[8] + abbrev_table_size);
+
+ invalid:
+  __libdw_seterrno (DWARF_E_INVALID_DWARF);
+  return -1;
+}
+
+/* Read all name indexes of the .debug_names section.  */
+static Dwarf_Names *
+read_debug_names (Dwarf *dbg)
+{
+  Elf_Data *data = dbg->sectiondata[IDX_debug_names];
+  if (data == NULL)
+    {
+      __libdw_seterrno (DWARF_E_NO_ENTRY);
+      return NULL;
+    }
+
+  const unsigned char *readp = data->d_buf;
+  const unsigned char *const dataend = readp + data->d_size;
+  size_t allocated = 1;
+  Dwarf_Names *names = malloc (sizeof (Dwarf_Names)
+			       + allocated * sizeof (Dwarf_Names_Index));
+  if (names == NULL)
+    {
+      __libdw_seterrno (DWARF_E_NOMEM);
+      return NULL;
+    }
+  names->nindexes = 0;
+
+  while (readp < dataend)
+    {
+      if (names->nindexes == allocated)
+	{
+	  allocated *= 2;
+	  Dwarf_Names *newp = realloc (names, (sizeof (Dwarf_Names)
+					       + (allocated
+						  * sizeof (Dwarf_Names_Index))));
+	  if (newp == NULL)
+	    {
+	      __libdw_seterrno (DWARF_E_NOMEM);
+	      goto fail;
+	    }
+	  names = newp;
+	}
+
+      Dwarf_Names_Index *index = &names->index[names->nindexes];
+      if (read_names_index (dbg, index, &readp, dataend) != 0)
+	{
+	  free (index->abbrevs);
+	  goto fail;
+	}
+      names->nindexes++;
+    }
+
+  return names;
+
+ fail:
+  for (size_t i = 0; i < names->nindexes; i++)
+    free (names->index[i].abbrevs);
+  free (names);
+  return NULL;
+}
+
+static Dwarf_Names *
+get_debug_names (Dwarf *dbg)
+{
+  mutex_lock (dbg->names_lock);
+  if (dbg->debug_names == NULL)
+    {
+      dbg->debug_names = read_debug_names (dbg);
+      /* If we failed, make sure we don't try again.  */
+      if (dbg->debug_names == NULL)
+	dbg->debug_names = (void *) -1;
+    }
+  Dwarf_Names *names = dbg->debug_names;
+  mutex_unlock (dbg->names_lock);
+  if (names == (void *) -1)
+    {
+      __libdw_seterrno (DWARF_E_INVALID_DWARF);
+      return NULL;
+    }
+  return names;
+}
+
+static inline Dwarf_Off
+read_index_offset (Dwarf *dbg, const Dwarf_Names_Index *index,
+		   const unsigned char *table, size_t i)
+{
+  if (index->offset_size == 4)
+    return read_4ubyte_unaligned (dbg, table + i * 4);
+  return read_8ubyte_unaligned (dbg, table + i * 8);
+}
+
+/* Find the type unit with signature SIG, scanning units of DBG (which
+   is usually a split Dwarf or DWARF package file) as necessary.  */
+static Dwarf_CU *
+find_type_unit (Dwarf *dbg, uint64_t sig)
+{
+  Dwarf_CU *cu = Dwarf_Sig8_Hash_find (&dbg->sig8_hash, sig);
+  if (cu != NULL)
+    return cu;
+
+  bool scan_debug_types = false;
+  do
+    {
+      mutex_lock (dbg->dwarf_lock);
+      cu = __libdw_intern_next_unit (dbg, scan_debug_types);
+      mutex_unlock (dbg->dwarf_lock);
+
+      if (cu == NULL)
+	{
+	  if (scan_debug_types)
+	    return NULL;
+	  scan_debug_types = true;
+	}
+    }
+  while (cu == NULL || cu->unit_id8 != sig);
+
+  return cu;
+}
+
+/* Resolve the unit an entry refers to.  For a skeleton unit this is
+   the associated split unit.  */
+static Dwarf_CU *
+entry_unit (Dwarf *dbg, const Dwarf_Names_Index *index,
+	    Dwarf_Word cu_idx, Dwarf_Word tu_idx)
+{
+  Dwarf_CU *cu = NULL;
+  if (cu_idx < index->cu_count)
+    {
+      Dwarf_Off off = read_index_offset (dbg, index, index->cu_offsets,
+					 cu_idx);
+      cu = __libdw_findcu (dbg, off, false);
+      if (cu == NULL || cu->start != off)
+	return NULL;
+      if (cu->unit_type == DW_UT_skeleton)
+	cu = __libdw_find_split_unit (cu);
+    }
+
+  if (tu_idx == (Dwarf_Word) -1)
+    return cu;
+
+  if (tu_idx < index->local_tu_count)
+    {
+      Dwarf_Off off = read_index_offset (dbg, index, index->local_tu_offsets,
+					 tu_idx);
+      Dwarf_CU *tu = __libdw_findcu (dbg, off, false);
+      if (tu == NULL || tu->start != off)
+	return NULL;
+      return tu;
+    }
+
+  tu_idx -= index->local_tu_count;
+  if (tu_idx >= index->foreign_tu_count)
+    return NULL;
+
+  /* A foreign type unit lives in a split Dwarf file.  Either the one
+     belonging to the given CU or the DWARF package file.  */
+  uint64_t sig = read_8ubyte_unaligned (dbg,
+					index->foreign_tu_sigs + tu_idx * 8);
+  Dwarf *split_dbg = cu != NULL ? cu->dbg : dbg->dwp_dwarf;
+  if (split_dbg == NULL)
+    return NULL;
+  return find_type_unit (split_dbg, sig);
+}
+
+/* Report all entries in the entry list at READP.  */
+static int
+report_entries (Dwarf *dbg, const Dwarf_Names_Index *index,
+		const unsigned char *readp,
+		int (*callback) (Dwarf_Die *, void *), void *arg)
+{
+  const unsigned char *readend = index->end;
+  while (readp < readend)
+    {
+      Dwarf_Word code;
+      get_uleb128 (code, readp, readend);
+      if (code == 0)
+	return 0;
+
+      struct Dwarf_Names_Abbrev_s fake = { .code = code };
+      struct Dwarf_Names_Abbrev_s *abbrev
+	= bsearch (&fake, index->abbrevs, index->nabbrevs,
+		   sizeof (index->abbrevs[0]), abbrev_compare);
+      if (abbrev == NULL)
+	goto invalid;
+
+      /* If there is only one CU, DW_IDX_compile_unit may be omitted.  */
+      Dwarf_Word cu_idx = index->cu_count == 1 ? 0 : (Dwarf_Word) -1;
+      Dwarf_Word tu_idx = (Dwarf_Word) -1;
+      Dwarf_Word die_offset = (Dwarf_Word) -1;
+      const unsigned char *attrp = abbrev->attrs;
+      while (1)
+	{
+	  Dwarf_Word idx, form;
+	  get_uleb128 (idx, attrp, index->entry_pool);
+	  get_uleb128 (form, attrp, index->entry_pool);
+	  if (idx == 0 && form == 0)
+	    break;
+
+	  Dwarf_Word value;
+	  if (! read_idx_value (dbg, form, &readp, readend, &value))
+	    goto invalid;
+
+	  if (idx == DW_IDX_compile_unit)
+	    cu_idx = value;
+	  else if (idx == DW_IDX_type_unit)
+	    tu_idx = value;
+	  else if (idx == DW_IDX_die_offset)
+	    die_offset = value;
+	}
+
+      Dwarf_CU *cu = entry_unit (dbg, index, cu_idx, tu_idx);
+      if (cu == NULL)
+	/* The unit could not be found, for example because the .dwo
+	   file is missing.  Just skip this entry.  */
+	continue;
+
+      /* Entries for type units without a DIE offset refer to the
+	 type DIE.  */
+      if (die_offset == (Dwarf_Word) -1)
+	{
+	  if (tu_idx == (Dwarf_Word) -1)
+	    continue;
+	  die_offset = cu->subdie_offset;
+	}
+
+      if (die_offset >= (Dwarf_Word) ((const char *) cu->endp
+				      - (const char *) cu->startp))
+	goto invalid;
+
+      Dwarf_Die die =
+	{
+	  .addr = (char *) cu->startp + die_offset,
+	  .cu = cu,
+	};
+      if (callback (&die, arg) != DWARF_CB_OK)
+	return 1;
+    }
+
+ invalid:
+  __libdw_seterrno (DWARF_E_INVALID_DWARF);
+  return -1;
+}
+
+static const char *
+index_name (Dwarf *dbg, const Dwarf_Names_Index *index, uint32_t i)
+{
+  Dwarf_Off off = read_index_offset (dbg, index, index->str_offsets, i);
+  if (dbg->sectiondata[IDX_debug_str] == NULL
+      || off >= dbg->string_section_size[STR_SCN_IDX_debug_str])
+    return NULL;
+  return (const char *) dbg->sectiondata[IDX_debug_str]->d_buf + off;
+}
+
+/* Report all entries for NAME in INDEX.  */
+static int
+lookup_index (Dwarf *dbg, const Dwarf_Names_Index *index,
+	      const char *name, uint32_t hash,
+	      int (*callback) (Dwarf_Die *, void *), void *arg)
+{
+  uint32_t i = 0;
+  uint32_t end = index->name_count;
+
+  if (index->bucket_count > 0)
+    {
+      /* Names in the same bucket are consecutive, starting at the
+	 (1-based) name index stored in the bucket.  */
+      uint32_t bucket = hash % index->bucket_count;
+      i = read_4ubyte_unaligned (dbg, index->buckets + bucket * 4);
+      if (i == 0)
+	return 0;
+      i--;
+    }
+
+  for (; i < end; i++)
+    {
+      if (index->bucket_count > 0)
+	{
+	  uint32_t h = read_4ubyte_unaligned (dbg, index->hashes + i * 4);
+	  if (h % index->bucket_count != hash % index->bucket_count)
+	    break;
+	  if (h != hash)
+	    continue;
+	}
+
+      const char *str = index_name (dbg, index, i);
+      if (str == NULL)
+	{
+	  __libdw_seterrno (DWARF_E_INVALID_DWARF);
+	  return -1;
+	}
+      if (strcmp (str, name) != 0)
+	continue;
+
+      Dwarf_Off entry = read_index_offset (dbg, index,
+					   index->entry_offsets, i);
+      if (entry >= (Dwarf_Off) (index->end - index->entry_pool))
+	{
+	  __libdw_seterrno (DWARF_E_INVALID_DWARF);
+	  return -1;
+	}
+
+      int res = report_entries (dbg, index, index->entry_pool + entry,
+				callback, arg);
+      if (res != 0)
+	return res;
+    }
+
+  return 0;
+}
+
+
+/* Helper for building the name cache.  */
+/* The names, scopes and subprograms found in one unit.  */
+struct name_cache_builder
+{
+  struct Dwarf_Name_Cache_Entry_s *entries;
+  size_t nentries;
+  size_t allocated;
+  struct Dwarf_Name_Cache_Scope_s *scopes;
+  size_t nscopes;
+  size_t scopes_allocated;
+  struct Dwarf_Name_Cache_Func_s *funcs;
+  size_t nfuncs;
+  size_t funcs_allocated;
+  bool funcs_p;
+};
+
+static void
+builder_free (struct name_cache_builder *b)
+{
+  free (b->entries);
+  free (b->scopes);
+  free (b->funcs);
+}
+
+/* The names of all units, collected by the threads of
+   dwarf_units_parallel_foreach.  */
+struct name_cache_state
+{
+  mutex_define (, lock);
+  struct unit_names
+  {
+    Dwarf_CU *cu;
+    struct name_cache_builder names;
+  } *units;
+  size_t nunits;
+  size_t allocated;
+  int error;
+};
+
+static int
+name_cache_compare (const void *a, const void *b)
+{
+  const struct Dwarf_Name_Cache_Entry_s *entry_a = a;
+  const struct Dwarf_Name_Cache_Entry_s *entry_b = b;
+  if (entry_a->hash != entry_b->hash)
+    return entry_a->hash < entry_b->hash ? -1 : 1;
+  /* Keep entries with the same hash in DIE order.  */
+  if (entry_a->order != entry_b->order)
+    return entry_a->order < entry_b->order ? -1 : 1;
+  return 0;
+}
+
+static int
+add_name (struct name_cache_builder *b, const char *name, Dwarf_Die *die)
+{
+  if (name == NULL || name[0] == '\0')
+    return 0;
+
+  if (b->nentries == b->allocated)
+    {
+      b->allocated = MAX (64, 2 * b->allocated);
+      struct Dwarf_Name_Cache_Entry_s *newp
+	= realloc (b->entries, b->allocated * sizeof (newp[0]));
+      if (newp == NULL)
+	{
+	  __libdw_seterrno (DWARF_E_NOMEM);
+	  return -1;
+	}
+      b->entries = newp;
+    }
+
+  struct Dwarf_Name_Cache_Entry_s *entry = &b->entries[b->nentries++];
+  entry->hash = names_hash (name);
+  entry->name = name;
+  entry->cu = die->cu;
+  entry->addr = die->addr;
+  return 0;
+}
+
+static int
+add_scope (struct name_cache_builder *b, Dwarf_Die *die, Dwarf_Die *parent)
+{
+  if (b->nscopes == b->scopes_allocated)
+    {
+      b->scopes_allocated = MAX (64, 2 * b->scopes_allocated);
+      struct Dwarf_Name_Cache_Scope_s *newp
+	= realloc (b->scopes, b->scopes_allocated * sizeof (newp[0]));
+      if (newp == NULL)
+	{
+	  __libdw_seterrno (DWARF_E_NOMEM);
+	  return -1;
+	}
+      b->scopes = newp;
+    }
+
+  b->scopes[b->nscopes++] = (struct Dwarf_Name_Cache_Scope_s)
+    { .addr = die->addr, .parent = parent->addr };
+  return 0;
+}
+
+/* dwarf_getfuncs callback collecting the subprograms of a unit.  */
+static int
+add_func (Dwarf_Die *die, void *arg)
+{
+  struct name_cache_builder *b = arg;
+  if (b->nfuncs == b->funcs_allocated)
+    {
+      b->funcs_allocated = MAX (64, 2 * b->funcs_allocated);
+      struct Dwarf_Name_Cache_Func_s *newp
+	= realloc (b->funcs, b->funcs_allocated * sizeof (newp[0]));
+      if (newp == NULL)
+	{
+	  __libdw_seterrno (DWARF_E_NOMEM);
+	  return DWARF_CB_ABORT;
+	}
+      b->funcs = newp;
+    }
+
+  b->funcs[b->nfuncs++] = (struct Dwarf_Name_Cache_Func_s)
+    { .addr = die->addr, .cu = die->cu };
+  return DWARF_CB_OK;
+}
+
+static const char *
+die_name (Dwarf_Die *die, unsigned int search_name)
+{
+  Dwarf_Attribute attr_mem;
+  return INTUSE(dwarf_formstring) (INTUSE(dwarf_attr_integrate)
+				   (die, search_name, &attr_mem));
+}
+
+/* Add the named DIEs below PARENT to the name cache, roughly
+   following what DWARF5 section 6.1.1.1 says belongs in a name
+   index: types, namespaces, enumerators, (inlined) functions and
+   variables outside of functions.  Declarations are skipped.  */
+static int
+index_children (struct name_cache_builder *b, Dwarf_Die *parent,
+		bool in_func)
+{
+  Dwarf_Die die;
+  int res = INTUSE(dwarf_child) (parent, &die);
+  while (res == 0)
+    {
+      int tag = INTUSE(dwarf_tag) (&die);
+      bool declaration = INTUSE(dwarf_hasattr) (&die, DW_AT_declaration);
+      bool index = false;
+      bool descend = false;
+      switch (tag)
+	{
+	case DW_TAG_subprogram:
+	case DW_TAG_inlined_subroutine:
+	  index = ! declaration;
+	  descend = true;
+	  if (index)
+	    {
+	      const char *linkage = die_name (&die, DW_AT_linkage_name);
+	      if (linkage == NULL)
+		linkage = die_name (&die, DW_AT_MIPS_linkage_name);
+	      if (add_name (b, linkage, &die) != 0)
+		return -1;
+	    }
+	  break;
+
+	case DW_TAG_variable:
+	  index = ! declaration && ! in_func;
+	  break;
+
+	case DW_TAG_namespace:
+	  index = true;
+	  descend = true;
+	  break;
+
+	case DW_TAG_base_type:
+	case DW_TAG_class_type:
+	case DW_TAG_enumeration_type:
+	case DW_TAG_interface_type:
+	case DW_TAG_structure_type:
+	case DW_TAG_typedef:
+	case DW_TAG_union_type:
+	case DW_TAG_unspecified_type:
+	  index = ! declaration;
+	  descend = true;
+	  break;
+
+	case DW_TAG_enumerator:
+	  index = true;
+	  break;
+
+	case DW_TAG_lexical_block:
+	  descend = true;
+	  break;
+
+	default:
+	  break;
+	}
+
+      if (index && add_name (b, die_name (&die, DW_AT_name), &die) != 0)
+	return -1;
+
+      /* Remember the parents of the DIEs dwarf_getscopes may look for
+	 an inlined function in.  */
+      if (descend
+	  && (tag == DW_TAG_subprogram || tag == DW_TAG_lexical_block
+	      || tag == DW_TAG_namespace || tag == DW_TAG_class_type
+	      || tag == DW_TAG_structure_type)
+	  && add_scope (b, &die, parent) != 0)
+	return -1;
+
+      if (descend
+	  && index_children (b, &die,
+			     in_func || tag == DW_TAG_subprogram
+			     || tag == DW_TAG_inlined_subroutine) != 0)
+	return -1;
+
+      res = INTUSE(dwarf_siblingof) (&die, &die);
+    }
+
+  return res < 0 ? -1 : 0;
+}
+
+/* Collect the names of one unit, called from the threads of
+   dwarf_units_parallel_foreach.  */
+static int
+index_unit (Dwarf_CU *cu, void *arg)
+{
+  struct name_cache_state *state = arg;
+
+  if (cu->version < 2 || cu->version > 5
+      || cu->unit_type < DW_UT_compile || cu->unit_type > DW_UT_split_type)
+    return DWARF_CB_OK;
+
+  /* For skeleton units index the split unit instead.  */
+  Dwarf_Die unitdie = CUDIE (cu);
+  if (cu->unit_type == DW_UT_skeleton)
+    {
+      Dwarf_CU *split_cu = __libdw_find_split_unit (cu);
+      if (split_cu == NULL)
+	return DWARF_CB_OK;
+      unitdie = CUDIE (split_cu);
+    }
+
+  struct name_cache_builder b = { .entries = NULL };
+  if (index_children (&b, &unitdie, false) != 0)
+    {
+      builder_free (&b);
+      /* The error number is per thread.  */
+      int error = INTUSE(dwarf_errno) ();
+      mutex_lock (state->lock);
+      state->error = error;
+      mutex_unlock (state->lock);
+      return DWARF_CB_ABORT;
+    }
+
+  /* What dwarf_getfuncs reports for this unit.  If walking it fails,
+     dwarf_getfuncs walks it again itself and reports the error.  */
+  Dwarf_Die cudie = CUDIE (cu);
+  if (INTUSE(dwarf_tag) (&cudie) == DW_TAG_compile_unit)
+    {
+      b.funcs_p = __libdw_getfuncs_walk (&cudie, add_func, &b, 0) == 0;
+      if (! b.funcs_p)
+	{
+	  free (b.funcs);
+	  b.funcs = NULL;
+	  b.nfuncs = 0;
+	}
+    }
+
+  int result = DWARF_CB_OK;
+  mutex_lock (state->lock);
+  if (state->nunits == state->allocated)
+    {
+      size_t allocated = MAX (16, 2 * state->allocated);
+      struct unit_names *newp = realloc (state->units,
+					 allocated * sizeof (newp[0]));
+      if (newp == NULL)
+	{
+	  state->error = DWARF_E_NOMEM;
+	  result = DWARF_CB_ABORT;
+	}
+      else
+	{
+	  state->units = newp;
+	  state->allocated = allocated;
+	}
+    }
+  if (result == DWARF_CB_OK)
+    state->units[state->nunits++] = (struct unit_names) { cu, b };
+  else
+    builder_free (&b);
+  mutex_unlock (state->lock);
+
+  return result;
+}
+
+static int
+unit_names_compare (const void *a, const void *b)
+{
+  const struct unit_names *unit_a = a;
+  const struct unit_names *unit_b = b;
+  if (unit_a->cu->sec_idx != unit_b->cu->sec_idx)
+    return unit_a->cu->sec_idx < unit_b->cu->sec_idx ? -1 : 1;
+  if (unit_a->cu->start != unit_b->cu->start)
+    return unit_a->cu->start < unit_b->cu->start ? -1 : 1;
+  return 0;
+}
+
+static int
+scope_compare (const void *a, const void *b)
+{
+  const struct Dwarf_Name_Cache_Scope_s *scope_a = a;
+  const struct Dwarf_Name_Cache_Scope_s *scope_b = b;
+  if (scope_a->addr != scope_b->addr)
+    return scope_a->addr < scope_b->addr ? -1 : 1;
+  return 0;
+}
+
+/* Build the name cache with one parallel pass over all units.  The
+   names are collected per unit and then put in DIE order, so the
+   result doesn't depend on which thread handled which unit.  */
+static Dwarf_Name_Cache *
+build_name_cache (Dwarf *dbg)
+{
+  struct name_cache_state state = { .units = NULL };
+  mutex_init (state.lock);
+
+  Dwarf_Name_Cache *cache = NULL;
+  int res = INTUSE(dwarf_units_parallel_foreach) (dbg, 0, index_unit,
+						  &state);
+  mutex_fini (state.lock);
+  if (res != 0)
+    {
+      if (state.error != DWARF_E_NOERROR)
+	__libdw_seterrno (state.error);
+      goto out;
+    }
+
+  qsort (state.units, state.nunits, sizeof (state.units[0]),
+	 unit_names_compare);
+
+  size_t nnames = 0, nscopes = 0, nfuncs = 0;
+  for (size_t i = 0; i < state.nunits; i++)
+    {
+      nnames += state.units[i].names.nentries;
+      nscopes += state.units[i].names.nscopes;
+      nfuncs += state.units[i].names.nfuncs;
+    }
+
+  cache = malloc (sizeof (Dwarf_Name_Cache) + nnames * sizeof (cache->info[0]));
+  if (cache == NULL)
+    {
+      __libdw_seterrno (DWARF_E_NOMEM);
+      goto out;
+    }
+  cache->nunits = state.nunits;
+  cache->units = malloc (MAX (state.nunits, 1) * sizeof (cache->units[0]));
+  cache->funcs = malloc (MAX (nfuncs, 1) * sizeof (cache->funcs[0]));
+  cache->nscopes = 0;
+  cache->scopes = malloc (MAX (nscopes, 1) * sizeof (cache->scopes[0]));
+  if (cache->units == NULL || cache->funcs == NULL || cache->scopes == NULL)
+    {
+      free (cache->units);
+      free (cache->funcs);
+      free (cache->scopes);
+      free (cache);
+      cache = NULL;
+      __libdw_seterrno (DWARF_E_NOMEM);
+      goto out;
+    }
+
+  nfuncs = 0;
+  for (size_t i = 0; i < state.nunits; i++)
+    {
+      struct name_cache_builder *b = &state.units[i].names;
+      cache->units[i] = (struct Dwarf_Name_Cache_Unit_s)
+	{
+	  .cu = state.units[i].cu,
+	  .first = nfuncs,
+	  .nfuncs = b->nfuncs,
+	  .funcs_p = b->funcs_p
+	};
+      memcpy (&cache->funcs[nfuncs], b->funcs,
+	      b->nfuncs * sizeof (cache->funcs[0]));
+      nfuncs += b->nfuncs;
+      memcpy (&cache->scopes[cache->nscopes], b->scopes,
+	      b->nscopes * sizeof (cache->scopes[0]));
+      cache->nscopes += b->nscopes;
+    }
+  qsort (cache->scopes, cache->nscopes, sizeof (cache->scopes[0]),
+	 scope_compare);
+
+  cache->nnames = 0;
+  for (size_t i = 0; i < state.nunits; i++)
+    for (size_t j = 0; j < state.units[i].names.nentries; j++)
+      {
+	cache->info[cache->nnames] = state.units[i].names.entries[j];
+	cache->info[cache->nnames].order = cache->nnames;
+	cache->nnames++;
+      }
+  qsort (cache->info, cache->nnames, sizeof (cache->info[0]),
+	 name_cache_compare);
+
+ out:
+  for (size_t i = 0; i < state.nunits; i++)
+    builder_free (&state.units[i].names);
+  free (state.units);
+  return cache;
+}
+
+Dwarf_Name_Cache *
+internal_function
+__libdw_get_name_cache (Dwarf *dbg)
+{
+  mutex_lock (dbg->names_lock);
+  if (dbg->name_cache == NULL)
+    {
+      dbg->name_cache = build_name_cache (dbg);
+      /* If we failed, make sure we don't try again.  */
+      if (dbg->name_cache == NULL)
+	dbg->name_cache = (void *) -1;
+    }
+  Dwarf_Name_Cache *cache = dbg->name_cache;
+  mutex_unlock (dbg->names_lock);
+  if (cache == (void *) -1)
+    {
+      __libdw_seterrno (DWARF_E_INVALID_DWARF);
+      return NULL;
+    }
+  return cache;
+}
+
+/* Report all DIEs for NAME from the name cache.  */
+static int
+lookup_name_cache (Dwarf *dbg, const char *name,
+		   int (*callback) (Dwarf_Die *, void *), void *arg)
+{
+  Dwarf_Name_Cache *cache = __libdw_get_name_cache (dbg);
+  if (cache == NULL)
+    return -1;
+
+  uint32_t hash = names_hash (name);
+  size_t l = 0, u = cache->nnames;
+  while (l < u)
+    {
+      size_t idx = (l + u) / 2;
+      if (cache->info[idx].hash < hash)
+	l = idx + 1;
+      else
+	u = idx;
+    }
+
+  for (size_t i = l; i < cache->nnames && cache->info[i].hash == hash; i++)
+    if (strcmp (cache->info[i].name, name) == 0)
+      {
+	Dwarf_Die die =
+	  {
+	    .addr = cache->info[i].addr,
+	    .cu = cache->info[i].cu,
+	  };
+	if (callback (&die, arg) != DWARF_CB_OK)
+	  return 1;
+      }
+
+  return 0;
+}
+
+
+int
+dwarf_names_lookup (Dwarf *dbg, const char *name,
+		    int (*callback) (Dwarf_Die *, void *), void *arg)
+{
+  if (dbg == NULL)
+    return -1;
+
+  /* Without accelerator tables fall back to an index of our own.  */
+  if (dbg->sectiondata[IDX_debug_names] == NULL)
+    return lookup_name_cache (dbg, name, callback, arg);
+
+  Dwarf_Names *names = get_debug_names (dbg);
+  if (names == NULL)
+    return -1;
+
+  uint32_t hash = names_hash (name);
+  for (size_t i = 0; i < names->nindexes; i++)
+    {
+      int res = lookup_index (dbg, &names->index[i], name, hash,
+			      callback, arg);
+      if (res != 0)
+	return res;
+    }
+
+  return 0;
+}
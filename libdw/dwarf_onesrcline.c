@@ -46,5 +46,5 @@ dwarf_onesrcline (Dwarf_Lines *lines, size_t idx)
       return NULL;
     }
 
-  return &lines->info[idx];
+  return __libdw_line (lines, idx);
 }
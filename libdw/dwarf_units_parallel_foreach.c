@@ -0,0 +1,232 @@
+/* Call a function for each unit, using several threads.
+   This file is part of elfutils.
+
+   This file is free software; you can redistribute it and/or modify
+   it under the terms of either
+
+     * the GNU Lesser General Public License as published by the Free
+       Software Foundation; either version 3 of the License, or (at
+       your option) any later version
+
+   or
+
+     * the GNU General Public License as published by the Free
+       Software Foundation; either version 2 of the License, or (at
+       your option) any later version
+
+   or both in parallel, as here.
+
+   elfutils is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received copies of the GNU General Public License and
+   the GNU Lesser General Public License along with this program.  If
+   not, see <http://www.gnu.org/licenses/>.  */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "libdwP.h"
+
+
+/* The units still to be handled by one worker thread, [next, end)
+   indexes into the units array.  Other threads that run out of work
+   steal the upper half.  */
+struct unit_range
+{
+  mutex_define (, lock);
+  size_t next;
+  size_t end;
+};
+
+struct foreach_state
+{
+  Dwarf_CU **units;
+  struct unit_range *ranges;
+  unsigned int nranges;
+  int (*callback) (Dwarf_CU *, void *);
+  void *arg;
+  atomic_bool aborted;
+};
+
+struct worker
+{
+  struct foreach_state *state;
+  unsigned int id;
+};
+
+/* Return the next unit for worker ID, or NULL if there is no work
+   left anywhere.  */
+static Dwarf_CU *
+next_unit (struct foreach_state *state, unsigned int id)
+{
+  struct unit_range *own = &state->ranges[id];
+  mutex_lock (own->lock);
+  if (own->next < own->end)
+    {
+      Dwarf_CU *cu = state->units[own->next++];
+      mutex_unlock (own->lock);
+      return cu;
+    }
+  mutex_unlock (own->lock);
+
+  for (unsigned int i = 1; i < state->nranges; i++)
+    {
+      struct unit_range *victim = &state->ranges[(id + i) % state->nranges];
+      mutex_lock (victim->lock);
+      size_t left = victim->end - victim->next;
+      if (left == 0)
+	{
+	  mutex_unlock (victim->lock);
+	  continue;
+	}
+
+      size_t begin = victim->end - (left + 1) / 2;
+      size_t end = victim->end;
+      victim->end = begin;
+      mutex_unlock (victim->lock);
+
+      mutex_lock (own->lock);
+      own->next = begin + 1;
+      own->end = end;
+      mutex_unlock (own->lock);
+      return state->units[begin];
+    }
+
+  return NULL;
+}
+
+static void *
+work (void *arg)
+{
+  struct worker *w = arg;
+  struct foreach_state *state = w->state;
+
+  Dwarf_CU *cu;
+  while (! atomic_load (&state->aborted)
+	 && (cu = next_unit (state, w->id)) != NULL)
+    if (state->callback (cu, state->arg) != DWARF_CB_OK)
+      atomic_store (&state->aborted, true);
+
+  return NULL;
+}
+
+int
+dwarf_units_parallel_foreach (Dwarf *dbg, unsigned int nthreads,
+			      int (*callback) (Dwarf_CU *, void *),
+			      void *arg)
+{
+  if (dbg == NULL)
+    return -1;
+
+  if (dbg->sectiondata[IDX_debug_info] == NULL)
+    return 0;
+
+  /* Reading the unit headers has to be done in order, but is cheap.
+     Do it upfront so the workers only have to pick units.  */
+  Dwarf_CU **units = NULL;
+  size_t nunits = 0;
+  size_t allocated = 0;
+  Dwarf_CU *cu = NULL;
+  int res;
+  while ((res = INTUSE(dwarf_get_units) (dbg, cu, &cu, NULL, NULL,
+					  NULL, NULL)) == 0)
+    {
+      if (nunits == allocated)
+	{
+	  allocated = MAX (16, 2 * allocated);
+	  Dwarf_CU **newp = realloc (units, allocated * sizeof (Dwarf_CU *));
+	  if (newp == NULL)
+	    {
+	      free (units);
+	      __libdw_seterrno (DWARF_E_NOMEM);
+	      return -1;
+	    }
+	  units = newp;
+	}
+      units[nunits++] = cu;
+    }
+  if (res < 0)
+    {
+      free (units);
+      return -1;
+    }
+
+#ifdef USE_LOCKS
+  if (nthreads == 0)
+    {
+      long ncpus = sysconf (_SC_NPROCESSORS_ONLN);
+      nthreads = ncpus > 0 ? ncpus : 1;
+    }
+#else
+  /* Without locks libdw cannot be used from multiple threads.  */
+  nthreads = 1;
+#endif
+  if (nthreads > nunits)
+    nthreads = MAX (nunits, 1);
+
+  struct foreach_state state =
+    {
+      .units = units,
+      .nranges = nthreads,
+      .callback = callback,
+      .arg = arg,
+    };
+  atomic_init (&state.aborted, false);
+
+  struct unit_range *ranges = malloc (nthreads * sizeof *ranges);
+  struct worker *workers = malloc (nthreads * sizeof *workers);
+  pthread_t *threads = malloc (nthreads * sizeof *threads);
+  if (ranges == NULL || workers == NULL || threads == NULL)
+    {
+      free (threads);
+      free (workers);
+      free (ranges);
+      free (units);
+      __libdw_seterrno (DWARF_E_NOMEM);
+      return -1;
+    }
+  state.ranges = ranges;
+
+  /* Give every worker an equal share to start with.  */
+  for (unsigned int i = 0; i < nthreads; i++)
+    {
+      mutex_init (ranges[i].lock);
+      ranges[i].next = nunits * i / nthreads;
+      ranges[i].end = nunits * (i + 1) / nthreads;
+      workers[i].state = &state;
+      workers[i].id = i;
+    }
+
+  /* The calling thread is worker zero.  If some threads cannot be
+     created the others will steal their share.  */
+  unsigned int started = 0;
+  for (unsigned int i = 1; i < nthreads; i++)
+    if (pthread_create (&threads[started], NULL, work, &workers[i]) == 0)
+      started++;
+
+  work (&workers[0]);
+
+  for (unsigned int i = 0; i < started; i++)
+    pthread_join (threads[i], NULL);
+
+  for (unsigned int i = 0; i < nthreads; i++)
+    mutex_fini (ranges[i].lock);
+
+  free (threads);
+  free (workers);
+  free (ranges);
+  free (units);
+
+  return atomic_load (&state.aborted) ? 1 : 0;
+}
+INTDEF(dwarf_units_parallel_foreach)
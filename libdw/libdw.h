@@ -265,6 +265,13 @@ extern Dwarf *dwarf_getalt (Dwarf *main);
    alt file itself on first use.  */
 extern void dwarf_setalt (Dwarf *main, Dwarf *alt);
 
+/* If COMPACT is true, line tables of DWARF read from now on are stored
+   in a compact encoding, instead of as an array of all rows.  Rows are
+   only expanded, in small blocks, when they are accessed.  That uses
+   much less memory when only some rows are looked up, for example with
+   dwarf_getsrc_die, but a bit more when all rows are used.  */
+extern void dwarf_set_compact_lines (Dwarf *dwarf, bool compact);
+
 /* Release debugging handling context.  */
 extern int dwarf_end (Dwarf *dwarf);
 
@@ -313,6 +320,20 @@ extern int dwarf_cu_info (Dwarf_CU *cu,
 			  uint64_t *unit_id,
 			  uint8_t *address_size, uint8_t *offset_size);
 
+/* Call CALLBACK for every unit of DBG, like iterating with
+   dwarf_get_units, but spread over NTHREADS threads (zero means one
+   per online CPU).  CALLBACK is called concurrently for different
+   units and in no particular order.  If CALLBACK returns
+   DWARF_CB_ABORT no more units are started.  Returns 0 if all units
+   have been handled, 1 if CALLBACK aborted and -1 on error.  When
+   libdw is built without thread safety all units are handled in the
+   calling thread.  */
+extern int dwarf_units_parallel_foreach (Dwarf *dbg, unsigned int nthreads,
+					 int (*callback) (Dwarf_CU *cu,
+							  void *arg),
+					 void *arg)
+     __nonnull_attribute__ (3);
+
 /* Decode one DWARF CFI entry (CIE or FDE) from the raw section data.
    The E_IDENT from the originating ELF file indicates the address
    size and byte order used in the CFI section contained in DATA;
@@ -638,6 +659,18 @@ extern ptrdiff_t dwarf_getpubnames (Dwarf *dbg,
 				    void *arg, ptrdiff_t offset)
      __nonnull_attribute__ (2);
 
+/* Look up NAME in the DWARF5 .debug_names accelerator table and call
+   CALLBACK for every DIE indexed under that name.  DIEs that live in
+   split units (.dwo or .dwp files) are resolved through their skeleton
+   unit.  Returns 0 if all matching DIEs have been reported, 1 if
+   CALLBACK returned DWARF_CB_ABORT and -1 on error.  If DBG has no
+   .debug_names section an index of the names of all units is built
+   from the DIEs on first use and kept until dwarf_end.  */
+extern int dwarf_names_lookup (Dwarf *dbg, const char *name,
+			       int (*callback) (Dwarf_Die *, void *),
+			       void *arg)
+     __nonnull_attribute__ (2, 3);
+
 
 /* Get source file information for CU.  */
 extern int dwarf_getsrclines (Dwarf_Die *cudie, Dwarf_Lines **lines,
@@ -655,6 +688,15 @@ extern int dwarf_getsrcfiles (Dwarf_Die *cudie, Dwarf_Files **files,
 /* Get source for address in CU.  */
 extern Dwarf_Line *dwarf_getsrc_die (Dwarf_Die *cudie, Dwarf_Addr addr);
 
+/* Get source for address in CU like dwarf_getsrc_die, but without
+   decoding the whole line table of the CU.  Only the boundaries of its
+   sequences are read, and then just the sequence covering ADDR is
+   decoded.  The result stays valid until dwarf_end, but is not one
+   of the lines returned by dwarf_getsrclines.  If the line table was
+   already decoded completely, or cannot be decoded per sequence, this
+   is the same as dwarf_getsrc_die.  */
+extern Dwarf_Line *dwarf_getsrc_lazy (Dwarf_Die *cudie, Dwarf_Addr addr);
+
 /* Get source for file and line number.  */
 extern int dwarf_getsrc_file (Dwarf *dbg, const char *fname, int line, int col,
 			      Dwarf_Line ***srcsp, size_t *nsrcs)
@@ -855,7 +897,9 @@ extern int dwarf_language_lower_bound (Dwarf_Word lname, Dwarf_Sword *result)
    and returns the number of elements in the array.
    (*SCOPES)[0] is the DIE for the innermost scope containing PC,
    (*SCOPES)[1] is the DIE for the scope containing that scope, and so on.
-   Returns -1 for errors or 0 if no scopes match PC.  */
+   Returns -1 for errors or 0 if no scopes match PC.  The scopes of the
+   abstract definition of an inlined function are found with the index
+   dwarf_names_lookup builds.  */
 extern int dwarf_getscopes (Dwarf_Die *cudie, Dwarf_Addr pc,
 			    Dwarf_Die **scopes);
 
@@ -912,7 +956,9 @@ extern Dwarf_Arange *dwarf_getarange_addr (Dwarf_Aranges *aranges,
    dwarf_getfuncs will not return but keep calling the callback for each
    function DIE it finds.  Pass zero for offset on the first call to walk
    the full CU DIE tree.  If no more functions can be found and the callback
-   returned DWARF_CB_OK then the function returns zero.  */
+   returned DWARF_CB_OK then the function returns zero.  The first call
+   walks all units of the Dwarf at once, as dwarf_names_lookup does, and
+   later calls use the functions found then.  */
 extern ptrdiff_t dwarf_getfuncs (Dwarf_Die *cudie,
 				 int (*callback) (Dwarf_Die *, void *),
 				 void *arg, ptrdiff_t offset);
@@ -30,6 +30,7 @@
 #define _LIBDWP_H 1
 
 #include <stdbool.h>
+#include <stdatomic.h>
 #include <pthread.h>
 
 #include <libdw.h>
@@ -77,6 +78,7 @@ enum
     IDX_debug_loc,
     IDX_debug_loclists,
     IDX_debug_pubnames,
+    IDX_debug_names,
     IDX_debug_str,
     IDX_debug_str_offsets,
     IDX_debug_macinfo,
@@ -164,6 +166,24 @@ enum dwarf_type
     TYPE_PLAIN = 64,
   };
 
+/* Units in offset order, as read by __libdw_intern_next_unit.  */
+struct Dwarf_CU_Array
+{
+  struct Dwarf_CU_Array *retired; /* Previous smaller array.  */
+  size_t allocated;
+  struct Dwarf_CU *units[];
+};
+
+/* The units are only appended, under the dwarf_lock.  Readers load
+   NUNITS and then ARRAY without a lock and binary search it.  A full
+   array is replaced by a bigger copy, the old one is kept until
+   dwarf_end since readers might still use it.  */
+typedef struct
+{
+  struct Dwarf_CU_Array *_Atomic array;
+  atomic_size_t nunits;
+} Dwarf_CU_Vector;
+
 /* This is the structure representing the debugging state.  */
 struct Dwarf
 {
@@ -197,6 +217,9 @@ struct Dwarf
   /* If true, we allocated the ELF descriptor ourselves.  */
   bool free_elf;
 
+  /* If true, line tables are stored compactly, see dwarf_set_compact_lines.  */
+  bool compact_lines;
+
   /* If >= 0, we allocated the alt_dwarf ourselves and must end it and
      close this file descriptor.  */
   int alt_fd;
@@ -215,12 +238,25 @@ struct Dwarf
   } *pubnames_sets;
   size_t pubnames_nsets;
 
-  /* Search tree for the CUs.  */
+  /* Decoded .debug_names name indexes.  Read lazily by
+     dwarf_names_lookup, NULL if not yet read, (void *) -1 if they
+     couldn't be read.  */
+  struct Dwarf_Names_s *debug_names;
+
+  /* Search tree for the CUs, owning them.  Lookups go to cu_vector
+     first.  */
   search_tree cu_tree;
+  Dwarf_CU_Vector cu_vector;
   Dwarf_Off next_cu_offset;
 
+  /* Name index built from the DIEs of all units by dwarf_names_lookup
+     when there is no .debug_names section, and by dwarf_getfuncs and
+     dwarf_getscopes.  NULL if not yet built.  */
+  struct Dwarf_Name_Cache_s *name_cache;
+
   /* Search tree and sig8 hash table for .debug_types type units.  */
   search_tree tu_tree;
+  Dwarf_CU_Vector tu_vector;
   Dwarf_Off next_tu_offset;
   Dwarf_Sig8_Hash sig8_hash;
 
@@ -272,6 +308,12 @@ struct Dwarf
   /* Synchronize access to dwarf_macro_getsrcfiles.  */
   mutex_define(, macro_lock);
 
+  /* Synchronize reading the debug_names and name_cache members.  */
+  mutex_define(, names_lock);
+
+  /* Synchronize updating the files_lines_tree nodes.  */
+  mutex_define(, files_lines_lock);
+
   /* Internal memory handling.  This is basically a simplified thread-local
      reimplementation of obstacks.  Unfortunately the standard obstack
      implementation is not usable in libraries.  */
@@ -350,9 +392,56 @@ struct Dwarf_Line_s
 struct Dwarf_Lines_s
 {
   size_t nlines;
+  struct Dwarf_Lines_Compact_s *compact; /* If not NULL, info is empty.  */
   struct Dwarf_Line_s info[0];
 };
 
+/* Rows of a compact line table are stored in blocks of this many.  */
+#define LINE_BLOCK_ROWS 32
+
+/* A block of rows of a compact line table.  The rows are encoded in
+   the bytes of the table, each one as the difference to the one
+   before, starting from the address of the block.  */
+struct Dwarf_Line_Block
+{
+  Dwarf_Addr addr;		/* Of the first row.  */
+  size_t offset;		/* Of the first row in bytes.  */
+  Dwarf_Line *_Atomic rows;	/* Decoded rows, NULL if not yet.  */
+};
+
+typedef struct Dwarf_Lines_Compact_s
+{
+  Dwarf *dbg;
+  Dwarf_Files *files;
+  const unsigned char *bytes;
+  size_t nblocks;
+  struct Dwarf_Line_Block blocks[0];
+} Dwarf_Lines_Compact;
+
+/* Where the sequences of a line program are, so dwarf_getsrc_lazy
+   can decode just the one it needs.  */
+struct Dwarf_Line_Sequence_s
+{
+  Dwarf_Addr low;		/* Lowest row address.  */
+  Dwarf_Addr high;		/* Highest, normally the end_sequence.  */
+  Dwarf_Addr max_high;		/* Highest of this and previous ones.  */
+  bool open_end;		/* A normal row sorts after the end.  */
+  const unsigned char *start;	/* The opcodes of the sequence.  */
+  const unsigned char *end;
+  Dwarf_Lines *lines;		/* Decoded rows, NULL if not yet.  */
+};
+
+typedef struct Dwarf_Line_Sequences_s
+{
+  const unsigned char *linep;	/* The .debug_line unit.  */
+  const unsigned char *lineendp;
+  const char *comp_dir;
+  unsigned int address_size;
+  Dwarf_Files *files;
+  size_t nseqs;
+  struct Dwarf_Line_Sequence_s seqs[0]; /* Sorted by low.  */
+} Dwarf_Line_Sequences;
+
 /* Representation of address ranges.  */
 struct Dwarf_Aranges_s
 {
@@ -388,6 +477,86 @@ typedef struct Dwarf_Package_Index_s
   Dwarf_Off *debug_info_offsets;
 } Dwarf_Package_Index;
 
+/* One name index of the DWARF5 .debug_names section.  A linked
+   object usually has one per CU, concatenated by the linker.  */
+typedef struct Dwarf_Names_Index_s
+{
+  uint8_t offset_size;
+  uint32_t cu_count;
+  uint32_t local_tu_count;
+  uint32_t foreign_tu_count;
+  uint32_t bucket_count;
+  uint32_t name_count;
+  const unsigned char *cu_offsets;
+  const unsigned char *local_tu_offsets;
+  const unsigned char *foreign_tu_sigs;
+  const unsigned char *buckets;
+  const unsigned char *hashes;
+  const unsigned char *str_offsets;
+  const unsigned char *entry_offsets;
+  const unsigned char *entry_pool;
+  const unsigned char *end;
+  /* Decoded abbreviations, sorted by code.  */
+  size_t nabbrevs;
+  struct Dwarf_Names_Abbrev_s
+  {
+    Dwarf_Word code;
+    unsigned int tag;
+    /* Start of the DW_IDX_* index/form pairs.  */
+    const unsigned char *attrs;
+  } *abbrevs;
+} Dwarf_Names_Index;
+
+/* All name indexes of the .debug_names section.  */
+typedef struct Dwarf_Names_s
+{
+  size_t nindexes;
+  Dwarf_Names_Index index[0];
+} Dwarf_Names;
+
+/* Name index built from the DIEs themselves, sorted by hash.  The
+   same pass also records what dwarf_getfuncs and dwarf_getscopes
+   would otherwise find by walking the DIEs on every call.  */
+typedef struct Dwarf_Name_Cache_s
+{
+  /* The units, sorted by section and offset, with their defining
+     subprograms in dwarf_getfuncs order in FUNCS.  Those of imported
+     units belong to other CUs.  */
+  size_t nunits;
+  struct Dwarf_Name_Cache_Unit_s
+  {
+    struct Dwarf_CU *cu;
+    size_t first;
+    size_t nfuncs;
+    bool funcs_p;		/* False if walking the unit failed.  */
+  } *units;
+  struct Dwarf_Name_Cache_Func_s
+  {
+    void *addr;
+    struct Dwarf_CU *cu;
+  } *funcs;
+
+  /* The parent of each subprogram, lexical block, namespace, class and
+     structure DIE the index went through, sorted by address.  */
+  size_t nscopes;
+  struct Dwarf_Name_Cache_Scope_s
+  {
+    void *addr;
+    void *parent;
+  } *scopes;
+
+  size_t nnames;
+  struct Dwarf_Name_Cache_Entry_s
+  {
+    uint32_t hash;
+    /* Position in DIE order, to keep the sort stable.  */
+    uint32_t order;
+    const char *name;
+    struct Dwarf_CU *cu;
+    void *addr;
+  } info[0];
+} Dwarf_Name_Cache;
+
 /* CU representation.  */
 struct Dwarf_CU
 {
@@ -431,6 +600,10 @@ struct Dwarf_CU
   /* The source file information.  */
   Dwarf_Files *files;
 
+  /* The sequences of the line table for dwarf_getsrc_lazy.  NULL if
+     not yet read, -1 if the table cannot be read per sequence.  */
+  Dwarf_Line_Sequences *sequences;
+
   /* Known location lists.  */
   search_tree locs_tree;
 
@@ -504,6 +677,7 @@ INTDECL (dwarf_getaranges)
 INTDECL (dwarf_getlocation_die)
 INTDECL (dwarf_getsrcfiles)
 INTDECL (dwarf_getsrclines)
+INTDECL (dwarf_getsrc_die)
 INTDECL (dwarf_get_units)
 INTDECL (dwarf_hasattr)
 INTDECL (dwarf_haschildren)
@@ -521,6 +695,7 @@ INTDECL (dwarf_setalt)
 INTDECL (dwarf_siblingof)
 INTDECL (dwarf_srclang)
 INTDECL (dwarf_tag)
+INTDECL (dwarf_units_parallel_foreach)
 
 #define ISV4TU(cu) ((cu)->version == 4 && (cu)->sec_idx == IDX_debug_types)
 
@@ -949,6 +1124,18 @@ extern int __libdw_visit_scopes (unsigned int depth,
 				 void *arg)
   __nonnull_attribute__ (2, 4) internal_function;
 
+/* Call CALLBACK for the defining subprograms of CUDIE, walking its
+   DIEs.  Like dwarf_getfuncs, but never uses the name cache.  */
+extern ptrdiff_t __libdw_getfuncs_walk (Dwarf_Die *cudie,
+					int (*callback) (Dwarf_Die *, void *),
+					void *arg, ptrdiff_t offset)
+  __nonnull_attribute__ (1, 2) internal_function;
+
+/* Return the name cache of DBG, building it on first use, or NULL on
+   error.  */
+extern Dwarf_Name_Cache *__libdw_get_name_cache (Dwarf *dbg)
+  __nonnull_attribute__ (1) internal_function;
+
 /* Parse a DWARF Dwarf_Block into an array of Dwarf_Op's,
    and cache the result (via tsearch).  */
 extern int __libdw_intern_expression (Dwarf *dbg,
@@ -1162,6 +1349,43 @@ int __libdw_getsrcfiles (Dwarf *dbg, Dwarf_Off debug_line_offset,
   internal_function
   __nonnull_attribute__ (1);
 
+/* Read where the sequences of the line table of CUDIE are, without
+   decoding any rows.  Returns NULL if the table cannot be read or
+   cannot be decoded per sequence.  */
+Dwarf_Line_Sequences *__libdw_getsrcsequences (Dwarf_Die *cudie)
+  internal_function;
+
+/* Decode the rows of one sequence SEQ of SEQS.  */
+Dwarf_Lines *__libdw_getsrcsequence_lines (Dwarf *dbg,
+					   Dwarf_Line_Sequences *seqs,
+					   struct Dwarf_Line_Sequence_s *seq)
+  internal_function;
+
+/* Encode the NROWS sorted ROWS, which all use FILES, as a compact line
+   table.  */
+Dwarf_Lines *__libdw_compact_lines (Dwarf *dbg, Dwarf_Line *const *rows,
+				    size_t nrows, Dwarf_Files *files)
+  internal_function;
+
+/* Return the decoded rows of block BLOCK of the compact table LINES.  */
+Dwarf_Line *__libdw_compact_lines_block (Dwarf_Lines *lines, size_t block)
+  internal_function;
+
+/* Row IDX of LINES, which must be less than nlines.  */
+static inline Dwarf_Line *
+__libdw_line (Dwarf_Lines *lines, size_t idx)
+{
+  if (likely (lines->compact == NULL))
+    return &lines->info[idx];
+  return &__libdw_compact_lines_block (lines, idx / LINE_BLOCK_ROWS)
+    [idx % LINE_BLOCK_ROWS];
+}
+
+/* Index of the last row of LINES at or before ADDR, or 0 if there is
+   none.  LINES must not be empty.  */
+size_t __libdw_lines_find (Dwarf_Lines *lines, Dwarf_Addr addr)
+  internal_function;
+
 /* Load and return value of DW_AT_comp_dir from CUDIE.  */
 const char *__libdw_getcompdir (Dwarf_Die *cudie);
 
@@ -0,0 +1,314 @@
+/* Compact encoding of line tables.
+   This file is part of elfutils.
+
+   This file is free software; you can redistribute it and/or modify
+   it under the terms of either
+
+     * the GNU Lesser General Public License as published by the Free
+       Software Foundation; either version 3 of the License, or (at
+       your option) any later version
+
+   or
+
+     * the GNU General Public License as published by the Free
+       Software Foundation; either version 2 of the License, or (at
+       your option) any later version
+
+   or both in parallel, as here.
+
+   elfutils is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received copies of the GNU General Public License and
+   the GNU Lesser General Public License along with this program.  If
+   not, see <http://www.gnu.org/licenses/>.  */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include "libdwP.h"
+#include <assert.h>
+
+/* Every row starts with a byte of flags, then follow the address as
+   ULEB128 difference to the row before, the line as SLEB128 difference
+   and the column.  The file, op_index, isa, discriminator, context and
+   function_name are only there if the flags say so.  The first row of
+   a block is encoded as difference to an empty row at the address of
+   the block, and always has the file.
+
+   Blocks are decoded into normal Dwarf_Line arrays when one of their
+   rows is used, so the rows can be returned as Dwarf_Line pointers
+   which stay valid until dwarf_end.  */
+
+#define ROW_IS_STMT		0x01
+#define ROW_BASIC_BLOCK		0x02
+#define ROW_END_SEQUENCE	0x04
+#define ROW_PROLOGUE_END	0x08
+#define ROW_EPILOGUE_BEGIN	0x10
+#define ROW_HAS_FILE		0x20
+#define ROW_HAS_EXTRA		0x40	/* op_index, isa, discriminator.  */
+#define ROW_HAS_CONTEXT		0x80	/* context, function_name.  */
+
+/* Write VALUE to P, unless P is NULL.  Returns the number of bytes.  */
+static size_t
+put_uleb128 (unsigned char *p, uint64_t value)
+{
+  size_t n = 0;
+  do
+    {
+      unsigned char byte = value & 0x7f;
+      value >>= 7;
+      if (value != 0)
+	byte |= 0x80;
+      if (p != NULL)
+	p[n] = byte;
+      n++;
+    }
+  while (value != 0);
+  return n;
+}
+
+static size_t
+put_sleb128 (unsigned char *p, int64_t value)
+{
+  size_t n = 0;
+  bool more;
+  do
+    {
+      unsigned char byte = value & 0x7f;
+      value >>= 7;
+      more = ! ((value == 0 && (byte & 0x40) == 0)
+		|| (value == -1 && (byte & 0x40) != 0));
+      if (more)
+	byte |= 0x80;
+      if (p != NULL)
+	p[n] = byte;
+      n++;
+    }
+  while (more);
+  return n;
+}
+
+/* Encode ROW after PREV to P, or just count the bytes if P is NULL.  */
+static size_t
+encode_row (unsigned char *p, const Dwarf_Line *row, const Dwarf_Line *prev,
+	    bool first)
+{
+  unsigned char flags = ((row->is_stmt ? ROW_IS_STMT : 0)
+			 | (row->basic_block ? ROW_BASIC_BLOCK : 0)
+			 | (row->end_sequence ? ROW_END_SEQUENCE : 0)
+			 | (row->prologue_end ? ROW_PROLOGUE_END : 0)
+			 | (row->epilogue_begin ? ROW_EPILOGUE_BEGIN : 0));
+  if (first || row->file != prev->file)
+    flags |= ROW_HAS_FILE;
+  if (row->op_index != 0 || row->isa != 0 || row->discriminator != 0)
+    flags |= ROW_HAS_EXTRA;
+  if (row->context != 0 || row->function_name != 0)
+    flags |= ROW_HAS_CONTEXT;
+
+#define NEXT (p == NULL ? NULL : p + n)
+  size_t n = 0;
+  if (p != NULL)
+    *p = flags;
+  n++;
+  n += put_uleb128 (NEXT, row->addr - prev->addr);
+  n += put_sleb128 (NEXT, (int64_t) row->line - prev->line);
+  n += put_uleb128 (NEXT, row->column);
+  if ((flags & ROW_HAS_FILE) != 0)
+    n += put_uleb128 (NEXT, row->file);
+  if ((flags & ROW_HAS_EXTRA) != 0)
+    {
+      n += put_uleb128 (NEXT, row->op_index);
+      n += put_uleb128 (NEXT, row->isa);
+      n += put_uleb128 (NEXT, row->discriminator);
+    }
+  if ((flags & ROW_HAS_CONTEXT) != 0)
+    {
+      n += put_uleb128 (NEXT, row->context);
+      n += put_uleb128 (NEXT, row->function_name);
+    }
+#undef NEXT
+  return n;
+}
+
+/* Encode the rows of one block, or count the bytes if P is NULL.  */
+static size_t
+encode_block (unsigned char *p, Dwarf_Line *const *rows, size_t nrows)
+{
+  Dwarf_Line start = { .addr = rows[0]->addr };
+  const Dwarf_Line *prev = &start;
+  size_t n = 0;
+  for (size_t i = 0; i < nrows; i++)
+    {
+      n += encode_row (p == NULL ? NULL : p + n, rows[i], prev, i == 0);
+      prev = rows[i];
+    }
+  return n;
+}
+
+Dwarf_Lines *
+internal_function
+__libdw_compact_lines (Dwarf *dbg, Dwarf_Line *const *rows, size_t nrows,
+		       Dwarf_Files *files)
+{
+  size_t nblocks = (nrows + LINE_BLOCK_ROWS - 1) / LINE_BLOCK_ROWS;
+  size_t nbytes = 0;
+  for (size_t b = 0; b < nblocks; b++)
+    {
+      size_t first = b * LINE_BLOCK_ROWS;
+      nbytes += encode_block (NULL, &rows[first],
+			      MIN (nrows - first, LINE_BLOCK_ROWS));
+    }
+
+  Dwarf_Lines *lines = libdw_typed_alloc (dbg, Dwarf_Lines);
+  Dwarf_Lines_Compact *compact
+    = libdw_alloc (dbg, Dwarf_Lines_Compact,
+		   (sizeof (Dwarf_Lines_Compact)
+		    + nblocks * sizeof (struct Dwarf_Line_Block)), 1);
+  unsigned char *bytes = libdw_alloc (dbg, unsigned char, 1, nbytes);
+
+  lines->nlines = nrows;
+  lines->compact = compact;
+  compact->dbg = dbg;
+  compact->files = files;
+  compact->bytes = bytes;
+  compact->nblocks = nblocks;
+
+  size_t offset = 0;
+  for (size_t b = 0; b < nblocks; b++)
+    {
+      size_t first = b * LINE_BLOCK_ROWS;
+      compact->blocks[b].addr = rows[first]->addr;
+      compact->blocks[b].offset = offset;
+      atomic_init (&compact->blocks[b].rows, NULL);
+      offset += encode_block (bytes + offset, &rows[first],
+			      MIN (nrows - first, LINE_BLOCK_ROWS));
+    }
+  assert (offset == nbytes);
+
+  return lines;
+}
+
+Dwarf_Line *
+internal_function
+__libdw_compact_lines_block (Dwarf_Lines *lines, size_t block)
+{
+  Dwarf_Lines_Compact *compact = lines->compact;
+  struct Dwarf_Line_Block *b = &compact->blocks[block];
+  Dwarf_Line *rows = atomic_load_explicit (&b->rows, memory_order_acquire);
+  if (rows != NULL)
+    return rows;
+
+  size_t first = block * LINE_BLOCK_ROWS;
+  size_t nrows = MIN (lines->nlines - first, LINE_BLOCK_ROWS);
+  rows = libdw_alloc (compact->dbg, Dwarf_Line, sizeof (Dwarf_Line), nrows);
+
+  const unsigned char *p = compact->bytes + b->offset;
+  Dwarf_Line prev = { .addr = b->addr };
+  for (size_t i = 0; i < nrows; i++)
+    {
+      Dwarf_Line *row = &rows[i];
+      unsigned char flags = *p++;
+      uint64_t value;
+      int64_t svalue;
+
+      memset (row, 0, sizeof *row);
+      row->files = compact->files;
+      row->is_stmt = (flags & ROW_IS_STMT) != 0;
+      row->basic_block = (flags & ROW_BASIC_BLOCK) != 0;
+      row->end_sequence = (flags & ROW_END_SEQUENCE) != 0;
+      row->prologue_end = (flags & ROW_PROLOGUE_END) != 0;
+      row->epilogue_begin = (flags & ROW_EPILOGUE_BEGIN) != 0;
+
+      get_uleb128_unchecked (value, p);
+      row->addr = prev.addr + value;
+      get_sleb128_unchecked (svalue, p);
+      row->line = prev.line + svalue;
+      get_uleb128_unchecked (value, p);
+      row->column = value;
+      if ((flags & ROW_HAS_FILE) != 0)
+	{
+	  get_uleb128_unchecked (value, p);
+	  row->file = value;
+	}
+      else
+	row->file = prev.file;
+      if ((flags & ROW_HAS_EXTRA) != 0)
+	{
+	  get_uleb128_unchecked (value, p);
+	  row->op_index = value;
+	  get_uleb128_unchecked (value, p);
+	  row->isa = value;
+	  get_uleb128_unchecked (value, p);
+	  row->discriminator = value;
+	}
+      if ((flags & ROW_HAS_CONTEXT) != 0)
+	{
+	  get_uleb128_unchecked (value, p);
+	  row->context = value;
+	  get_uleb128_unchecked (value, p);
+	  row->function_name = value;
+	}
+
+      prev = *row;
+    }
+
+  /* Another thread might have decoded the same block meanwhile, then
+     use theirs.  Nothing else was allocated since ours, so it can be
+     given back.  */
+  Dwarf_Line *expected = NULL;
+  if (! atomic_compare_exchange_strong_explicit (&b->rows, &expected, rows,
+						 memory_order_acq_rel,
+						 memory_order_acquire))
+    {
+      libdw_unalloc (compact->dbg, Dwarf_Line, sizeof (Dwarf_Line), nrows);
+      rows = expected;
+    }
+
+  return rows;
+}
+
+/* The last of the NROWS sorted ROWS at or before ADDR, or 0.  */
+static size_t
+find_row (const Dwarf_Line *rows, size_t nrows, Dwarf_Addr addr)
+{
+  size_t l = 0, u = nrows - 1;
+  while (l < u)
+    {
+      size_t idx = u - (u - l) / 2;
+      if (addr < rows[idx].addr)
+	u = idx - 1;
+      else
+	l = idx;
+    }
+  return l;
+}
+
+size_t
+internal_function
+__libdw_lines_find (Dwarf_Lines *lines, Dwarf_Addr addr)
+{
+  Dwarf_Lines_Compact *compact = lines->compact;
+  if (compact == NULL)
+    return find_row (lines->info, lines->nlines, addr);
+
+  /* Rows in later blocks are all after ADDR, so the row is in the last
+     block starting at or before ADDR.  Only that one gets decoded.  */
+  size_t l = 0, u = compact->nblocks - 1;
+  while (l < u)
+    {
+      size_t idx = u - (u - l) / 2;
+      if (addr < compact->blocks[idx].addr)
+	u = idx - 1;
+      else
+	l = idx;
+    }
+
+  size_t first = l * LINE_BLOCK_ROWS;
+  return first + find_row (__libdw_compact_lines_block (lines, l),
+			   MIN (lines->nlines - first, LINE_BLOCK_ROWS),
+			   addr);
+}
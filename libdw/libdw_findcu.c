@@ -95,6 +95,67 @@ __libdw_finddbg_cb (const void *arg1, const void *arg2)
   return 0;
 }
 
+/* Add NEWP to the end of VEC.  Called with the dwarf_lock held.  */
+static bool
+cu_vector_append (Dwarf_CU_Vector *vec, struct Dwarf_CU *newp)
+{
+  size_t n = atomic_load_explicit (&vec->nunits, memory_order_relaxed);
+  struct Dwarf_CU_Array *array
+    = atomic_load_explicit (&vec->array, memory_order_relaxed);
+
+  /* Units are read in offset order.  Should one ever not be, it is
+     only kept in the search tree.  */
+  if (n > 0 && newp->start < array->units[n - 1]->end)
+    return false;
+
+  if (array == NULL || n == array->allocated)
+    {
+      size_t allocated = array == NULL ? 16 : 2 * array->allocated;
+      struct Dwarf_CU_Array *bigger
+	= malloc (sizeof *bigger + allocated * sizeof bigger->units[0]);
+      if (bigger == NULL)
+	return false;
+      bigger->retired = array;
+      bigger->allocated = allocated;
+      if (n > 0)
+	memcpy (bigger->units, array->units, n * sizeof array->units[0]);
+      bigger->units[n] = newp;
+      atomic_store_explicit (&vec->array, bigger, memory_order_release);
+    }
+  else
+    array->units[n] = newp;
+
+  atomic_store_explicit (&vec->nunits, n + 1, memory_order_release);
+  return true;
+}
+
+/* Find the unit containing offset START, first with a binary search
+   in VEC and then in TREE for units that didn't make it into VEC.  */
+static struct Dwarf_CU *
+find_unit (Dwarf_CU_Vector *vec, search_tree *tree, Dwarf_Off start)
+{
+  size_t n = atomic_load_explicit (&vec->nunits, memory_order_acquire);
+  struct Dwarf_CU_Array *array
+    = atomic_load_explicit (&vec->array, memory_order_acquire);
+  size_t l = 0;
+  size_t u = n;
+  while (l < u)
+    {
+      size_t idx = (l + u) / 2;
+      struct Dwarf_CU *cu = array->units[idx];
+      if (start < cu->start)
+	u = idx;
+      else if (start >= cu->end)
+	l = idx + 1;
+      else
+	return cu;
+    }
+
+  struct Dwarf_CU fake = { .start = start, .end = 0 };
+  struct Dwarf_CU **found = eu_tfind (&fake, tree, findcu_cb);
+  return found != NULL ? *found : NULL;
+}
+
 struct Dwarf_CU *
 internal_function
 __libdw_intern_next_unit (Dwarf *dbg, bool debug_types)
@@ -102,6 +163,7 @@ __libdw_intern_next_unit (Dwarf *dbg, bool debug_types)
   Dwarf_Off *const offsetp
     = debug_types ? &dbg->next_tu_offset : &dbg->next_cu_offset;
   search_tree *tree = debug_types ? &dbg->tu_tree : &dbg->cu_tree;
+  Dwarf_CU_Vector *vec = debug_types ? &dbg->tu_vector : &dbg->cu_vector;
 
   Dwarf_Off oldoff = *offsetp;
   uint16_t version;
@@ -167,6 +229,7 @@ __libdw_intern_next_unit (Dwarf *dbg, bool debug_types)
   newp->orig_abbrev_offset = newp->last_abbrev_offset = abbrev_offset;
   newp->files = NULL;
   newp->lines = NULL;
+  newp->sequences = NULL;
   newp->split = (Dwarf_CU *) -1;
   newp->base_address = (Dwarf_Addr) -1;
   newp->addr_base = (Dwarf_Off) -1;
@@ -176,7 +239,7 @@ __libdw_intern_next_unit (Dwarf *dbg, bool debug_types)
 
   newp->startp = data->d_buf + newp->start;
   newp->endp = data->d_buf + newp->end;
-  eu_search_tree_init (&newp->locs_tree);
+  eu_search_tree_init_read_mostly (&newp->locs_tree);
   rwlock_init (newp->abbrev_lock);
   rwlock_init (newp->split_lock);
   mutex_init (newp->src_lock);
@@ -233,6 +296,9 @@ __libdw_intern_next_unit (Dwarf *dbg, bool debug_types)
       return NULL;
     }
 
+  /* If this fails the unit can still be found through the tree.  */
+  cu_vector_append (vec, newp);
+
   return newp;
 }
 
@@ -240,20 +306,25 @@ struct Dwarf_CU *
 internal_function
 __libdw_findcu (Dwarf *dbg, Dwarf_Off start, bool v4_debug_types)
 {
-  mutex_lock (dbg->dwarf_lock);
-
   search_tree *tree = v4_debug_types ? &dbg->tu_tree : &dbg->cu_tree;
+  Dwarf_CU_Vector *vec = v4_debug_types ? &dbg->tu_vector : &dbg->cu_vector;
   Dwarf_Off *next_offset
     = v4_debug_types ? &dbg->next_tu_offset : &dbg->next_cu_offset;
 
-  /* Maybe we already know that CU.  */
-  struct Dwarf_CU fake = { .start = start, .end = 0 };
-  struct Dwarf_CU **found = eu_tfind (&fake, tree, findcu_cb);
-  struct Dwarf_CU *result = NULL;
-  if (found != NULL)
+  /* Maybe we already know that CU.  Units are never removed, so this
+     doesn't need the dwarf_lock.  */
+  struct Dwarf_CU *result = find_unit (vec, tree, start);
+  if (result != NULL)
+    return result;
+
+  mutex_lock (dbg->dwarf_lock);
+
+  /* Another thread might have read it in the meantime.  */
+  result = find_unit (vec, tree, start);
+  if (result != NULL)
     {
       mutex_unlock (dbg->dwarf_lock);
-      return *found;
+      return result;
     }
 
   if (start < *next_offset)
@@ -290,12 +361,14 @@ internal_function
 __libdw_findcu_addr (Dwarf *dbg, void *addr)
 {
   search_tree *tree;
+  Dwarf_CU_Vector *vec;
   Dwarf_Off start;
   if (addr >= dbg->sectiondata[IDX_debug_info]->d_buf
       && addr < (dbg->sectiondata[IDX_debug_info]->d_buf
 		 + dbg->sectiondata[IDX_debug_info]->d_size))
     {
       tree = &dbg->cu_tree;
+      vec = &dbg->cu_vector;
       start = addr - dbg->sectiondata[IDX_debug_info]->d_buf;
     }
   else if (dbg->sectiondata[IDX_debug_types] != NULL
@@ -304,18 +377,13 @@ __libdw_findcu_addr (Dwarf *dbg, void *addr)
 		      + dbg->sectiondata[IDX_debug_types]->d_size))
     {
       tree = &dbg->tu_tree;
+      vec = &dbg->tu_vector;
       start = addr - dbg->sectiondata[IDX_debug_types]->d_buf;
     }
   else
     return NULL;
 
-  struct Dwarf_CU fake = { .start = start, .end = 0 };
-  struct Dwarf_CU **found = eu_tfind (&fake, tree, findcu_cb);
-
-  if (found != NULL)
-    return *found;
-
-  return NULL;
+  return find_unit (vec, tree, start);
 }
 
 Dwarf *
@@ -0,0 +1,256 @@
+/* Keep the dwfl_module_addrsym index next to debuginfod cached files.
+   This file is part of elfutils.
+
+   This file is free software; you can redistribute it and/or modify
+   it under the terms of either
+
+     * the GNU Lesser General Public License as published by the Free
+       Software Foundation; either version 3 of the License, or (at
+       your option) any later version
+
+   or
+
+     * the GNU General Public License as published by the Free
+       Software Foundation; either version 2 of the License, or (at
+       your option) any later version
+
+   or both in parallel, as here.
+
+   elfutils is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received copies of the GNU General Public License and
+   the GNU Lesser General Public License along with this program.  If
+   not, see <http://www.gnu.org/licenses/>.  */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include "libdwflP.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/stat.h>
+
+/* Building the index means reading and sorting the whole symbol table.
+   For files found through debuginfod we store the result in the client
+   cache directory of the build-id, next to the executable and debuginfo
+   files, so the next process symbolizing the same build-id can just map
+   it in.  The file is written in host byte order, a file written on a
+   different host doesn't match INDEX_VERSION and is ignored.  The
+   entries and labels are the arrays of struct dwfl_addrsym_index as
+   they are, and are used in place where they are mapped.
+
+   Values are relative to the module low address, so the index can be
+   used whatever the module bias is.  Unless the index is pinned, see
+   rebase_index in dwfl_module_addrsym.c, then it only fits a module at
+   the same low address.
+
+   Only the symbol index is kept here.  Line rows and inline ranges are
+   libdw's own Dwarf_Lines and DIEs, which Dwfl_Line and the scopes
+   point into.  Persisting them would need libdw to load those from a
+   file instead of decoding .debug_line and .debug_info, so they are
+   left out on purpose.  */
+
+#define INDEX_MAGIC "ELFUSYMX"
+#define INDEX_VERSION 1
+
+/* Flags in the file header.  */
+#define INDEX_ADJUST_ST_VALUE	0x1
+#define INDEX_HAS_ADJUSTED	0x2
+#define INDEX_HAS_ABSOLUTE	0x4
+#define INDEX_PINNED		0x8
+
+struct index_header
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t flags;
+  int32_t first_global;
+  int32_t syments;
+  uint64_t low_addr;
+  uint64_t size;		/* high_addr - low_addr.  */
+  uint64_t nentries[2];
+  uint64_t nlabels[2];
+};
+
+/* The struct dwfl_addrsym_entry entries and then the labels of both
+   passes follow the header.  */
+
+static char *
+index_file_name (Dwfl_Module *mod, bool adjust_st_value)
+{
+  char *file;
+  if (asprintf (&file, "%s/%s", mod->debuginfod_dir,
+		adjust_st_value ? "addrsym-index" : "addrinfo-index") < 0)
+    return NULL;
+  return file;
+}
+
+static bool
+usable_module (Dwfl_Module *mod)
+{
+  return (mod->debuginfod_dir != NULL
+	  && (mod->e_type == ET_EXEC || mod->e_type == ET_DYN));
+}
+
+struct dwfl_addrsym_index *
+internal_function
+__libdwfl_addrsym_index_load (Dwfl_Module *mod, int first_global,
+			      int syments, bool adjust_st_value)
+{
+  if (! usable_module (mod))
+    return NULL;
+
+  char *file = index_file_name (mod, adjust_st_value);
+  if (file == NULL)
+    return NULL;
+  int fd = open (file, O_RDONLY | O_CLOEXEC);
+  free (file);
+  if (fd < 0)
+    return NULL;
+
+  struct stat st;
+  void *map = MAP_FAILED;
+  if (fstat (fd, &st) == 0
+      && (size_t) st.st_size >= sizeof (struct index_header))
+    map = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close (fd);
+  if (map == MAP_FAILED)
+    return NULL;
+
+  struct dwfl_addrsym_index *index = NULL;
+  struct index_header *header = map;
+  size_t size = st.st_size;
+  bool pinned = (header->flags & INDEX_PINNED) != 0;
+  uint32_t flags = (header->flags
+		    & ~(INDEX_HAS_ADJUSTED | INDEX_HAS_ABSOLUTE
+			| INDEX_PINNED));
+  if (memcmp (header->magic, INDEX_MAGIC, sizeof header->magic) != 0
+      || header->version != INDEX_VERSION
+      || flags != (adjust_st_value ? INDEX_ADJUST_ST_VALUE : 0)
+      || header->first_global != first_global
+      || header->syments != syments
+      || header->size != mod->high_addr - mod->low_addr
+      || (pinned && header->low_addr != mod->low_addr))
+    goto out;
+
+  /* Check the counts add up to exactly the file size, without
+     overflowing.  */
+  size_t avail = size - sizeof *header;
+  size_t nentries = 0;
+  for (size_t i = 0; i < 2; ++i)
+    {
+      if (header->nentries[i] > avail / sizeof (struct dwfl_addrsym_entry))
+	goto out;
+      avail -= header->nentries[i] * sizeof (struct dwfl_addrsym_entry);
+      nentries += header->nentries[i];
+    }
+  for (size_t i = 0; i < 2; ++i)
+    {
+      if (header->nlabels[i] > avail / sizeof (GElf_Addr))
+	goto out;
+      avail -= header->nlabels[i] * sizeof (GElf_Addr);
+    }
+  if (avail != 0)
+    goto out;
+
+  index = calloc (1, sizeof *index);
+  if (index == NULL)
+    goto out;
+  index->map = map;
+  index->map_size = size;
+  index->pinned = pinned;
+  index->base = pinned ? 0 : mod->low_addr;
+  index->has_adjusted = (header->flags & INDEX_HAS_ADJUSTED) != 0;
+  index->has_absolute = (header->flags & INDEX_HAS_ABSOLUTE) != 0;
+
+  /* The entries aren't checked, the search only reads within the
+     arrays whatever they hold, and __libdwfl_getsym rejects a bad
+     symbol index.  A damaged file can only give wrong answers.  */
+  struct dwfl_addrsym_entry *entries = (void *) (header + 1);
+  GElf_Addr *labels = (void *) (entries + nentries);
+  for (size_t i = 0; i < 2; ++i)
+    {
+      struct dwfl_addrsym_pass *pass = &index->pass[i];
+      pass->entries = entries;
+      pass->nentries = header->nentries[i];
+      pass->labels = labels;
+      pass->nlabels = header->nlabels[i];
+      entries += header->nentries[i];
+      labels += header->nlabels[i];
+    }
+  return index;
+
+ out:
+  munmap (map, size);
+  return NULL;
+}
+
+void
+internal_function
+__libdwfl_addrsym_index_save (Dwfl_Module *mod, int first_global,
+			      int syments, bool adjust_st_value,
+			      const struct dwfl_addrsym_index *index)
+{
+  if (! usable_module (mod))
+    return;
+
+  struct index_header header =
+    {
+      .version = INDEX_VERSION,
+      .flags = ((adjust_st_value ? INDEX_ADJUST_ST_VALUE : 0)
+		| (index->has_adjusted ? INDEX_HAS_ADJUSTED : 0)
+		| (index->has_absolute ? INDEX_HAS_ABSOLUTE : 0)
+		| (index->pinned ? INDEX_PINNED : 0)),
+      .first_global = first_global,
+      .syments = syments,
+      .low_addr = mod->low_addr,
+      .size = mod->high_addr - mod->low_addr,
+      .nentries = { index->pass[0].nentries, index->pass[1].nentries },
+      .nlabels = { index->pass[0].nlabels, index->pass[1].nlabels }
+    };
+  memcpy (header.magic, INDEX_MAGIC, sizeof header.magic);
+
+  /* The arrays are already relative to the base, write them as they
+     are.  */
+  const struct
+  {
+    const void *data;
+    size_t size;
+  } parts[] =
+    {
+      { &header, sizeof header },
+      { index->pass[0].entries,
+	index->pass[0].nentries * sizeof index->pass[0].entries[0] },
+      { index->pass[1].entries,
+	index->pass[1].nentries * sizeof index->pass[1].entries[0] },
+      { index->pass[0].labels,
+	index->pass[0].nlabels * sizeof index->pass[0].labels[0] },
+      { index->pass[1].labels,
+	index->pass[1].nlabels * sizeof index->pass[1].labels[0] },
+    };
+
+  /* Write to a temporary file and rename it into place, so concurrent
+     readers never see a partial index.  */
+  char *file = index_file_name (mod, adjust_st_value);
+  char *tmp = NULL;
+  if (file != NULL && asprintf (&tmp, "%s.XXXXXX", file) >= 0)
+    {
+      int fd = mkstemp (tmp);
+      if (fd >= 0)
+	{
+	  bool ok = true;
+	  for (size_t i = 0; ok && i < sizeof parts / sizeof parts[0]; ++i)
+	    ok = (parts[i].size == 0
+		  || (write_retry (fd, parts[i].data, parts[i].size)
+		      == (ssize_t) parts[i].size));
+	  if (close (fd) != 0 || ! ok || rename (tmp, file) != 0)
+	    unlink (tmp);
+	}
+      free (tmp);
+    }
+  free (file);
+}
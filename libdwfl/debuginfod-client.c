@@ -39,12 +39,20 @@
 
 #include <pthread.h>
 #include <dlfcn.h>
+#include <stdio.h>
+#include <unistd.h>
 
 static __typeof__ (debuginfod_begin) *fp_debuginfod_begin;
 static __typeof__ (debuginfod_find_executable) *fp_debuginfod_find_executable;
 static __typeof__ (debuginfod_find_debuginfo) *fp_debuginfod_find_debuginfo;
 static __typeof__ (debuginfod_end) *fp_debuginfod_end;
 
+/* Only needed by dwfl_debuginfod_prefetch, missing in older
+   libdebuginfod.  */
+static __typeof__ (debuginfod_prefetch_begin) *fp_debuginfod_prefetch_begin;
+static __typeof__ (debuginfod_prefetch_take) *fp_debuginfod_prefetch_take;
+static __typeof__ (debuginfod_prefetch_end) *fp_debuginfod_prefetch_end;
+
 static void __libdwfl_debuginfod_init (void);
 
 static pthread_once_t init_control = PTHREAD_ONCE_INIT;
@@ -69,18 +77,76 @@ dwfl_get_debuginfod_client (Dwfl *dwfl)
 }
 INTDEF(dwfl_get_debuginfod_client)
 
+/* Turn PATH, the cached file returned by the debuginfod client, into
+   the per build-id cache directory and store it in *CACHE_DIR.  */
+static void
+set_cache_dir (int fd, char *path, char **cache_dir)
+{
+  if (fd >= 0 && path != NULL && cache_dir != NULL)
+    {
+      char *slash = strrchr (path, '/');
+      if (slash != NULL && slash != path)
+	{
+	  *slash = '\0';
+	  *cache_dir = path;
+	  return;
+	}
+    }
+  free (path);
+}
+
+/* The files being fetched by dwfl_debuginfod_prefetch.  */
+struct dwfl_debuginfod_prefetch
+{
+  debuginfod_client *client;
+  debuginfod_prefetch *handle;
+  int n;
+  const unsigned char **build_ids;
+  int *build_id_lens;
+  const char **types;
+};
+
+/* Take the file of TYPE and the build id, if it is prefetched, out of
+   the prefetch before looking it up, so it isn't downloaded twice.
+   If it is being downloaded this waits for it, if it is still queued
+   the lookup fetches it right away instead.  */
+static void
+prefetch_take (Dwfl *dwfl, const unsigned char *build_id_bits,
+	       size_t build_id_len, const char *type)
+{
+  struct dwfl_debuginfod_prefetch *p = dwfl->prefetch;
+  if (p == NULL)
+    return;
+
+  for (int i = 0; i < p->n; i++)
+    if ((size_t) p->build_id_lens[i] == build_id_len
+	&& strcmp (p->types[i], type) == 0
+	&& memcmp (p->build_ids[i], build_id_bits, build_id_len) == 0)
+      {
+	(void) (*fp_debuginfod_prefetch_take) (p->handle, i);
+	break;
+      }
+}
+
 int
 __libdwfl_debuginfod_find_executable (Dwfl *dwfl,
 				      const unsigned char *build_id_bits,
-				      size_t build_id_len)
+				      size_t build_id_len, char **cache_dir)
 {
   int fd = -1;
   if (build_id_len > 0)
     {
       debuginfod_client *c = INTUSE (dwfl_get_debuginfod_client) (dwfl);
       if (c != NULL)
-	fd = (*fp_debuginfod_find_executable) (c, build_id_bits,
-					       build_id_len, NULL);
+	{
+	  prefetch_take (dwfl, build_id_bits, build_id_len, "executable");
+	  char *path = NULL;
+	  fd = (*fp_debuginfod_find_executable) (c, build_id_bits,
+						 build_id_len,
+						 cache_dir != NULL
+						 ? &path : NULL);
+	  set_cache_dir (fd, path, cache_dir);
+	}
     }
 
   return fd;
@@ -89,15 +155,22 @@ __libdwfl_debuginfod_find_executable (Dwfl *dwfl,
 int
 __libdwfl_debuginfod_find_debuginfo (Dwfl *dwfl,
 				     const unsigned char *build_id_bits,
-				     size_t build_id_len)
+				     size_t build_id_len, char **cache_dir)
 {
   int fd = -1;
   if (build_id_len > 0)
     {
       debuginfod_client *c = INTUSE (dwfl_get_debuginfod_client) (dwfl);
       if (c != NULL)
-	fd = (*fp_debuginfod_find_debuginfo) (c, build_id_bits,
-					      build_id_len, NULL);
+	{
+	  prefetch_take (dwfl, build_id_bits, build_id_len, "debuginfo");
+	  char *path = NULL;
+	  fd = (*fp_debuginfod_find_debuginfo) (c, build_id_bits,
+						build_id_len,
+						cache_dir != NULL
+						? &path : NULL);
+	  set_cache_dir (fd, path, cache_dir);
+	}
     }
 
   return fd;
@@ -110,6 +183,143 @@ __libdwfl_debuginfod_end (debuginfod_client *c)
     (*fp_debuginfod_end) (c);
 }
 
+static void
+prefetch_free (struct dwfl_debuginfod_prefetch *p)
+{
+  for (int i = 0; i < p->n; i++)
+    if (i == 0 || p->build_ids[i] != p->build_ids[i - 1])
+      free ((void *) p->build_ids[i]);
+  free (p->build_ids);
+  free (p->build_id_lens);
+  free (p->types);
+  if (p->client != NULL)
+    (*fp_debuginfod_end) (p->client);
+  free (p);
+}
+
+/* Whether FILE, relative to the standard build-id debug directory, is
+   there for the build id.  */
+static bool
+build_id_file_exists (const unsigned char *bits, int len, const char *suffix)
+{
+  char path[sizeof "/usr/lib/debug/.build-id/" + 2 * 64 + 1 + sizeof ".debug"];
+  if (len <= 1 || len > 64)
+    return false;
+  char *s = stpcpy (path, "/usr/lib/debug/.build-id/");
+  for (int i = 0; i < len; i++)
+    {
+      s += sprintf (s, "%02x", bits[i]);
+      if (i == 0)
+	*s++ = '/';
+    }
+  strcpy (s, suffix);
+  return access (path, R_OK) == 0;
+}
+
+int
+dwfl_debuginfod_prefetch (Dwfl *dwfl)
+{
+  if (dwfl == NULL)
+    return -1;
+
+  const char *urls = getenv (DEBUGINFOD_URLS_ENV_VAR);
+  if (urls == NULL || urls[0] == '\0')
+    return 0;
+  pthread_once (&init_control, __libdwfl_debuginfod_init);
+  if (fp_debuginfod_prefetch_begin == NULL)
+    return 0;
+
+  /* Only one at a time.  */
+  __libdwfl_debuginfod_prefetch_end (dwfl);
+
+  size_t nmods = 0;
+  for (Dwfl_Module *mod = dwfl->modulelist; mod != NULL; mod = mod->next)
+    nmods++;
+
+  struct dwfl_debuginfod_prefetch *p = calloc (1, sizeof *p);
+  if (p == NULL)
+    goto nomem;
+  p->build_ids = calloc (2 * nmods, sizeof p->build_ids[0]);
+  p->build_id_lens = calloc (2 * nmods, sizeof p->build_id_lens[0]);
+  p->types = calloc (2 * nmods, sizeof p->types[0]);
+  if (p->build_ids == NULL || p->build_id_lens == NULL || p->types == NULL)
+    goto nomem;
+
+  for (Dwfl_Module *mod = dwfl->modulelist; mod != NULL; mod = mod->next)
+    {
+      if (mod->gc || mod->build_id_len <= 0)
+	continue;
+      bool need_debuginfo = ! build_id_file_exists (mod->build_id_bits,
+						    mod->build_id_len,
+						    ".debug");
+      bool need_executable = (mod->main.elf == NULL
+			      && access (mod->name, R_OK) != 0
+			      && ! build_id_file_exists (mod->build_id_bits,
+							 mod->build_id_len,
+							 ""));
+      if (! need_debuginfo && ! need_executable)
+	continue;
+
+      unsigned char *bits = malloc (mod->build_id_len);
+      if (bits == NULL)
+	goto nomem;
+      memcpy (bits, mod->build_id_bits, mod->build_id_len);
+      if (need_debuginfo)
+	{
+	  p->build_ids[p->n] = bits;
+	  p->build_id_lens[p->n] = mod->build_id_len;
+	  p->types[p->n++] = "debuginfo";
+	}
+      if (need_executable)
+	{
+	  p->build_ids[p->n] = bits;
+	  p->build_id_lens[p->n] = mod->build_id_len;
+	  p->types[p->n++] = "executable";
+	}
+    }
+
+  if (p->n == 0)
+    {
+      prefetch_free (p);
+      return 0;
+    }
+
+  /* Not the client of the Dwfl, that one is used by the lookups at
+     the same time.  */
+  p->client = (*fp_debuginfod_begin) ();
+  if (p->client != NULL)
+    p->handle = (*fp_debuginfod_prefetch_begin) (p->client, p->build_ids,
+						 p->build_id_lens, p->types,
+						 p->n, NULL);
+  if (p->handle == NULL)
+    {
+      prefetch_free (p);
+      __libdwfl_seterrno (DWFL_E_ERRNO);
+      return -1;
+    }
+  dwfl->prefetch = p;
+  return p->n;
+
+ nomem:
+  if (p != NULL)
+    prefetch_free (p);
+  __libdwfl_seterrno (DWFL_E_NOMEM);
+  return -1;
+}
+
+void
+__libdwfl_debuginfod_prefetch_end (Dwfl *dwfl)
+{
+  struct dwfl_debuginfod_prefetch *p = dwfl->prefetch;
+  if (p == NULL)
+    return;
+
+  /* Don't start any more fetches, and abandon those going on.  */
+  (void) (*fp_debuginfod_prefetch_end) (p->handle, 1);
+  prefetch_free (p);
+  dwfl->prefetch = NULL;
+}
+
 /* Try to get the libdebuginfod library functions.
    Only needs to be called once from dwfl_get_debuginfod_client.  */
 static void
@@ -137,7 +347,18 @@ __libdwfl_debuginfod_init (void)
 	  fp_debuginfod_find_debuginfo = NULL;
 	  fp_debuginfod_end = NULL;
 	  dlclose (debuginfod_so);
+	  return;
 	}
+
+      fp_debuginfod_prefetch_begin = dlsym (debuginfod_so,
+					    "debuginfod_prefetch_begin");
+      fp_debuginfod_prefetch_take = dlsym (debuginfod_so,
+					   "debuginfod_prefetch_take");
+      fp_debuginfod_prefetch_end = dlsym (debuginfod_so,
+					  "debuginfod_prefetch_end");
+      if (fp_debuginfod_prefetch_take == NULL
+	  || fp_debuginfod_prefetch_end == NULL)
+	fp_debuginfod_prefetch_begin = NULL;
     }
 }
 
@@ -149,4 +370,10 @@ dwfl_get_debuginfod_client (Dwfl *dummy __attribute__ ((unused)))
   return NULL;
 }
 
+int
+dwfl_debuginfod_prefetch (Dwfl *dummy __attribute__ ((unused)))
+{
+  return 0;
+}
+
 #endif // ENABLE_LIBDEBUGINFOD
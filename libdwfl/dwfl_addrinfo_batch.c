@@ -0,0 +1,196 @@
+/* Look up symbol, source line and scopes for many addresses at once.
+   This file is part of elfutils.
+
+   This file is free software; you can redistribute it and/or modify
+   it under the terms of either
+
+     * the GNU Lesser General Public License as published by the Free
+       Software Foundation; either version 3 of the License, or (at
+       your option) any later version
+
+   or
+
+     * the GNU General Public License as published by the Free
+       Software Foundation; either version 2 of the License, or (at
+       your option) any later version
+
+   or both in parallel, as here.
+
+   elfutils is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received copies of the GNU General Public License and
+   the GNU Lesser General Public License along with this program.  If
+   not, see <http://www.gnu.org/licenses/>.  */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include "libdwflP.h"
+#include "libdwP.h"
+
+struct sorted_addr
+{
+  Dwarf_Addr addr;
+  size_t idx;
+};
+
+static int
+compare_addrs (const void *a, const void *b)
+{
+  const struct sorted_addr *s1 = a;
+  const struct sorted_addr *s2 = b;
+  if (s1->addr != s2->addr)
+    return s1->addr < s2->addr ? -1 : 1;
+  return s1->idx < s2->idx ? -1 : s1->idx > s2->idx;
+}
+
+/* Where the previous address was found.  Since the addresses come in
+   increasing order the next one is in the same module, CU or line
+   table row, or in a later one.  */
+struct batch_state
+{
+  Dwfl_Module *mod;
+  Dwarf *dw;
+  Dwarf_Addr bias;
+  struct dwfl_cu *cu;
+  bool have_lines;
+  size_t line;
+};
+
+/* Find the line for the module relative ADDR in the lines of
+   STATE->cu, the same one dwfl_module_getsrc would return.  */
+static Dwfl_Line *
+find_line (struct batch_state *state, Dwarf_Addr addr)
+{
+  Dwarf_Lines *lines = state->cu->die.cu->lines;
+  size_t nlines = lines->nlines;
+  if (nlines == 0)
+    return NULL;
+
+  /* The result is the last line which is less than or equal to ADDR.
+     Gallop forward from the previous result to find the range it is
+     in, then do a binary search in that range.  */
+  size_t l = state->line;
+  size_t step = 1;
+  while (l + step < nlines && __libdw_line (lines, l + step)->addr <= addr)
+    {
+      l += step;
+      step *= 2;
+    }
+  size_t u = MIN (l + step, nlines) - 1;
+  while (l < u)
+    {
+      size_t idx = u - (u - l) / 2;
+      if (addr < __libdw_line (lines, idx)->addr)
+	u = idx - 1;
+      else
+	l = idx;
+    }
+  state->line = l;
+
+  Dwarf_Line *line = __libdw_line (lines, l);
+  if (! line->end_sequence && line->addr <= addr)
+    return &state->cu->lines->idx[l];
+  return NULL;
+}
+
+static void
+lookup_addr (Dwfl *dwfl, struct batch_state *state, Dwarf_Addr addr,
+	     Dwfl_Addrinfo *result)
+{
+  memset (result, 0, sizeof *result);
+
+  /* Modules don't overlap, so if the address is still inside the
+     previous module we don't need to look it up again.  */
+  if (state->mod == NULL
+      || addr < state->mod->low_addr || addr >= state->mod->high_addr)
+    {
+      state->mod = INTUSE(dwfl_addrmodule) (dwfl, addr);
+      if (state->mod == NULL)
+	return;
+      state->dw = INTUSE(dwfl_module_getdwarf) (state->mod, &state->bias);
+      state->cu = NULL;
+    }
+
+  result->module = state->mod;
+  result->name = INTUSE(dwfl_module_addrinfo) (state->mod, addr,
+					       &result->offset, &result->sym,
+					       NULL, NULL, NULL);
+
+  if (state->dw == NULL)
+    return;
+
+  struct dwfl_cu *cu;
+  if (__libdwfl_addrcu (state->mod, addr, &cu) != DWFL_E_NOERROR)
+    return;
+  if (cu != state->cu)
+    {
+      state->cu = cu;
+      state->line = 0;
+      state->have_lines = __libdwfl_cu_getsrclines (cu) == DWFL_E_NOERROR;
+    }
+
+  if (state->have_lines)
+    result->line = find_line (state, addr - state->bias);
+
+  int nscopes = dwarf_getscopes (&cu->die, addr - state->bias,
+				 &result->scopes);
+  if (nscopes > 0)
+    result->nscopes = nscopes;
+  else
+    result->scopes = NULL;
+}
+
+int
+dwfl_addrinfo_batch (Dwfl *dwfl, const Dwarf_Addr *addrs, size_t naddrs,
+		     Dwfl_Addrinfo *results)
+{
+  if (dwfl == NULL)
+    return -1;
+
+  struct sorted_addr *sorted = malloc (naddrs * sizeof *sorted);
+  if (unlikely (sorted == NULL && naddrs > 0))
+    {
+      __libdwfl_seterrno (DWFL_E_NOMEM);
+      return -1;
+    }
+
+  for (size_t i = 0; i < naddrs; ++i)
+    {
+      sorted[i].addr = addrs[i];
+      sorted[i].idx = i;
+    }
+  qsort (sorted, naddrs, sizeof *sorted, compare_addrs);
+
+  struct batch_state state = { .mod = NULL };
+  for (size_t i = 0; i < naddrs; ++i)
+    {
+      Dwfl_Addrinfo *result = &results[sorted[i].idx];
+
+      /* The same address again, just copy the previous result.  */
+      if (i > 0 && sorted[i].addr == sorted[i - 1].addr)
+	{
+	  Dwfl_Addrinfo *prev = &results[sorted[i - 1].idx];
+	  *result = *prev;
+	  if (prev->nscopes > 0)
+	    {
+	      result->scopes = malloc (prev->nscopes * sizeof (Dwarf_Die));
+	      if (result->scopes == NULL)
+		result->nscopes = 0;
+	      else
+		memcpy (result->scopes, prev->scopes,
+			prev->nscopes * sizeof (Dwarf_Die));
+	    }
+	  continue;
+	}
+
+      lookup_addr (dwfl, &state, sorted[i].addr, result);
+    }
+
+  free (sorted);
+  return 0;
+}
@@ -197,7 +197,10 @@ dwfl_build_id_find_elf (Dwfl_Module *mod,
       if (fd < 0 && mod->build_id_len > 0)
 	fd = __libdwfl_debuginfod_find_executable (mod->dwfl,
 						   mod->build_id_bits,
-						   mod->build_id_len);
+						   mod->build_id_len,
+						   mod->debuginfod_dir == NULL
+						   ? &mod->debuginfod_dir
+						   : NULL);
 #endif
     }
 
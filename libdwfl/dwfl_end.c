@@ -40,6 +40,7 @@ dwfl_end (Dwfl *dwfl)
     return;
 
 #ifdef ENABLE_LIBDEBUGINFOD
+  __libdwfl_debuginfod_prefetch_end (dwfl);
   __libdwfl_debuginfod_end (dwfl->debuginfod);
 #endif
 
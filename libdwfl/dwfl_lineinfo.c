@@ -41,7 +41,7 @@ dwfl_lineinfo (Dwfl_Line *line, Dwarf_Addr *addr, int *linep, int *colp,
     return NULL;
 
   struct dwfl_cu *cu = dwfl_linecu (line);
-  const Dwarf_Line *info = &cu->die.cu->lines->info[line->idx];
+  const Dwarf_Line *info = __libdw_line (cu->die.cu->lines, line->idx);
 
   if (addr != NULL)
     *addr = dwfl_adjusted_dwarf_addr (cu->mod, info->addr);
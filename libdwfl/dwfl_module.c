@@ -66,6 +66,9 @@ __libdwfl_module_free (Dwfl_Module *mod)
   if (mod->aranges != NULL)
     free (mod->aranges);
 
+  for (size_t i = 0; i < 2; ++i)
+    __libdwfl_addrsym_index_free (mod->addrsym_index[i]);
+
   if (mod->cu != NULL)
     {
       for (size_t i = 0; i < mod->ncu; ++i)
@@ -119,6 +122,7 @@ __libdwfl_module_free (Dwfl_Module *mod)
 
   free (mod->name);
   free (mod->elfpath);
+  free (mod->debuginfod_dir);
   free (mod);
 }
 
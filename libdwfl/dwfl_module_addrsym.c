@@ -234,6 +234,406 @@ search_table (struct search_state *state, int start, int end)
 	}
 }
 
+/* Whether search_table would try symbol NDX.  Returns its name and
+   fills in the same things as __libdwfl_getsym if so.  */
+static inline const char *
+candidate_sym (Dwfl_Module *mod, int ndx, GElf_Sym *sym, GElf_Addr *value,
+	       GElf_Word *shndx, Elf **elf, bool *resolved,
+	       bool adjust_st_value)
+{
+  const char *name = __libdwfl_getsym (mod, ndx, sym, value, shndx, elf,
+				       NULL, resolved, adjust_st_value);
+  if (name != NULL && name[0] != '\0'
+      && sym->st_shndx != SHN_UNDEF
+      && GELF_ST_TYPE (sym->st_info) != STT_SECTION
+      && GELF_ST_TYPE (sym->st_info) != STT_FILE
+      && GELF_ST_TYPE (sym->st_info) != STT_TLS)
+    return name;
+  return NULL;
+}
+
+/* Whether search_table tries E1 before E2.  */
+static inline bool
+symtab_order_before (const struct dwfl_addrsym_entry *e1,
+		     const struct dwfl_addrsym_entry *e2)
+{
+  return (e1->ndx < e2->ndx
+	  || (e1->ndx == e2->ndx && ! e1->adjusted && e2->adjusted));
+}
+
+static int
+compare_entries (const void *a, const void *b)
+{
+  const struct dwfl_addrsym_entry *e1 = a;
+  const struct dwfl_addrsym_entry *e2 = b;
+  if (e1->value != e2->value)
+    return e1->value < e2->value ? -1 : 1;
+  if (symtab_order_before (e1, e2))
+    return -1;
+  return symtab_order_before (e2, e1);
+}
+
+static int
+compare_labels (const void *a, const void *b)
+{
+  GElf_Addr l1 = *(const GElf_Addr *) a;
+  GElf_Addr l2 = *(const GElf_Addr *) b;
+  return l1 < l2 ? -1 : l1 > l2;
+}
+
+/* Add one value of symbol NDX to PASS.  */
+static bool
+add_index_value (struct dwfl_addrsym_pass *pass, size_t *allocated,
+		 size_t *labels_allocated, int ndx, GElf_Addr value,
+		 GElf_Xword size, bool adjusted)
+{
+  if (size == 0)
+    {
+      if (pass->nlabels == *labels_allocated)
+	{
+	  size_t n = *labels_allocated * 2 + 16;
+	  GElf_Addr *newp = realloc (pass->labels, n * sizeof *newp);
+	  if (newp == NULL)
+	    return false;
+	  pass->labels = newp;
+	  *labels_allocated = n;
+	}
+      pass->labels[pass->nlabels++] = value;
+      return true;
+    }
+
+  if (pass->nentries == *allocated)
+    {
+      size_t n = *allocated * 2 + 16;
+      struct dwfl_addrsym_entry *newp = realloc (pass->entries,
+						 n * sizeof *newp);
+      if (newp == NULL)
+	return false;
+      pass->entries = newp;
+      *allocated = n;
+    }
+  pass->entries[pass->nentries++] = (struct dwfl_addrsym_entry)
+    {
+      .value = value,
+      .size = size,
+      .ndx = ndx,
+      .adjusted = adjusted
+    };
+  return true;
+}
+
+/* Collect the symbols search_table would try for symbol indexes START
+   to END into PASS and sort them.  */
+static bool
+build_index_pass (Dwfl_Module *mod, struct dwfl_addrsym_index *index,
+		  struct dwfl_addrsym_pass *pass, int start, int end,
+		  bool adjust_st_value)
+{
+  size_t allocated = 0;
+  size_t labels_allocated = 0;
+  for (int i = start; i < end; ++i)
+    {
+      GElf_Sym sym;
+      GElf_Addr value;
+      GElf_Word shndx;
+      Elf *elf;
+      bool resolved;
+      const char *name = candidate_sym (mod, i, &sym, &value, &shndx, &elf,
+					&resolved, adjust_st_value);
+      if (name == NULL)
+	continue;
+      if (sym.st_shndx == SHN_ABS)
+	index->has_absolute = true;
+
+      if (! add_index_value (pass, &allocated, &labels_allocated, i,
+			     value, sym.st_size, false))
+	return false;
+
+      if (resolved && mod->e_type != ET_REL)
+	{
+	  GElf_Addr adjusted_st_value;
+	  adjusted_st_value = dwfl_adjusted_st_value (mod, elf, sym.st_value);
+	  if (value != adjusted_st_value)
+	    {
+	      if (! add_index_value (pass, &allocated, &labels_allocated, i,
+				     adjusted_st_value, sym.st_size, true))
+		return false;
+	      index->has_adjusted = true;
+	    }
+	}
+    }
+
+  qsort (pass->entries, pass->nentries, sizeof pass->entries[0],
+	 compare_entries);
+  qsort (pass->labels, pass->nlabels, sizeof pass->labels[0],
+	 compare_labels);
+
+  GElf_Addr max_end = 0;
+  for (size_t i = 0; i < pass->nentries; ++i)
+    {
+      struct dwfl_addrsym_entry *entry = &pass->entries[i];
+      GElf_Addr end_value = entry->value + entry->size;
+      if (end_value < entry->value)
+	end_value = (GElf_Addr) -1;
+      if (end_value > max_end)
+	max_end = end_value;
+      entry->max_end = max_end;
+    }
+
+  return true;
+}
+
+/* Make the values of INDEX relative to the module low address, so
+   that the saved index fits the module wherever it is loaded.  Unless
+   some values come from SHN_ABS symbols, which don't get the bias
+   applied, or lie below the low address.  Then the index is pinned,
+   its base stays 0.  */
+static void
+rebase_index (Dwfl_Module *mod, struct dwfl_addrsym_index *index)
+{
+  index->pinned = index->has_absolute;
+  for (size_t i = 0; i < 2; ++i)
+    {
+      const struct dwfl_addrsym_pass *pass = &index->pass[i];
+      if ((pass->nentries > 0 && pass->entries[0].value < mod->low_addr)
+	  || (pass->nlabels > 0 && pass->labels[0] < mod->low_addr))
+	index->pinned = true;
+    }
+  index->base = index->pinned ? 0 : mod->low_addr;
+  if (index->base == 0)
+    return;
+
+  for (size_t i = 0; i < 2; ++i)
+    {
+      struct dwfl_addrsym_pass *pass = &index->pass[i];
+      for (size_t j = 0; j < pass->nentries; ++j)
+	{
+	  struct dwfl_addrsym_entry *entry = &pass->entries[j];
+	  entry->value -= index->base;
+	  if (entry->max_end != (GElf_Addr) -1)
+	    entry->max_end -= index->base;
+	}
+      for (size_t j = 0; j < pass->nlabels; ++j)
+	pass->labels[j] -= index->base;
+    }
+}
+
+void
+internal_function
+__libdwfl_addrsym_index_free (struct dwfl_addrsym_index *index)
+{
+  if (index == NULL || index == (void *) -1l)
+    return;
+
+  if (index->map != NULL)
+    munmap (index->map, index->map_size);
+  else
+    for (size_t i = 0; i < 2; ++i)
+      {
+	free (index->pass[i].entries);
+	free (index->pass[i].labels);
+      }
+  free (index);
+}
+
+/* Return the index for the symbols searched by __libdwfl_addrsym, or
+   NULL if it cannot be built.  */
+static struct dwfl_addrsym_index *
+get_index (Dwfl_Module *mod, int first_global, int syments,
+	   bool adjust_st_value)
+{
+  struct dwfl_addrsym_index **indexp = &mod->addrsym_index[adjust_st_value];
+  if (*indexp == (void *) -1l)
+    return NULL;
+  if (*indexp != NULL)
+    return *indexp;
+
+  struct dwfl_addrsym_index *index
+    = __libdwfl_addrsym_index_load (mod, first_global, syments,
+				    adjust_st_value);
+  if (index != NULL)
+    {
+      *indexp = index;
+      return index;
+    }
+
+  index = calloc (1, sizeof *index);
+  if (index == NULL
+      || ! build_index_pass (mod, index, &index->pass[0],
+			     first_global == 0 ? 1 : first_global, syments,
+			     adjust_st_value)
+      || (first_global > 1
+	  && ! build_index_pass (mod, index, &index->pass[1], 1, first_global,
+				 adjust_st_value)))
+    {
+      __libdwfl_addrsym_index_free (index);
+      *indexp = (void *) -1l;
+      return NULL;
+    }
+
+  rebase_index (mod, index);
+  __libdwfl_addrsym_index_save (mod, first_global, syments, adjust_st_value,
+				index);
+  *indexp = index;
+  return index;
+}
+
+/* Maximum number of sized symbols containing one address we handle
+   through the index.  Beyond that search_table is used.  */
+#define MAX_CONTAINING 64
+
+/* Collect the entries of PASS whose range contains ADDR into FOUND,
+   in the order search_table would try them.  Returns the number
+   found, or -1 if there are too many.  If LAST_END is not NULL it is
+   set to the highest end of all entries starting at or below ADDR.  */
+static int
+containing_entries (struct dwfl_addrsym_pass *pass, GElf_Addr addr,
+		    struct dwfl_addrsym_entry **found, GElf_Addr *last_end)
+{
+  size_t l = 0, u = pass->nentries;
+  while (l < u)
+    {
+      size_t idx = (l + u) / 2;
+      if (pass->entries[idx].value <= addr)
+	l = idx + 1;
+      else
+	u = idx;
+    }
+
+  if (last_end != NULL)
+    *last_end = l == 0 ? 0 : pass->entries[l - 1].max_end;
+
+  /* Walk back as long as some earlier entry might still reach ADDR.  */
+  int nfound = 0;
+  while (l > 0 && pass->entries[l - 1].max_end > addr)
+    {
+      struct dwfl_addrsym_entry *entry = &pass->entries[--l];
+      if (addr - entry->value < entry->size)
+	{
+	  if (nfound == MAX_CONTAINING)
+	    return -1;
+	  found[nfound++] = entry;
+	}
+    }
+
+  /* Restore the symbol table order.  */
+  for (int i = 1; i < nfound; ++i)
+    for (int j = i; j > 0 && symtab_order_before (found[j], found[j - 1]); --j)
+      {
+	struct dwfl_addrsym_entry *tmp = found[j];
+	found[j] = found[j - 1];
+	found[j - 1] = tmp;
+      }
+
+  return nfound;
+}
+
+/* Largest label of PASS at or below ADDR, if any.  */
+static bool
+last_label (struct dwfl_addrsym_pass *pass, GElf_Addr addr, GElf_Addr *label)
+{
+  size_t l = 0, u = pass->nlabels;
+  while (l < u)
+    {
+      size_t idx = (l + u) / 2;
+      if (pass->labels[idx] <= addr)
+	l = idx + 1;
+      else
+	u = idx;
+    }
+  if (l == 0)
+    return false;
+  *label = pass->labels[l - 1];
+  return true;
+}
+
+/* Try the entries FOUND of an index at BASE, like search_table would.  */
+static void
+try_entries (struct search_state *state, GElf_Addr base,
+	     struct dwfl_addrsym_entry **found, int nfound)
+{
+  for (int i = 0; i < nfound; ++i)
+    {
+      GElf_Sym sym;
+      GElf_Addr value;
+      GElf_Word shndx;
+      Elf *elf;
+      bool resolved;
+      const char *name = candidate_sym (state->mod, found[i]->ndx, &sym,
+					&value, &shndx, &elf, &resolved,
+					state->adjust_st_value);
+      /* The adjusted value is only tried if the value itself is not
+	 above ADDR.  */
+      if (name != NULL && value <= state->addr)
+	try_sym_value (state, base + found[i]->value, &sym, name, shndx, elf,
+		       found[i]->adjusted ? false : resolved);
+    }
+}
+
+/* Use the index to do what search_table does for all global and then
+   all local symbols.  The index only keeps track of which symbols
+   contain ADDR.  Returns false if that isn't enough to get the same
+   result as search_table, which happens when a sizeless symbol could
+   be picked.  */
+static bool
+search_index (struct search_state *state, struct dwfl_addrsym_index *index,
+	      bool search_locals)
+{
+  /* All values lie at or above the base of the index.  Without any,
+     search_table would only find nothing.  */
+  if (state->addr < index->base)
+    return ! index->has_adjusted;
+  GElf_Addr addr = state->addr - index->base;
+
+  struct dwfl_addrsym_entry *found[MAX_CONTAINING];
+  GElf_Addr global_end;
+  int nfound = containing_entries (&index->pass[0], addr, found,
+				   &global_end);
+  if (nfound < 0)
+    return false;
+
+  /* Only symbols with a size containing ADDR can be the closest.  If
+     there is one, sizeless symbols don't matter.  */
+  if (nfound > 0)
+    {
+      try_entries (state, index->base, found, nfound);
+      return state->closest_name != NULL;
+    }
+
+  GElf_Addr global_label;
+  bool have_global_label = last_label (&index->pass[0], addr,
+				       &global_label);
+  if (search_locals)
+    {
+      /* search_table skips the locals if a global sizeless symbol is
+	 exactly at ADDR.  */
+      if (have_global_label && global_label == addr)
+	return false;
+
+      nfound = containing_entries (&index->pass[1], addr, found, NULL);
+      if (nfound < 0)
+	return false;
+      if (nfound > 0)
+	{
+	  try_entries (state, index->base, found, nfound);
+	  return state->closest_name != NULL;
+	}
+    }
+
+  /* No sized symbol contains ADDR.  A sizeless symbol is only used if
+     no global symbol ends above it.  */
+  GElf_Addr local_label;
+  bool have_local_label = (search_locals
+			   && last_label (&index->pass[1], addr,
+					  &local_label));
+  if (index->has_adjusted
+      || (have_global_label && global_label >= global_end)
+      || (have_local_label && local_label >= global_end))
+    return false;
+
+  return true;
+}
+
 /* Returns the name of the symbol "closest" to ADDR.
    Never returns symbols at addresses above ADDR.
 
@@ -281,13 +681,25 @@ __libdwfl_addrsym (Dwfl_Module *_mod, GElf_Addr _addr, GElf_Off *off,
   int first_global = INTUSE (dwfl_module_getsymtab_first_global) (state.mod);
   if (first_global < 0)
     return NULL;
-  search_table (&state, first_global == 0 ? 1 : first_global, syments);
 
-  /* If we found nothing searching the global symbols, then try the locals.
-     Unless we have a global sizeless symbol that matches exactly.  */
-  if (state.closest_name == NULL && first_global > 1
-      && (state.sizeless_name == NULL || state.sizeless_value != state.addr))
-    search_table (&state, 1, first_global);
+  /* Use the sorted index if it gives the same answer, otherwise
+     search the tables.  */
+  struct dwfl_addrsym_index *index = get_index (state.mod, first_global,
+						syments, _adjust_st_value);
+  if (index == NULL || ! search_index (&state, index, first_global > 1))
+    {
+      state.closest_name = NULL;
+      state.min_label = 0;
+      search_table (&state, first_global == 0 ? 1 : first_global, syments);
+
+      /* If we found nothing searching the global symbols, then try the
+	 locals.  Unless we have a global sizeless symbol that matches
+	 exactly.  */
+      if (state.closest_name == NULL && first_global > 1
+	  && (state.sizeless_name == NULL
+	      || state.sizeless_value != state.addr))
+	search_table (&state, 1, first_global);
+    }
 
   /* If we found no proper sized symbol to use, fall back to the best
      candidate sizeless symbol we found, if any.  */
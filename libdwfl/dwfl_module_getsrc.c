@@ -51,27 +51,18 @@ dwfl_module_getsrc (Dwfl_Module *mod, Dwarf_Addr addr)
       if (nlines > 0)
 	{
 	  /* This is guaranteed for us by libdw read_srclines.  */
-	  assert(lines->info[nlines - 1].end_sequence);
+	  assert(__libdw_line (lines, nlines - 1)->end_sequence);
 
 	  /* Now we look at the module-relative address.  */
 	  addr -= bias;
 
 	  /* The lines are sorted by address, so we can use binary search.  */
-	  size_t l = 0, u = nlines - 1;
-	  while (l < u)
-	    {
-	      size_t idx = u - (u - l) / 2;
-	      Dwarf_Line *line = &lines->info[idx];
-	      if (addr < line->addr)
-		u = idx - 1;
-	      else
-		l = idx;
-	    }
+	  size_t l = __libdw_lines_find (lines, addr);
 
 	  /* The last line which is less than or equal to addr is what
 	     we want, unless it is the end_sequence which is after the
 	     current line sequence.  */
-	  Dwarf_Line *line = &lines->info[l];
+	  Dwarf_Line *line = __libdw_line (lines, l);
 	  if (! line->end_sequence && line->addr <= addr)
 	    return &cu->lines->idx[l];
 	}
@@ -43,7 +43,7 @@ dwfl_dwarf_line_file (const Dwarf_Line *line)
 static inline Dwarf_Line *
 dwfl_line (const Dwfl_Line *line)
 {
-  return &dwfl_linecu (line)->die.cu->lines->info[line->idx];
+  return __libdw_line (dwfl_linecu (line)->die.cu->lines, line->idx);
 }
 
 static inline const char *
@@ -87,7 +87,7 @@ dwfl_module_getsrc_file (Dwfl_Module *mod,
       bool lastmatch = false;
       for (size_t cnt = 0; cnt < cu->die.cu->lines->nlines; ++cnt)
 	{
-	  Dwarf_Line *line = &cu->die.cu->lines->info[cnt];
+	  Dwarf_Line *line = __libdw_line (cu->die.cu->lines, cnt);
 
 	  if (unlikely (line->file >= line->files->nfiles))
 	    {
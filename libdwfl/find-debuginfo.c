@@ -419,8 +419,14 @@ dwfl_standard_find_debuginfo (Dwfl_Module *mod,
 							   &bits);
 	}
 
+      /* Only remember where the module's own debuginfo is cached,
+	 not the alt file.  */
       if (bits_len > 0)
-	fd = __libdwfl_debuginfod_find_debuginfo (mod->dwfl, bits, bits_len);
+	fd = __libdwfl_debuginfod_find_debuginfo (mod->dwfl, bits, bits_len,
+						  (mod->dw == NULL
+						   && mod->debuginfod_dir == NULL)
+						  ? &mod->debuginfod_dir
+						  : NULL);
     }
 #endif
 
@@ -510,7 +510,13 @@ extern const char *dwfl_module_addrname (Dwfl_Module *mod, GElf_Addr address);
    symbol table of the ELF file.  Note that the address matched
    against the symbol might be in a different section than the
    returned symbol.  The section in the main elf file in ADDRESS falls
-   can be found with dwfl_module_address_section.  */
+   can be found with dwfl_module_address_section.
+
+   If the module's files came from the debuginfod client cache, the
+   sorted symbol index this and dwfl_module_addrsym build is kept in
+   that cache and reused by later processes.  Only the symbol index is
+   kept, line rows (dwfl_module_getsrc) and inline function ranges
+   (dwarf_getscopes) are still decoded from DWARF by each process.  */
 extern const char *dwfl_module_addrinfo (Dwfl_Module *mod, GElf_Addr address,
 					 GElf_Off *offset, GElf_Sym *sym,
 					 GElf_Word *shndxp, Elf **elfp,
@@ -590,6 +596,33 @@ extern Dwfl_Line *dwfl_onesrcline (Dwarf_Die *cudie, size_t idx);
 extern Dwfl_Line *dwfl_module_getsrc (Dwfl_Module *mod, Dwarf_Addr addr);
 extern Dwfl_Line *dwfl_getsrc (Dwfl *dwfl, Dwarf_Addr addr);
 
+/* What dwfl_addrinfo_batch found for one address.  */
+typedef struct
+{
+  Dwfl_Module *module;		/* Module containing the address, or NULL.  */
+  const char *name;		/* As from dwfl_module_addrinfo, or NULL.  */
+  GElf_Off offset;		/* Offset of the address in the symbol.  */
+  GElf_Sym sym;			/* Symbol, like dwfl_module_addrinfo.  */
+  Dwfl_Line *line;		/* As from dwfl_module_getsrc, or NULL.  */
+  Dwarf_Die *scopes;		/* As from dwarf_getscopes, or NULL.  */
+  int nscopes;
+} Dwfl_Addrinfo;
+
+/* Look up the module, symbol, source line and scopes of NADDRS
+   addresses ADDRS at once, filling in RESULTS[I] for ADDRS[I].  This
+   gives the same results as calling dwfl_addrmodule,
+   dwfl_module_addrinfo, dwfl_module_getsrc and dwarf_getscopes (on
+   the CU DIE from dwfl_module_addrdie) for every address, but handles
+   the addresses in sorted order so module, CU and line table lookups
+   are shared between nearby addresses.  The SCOPES array goes from
+   the innermost scope outwards; the DW_TAG_inlined_subroutine scopes
+   in it are the inlined frames for the address.  The caller must free
+   each SCOPES array.
+   Returns 0 on success, -1 if the lookup could not be done at all.  */
+extern int dwfl_addrinfo_batch (Dwfl *dwfl, const Dwarf_Addr *addrs,
+				size_t naddrs, Dwfl_Addrinfo *results)
+  __nonnull_attribute__ (4);
+
 /* Get address for source.  */
 extern int dwfl_module_getsrc_file (Dwfl_Module *mod,
 				    const char *fname, int lineno, int column,
@@ -838,6 +871,21 @@ int dwfl_frame_reg (Dwfl_Frame *state, unsigned regno, Dwarf_Word *val)
  */
 extern debuginfod_client *dwfl_get_debuginfod_client (Dwfl *dwfl);
 
+/* Start fetching the debuginfo of all modules reported so far, and the
+   executables of those whose files aren't found under their names,
+   from debuginfod in the background.  Several are fetched at the same
+   time, see debuginfod_prefetch_begin.  Call it after
+   dwfl_core_file_report or dwfl_linux_proc_report, so that the lookups
+   for the modules later find the files in the debuginfod client cache
+   instead of downloading them one by one.  A lookup for a file being
+   fetched waits for it, one for a file not started yet fetches it
+   right away.  Files found locally under /usr/lib/debug/.build-id are
+   not fetched.  The fetches use a debuginfod client of their own, with
+   the settings from the environment, and dwfl_end abandons those still
+   going on.  Returns the number of files being fetched, which is 0 if
+   elfutils or libdebuginfod lack debuginfod support, or -1 on error.  */
+extern int dwfl_debuginfod_prefetch (Dwfl *dwfl);
+
 /* Set the sysroot to use when searching for shared libraries and binaries. If not
    specified, search the system root. Passing NULL clears previously set sysroot. Note
    that library creates a copy of the sysroot argument.  */
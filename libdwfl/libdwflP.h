@@ -120,6 +120,7 @@ struct Dwfl
   Dwflst_Process_Tracker *tracker;
 #ifdef ENABLE_LIBDEBUGINFOD
   debuginfod_client *debuginfod;
+  struct dwfl_debuginfod_prefetch *prefetch;
 #endif
   Dwfl_Module *modulelist;    /* List in order used by full traversals.  */
 
@@ -210,6 +211,12 @@ struct Dwfl_Module
 
   struct dwfl_arange *aranges;	/* Mapping of addresses in module to CUs.  */
 
+  /* Sorted symbol index used by dwfl_module_addrsym (index 1) and
+     dwfl_module_addrinfo (index 0), built on first use.  */
+  struct dwfl_addrsym_index *addrsym_index[2];
+  char *debuginfod_dir;		/* Client cache directory of files we got
+				   through debuginfod, or NULL.  */
+
   void *build_id_bits;		/* malloc'd copy of build ID bits.  */
   GElf_Addr build_id_vaddr;	/* Address where they reside, 0 if unknown.  */
   int build_id_len;		/* -1 for prior failure, 0 if unset.  */
@@ -414,6 +421,41 @@ struct dwfl_arange
   size_t arange;		/* Index in Dwarf_Aranges.  */
 };
 
+/* One symbol value with nonzero st_size that __libdwfl_addrsym would
+   try, see dwfl_module_addrsym.c.  Values are relative to the base of
+   the index.  This is also the layout of the saved index, which is
+   used where it is mapped, see addrsym-cache.c.  */
+struct dwfl_addrsym_entry
+{
+  GElf_Addr value;
+  GElf_Addr max_end;		/* Highest end of this and previous entries,
+				   -1 if that wraps around.  */
+  GElf_Xword size;
+  int32_t ndx;			/* Symbol index for __libdwfl_getsym.  */
+  uint32_t adjusted;		/* Value is the adjusted st_value.  */
+};
+
+/* The symbols searched in one pass of __libdwfl_addrsym.  */
+struct dwfl_addrsym_pass
+{
+  struct dwfl_addrsym_entry *entries; /* Sorted by value.  */
+  size_t nentries;
+  GElf_Addr *labels;		/* Sorted values of sizeless symbols.  */
+  size_t nlabels;
+};
+
+/* Index of the global (pass 0) and local (pass 1) symbols.  */
+struct dwfl_addrsym_index
+{
+  struct dwfl_addrsym_pass pass[2];
+  GElf_Addr base;		/* Added to all values in PASS.  */
+  void *map;			/* Saved index PASS points into, or NULL.  */
+  size_t map_size;
+  bool has_adjusted;		/* Some entries are adjusted values.  */
+  bool has_absolute;		/* Some values are SHN_ABS symbols.  */
+  bool pinned;			/* BASE is 0, not the module low address.  */
+};
+
 #define __LIBDWFL_REMOTE_MEM_CACHE_SIZE 4096
 /* Structure for caching remote memory reads as used by __libdwfl_pid_arg.  */
 struct __libdwfl_remote_mem_cache
@@ -476,6 +518,26 @@ extern const char *__libdwfl_getsym (Dwfl_Module *mod, int ndx, GElf_Sym *sym,
 
 extern void __libdwfl_module_free (Dwfl_Module *mod) internal_function;
 
+/* Free an index built by __libdwfl_addrsym or mapped by
+   __libdwfl_addrsym_index_load.  */
+extern void __libdwfl_addrsym_index_free (struct dwfl_addrsym_index *index)
+  internal_function;
+
+/* Read the index of the symbols __libdwfl_addrsym searches saved by
+   __libdwfl_addrsym_index_save next to the files MOD got from the
+   debuginfod cache.  Returns NULL if there is none that fits.  */
+extern struct dwfl_addrsym_index *
+__libdwfl_addrsym_index_load (Dwfl_Module *mod, int first_global,
+			      int syments, bool adjust_st_value)
+  internal_function;
+
+/* Save INDEX in the debuginfod cache directory of MOD, if any.  */
+extern void __libdwfl_addrsym_index_save (Dwfl_Module *mod,
+					  int first_global, int syments,
+					  bool adjust_st_value,
+					  const struct dwfl_addrsym_index *index)
+  internal_function;
+
 /* Find the main ELF file, update MOD->elferr and/or MOD->main.elf.  */
 extern void __libdwfl_getelf (Dwfl_Module *mod) internal_function;
 
@@ -665,17 +727,24 @@ extern bool __libdwfl_dynamic_vaddr_get (Elf *elf, GElf_Addr *vaddrp)
   internal_function;
 
 #ifdef ENABLE_LIBDEBUGINFOD
-/* Internal interface to libdebuginfod (if installed).  */
+/* Internal interface to libdebuginfod (if installed).  If CACHE_DIR
+   is not NULL and a file is found, *CACHE_DIR is set to the malloc'd
+   client cache directory holding it.  */
 int
 __libdwfl_debuginfod_find_executable (Dwfl *dwfl,
 				      const unsigned char *build_id_bits,
-				      size_t build_id_len);
+				      size_t build_id_len, char **cache_dir);
 int
 __libdwfl_debuginfod_find_debuginfo (Dwfl *dwfl,
 				     const unsigned char *build_id_bits,
-				     size_t build_id_len);
+				     size_t build_id_len, char **cache_dir);
 void
 __libdwfl_debuginfod_end (debuginfod_client *c);
+
+/* Stop the fetches started by dwfl_debuginfod_prefetch, abandoning
+   those in flight, and free them.  */
+void
+__libdwfl_debuginfod_prefetch_end (Dwfl *dwfl);
 #endif
 
 
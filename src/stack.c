@@ -40,6 +40,7 @@ ARGP_PROGRAM_BUG_ADDRESS_DEF = PACKAGE_BUGREPORT;
 /* non-printable argp options.  */
 #define OPT_DEBUGINFO	0x100
 #define OPT_COREFILE	0x101
+#define OPT_PREFETCH	0x102
 
 static bool show_activation = false;
 static bool show_module = false;
@@ -52,6 +53,7 @@ static bool show_raw = false;
 static bool show_modules = false;
 static bool show_debugname = false;
 static bool show_inlines = false;
+static bool prefetch = false;
 
 static int maxframes = 256;
 
@@ -516,6 +518,10 @@ parse_opt (int key, char *arg __attribute__ ((unused)),
       debuginfo_path = arg;
       break;
 
+    case OPT_PREFETCH:
+      prefetch = true;
+      break;
+
     case 'm':
       show_module = true;
       break;
@@ -620,6 +626,11 @@ parse_opt (int key, char *arg __attribute__ ((unused)),
       if (dwfl_report_end (dwfl, NULL, NULL) != 0)
 	error (EXIT_BAD, 0, "dwfl_report_end: %s", dwfl_errmsg (-1));
 
+      /* Get the debuginfo of all modules from debuginfod at once,
+	 instead of one after another as the frames need them.  */
+      if (prefetch)
+	(void) dwfl_debuginfod_prefetch (dwfl);
+
       if (pid != 0)
 	{
 	  int err = dwfl_linux_proc_attach (dwfl, pid, false);
@@ -669,6 +680,8 @@ main (int argc, char **argv)
       {  "executable", 'e', "EXEC", 0, N_("(optional) EXECUTABLE that produced COREFILE"), 0 },
       { "debuginfo-path", OPT_DEBUGINFO, "PATH", 0,
 	N_("Search path for separate debuginfo files"), 0 },
+      { "prefetch", OPT_PREFETCH, NULL, 0,
+	N_("Fetch the files of all modules from debuginfod at once, in the background"), 0 },
 
       { NULL, 0, NULL, 0, N_("Output selection options:"), 0 },
       { "activation",  'a', NULL, 0,
@@ -0,0 +1,175 @@
+/* Test program for dwfl_addrinfo_batch
+   This file is part of elfutils.
+
+   This file is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   elfutils is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <dwarf.h>
+#include ELFUTILS_HEADER(dwfl)
+
+static const Dwfl_Callbacks offline_callbacks =
+  {
+    .find_debuginfo = dwfl_standard_find_debuginfo,
+    .section_address = dwfl_offline_section_address,
+  };
+
+static Dwarf_Addr *addrs;
+static size_t naddrs;
+static size_t allocated;
+
+static void
+add_addr (Dwarf_Addr addr)
+{
+  if (naddrs == allocated)
+    {
+      allocated = allocated * 2 + 64;
+      addrs = realloc (addrs, allocated * sizeof addrs[0]);
+      if (addrs == NULL)
+	{
+	  puts ("out of memory");
+	  exit (1);
+	}
+    }
+  addrs[naddrs++] = addr;
+}
+
+/* Addresses around every symbol, every one twice and in reverse
+   order, plus a few outside the module.  */
+static int
+collect_addrs (Dwfl_Module *mod, void **userdata __attribute__ ((unused)),
+	       const char *name __attribute__ ((unused)),
+	       Dwarf_Addr start __attribute__ ((unused)),
+	       void *arg __attribute__ ((unused)))
+{
+  Dwarf_Addr low, high;
+  dwfl_module_info (mod, NULL, &low, &high, NULL, NULL, NULL, NULL);
+  add_addr (low - 1);
+  add_addr (high);
+
+  int nsyms = dwfl_module_getsymtab (mod);
+  for (int i = nsyms - 1; i > 0; i--)
+    {
+      GElf_Sym sym;
+      GElf_Addr value;
+      if (dwfl_module_getsym_info (mod, i, &sym, &value,
+				   NULL, NULL, NULL) == NULL)
+	continue;
+      for (int twice = 0; twice < 2; twice++)
+	{
+	  add_addr (value + sym.st_size);
+	  add_addr (value + sym.st_size / 2);
+	  add_addr (value);
+	}
+    }
+
+  return DWARF_CB_OK;
+}
+
+int
+main (int argc, char *argv[])
+{
+  if (argc != 2)
+    {
+      fprintf (stderr, "usage: %s FILE\n", argv[0]);
+      return -1;
+    }
+
+  Dwfl *dwfl = dwfl_begin (&offline_callbacks);
+  if (dwfl_report_offline (dwfl, argv[1], argv[1], -1) == NULL)
+    {
+      printf ("%s: %s\n", argv[1], dwfl_errmsg (-1));
+      return -1;
+    }
+  dwfl_report_end (dwfl, NULL, NULL);
+  dwfl_getmodules (dwfl, collect_addrs, NULL, 0);
+
+  Dwfl_Addrinfo *results = calloc (naddrs, sizeof results[0]);
+  if (results == NULL || dwfl_addrinfo_batch (dwfl, addrs, naddrs,
+					      results) != 0)
+    {
+      printf ("dwfl_addrinfo_batch: %s\n", dwfl_errmsg (-1));
+      return -1;
+    }
+
+  /* Compare against looking up the addresses one by one.  */
+  int result = 0;
+  size_t nnames = 0, nlines = 0, ninlined = 0;
+  for (size_t i = 0; i < naddrs; i++)
+    {
+      Dwarf_Addr addr = addrs[i];
+      Dwfl_Addrinfo *r = &results[i];
+      Dwfl_Module *mod = dwfl_addrmodule (dwfl, addr);
+      const char *name = NULL;
+      GElf_Off offset = 0;
+      GElf_Sym sym;
+      Dwfl_Line *line = NULL;
+      Dwarf_Die *scopes = NULL;
+      int nscopes = 0;
+      if (mod != NULL)
+	{
+	  name = dwfl_module_addrinfo (mod, addr, &offset, &sym,
+				       NULL, NULL, NULL);
+	  line = dwfl_module_getsrc (mod, addr);
+	  Dwarf_Addr bias;
+	  Dwarf_Die *cudie = dwfl_module_addrdie (mod, addr, &bias);
+	  if (cudie != NULL)
+	    nscopes = dwarf_getscopes (cudie, addr - bias, &scopes);
+	  if (nscopes < 0)
+	    nscopes = 0;
+	}
+
+      bool same = (r->module == mod && r->name == name
+		   && (name == NULL
+		       || (r->offset == offset
+			   && r->sym.st_value == sym.st_value))
+		   && r->line == line && r->nscopes == nscopes);
+      for (int s = 0; same && s < nscopes; s++)
+	same = r->scopes[s].addr == scopes[s].addr;
+      if (! same)
+	{
+	  printf ("%#" PRIx64 ": batch %s+%#" PRIx64 " %p %d,"
+		  " single %s+%#" PRIx64 " %p %d\n", addr,
+		  r->name ?: "???", r->offset, r->line, r->nscopes,
+		  name ?: "???", offset, line, nscopes);
+	  result = 1;
+	}
+
+      nnames += name != NULL;
+      nlines += line != NULL;
+      for (int s = 0; s < nscopes; s++)
+	if (dwarf_tag (&scopes[s]) == DW_TAG_inlined_subroutine)
+	  {
+	    ninlined++;
+	    break;
+	  }
+
+      free (scopes);
+      free (r->scopes);
+    }
+
+  printf ("%zu addresses, %zu with symbol, %zu with line, %zu inlined\n",
+	  naddrs, nnames, nlines, ninlined);
+
+  free (results);
+  free (addrs);
+  dwfl_end (dwfl);
+  return result;
+}
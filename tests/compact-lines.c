@@ -0,0 +1,246 @@
+/* Test and measure compact line tables.
+   This file is part of elfutils.
+
+   This file is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   elfutils is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <fcntl.h>
+#include <inttypes.h>
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <dwarf.h>
+#include ELFUTILS_HEADER(dw)
+
+#if defined __GLIBC__ && __GLIBC_PREREQ (2, 33)
+# define HAVE_HEAP_SIZE 1
+static size_t
+heap_size (void)
+{
+  struct mallinfo2 mi = mallinfo2 ();
+  return mi.uordblks + mi.hblkhd;
+}
+#else
+# define HAVE_HEAP_SIZE 0
+static size_t
+heap_size (void)
+{
+  return 0;
+}
+#endif
+
+struct table
+{
+  Dwarf_Die cudie;
+  Dwarf_Lines *lines;
+  size_t nlines;
+};
+
+/* Read the line tables of all units in FILE.  Returns the number of
+   heap bytes that took.  */
+static size_t
+read_tables (const char *file, bool compact, Dwarf **dbgp, int *fdp,
+	     struct table **tablesp, size_t *ntablesp)
+{
+  *fdp = open (file, O_RDONLY);
+  Dwarf *dbg = dwarf_begin (*fdp, DWARF_C_READ);
+  if (dbg == NULL)
+    {
+      printf ("%s not usable: %s\n", file, dwarf_errmsg (-1));
+      exit (1);
+    }
+  dwarf_set_compact_lines (dbg, compact);
+
+  struct table *tables = NULL;
+  size_t ntables = 0;
+  size_t allocated = 0;
+  size_t before = heap_size ();
+  Dwarf_CU *cu = NULL;
+  Dwarf_Die cudie, subdie;
+  uint8_t unit_type;
+  while (dwarf_get_units (dbg, cu, &cu, NULL, &unit_type,
+			  &cudie, &subdie) == 0)
+    {
+      if (unit_type == DW_UT_skeleton)
+	cudie = subdie;
+
+      struct table t = { .cudie = cudie };
+      if (dwarf_getsrclines (&cudie, &t.lines, &t.nlines) != 0)
+	continue;
+
+      if (ntables == allocated)
+	{
+	  allocated = allocated * 2 + 16;
+	  tables = realloc (tables, allocated * sizeof tables[0]);
+	  if (tables == NULL)
+	    {
+	      puts ("out of memory");
+	      exit (1);
+	    }
+	}
+      tables[ntables++] = t;
+    }
+
+  /* Don't count our own array.  */
+  size_t used = heap_size () - before - malloc_usable_size (tables);
+
+  *dbgp = dbg;
+  *tablesp = tables;
+  *ntablesp = ntables;
+  return used;
+}
+
+static bool
+same_line (Dwarf_Lines *lines1, Dwarf_Line *l1,
+	   Dwarf_Lines *lines2, Dwarf_Line *l2)
+{
+  if (l1 == NULL || l2 == NULL)
+    return l1 == l2;
+
+  Dwarf_Addr a1, a2;
+  int n1, n2, c1, c2;
+  bool f1, f2;
+  unsigned int u1, u2;
+  const char *s1 = dwarf_linesrc (l1, NULL, NULL);
+  const char *s2 = dwarf_linesrc (l2, NULL, NULL);
+  if (dwarf_lineaddr (l1, &a1) != 0 || dwarf_lineaddr (l2, &a2) != 0
+      || a1 != a2
+      || dwarf_lineno (l1, &n1) != 0 || dwarf_lineno (l2, &n2) != 0
+      || n1 != n2
+      || dwarf_linecol (l1, &c1) != 0 || dwarf_linecol (l2, &c2) != 0
+      || c1 != c2
+      || (s1 != s2 && (s1 == NULL || s2 == NULL || strcmp (s1, s2) != 0)))
+    return false;
+
+#define SAME_FLAG(fn)							\
+  if (fn (l1, &f1) != 0 || fn (l2, &f2) != 0 || f1 != f2)		\
+    return false
+  SAME_FLAG (dwarf_linebeginstatement);
+  SAME_FLAG (dwarf_lineendsequence);
+  SAME_FLAG (dwarf_lineblock);
+  SAME_FLAG (dwarf_lineprologueend);
+  SAME_FLAG (dwarf_lineepiloguebegin);
+#define SAME_VALUE(fn)							\
+  if (fn (l1, &u1) != 0 || fn (l2, &u2) != 0 || u1 != u2)		\
+    return false
+  SAME_VALUE (dwarf_lineop_index);
+  SAME_VALUE (dwarf_lineisa);
+  SAME_VALUE (dwarf_linediscriminator);
+
+  /* The NVIDIA inlining context is the index of another row.  */
+  Dwarf_Line *ctx1 = dwarf_linecontext (lines1, l1);
+  Dwarf_Line *ctx2 = dwarf_linecontext (lines2, l2);
+  if (ctx1 == NULL || ctx2 == NULL)
+    return ctx1 == ctx2;
+  return (dwarf_lineaddr (ctx1, &a1) == 0 && dwarf_lineaddr (ctx2, &a2) == 0
+	  && a1 == a2);
+}
+
+/* Read all line tables of each FILE as normal and as compact table,
+   and print how much heap each took.  Then check all rows and address
+   lookups give the same results.  */
+int
+main (int argc, char *argv[])
+{
+  if (argc < 2)
+    {
+      fprintf (stderr, "usage: %s FILE...\n", argv[0]);
+      return -1;
+    }
+
+  int result = 0;
+  size_t total_rows = 0, total_normal = 0, total_compact = 0;
+  for (int i = 1; i < argc; i++)
+    {
+      const char *file = argv[i];
+      Dwarf *dbg, *cdbg;
+      int fd, cfd;
+      struct table *tables, *ctables;
+      size_t ntables, nctables;
+      size_t normal = read_tables (file, false, &dbg, &fd,
+				   &tables, &ntables);
+      size_t compact = read_tables (file, true, &cdbg, &cfd,
+				    &ctables, &nctables);
+
+      size_t nrows = 0;
+      if (ntables != nctables)
+	{
+	  printf ("%s: %zu tables, %zu compact\n", file, ntables, nctables);
+	  result = 1;
+	  ntables = 0;
+	}
+
+      /* Compare lookups first, so they only expand what they need.  */
+      for (size_t t = 0; t < ntables; t++)
+	for (size_t r = 0; r < tables[t].nlines; r++)
+	  {
+	    Dwarf_Addr addr;
+	    dwarf_lineaddr (dwarf_onesrcline (tables[t].lines, r), &addr);
+	    if (! same_line (tables[t].lines,
+			     dwarf_getsrc_die (&tables[t].cudie, addr),
+			     ctables[t].lines,
+			     dwarf_getsrc_die (&ctables[t].cudie, addr)))
+	      {
+		printf ("%s: lookup of %#" PRIx64 " differs\n", file, addr);
+		result = 1;
+	      }
+	  }
+
+      for (size_t t = 0; t < ntables; t++)
+	{
+	  if (tables[t].nlines != ctables[t].nlines)
+	    {
+	      printf ("%s: %zu lines, %zu compact\n", file,
+		      tables[t].nlines, ctables[t].nlines);
+	      result = 1;
+	      continue;
+	    }
+	  nrows += tables[t].nlines;
+	  for (size_t r = 0; r < tables[t].nlines; r++)
+	    if (! same_line (tables[t].lines,
+			     dwarf_onesrcline (tables[t].lines, r),
+			     ctables[t].lines,
+			     dwarf_onesrcline (ctables[t].lines, r)))
+	      {
+		printf ("%s: row %zu differs\n", file, r);
+		result = 1;
+	      }
+	}
+
+      if (HAVE_HEAP_SIZE)
+	printf ("%s: %zu rows, %zu bytes, compact %zu bytes\n",
+		file, nrows, normal, compact);
+      total_rows += nrows;
+      total_normal += normal;
+      total_compact += compact;
+
+      free (tables);
+      free (ctables);
+      dwarf_end (cdbg);
+      dwarf_end (dbg);
+      close (cfd);
+      close (fd);
+    }
+
+  if (HAVE_HEAP_SIZE && argc > 2)
+    printf ("total: %zu rows, %zu bytes, compact %zu bytes\n",
+	    total_rows, total_normal, total_compact);
+
+  return result;
+}
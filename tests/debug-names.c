@@ -0,0 +1,69 @@
+/* Test program for dwarf_names_lookup
+   This file is part of elfutils.
+
+   This file is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   elfutils is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <dwarf.h>
+#include ELFUTILS_HEADER(dw)
+
+static int
+found_die (Dwarf_Die *die, void *arg)
+{
+  const char *name = arg;
+  Dwarf_Die cudie;
+  dwarf_diecu (die, &cudie, NULL, NULL);
+  printf ("%s: [%" PRIx64 "] tag 0x%x, %s, cu %s\n", name,
+	  dwarf_dieoffset (die), dwarf_tag (die), dwarf_diename (die),
+	  dwarf_diename (&cudie));
+  return DWARF_CB_OK;
+}
+
+int
+main (int argc, char *argv[])
+{
+  if (argc < 3)
+    {
+      fprintf (stderr, "usage: %s FILE NAME...\n", argv[0]);
+      return -1;
+    }
+
+  int fd = open (argv[1], O_RDONLY);
+  Dwarf *dbg = dwarf_begin (fd, DWARF_C_READ);
+  if (dbg == NULL)
+    {
+      printf ("%s not usable: %s\n", argv[1], dwarf_errmsg (-1));
+      return -1;
+    }
+
+  int result = 0;
+  for (int i = 2; i < argc; i++)
+    if (dwarf_names_lookup (dbg, argv[i], found_die, argv[i]) != 0)
+      {
+	printf ("%s: %s\n", argv[i], dwarf_errmsg (-1));
+	result = 1;
+      }
+
+  dwarf_end (dbg);
+  close (fd);
+
+  return result;
+}
@@ -0,0 +1,195 @@
+/* Test and benchmark concurrent lookups in eu-search trees.
+   This file is part of elfutils.
+
+   This file is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   elfutils is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include <config.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "system.h"
+#include "eu-search.h"
+
+/* Number of keys in the tree, like the CUs of a big program.  */
+#define NKEYS 4096
+
+/* Keys are ranges like Dwarf_CUs, a lookup key has end zero.  */
+struct range
+{
+  uint64_t start;
+  uint64_t end;
+};
+
+static struct range ranges[NKEYS];
+
+static int
+range_compare (const void *a, const void *b)
+{
+  const struct range *r1 = a;
+  const struct range *r2 = b;
+  if (r1->end == 0)
+    {
+      if (r1->start < r2->start)
+	return -1;
+      return r1->start >= r2->end;
+    }
+  if (r2->end == 0)
+    return -range_compare (b, a);
+  return r1->start < r2->start ? -1 : r1->start > r2->start;
+}
+
+struct work
+{
+  search_tree *tree;
+  unsigned int id;
+  unsigned long lookups;
+  int failed;
+};
+
+static void *
+lookup_work (void *arg)
+{
+  struct work *w = arg;
+  uint64_t x = w->id * 2654435761u + 1;
+  for (unsigned long i = 0; i < w->lookups; i++)
+    {
+      /* Simple xorshift to pick a random key and offset in it.  */
+      x ^= x << 13;
+      x ^= x >> 7;
+      x ^= x << 17;
+      struct range *r = &ranges[x % NKEYS];
+      struct range key = { .start = r->start + (x >> 32) % 16, .end = 0 };
+
+      /* Sometimes a key in the gaps between the ranges.  */
+      bool gap = i % 8 == 7;
+      if (gap)
+	key.start = r->end;
+
+      struct range **found = eu_tfind (&key, w->tree, range_compare);
+      if (gap ? found != NULL : (found == NULL || *found != r))
+	w->failed = 1;
+
+      /* And sometimes add a key that is already there.  */
+      if (i % 64 == 0)
+	{
+	  found = eu_tsearch (r, w->tree, range_compare);
+	  if (found == NULL || *found != r)
+	    w->failed = 1;
+	}
+    }
+  return NULL;
+}
+
+static void
+noop_free (void *arg __attribute__ ((unused)))
+{
+}
+
+static double
+now (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Do LOOKUPS lookups in each of NTHREADS threads.  Returns the number
+   of lookups per second, or -1 if some lookup failed.  */
+static double
+run (bool read_mostly, unsigned int nthreads, unsigned long lookups)
+{
+  search_tree tree;
+  if (read_mostly)
+    eu_search_tree_init_read_mostly (&tree);
+  else
+    eu_search_tree_init (&tree);
+
+  /* Insert in a shuffled order.  */
+  for (size_t i = 0; i < NKEYS; i++)
+    {
+      struct range *r = &ranges[(i * 1031) % NKEYS];
+      if (eu_tsearch (r, &tree, range_compare) == NULL)
+	{
+	  puts ("eu_tsearch failed");
+	  exit (1);
+	}
+    }
+
+  pthread_t *threads = malloc (nthreads * sizeof *threads);
+  struct work *work = malloc (nthreads * sizeof *work);
+  if (threads == NULL || work == NULL)
+    {
+      puts ("out of memory");
+      exit (1);
+    }
+
+  double start = now ();
+  for (unsigned int i = 0; i < nthreads; i++)
+    {
+      work[i] = (struct work) { .tree = &tree, .id = i, .lookups = lookups };
+      if (pthread_create (&threads[i], NULL, lookup_work, &work[i]) != 0)
+	{
+	  puts ("pthread_create failed");
+	  exit (1);
+	}
+    }
+
+  int failed = 0;
+  for (unsigned int i = 0; i < nthreads; i++)
+    {
+      pthread_join (threads[i], NULL);
+      failed |= work[i].failed;
+    }
+  double secs = now () - start;
+  free (threads);
+  free (work);
+
+  eu_search_tree_fini (&tree, noop_free);
+  return failed ? -1 : nthreads * lookups / secs;
+}
+
+/* Print lookups per second for 1, 2, 4 up to MAXTHREADS threads,
+   with the plain rwlock protected tree and a read-mostly tree.  */
+int
+main (int argc, char *argv[])
+{
+  unsigned int maxthreads = argc > 1 ? atoi (argv[1]) : 64;
+  unsigned long lookups = argc > 2 ? strtoul (argv[2], NULL, 0) : 1000000;
+
+  for (size_t i = 0; i < NKEYS; i++)
+    {
+      ranges[i].start = i * 32;
+      ranges[i].end = i * 32 + 16;
+    }
+
+  int result = 0;
+  for (unsigned int n = 1; n <= maxthreads; n *= 2)
+    {
+      double locked = run (false, n, lookups);
+      double read_mostly = run (true, n, lookups);
+      if (locked < 0 || read_mostly < 0)
+	{
+	  printf ("%u threads: lookup failed\n", n);
+	  result = 1;
+	}
+      else
+	printf ("%2u threads: %8.2f M lookups/s locked, "
+		"%8.2f M lookups/s read-mostly\n",
+		n, locked / 1e6, read_mostly / 1e6);
+    }
+
+  return result;
+}
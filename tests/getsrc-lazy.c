@@ -0,0 +1,131 @@
+/* Test program for dwarf_getsrc_lazy
+   This file is part of elfutils.
+
+   This file is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   elfutils is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <dwarf.h>
+#include ELFUTILS_HEADER(dw)
+
+static Dwarf *
+open_dwarf (const char *file, int *fd)
+{
+  *fd = open (file, O_RDONLY);
+  Dwarf *dbg = dwarf_begin (*fd, DWARF_C_READ);
+  if (dbg == NULL)
+    {
+      printf ("%s not usable: %s\n", file, dwarf_errmsg (-1));
+      exit (1);
+    }
+  return dbg;
+}
+
+static bool
+same_line (Dwarf_Line *l1, Dwarf_Line *l2)
+{
+  if (l1 == NULL || l2 == NULL)
+    return l1 == l2;
+
+  Dwarf_Addr a1, a2;
+  int n1, n2, c1, c2;
+  const char *s1 = dwarf_linesrc (l1, NULL, NULL);
+  const char *s2 = dwarf_linesrc (l2, NULL, NULL);
+  return (dwarf_lineaddr (l1, &a1) == 0 && dwarf_lineaddr (l2, &a2) == 0
+	  && a1 == a2
+	  && dwarf_lineno (l1, &n1) == 0 && dwarf_lineno (l2, &n2) == 0
+	  && n1 == n2
+	  && dwarf_linecol (l1, &c1) == 0 && dwarf_linecol (l2, &c2) == 0
+	  && c1 == c2
+	  && (s1 == s2 || (s1 != NULL && s2 != NULL && strcmp (s1, s2) == 0)));
+}
+
+/* Look up every line address, and the address after it, in every CU
+   of FILE with dwarf_getsrc_lazy and check the result is the same as
+   the one dwarf_getsrc_die gives.  The lazy lookups are done in a
+   separate Dwarf, so the complete line tables are never decoded
+   there.  */
+int
+main (int argc, char *argv[])
+{
+  if (argc != 2)
+    {
+      fprintf (stderr, "usage: %s FILE\n", argv[0]);
+      return -1;
+    }
+
+  int fd, lazyfd;
+  Dwarf *dbg = open_dwarf (argv[1], &fd);
+  Dwarf *lazydbg = open_dwarf (argv[1], &lazyfd);
+
+  int result = 0;
+  size_t ncus = 0, naddrs = 0, nfound = 0;
+  Dwarf_CU *cu = NULL, *lazycu = NULL;
+  Dwarf_Die cudie, subdie, lazydie, lazysubdie;
+  uint8_t unit_type;
+  while (dwarf_get_units (dbg, cu, &cu, NULL, &unit_type,
+			  &cudie, &subdie) == 0
+	 && dwarf_get_units (lazydbg, lazycu, &lazycu, NULL, NULL,
+			     &lazydie, &lazysubdie) == 0)
+    {
+      if (unit_type == DW_UT_skeleton)
+	{
+	  cudie = subdie;
+	  lazydie = lazysubdie;
+	}
+
+      Dwarf_Lines *lines;
+      size_t nlines;
+      if (dwarf_getsrclines (&cudie, &lines, &nlines) != 0)
+	continue;
+      ncus++;
+
+      for (size_t i = 0; i < nlines; i++)
+	{
+	  Dwarf_Addr addr;
+	  if (dwarf_lineaddr (dwarf_onesrcline (lines, i), &addr) != 0)
+	    continue;
+
+	  for (Dwarf_Addr a = addr; a <= addr + 1; a++)
+	    {
+	      Dwarf_Line *line = dwarf_getsrc_die (&cudie, a);
+	      Dwarf_Line *lazy = dwarf_getsrc_lazy (&lazydie, a);
+	      naddrs++;
+	      nfound += line != NULL;
+	      if (! same_line (line, lazy))
+		{
+		  printf ("%s: CU [%" PRIx64 "] %#" PRIx64 " differs\n",
+			  argv[1], dwarf_dieoffset (&cudie), a);
+		  result = 1;
+		}
+	    }
+	}
+    }
+
+  printf ("%zu CUs, %zu addresses, %zu with line\n", ncus, naddrs, nfound);
+
+  dwarf_end (lazydbg);
+  dwarf_end (dbg);
+  close (lazyfd);
+  close (fd);
+  return result;
+}
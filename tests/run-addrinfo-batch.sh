@@ -0,0 +1,35 @@
+#! /bin/sh
+# This file is part of elfutils.
+#
+# This file is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 3 of the License, or
+# (at your option) any later version.
+#
+# elfutils is distributed in the hope that it will be useful, but
+# WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+. $srcdir/test-subr.sh
+
+# addrinfo-batch looks up addresses around every symbol with
+# dwfl_addrinfo_batch and fails if any result differs from looking
+# the address up on its own.
+
+testfiles testfile-inlines
+testrun_compare ${abs_builddir}/addrinfo-batch testfile-inlines << EOF
+392 addresses, 206 with symbol, 34 with line, 10 inlined
+EOF
+
+testfiles testfile-dwp-5 testfile-dwp-5.dwp
+testrun_compare ${abs_builddir}/addrinfo-batch testfile-dwp-5 << EOF
+416 addresses, 353 with symbol, 128 with line, 0 inlined
+EOF
+
+testrun_on_self_quiet ${abs_builddir}/addrinfo-batch
+
+exit 0
@@ -0,0 +1,31 @@
+#! /bin/sh
+# This file is part of elfutils.
+#
+# This file is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 3 of the License, or
+# (at your option) any later version.
+#
+# elfutils is distributed in the hope that it will be useful, but
+# WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+. $srcdir/test-subr.sh
+
+# compact-lines reads all line tables normally and compactly, fails
+# if any row or address lookup differs and prints the heap size of
+# both.  The sizes depend on the host, so only the result is checked.
+
+testfiles testfile-inlines testfile-dw-form-indirect
+testfiles testfile-dwp-5 testfile-dwp-5.dwp testfile-debug-names
+testrun ${abs_builddir}/compact-lines testfile-inlines \
+  testfile-dw-form-indirect testfile-dwp-5 \
+  testfile-debug-names
+
+testrun_on_self_quiet ${abs_builddir}/compact-lines
+
+exit 0
@@ -0,0 +1,88 @@
+#! /bin/sh
+# This file is part of elfutils.
+#
+# This file is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 3 of the License, or
+# (at your option) any later version.
+#
+# elfutils is distributed in the hope that it will be useful, but
+# WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+. $srcdir/test-subr.sh
+
+# See testfile-debug-names.source.
+testfiles testfile-debug-names
+testfiles testfile-debug-names-split testfile-debug-names-split.dwp
+
+testrun_compare ${abs_builddir}/debug-names testfile-debug-names \
+	main helper point int global_var other_func nosuchname << EOF
+main: [4f] tag 0x2e, main, cu testfile-debug-names.c
+helper: [36] tag 0x2e, helper, cu testfile-debug-names.c
+helper: [b5] tag 0x2e, helper, cu testfile-debug-names-b.c
+point: [6a] tag 0x13, point, cu testfile-debug-names.c
+point: [e3] tag 0x13, point, cu testfile-debug-names-b.c
+int: [32] tag 0x24, int, cu testfile-debug-names.c
+int: [b1] tag 0x24, int, cu testfile-debug-names-b.c
+global_var: [27] tag 0x34, global_var, cu testfile-debug-names.c
+other_func: [cf] tag 0x2e, other_func, cu testfile-debug-names-b.c
+EOF
+
+# The entries point into the split units, which are found in the .dwp.
+testrun_compare ${abs_builddir}/debug-names testfile-debug-names-split \
+	main helper point int global_var other_func nosuchname << EOF
+main: [42] tag 0x2e, main, cu testfile-debug-names.c
+helper: [29] tag 0x2e, helper, cu testfile-debug-names.c
+helper: [9f] tag 0x2e, helper, cu testfile-debug-names-b.c
+point: [5d] tag 0x13, point, cu testfile-debug-names.c
+point: [cd] tag 0x13, point, cu testfile-debug-names-b.c
+int: [25] tag 0x24, int, cu testfile-debug-names.c
+int: [9b] tag 0x24, int, cu testfile-debug-names-b.c
+global_var: [1a] tag 0x34, global_var, cu testfile-debug-names.c
+other_func: [b9] tag 0x2e, other_func, cu testfile-debug-names-b.c
+EOF
+
+# A damaged .debug_names section fails every lookup, it is only read
+# once.
+cp testfile-debug-names testfile-debug-names-bad
+tempfiles testfile-debug-names-bad
+off=`testrun ${abs_top_builddir}/src/readelf -S -W testfile-debug-names \
+     | awk '$2 == ".debug_names" { print $5 }'`
+printf '\377\377\377\377\377\377\377\377\377\377\377\377' \
+  | dd of=testfile-debug-names-bad bs=1 seek=$((0x$off)) conv=notrunc \
+       2>/dev/null
+testrun_compare ${abs_builddir}/debug-names testfile-debug-names-bad \
+	main helper << EOF
+main: invalid DWARF
+helper: invalid DWARF
+EOF
+
+# No .debug_names section, names are indexed from the DIEs.
+testfiles testfile-dwarf-5
+testrun_compare ${abs_builddir}/debug-names testfile-dwarf-5 \
+	main foo int nosuchname << EOF
+main: [292] tag 0x2e, main, cu world.c
+foo: [7a] tag 0x2e, foo, cu hello.c
+foo: [e6] tag 0x2e, foo, cu hello.c
+int: [49] tag 0x24, int, cu hello.c
+int: [240] tag 0x24, int, cu world.c
+EOF
+
+# Same, but through the skeleton units into the .dwp file.
+testfiles testfile-dwp-5 testfile-dwp-5.dwp
+testrun_compare ${abs_builddir}/debug-names testfile-dwp-5 \
+	main foo bar int << EOF
+main: [2c7] tag 0x2e, main, cu main.cc
+foo: [c6] tag 0x2e, foo, cu foo.cc
+bar: [23c] tag 0x2e, bar, cu bar.cc
+int: [af] tag 0x24, int, cu foo.cc
+int: [205] tag 0x24, int, cu bar.cc
+int: [29c] tag 0x24, int, cu main.cc
+EOF
+
+exit 0
@@ -0,0 +1,96 @@
+#!/usr/bin/env bash
+#
+# This file is part of elfutils.
+#
+# This file is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 3 of the License, or
+# (at your option) any later version.
+#
+# elfutils is distributed in the hope that it will be useful, but
+# WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+. $srcdir/debuginfod-subr.sh
+
+# for test case debugging, uncomment:
+set -x
+unset VALGRIND_CMD
+
+DB=${PWD}/.debuginfod_tmp.sqlite
+tempfiles $DB ${DB}-wal ${DB}-shm
+export DEBUGINFOD_CACHE_PATH=${PWD}/.client_cache
+
+# This variable is essential and ensures no time-race for claiming ports occurs
+# set base to a unique multiple of 100 not used in any other 'run-debuginfod-*' test
+base=15000
+get_ports
+
+# A fully stripped program, so its symbols only come from the
+# debuginfo the server has.
+mkdir F L
+tempfiles prog.c
+echo "int foo (int x) { return x + 1; }" > prog.c
+echo "int main (int argc, char **argv) { return foo (argc); }" >> prog.c
+gcc -Wl,--build-id -g -o L/prog prog.c
+testrun ${abs_top_builddir}/src/strip -f F/prog.debug L/prog
+BUILDID=`env LD_LIBRARY_PATH=$ldpath ${abs_builddir}/../src/readelf \
+          -n L/prog | grep 'Build ID' | awk '{print $3}'`
+MAIN=0x`env LD_LIBRARY_PATH=$ldpath ${abs_builddir}/../src/readelf \
+          -s F/prog.debug | awk '$8 == "main" { print $2 }'`
+FOO_NDX=`env LD_LIBRARY_PATH=$ldpath ${abs_builddir}/../src/readelf \
+          -s F/prog.debug | awk '$8 == "foo" { print $1 + 0 }'`
+
+env LD_LIBRARY_PATH=$ldpath DEBUGINFOD_URLS= ${abs_builddir}/../debuginfod/debuginfod $VERBOSE \
+    -F -d $DB -p $PORT1 -t0 -g0 F > vlog$PORT1 2>&1 &
+PID1=$!
+tempfiles vlog$PORT1
+errfiles vlog$PORT1
+
+wait_ready $PORT1 'ready' 1
+wait_ready $PORT1 'thread_work_total{role="traverse"}' 1
+wait_ready $PORT1 'thread_work_pending{role="scan"}' 0
+wait_ready $PORT1 'thread_busy{role="scan"}' 0
+
+export DEBUGINFOD_URLS=http://127.0.0.1:$PORT1
+symbol()
+{
+    testrun ${abs_top_builddir}/src/addr2line -S -e L/prog $MAIN | head -1
+}
+
+# The first process builds the symbol index and saves it next to the
+# debuginfo in the client cache.
+test "`symbol`" = main
+ls $DEBUGINFOD_CACHE_PATH/$BUILDID/addr*-index
+
+# Point every entry of the saved index at the symbol table index of
+# foo, a 32-bit little-endian ndx field at offset 24 of each 32-byte
+# entry after the 72-byte header.  If the next process really maps the
+# index instead of reading the symbol table, it reports foo for main.
+ndx=`printf '\\%03o\\%03o\\%03o\\%03o' $((FOO_NDX & 255)) \
+     $((FOO_NDX >> 8 & 255)) $((FOO_NDX >> 16 & 255)) $((FOO_NDX >> 24))`
+for idx in $DEBUGINFOD_CACHE_PATH/$BUILDID/addr*-index; do
+    n0=`od -An -t u8 -j 40 -N 8 $idx`
+    n1=`od -An -t u8 -j 48 -N 8 $idx`
+    for i in `seq 0 $((n0 + n1 - 1))`; do
+        printf "$ndx" | dd of=$idx bs=1 seek=$((72 + i * 32 + 24)) \
+                           conv=notrunc status=none
+    done
+done
+test "`symbol`" = foo
+
+# Without the index the symbol table is read again and the index saved
+# anew.
+rm $DEBUGINFOD_CACHE_PATH/$BUILDID/addr*-index
+test "`symbol`" = main
+ls $DEBUGINFOD_CACHE_PATH/$BUILDID/addr*-index
+
+kill $PID1
+wait $PID1
+PID1=0
+
+exit 0
@@ -81,7 +81,35 @@ archive_test d44d42cbd7d915bc938c81333a21e355a6022fb7 /usr/src/debug/hello-1.0/h
 # arch
 #archive_test cee13b2ea505a7f37bd20d271c6bc7e5f8d2dfcb /usr/src/debug/hello.c 7a1334e086b97e5f124003a6cfb3ed792d10cdf4
 
+# The ELF members were classified by the classifier threads, and all
+# their memory was given back.
+curl -s http://127.0.0.1:$PORT1/metrics | grep 'thread_work_total{role="classify"}'
+wait_ready $PORT1 'thread_work_pending{role="classify"}' 0
+wait_ready $PORT1 'thread_busy{role="classify"}' 0
+
 kill $PID1
 wait $PID1
 PID1=0
+
+# Without memory for them, the scanners extract the members to
+# $TMPDIR and classify them themselves, with the same results.
+rm -f $DB ${DB}-wal ${DB}-shm
+env LD_LIBRARY_PATH=$ldpath ${abs_builddir}/../debuginfod/debuginfod $VERBOSE -R -p $PORT2 -d $DB -t0 -g0 -v --scan-memory=0 R > vlog$PORT2 2>&1 &
+PID2=$!
+tempfiles vlog$PORT2
+errfiles vlog$PORT2
+wait_ready $PORT2 'ready' 1
+wait_ready $PORT2 'thread_work_total{role="traverse"}' 1
+wait_ready $PORT2 'thread_work_pending{role="scan"}' 0
+wait_ready $PORT2 'thread_busy{role="scan"}' 0
+if curl -s http://127.0.0.1:$PORT2/metrics | grep 'thread_work_total{role="classify"}'; then false; fi
+
+export DEBUGINFOD_URLS='http://127.0.0.1:'$PORT2
+rm -rf $DEBUGINFOD_CACHE_PATH
+archive_test c36708a78618d597dee15d0dc989f093ca5f9120 /usr/src/debug/hello2-1.0-2.x86_64/hello.c $SHA
+archive_test bc1febfd03ca05e030f0d205f7659db29f8a4b30 /usr/src/debug/hello-1.0/hello.c $SHA
+
+kill $PID2
+wait $PID2
+PID2=0
 exit 0
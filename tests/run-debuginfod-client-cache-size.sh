@@ -0,0 +1,110 @@
+#!/usr/bin/env bash
+#
+# This file is part of elfutils.
+#
+# This file is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 3 of the License, or
+# (at your option) any later version.
+#
+# elfutils is distributed in the hope that it will be useful, but
+# WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+. $srcdir/debuginfod-subr.sh
+
+# for test case debugging, uncomment:
+set -x
+unset VALGRIND_CMD
+
+DB=${PWD}/.debuginfod_tmp.sqlite
+tempfiles $DB ${DB}-wal ${DB}-shm
+export DEBUGINFOD_CACHE_PATH=${PWD}/.client_cache
+
+# This variable is essential and ensures no time-race for claiming ports occurs
+# set base to a unique multiple of 100 not used in any other 'run-debuginfod-*' test
+base=14900
+get_ports
+
+# Three programs of about 2MB each, with different build-ids.
+mkdir F
+tempfiles prog.c blob
+echo "int main() { return 0; }" > prog.c
+for i in 1 2 3; do
+    gcc -Wl,--build-id -g -DPROG=$i -o prog prog.c
+    head -c 2M /dev/urandom > blob
+    objcopy --add-section .debug_bench=blob prog F/prog$i
+    rm -f prog
+    eval BUILDID$i=`env LD_LIBRARY_PATH=$ldpath ${abs_builddir}/../src/readelf \
+              -n F/prog$i | grep 'Build ID' | awk '{print $3}'`
+done
+
+env LD_LIBRARY_PATH=$ldpath DEBUGINFOD_URLS= ${abs_builddir}/../debuginfod/debuginfod $VERBOSE \
+    -F -d $DB -p $PORT1 -t0 -g0 F > vlog$PORT1 2>&1 &
+PID1=$!
+tempfiles vlog$PORT1
+errfiles vlog$PORT1
+
+wait_ready $PORT1 'ready' 1
+wait_ready $PORT1 'thread_work_total{role="traverse"}' 1
+wait_ready $PORT1 'thread_work_pending{role="scan"}' 0
+wait_ready $PORT1 'thread_busy{role="scan"}' 0
+
+export DEBUGINFOD_URLS=http://127.0.0.1:$PORT1
+find_debuginfo()
+{
+    env LD_LIBRARY_PATH=$ldpath ${abs_top_builddir}/debuginfod/debuginfod-find \
+        debuginfo $1
+}
+
+for i in 1 2 3; do
+    eval find_debuginfo \$BUILDID$i
+done
+touch -a -d '-3 hours' $DEBUGINFOD_CACHE_PATH/$BUILDID1/debuginfo
+touch -a -d '-2 hours' $DEBUGINFOD_CACHE_PATH/$BUILDID2/debuginfo
+touch -a -d '-1 hours' $DEBUGINFOD_CACHE_PATH/$BUILDID3/debuginfo
+
+# Without an index the first cleaning walks the cache and trims it to
+# 5MB, dropping the least recently used file, and writes the index.
+echo 0 > $DEBUGINFOD_CACHE_PATH/cache_clean_interval_s
+echo 5 > $DEBUGINFOD_CACHE_PATH/max_size_mb
+find_debuginfo $BUILDID3
+test ! -f $DEBUGINFOD_CACHE_PATH/$BUILDID1/debuginfo
+test -f $DEBUGINFOD_CACHE_PATH/$BUILDID2/debuginfo
+test -f $DEBUGINFOD_CACHE_PATH/$BUILDID3/debuginfo
+grep -q "$BUILDID3/debuginfo" $DEBUGINFOD_CACHE_PATH/cache_index
+
+# A file that isn't in the index, since it bypassed the client.
+mkdir $DEBUGINFOD_CACHE_PATH/00000000
+touch -d '1970-01-01' $DEBUGINFOD_CACHE_PATH/00000000/executable
+
+# Bringing the first file back makes the second the least recently
+# used one, the next cleaning finds that in the index without a walk.
+find_debuginfo $BUILDID1
+find_debuginfo 0000000000000000000000000000000000000000 && false || true
+test -f $DEBUGINFOD_CACHE_PATH/$BUILDID1/debuginfo
+test ! -f $DEBUGINFOD_CACHE_PATH/$BUILDID2/debuginfo
+test -f $DEBUGINFOD_CACHE_PATH/$BUILDID3/debuginfo
+test -f $DEBUGINFOD_CACHE_PATH/00000000/executable
+
+# A file read straight from the cache, here the first one, was used
+# later than the index says.  Cleaning keeps it, and drops the third.
+now=`date +%s`
+echo "$((now - 7200)) 2097152 $BUILDID1/debuginfo" >> $DEBUGINFOD_CACHE_PATH/cache_index
+echo "$((now - 3600)) 2097152 $BUILDID3/debuginfo" >> $DEBUGINFOD_CACHE_PATH/cache_index
+touch -a -d '-1 hours' $DEBUGINFOD_CACHE_PATH/$BUILDID3/debuginfo
+touch -a $DEBUGINFOD_CACHE_PATH/$BUILDID1/debuginfo
+echo 3 > $DEBUGINFOD_CACHE_PATH/max_size_mb
+find_debuginfo $BUILDID2
+test -f $DEBUGINFOD_CACHE_PATH/$BUILDID1/debuginfo
+test ! -f $DEBUGINFOD_CACHE_PATH/$BUILDID3/debuginfo
+
+kill $PID1
+wait $PID1
+PID1=0
+
+exit 0
@@ -0,0 +1,72 @@
+#!/usr/bin/env bash
+#
+# This file is part of elfutils.
+#
+# This file is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 3 of the License, or
+# (at your option) any later version.
+#
+# elfutils is distributed in the hope that it will be useful, but
+# WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+. $srcdir/debuginfod-subr.sh
+
+# for test case debugging, uncomment:
+set -x
+unset VALGRIND_CMD
+
+export DEBUGINFOD_CACHE_PATH=${PWD}/.client_cache
+
+# The same source under three build-ids, and a different one of the
+# same size under a fourth.  No debuginfod server needed, file:// will do.
+for id in aaaaaaaaaabbbbbbbbbbccccccccccdddddddddd \
+          bbbbbbbbbbccccccccccddddddddddeeeeeeeeee \
+          ccccccccccddddddddddeeeeeeeeeeffffffffff \
+          ddddddddddeeeeeeeeeeffffffffff0000000000; do
+    mkdir -p ${PWD}/mocktree/buildid/$id/source/my/path
+    echo "int main() { return 0; }" > ${PWD}/mocktree/buildid/$id/source/my/path/main.c
+done
+other=${PWD}/mocktree/buildid/ddddddddddeeeeeeeeeeffffffffff0000000000/source/my/path/main.c
+echo "int main() { return 1; }" > $other
+export DEBUGINFOD_URLS="file://${PWD}/mocktree/"
+
+find_source()
+{
+    testrun ${abs_top_builddir}/debuginfod/debuginfod-find source $1 /my/path/main.c
+}
+
+# Clean, and so keep the cache index, on every query.
+mkdir -p $DEBUGINFOD_CACHE_PATH
+echo 0 > $DEBUGINFOD_CACHE_PATH/cache_clean_interval_s
+
+export DEBUGINFOD_CACHE_DEDUP=1
+file1=`find_source aaaaaaaaaabbbbbbbbbbccccccccccdddddddddd`
+file2=`find_source bbbbbbbbbbccccccccccddddddddddeeeeeeeeee`
+file4=`find_source ddddddddddeeeeeeeeeeffffffffff0000000000`
+
+# The same content is stored once, different content is not shared.
+test `stat -c %i $file1` = `stat -c %i $file2`
+test `stat -c %h $file1` = 2
+test `stat -c %h $file4` = 1
+cmp $file4 $other
+
+# Both links are in the index with half of the blocks each.
+half=$((`stat -c %b $file1` * 512 / 2))
+for f in $file1 $file2; do
+    rel=`basename $(dirname $f)`/`basename $f`
+    test `grep " $rel\$" $DEBUGINFOD_CACHE_PATH/cache_index | tail -1 | cut -d' ' -f2` = $half
+done
+
+# Without DEBUGINFOD_CACHE_DEDUP every file keeps its own copy.
+unset DEBUGINFOD_CACHE_DEDUP
+file3=`find_source ccccccccccddddddddddeeeeeeeeeeffffffffff`
+test `stat -c %h $file3` = 1
+cmp $file1 $file3
+
+exit 0
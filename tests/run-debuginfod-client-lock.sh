@@ -0,0 +1,95 @@
+#!/usr/bin/env bash
+#
+# This file is part of elfutils.
+#
+# This file is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 3 of the License, or
+# (at your option) any later version.
+#
+# elfutils is distributed in the hope that it will be useful, but
+# WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+. $srcdir/debuginfod-subr.sh
+
+# for test case debugging, uncomment:
+set -x
+unset VALGRIND_CMD
+
+DB=${PWD}/.debuginfod_tmp.sqlite
+tempfiles $DB ${DB}-wal ${DB}-shm
+export DEBUGINFOD_CACHE_PATH=${PWD}/.client_cache
+
+# This variable is essential and ensures no time-race for claiming ports occurs
+# set base to a unique multiple of 100 not used in any other 'run-debuginfod-*' test
+base=14800
+get_ports
+
+# A program big enough that the downloads overlap.
+mkdir F
+tempfiles prog.c blob
+echo "int main() { return 0; }" > prog.c
+gcc -Wl,--build-id -g -o prog prog.c
+head -c 32M /dev/urandom > blob
+objcopy --add-section .debug_bench=blob prog F/prog
+rm -f prog
+BUILDID=`env LD_LIBRARY_PATH=$ldpath ${abs_builddir}/../src/readelf \
+          -n F/prog | grep 'Build ID' | awk '{print $3}'`
+
+env LD_LIBRARY_PATH=$ldpath DEBUGINFOD_URLS= ${abs_builddir}/../debuginfod/debuginfod $VERBOSE \
+    -F -d $DB -p $PORT1 -t0 -g0 F > vlog$PORT1 2>&1 &
+PID1=$!
+tempfiles vlog$PORT1
+errfiles vlog$PORT1
+
+wait_ready $PORT1 'ready' 1
+wait_ready $PORT1 'thread_work_total{role="traverse"}' 1
+wait_ready $PORT1 'thread_work_pending{role="scan"}' 0
+wait_ready $PORT1 'thread_busy{role="scan"}' 0
+
+# Many processes asking for the same file at the same moment download
+# it once, the others wait and take it from the cache.
+export DEBUGINFOD_URLS=http://127.0.0.1:$PORT1
+nclients=20
+pids=
+for i in `seq $nclients`; do
+    env LD_LIBRARY_PATH=$ldpath ${abs_top_builddir}/debuginfod/debuginfod-find \
+        debuginfo $BUILDID > path$i &
+    pids="$pids $!"
+    tempfiles path$i
+done
+for pid in $pids; do
+    wait $pid
+done
+
+for i in `seq $nclients`; do
+    cmp `cat path$i` F/prog
+done
+wait_ready $PORT1 'http_responses_total{result="file"}' 1
+
+# The same for a file nobody has: one query, the others see the
+# negative cache entry.
+pids=
+for i in `seq $nclients`; do
+    env LD_LIBRARY_PATH=$ldpath ${abs_top_builddir}/debuginfod/debuginfod-find \
+        executable 0000000000000000000000000000000000000000 &
+    pids="$pids $!"
+done
+for pid in $pids; do
+    if wait $pid; then false; fi
+done
+wait_ready $PORT1 'http_responses_total{result="error"}' 1
+
+# The lock files go away with the downloads.
+if find $DEBUGINFOD_CACHE_PATH -name '*.lock' | grep .; then false; fi
+
+kill $PID1
+wait $PID1
+PID1=0
+
+exit 0
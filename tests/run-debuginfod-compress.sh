@@ -0,0 +1,99 @@
+#!/usr/bin/env bash
+#
+# This file is part of elfutils.
+#
+# This file is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 3 of the License, or
+# (at your option) any later version.
+#
+# elfutils is distributed in the hope that it will be useful, but
+# WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+. $srcdir/debuginfod-subr.sh
+
+# for test case debugging, uncomment:
+set -x
+unset VALGRIND_CMD
+
+DB=${PWD}/.debuginfod_tmp.sqlite
+tempfiles $DB ${DB}-wal ${DB}-shm
+export DEBUGINFOD_CACHE_PATH=${PWD}/.client_cache
+
+# This variable is essential and ensures no time-race for claiming ports occurs
+# set base to a unique multiple of 100 not used in any other 'run-debuginfod-*' test
+base=14500
+get_ports
+
+# A program with a big, very compressible section and a random one.
+mkdir F
+tempfiles prog.c blob random
+echo "int main() { return 0; }" > prog.c
+gcc -Wl,--build-id -g -o prog prog.c
+head -c 1M /dev/zero > blob
+head -c 64K /dev/urandom > random
+objcopy --add-section .debug_bench=blob --add-section .debug_random=random prog F/prog
+rm -f prog
+BUILDID=`env LD_LIBRARY_PATH=$ldpath ${abs_builddir}/../src/readelf \
+          -n F/prog | grep 'Build ID' | awk '{print $3}'`
+
+env LD_LIBRARY_PATH=$ldpath DEBUGINFOD_URLS= ${abs_builddir}/../debuginfod/debuginfod $VERBOSE \
+    -F -d $DB -p $PORT1 -t0 -g0 --http-compress=gzip F > vlog$PORT1 2>&1 &
+PID1=$!
+tempfiles vlog$PORT1
+errfiles vlog$PORT1
+
+wait_ready $PORT1 'ready' 1
+wait_ready $PORT1 'thread_work_total{role="traverse"}' 1
+wait_ready $PORT1 'thread_work_pending{role="scan"}' 0
+wait_ready $PORT1 'thread_busy{role="scan"}' 0
+
+URL=http://127.0.0.1:$PORT1/buildid/$BUILDID
+tempfiles headers body body.gz
+
+# Without Accept-Encoding, the file is sent as it is.
+curl -s -D headers -o body $URL/executable
+if grep -i '^Content-Encoding:' headers; then false; fi
+cmp body F/prog
+
+# With it, compressed.
+curl -s -D headers -H 'Accept-Encoding: zstd;q=0, gzip' -o body.gz $URL/executable
+grep -i '^Content-Encoding: gzip' headers
+grep -i "^X-DEBUGINFOD-SIZE: `stat -c %s F/prog`" headers
+test `stat -c %s body.gz` -lt `stat -c %s F/prog`
+gzip -dc < body.gz > body
+cmp body F/prog
+
+# Sections too.
+curl -s -D headers -H 'Accept-Encoding: gzip' -o body.gz $URL/section/.debug_bench
+grep -i '^Content-Encoding: gzip' headers
+gzip -dc < body.gz > body
+cmp body blob
+
+# Not if the data doesn't compress.
+curl -s -D headers -H 'Accept-Encoding: gzip' -o body $URL/section/.debug_random
+if grep -i '^Content-Encoding:' headers; then false; fi
+cmp body random
+
+# Not if the client refuses it.
+curl -s -D headers -H 'Accept-Encoding: gzip;q=0' -o body $URL/executable
+if grep -i '^Content-Encoding:' headers; then false; fi
+cmp body F/prog
+
+# The client library decodes while writing to its cache.
+export DEBUGINFOD_URLS=http://127.0.0.1:$PORT1
+filename=`testrun ${abs_top_builddir}/debuginfod/debuginfod-find executable $BUILDID`
+cmp $filename F/prog
+
+wait_ready $PORT1 'http_responses_encoded_total{encoding="gzip"}' 3
+
+kill $PID1
+wait $PID1
+PID1=0
+
+exit 0
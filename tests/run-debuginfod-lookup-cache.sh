@@ -0,0 +1,84 @@
+#!/usr/bin/env bash
+#
+# This file is part of elfutils.
+#
+# This file is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 3 of the License, or
+# (at your option) any later version.
+#
+# elfutils is distributed in the hope that it will be useful, but
+# WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+. $srcdir/debuginfod-subr.sh
+
+# for test case debugging, uncomment:
+set -x
+unset VALGRIND_CMD
+
+DB=${PWD}/.debuginfod_tmp.sqlite
+tempfiles $DB ${DB}-wal ${DB}-shm
+
+# This variable is essential and ensures no time-race for claiming ports occurs
+# set base to a unique multiple of 100 not used in any other 'run-debuginfod-*' test
+base=15100
+get_ports
+
+mkdir F L
+env LD_LIBRARY_PATH=$ldpath DEBUGINFOD_URLS= ${abs_builddir}/../debuginfod/debuginfod $VERBOSE \
+    -F -d $DB -p $PORT1 -t0 -g0 --lookup-cache-ttl=3600 F > vlog$PORT1 2>&1 &
+PID1=$!
+tempfiles vlog$PORT1
+errfiles vlog$PORT1
+
+wait_ready $PORT1 'ready' 1
+wait_ready $PORT1 'thread_work_total{role="traverse"}' 1
+wait_ready $PORT1 'thread_work_pending{role="scan"}' 0
+wait_ready $PORT1 'thread_busy{role="scan"}' 0
+
+# A program the server doesn't know about yet.
+tempfiles prog.c
+echo "int main() { return 0; }" > prog.c
+gcc -Wl,--build-id -g -o L/prog prog.c
+BUILDID=`env LD_LIBRARY_PATH=$ldpath ${abs_builddir}/../src/readelf \
+          -a L/prog | grep 'Build ID' | cut -d ' ' -f 7`
+
+status()
+{
+    curl -s -o /dev/null -w '%{http_code}\n' http://127.0.0.1:$PORT1/buildid/$BUILDID/debuginfo
+}
+
+# The first lookup goes to the database and caches the 404, the
+# second is answered from the cache.
+test "`status`" = 404
+wait_ready $PORT1 'buildid_cache_op_count{op="miss"}' 1
+test "`status`" = 404
+wait_ready $PORT1 'buildid_cache_op_count{op="negative_hit"}' 1
+wait_ready $PORT1 'buildid_cache_count' 1
+
+# Once the scan that indexes the program commits, the cached 404 is
+# dropped and the program is served.
+cp L/prog F/prog
+kill -USR1 $PID1
+wait_ready $PORT1 'thread_work_total{role="traverse"}' 2
+wait_ready $PORT1 'thread_work_pending{role="scan"}' 0
+wait_ready $PORT1 'thread_busy{role="scan"}' 0
+wait_ready $PORT1 'buildid_cache_op_count{op="invalidate"}' 1
+wait_ready $PORT1 'buildid_cache_count' 0
+
+test "`status`" = 200
+wait_ready $PORT1 'buildid_cache_op_count{op="miss"}' 2
+test "`status`" = 200
+wait_ready $PORT1 'buildid_cache_op_count{op="hit"}' 1
+wait_ready $PORT1 'buildid_cache_op_count{op="negative_hit"}' 1
+
+kill $PID1
+wait $PID1
+PID1=0
+
+exit 0
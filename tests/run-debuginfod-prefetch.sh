@@ -0,0 +1,87 @@
+#!/usr/bin/env bash
+#
+# This file is part of elfutils.
+#
+# This file is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 3 of the License, or
+# (at your option) any later version.
+#
+# elfutils is distributed in the hope that it will be useful, but
+# WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+. $srcdir/debuginfod-subr.sh
+
+# for test case debugging, uncomment:
+set -x
+unset VALGRIND_CMD
+
+DB=${PWD}/.debuginfod_tmp.sqlite
+tempfiles $DB ${DB}-wal ${DB}-shm
+export DEBUGINFOD_CACHE_PATH=${PWD}/.client_cache
+
+# This variable is essential and ensures no time-race for claiming ports occurs
+# set base to a unique multiple of 100 not used in any other 'run-debuginfod-*' test
+base=14700
+get_ports
+
+# Many small programs, each with its own buildid, like the shared
+# libraries of a core file.
+mkdir F
+tempfiles prog.c
+nprogs=20
+for i in `seq $nprogs`; do
+    echo "int main() { return $i; }" > prog.c
+    gcc -Wl,--build-id -g -o F/prog$i prog.c
+done
+BUILDIDS=
+for i in `seq $nprogs`; do
+    BUILDIDS="$BUILDIDS `env LD_LIBRARY_PATH=$ldpath ${abs_builddir}/../src/readelf \
+                         -n F/prog$i | grep 'Build ID' | awk '{print $3}'`"
+done
+
+env LD_LIBRARY_PATH=$ldpath DEBUGINFOD_URLS= ${abs_builddir}/../debuginfod/debuginfod $VERBOSE \
+    -F -d $DB -p $PORT1 -t0 -g0 F > vlog$PORT1 2>&1 &
+PID1=$!
+tempfiles vlog$PORT1
+errfiles vlog$PORT1
+
+wait_ready $PORT1 'ready' 1
+wait_ready $PORT1 'thread_work_total{role="traverse"}' 1
+wait_ready $PORT1 'thread_work_pending{role="scan"}' 0
+wait_ready $PORT1 'thread_busy{role="scan"}' 0
+
+export DEBUGINFOD_URLS=http://127.0.0.1:$PORT1
+export DEBUGINFOD_PREFETCH_CONCURRENCY=4
+tempfiles paths
+
+# All of them at once.
+testrun ${abs_top_builddir}/debuginfod/debuginfod-find prefetch executable $BUILDIDS > paths
+test `wc -l < paths` -eq $nprogs
+for i in `seq $nprogs`; do
+    id=`echo $BUILDIDS | cut -d' ' -f$i`
+    grep -q "/$id/executable\$" paths
+    cmp $DEBUGINFOD_CACHE_PATH/$id/executable F/prog$i
+done
+wait_ready $PORT1 'http_responses_total{result="file"}' $nprogs
+
+# Now they are found in the cache, without asking the server.
+testrun ${abs_top_builddir}/debuginfod/debuginfod-find prefetch executable $BUILDIDS > paths
+test `wc -l < paths` -eq $nprogs
+wait_ready $PORT1 'http_responses_total{result="file"}' $nprogs
+
+# One not found fails, but the others are still fetched.
+rm -rf $DEBUGINFOD_CACHE_PATH
+if testrun ${abs_top_builddir}/debuginfod/debuginfod-find prefetch debuginfo $BUILDIDS 0000000000000000000000000000000000000000 > paths; then false; fi
+test `wc -l < paths` -eq $nprogs
+
+kill $PID1
+wait $PID1
+PID1=0
+
+exit 0
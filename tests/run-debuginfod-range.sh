@@ -0,0 +1,118 @@
+#!/usr/bin/env bash
+#
+# This file is part of elfutils.
+#
+# This file is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 3 of the License, or
+# (at your option) any later version.
+#
+# elfutils is distributed in the hope that it will be useful, but
+# WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+. $srcdir/debuginfod-subr.sh
+
+# for test case debugging, uncomment:
+set -x
+unset VALGRIND_CMD
+
+DB=${PWD}/.debuginfod_tmp.sqlite
+tempfiles $DB ${DB}-wal ${DB}-shm
+export DEBUGINFOD_CACHE_PATH=${PWD}/.client_cache
+
+# This variable is essential and ensures no time-race for claiming ports occurs
+# set base to a unique multiple of 100 not used in any other 'run-debuginfod-*' test
+base=14600
+get_ports
+
+# A program with a big debug section of random bytes, so that parts
+# not fetched, which read as zeros, don't compare equal by accident.
+mkdir F
+tempfiles prog.c blob
+echo "int main() { return 0; }" > prog.c
+gcc -Wl,--build-id -g -o prog prog.c
+head -c 1M /dev/urandom > blob
+objcopy --add-section .debug_bench=blob prog F/prog
+rm -f prog
+BUILDID=`env LD_LIBRARY_PATH=$ldpath ${abs_builddir}/../src/readelf \
+          -n F/prog | grep 'Build ID' | awk '{print $3}'`
+SIZE=`stat -c %s F/prog`
+
+env LD_LIBRARY_PATH=$ldpath DEBUGINFOD_URLS= ${abs_builddir}/../debuginfod/debuginfod $VERBOSE \
+    -F -d $DB -p $PORT1 -t0 -g0 F > vlog$PORT1 2>&1 &
+PID1=$!
+tempfiles vlog$PORT1
+errfiles vlog$PORT1
+
+wait_ready $PORT1 'ready' 1
+wait_ready $PORT1 'thread_work_total{role="traverse"}' 1
+wait_ready $PORT1 'thread_work_pending{role="scan"}' 0
+wait_ready $PORT1 'thread_busy{role="scan"}' 0
+
+URL=http://127.0.0.1:$PORT1/buildid/$BUILDID
+tempfiles headers body slice
+
+# A range, an open ended range and a suffix range.
+curl -s -D headers -r 1000-100999 -o body $URL/debuginfo
+grep '^HTTP/1.1 206' headers
+grep -i "^Content-Range: bytes 1000-100999/$SIZE" headers
+grep -i '^Accept-Ranges: bytes' headers
+dd if=F/prog of=slice bs=1000 skip=1 count=100 2>/dev/null
+cmp body slice
+
+curl -s -D headers -r $((SIZE - 10))- -o body $URL/debuginfo
+grep '^HTTP/1.1 206' headers
+grep -i "^Content-Range: bytes $((SIZE - 10))-$((SIZE - 1))/$SIZE" headers
+tail -c 10 F/prog | cmp body -
+
+curl -s -D headers -r -10 -o body $URL/debuginfo
+grep '^HTTP/1.1 206' headers
+tail -c 10 F/prog | cmp body -
+
+# Past the end of the file.
+curl -s -D headers -r $SIZE- -o body $URL/debuginfo
+grep '^HTTP/1.1 416' headers
+grep -i "^Content-Range: bytes \*/$SIZE" headers
+
+# Not compressed, even if the client would accept it.
+curl -s -D headers -r 0-99 -H 'Accept-Encoding: gzip' -o body $URL/debuginfo
+grep '^HTTP/1.1 206' headers
+if grep -i '^Content-Encoding:' headers; then false; fi
+
+# The client fetches just what is asked for into a sparse file.
+export DEBUGINFOD_URLS=http://127.0.0.1:$PORT1
+filename=`testrun ${abs_top_builddir}/debuginfod/debuginfod-find debuginfo-range $BUILDID 300000 5000`
+test -f $filename
+test `stat -c %s $filename` -eq $SIZE
+dd if=$filename of=body bs=1000 skip=300 count=5 2>/dev/null
+dd if=F/prog of=slice bs=1000 skip=300 count=5 2>/dev/null
+cmp body slice
+# One block of 64K, not the whole file.
+if cmp $filename F/prog; then false; fi
+
+# Asking again is served from the cache, asking for more fills it in.
+testrun ${abs_top_builddir}/debuginfod/debuginfod-find debuginfo-range $BUILDID 300000 5000
+testrun ${abs_top_builddir}/debuginfod/debuginfod-find debuginfo-range $BUILDID 0 $SIZE
+cmp $filename F/prog
+
+# The four satisfiable ranges above and the two client fetches.
+wait_ready $PORT1 'http_responses_range_total' 6
+
+# DEBUGINFOD_MAXSIZE limits the whole file, not just the range.
+rm -rf $DEBUGINFOD_CACHE_PATH
+if env DEBUGINFOD_MAXSIZE=$((SIZE - 1)) LD_LIBRARY_PATH=$ldpath \
+     ${abs_top_builddir}/debuginfod/debuginfod-find debuginfo-range \
+     $BUILDID 0 100; then false; fi
+env DEBUGINFOD_MAXSIZE=$SIZE LD_LIBRARY_PATH=$ldpath \
+  ${abs_top_builddir}/debuginfod/debuginfod-find debuginfo-range $BUILDID 0 100
+
+kill $PID1
+wait $PID1
+PID1=0
+
+exit 0
@@ -0,0 +1,80 @@
+#!/usr/bin/env bash
+#
+# This file is part of elfutils.
+#
+# This file is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 3 of the License, or
+# (at your option) any later version.
+#
+# elfutils is distributed in the hope that it will be useful, but
+# WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+. $srcdir/debuginfod-subr.sh
+
+# for test case debugging, uncomment:
+set -x
+unset VALGRIND_CMD
+
+# This variable is essential and ensures no time-race for claiming ports occurs
+# set base to a unique multiple of 100 not used in any other 'run-debuginfod-*' test
+base=14300
+get_ports
+
+# A synthetic archive tree: many copies of the same rpms under
+# different names, so each one is a separate archive to index.
+copies=25
+mkdir R
+for i in `seq $copies`; do
+    mkdir R/$i
+    for f in ${abs_srcdir}/debuginfod-rpms/rhel7/*.rpm; do
+        cp -p $f R/$i/copy$i-`basename $f`
+    done
+done
+rpms=`ls R/*/*.rpm | wc -l`
+
+# Index the tree committing every row on its own, then in batches,
+# and report the time spent in sqlite and overall.
+for batch in 1 64; do
+    DB=${PWD}/.debuginfod_tmp$batch.sqlite
+    tempfiles $DB ${DB}-wal ${DB}-shm
+
+    start=`date +%s.%N`
+    env LD_LIBRARY_PATH=$ldpath DEBUGINFOD_URLS= ${abs_builddir}/../debuginfod/debuginfod $VERBOSE -R \
+        -d $DB -p $PORT1 -t0 -g0 --scan-batch=$batch R > vlog$PORT1 2>&1 &
+    PID1=$!
+    tempfiles vlog$PORT1
+    errfiles vlog$PORT1
+
+    wait_ready $PORT1 'ready' 1
+    wait_ready $PORT1 'thread_work_total{role="traverse"}' 1
+    wait_ready $PORT1 'scanned_files_total{source=".rpm archive"}' $rpms
+    wait_ready $PORT1 'thread_work_pending{role="scan"}' 0
+    wait_ready $PORT1 'thread_busy{role="scan"}' 0
+    end=`date +%s.%N`
+
+    sqlite_ms=`curl -s http://127.0.0.1:$PORT1/metrics | awk '/^sqlite3_milliseconds_sum/ { s += $2 } END { print s }'`
+    echo "scan-batch=$batch: $rpms rpms indexed in" `echo "$start $end" | awk '{ print $2 - $1 }'` "s, sqlite ${sqlite_ms} ms"
+
+    # Everything must be committed and visible to the webapi by now.
+    curl -s -o /dev/null -w '%{http_code}\n' http://127.0.0.1:$PORT1/buildid/bc1febfd03ca05e030f0d205f7659db29f8a4b30/executable | grep 200
+    curl -s "http://127.0.0.1:$PORT1/metadata?key=glob&value=/usr/bin/*" > metadata$batch.json
+    tempfiles metadata$batch.json
+    grep -o '"buildid"' metadata$batch.json | wc -l > count$batch
+    tempfiles count$batch
+    test `cat count$batch` -gt 0
+
+    kill $PID1
+    wait $PID1
+    PID1=0
+done
+
+# Batching must not change what got recorded.
+cmp count1 count64
+
+exit 0
@@ -120,6 +120,11 @@ curl -s http://localhost:$PORT1/metrics | awk '
 	full = $NF
 }
 
+/^xz_index_cache_op_count\{op="hit"\}/ {
+	print
+	index_hits = $NF
+}
+
 END {
 	if (seekable == 0) {
 		print "error: no seekable extractions" > "/dev/stderr"
@@ -129,6 +134,10 @@ END {
 		print "error: no fdcache hits" > "/dev/stderr"
 		exit 1
 	}
+	if (index_hits == 0) {
+		print "error: no xz index cache hits" > "/dev/stderr"
+		exit 1
+	}
 	if (full > 0) {
 		print "error: " full " full extractions" > "/dev/stderr"
 		exit 1
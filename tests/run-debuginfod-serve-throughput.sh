@@ -0,0 +1,97 @@
+#!/usr/bin/env bash
+#
+# This file is part of elfutils.
+#
+# This file is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 3 of the License, or
+# (at your option) any later version.
+#
+# elfutils is distributed in the hope that it will be useful, but
+# WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+. $srcdir/debuginfod-subr.sh
+
+# for test case debugging, uncomment:
+set -x
+unset VALGRIND_CMD
+
+# Serve a big file and a big section of it to many clients at once
+# over loopback, and report the throughput.  The sizes are kept small
+# for the testsuite; for a real benchmark run e.g. with
+# DEBUGINFOD_BENCH_MB=4096 DEBUGINFOD_BENCH_CLIENTS=32.
+mbs=${DEBUGINFOD_BENCH_MB:-64}
+clients=${DEBUGINFOD_BENCH_CLIENTS:-8}
+
+DB=${PWD}/.debuginfod_tmp.sqlite
+tempfiles $DB ${DB}-wal ${DB}-shm
+
+# This variable is essential and ensures no time-race for claiming ports occurs
+# set base to a unique multiple of 100 not used in any other 'run-debuginfod-*' test
+base=14400
+get_ports
+
+# A program with a big debug section.
+mkdir F
+tempfiles prog.c blob
+echo "int main() { return 0; }" > prog.c
+gcc -Wl,--build-id -g -o prog prog.c
+head -c ${mbs}M /dev/urandom > blob
+objcopy --add-section .debug_bench=blob prog F/prog
+rm -f prog
+BUILDID=`env LD_LIBRARY_PATH=$ldpath ${abs_builddir}/../src/readelf \
+          -n F/prog | grep 'Build ID' | awk '{print $3}'`
+filesize=`stat -c %s F/prog`
+sectionsize=`stat -c %s blob`
+
+env LD_LIBRARY_PATH=$ldpath DEBUGINFOD_URLS= ${abs_builddir}/../debuginfod/debuginfod $VERBOSE \
+    -F -d $DB -p $PORT1 -t0 -g0 F > vlog$PORT1 2>&1 &
+PID1=$!
+tempfiles vlog$PORT1
+errfiles vlog$PORT1
+
+wait_ready $PORT1 'ready' 1
+wait_ready $PORT1 'thread_work_total{role="traverse"}' 1
+wait_ready $PORT1 'thread_work_pending{role="scan"}' 0
+wait_ready $PORT1 'thread_busy{role="scan"}' 0
+
+# Fetch URL from all the clients at once, check each got SIZE bytes,
+# and print the aggregate throughput.
+fetch_all()
+{
+    url=$1
+    size=$2
+    pids=
+    start=`date +%s.%N`
+    for i in `seq $clients`; do
+        curl -s -o /dev/null -w '%{http_code} %{size_download}\n' $url > fetch$i &
+        pids="$pids $!"
+    done
+    wait $pids
+    end=`date +%s.%N`
+    for i in `seq $clients`; do
+        tempfiles fetch$i
+        test "`cat fetch$i`" = "200 $size"
+    done
+    echo "$url: $clients x $size bytes in" \
+         `echo "$start $end $clients $size" | awk '{ t = $2 - $1; printf "%.3f s, %.1f MB/s", t, $3 * $4 / t / 1048576 }'`
+}
+
+fetch_all http://127.0.0.1:$PORT1/buildid/$BUILDID/executable $filesize
+fetch_all http://127.0.0.1:$PORT1/buildid/$BUILDID/section/.debug_bench $sectionsize
+
+# The section is exactly the blob, sent from the middle of the file.
+curl -s -o section http://127.0.0.1:$PORT1/buildid/$BUILDID/section/.debug_bench
+tempfiles section
+cmp section blob
+
+kill $PID1
+wait $PID1
+PID1=0
+
+exit 0
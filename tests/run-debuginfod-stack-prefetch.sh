@@ -0,0 +1,89 @@
+#!/usr/bin/env bash
+#
+# This file is part of elfutils.
+#
+# This file is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 3 of the License, or
+# (at your option) any later version.
+#
+# elfutils is distributed in the hope that it will be useful, but
+# WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+. $srcdir/debuginfod-subr.sh
+
+# for test case debugging, uncomment:
+set -x
+unset VALGRIND_CMD
+
+DB=${PWD}/.debuginfod_tmp.sqlite
+tempfiles $DB ${DB}-wal ${DB}-shm
+export DEBUGINFOD_CACHE_PATH=${PWD}/.client_cache
+
+# This variable is essential and ensures no time-race for claiming ports occurs
+# set base to a unique multiple of 100 not used in any other 'run-debuginfod-*' test
+base=15200
+get_ports
+
+# A waiting program whose debuginfo only the server has.
+mkdir F L
+tempfiles prog.c
+echo "#include <unistd.h>" > prog.c
+echo "int main (void) { pause (); return 0; }" >> prog.c
+gcc -Wl,--build-id -g -o L/prog prog.c
+testrun ${abs_top_builddir}/src/strip -f F/prog.debug L/prog
+BUILDID=`env LD_LIBRARY_PATH=$ldpath ${abs_builddir}/../src/readelf \
+          -n L/prog | grep 'Build ID' | awk '{print $3}'`
+
+env LD_LIBRARY_PATH=$ldpath DEBUGINFOD_URLS= ${abs_builddir}/../debuginfod/debuginfod $VERBOSE \
+    -F -d $DB -p $PORT1 -t0 -g0 F > vlog$PORT1 2>&1 &
+PID1=$!
+tempfiles vlog$PORT1
+errfiles vlog$PORT1
+
+wait_ready $PORT1 'ready' 1
+wait_ready $PORT1 'thread_work_total{role="traverse"}' 1
+wait_ready $PORT1 'thread_work_pending{role="scan"}' 0
+wait_ready $PORT1 'thread_busy{role="scan"}' 0
+
+L/prog &
+PID2=$!
+sleep 1
+tempfiles bt bt.err
+
+export DEBUGINFOD_URLS=http://127.0.0.1:$PORT1
+export DEBUGINFOD_VERBOSE=1
+
+# Prefetching is opt-in.
+testrun ${abs_top_builddir}/src/stack -q -p $PID2 > bt 2> bt.err || true
+cat bt.err
+if grep -q -E ': dwfl_linux_proc_attach pid ([[:digit:]]+): ' bt.err; then
+    echo >&2 cannot attach to process
+    exit 77
+fi
+if grep -q 'prefetching' bt.err; then
+    exit 1
+fi
+
+# With --prefetch the files of all modules are queued at once, and the
+# lookup for the debuginfo of the program doesn't download it again.
+testrun ${abs_top_builddir}/src/stack -d --prefetch -p $PID2 > bt 2> bt.err || true
+cat bt bt.err
+grep -q 'prefetching [1-9][0-9]* files' bt.err
+grep -qw main bt
+test -f $DEBUGINFOD_CACHE_PATH/$BUILDID/debuginfo
+wait_ready $PORT1 'http_responses_total{result="file"}' 1
+
+kill $PID2
+wait $PID2 || :
+PID2=0
+kill $PID1
+wait $PID1
+PID1=0
+
+exit 0
@@ -0,0 +1,25 @@
+#! /bin/sh
+# Concurrent lookups in plain and read-mostly eu-search trees
+# This file is part of elfutils.
+#
+# This file is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 3 of the License, or
+# (at your option) any later version.
+#
+# elfutils is distributed in the hope that it will be useful, but
+# WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+. $srcdir/thread-safety-subr.sh
+
+check_thread_safety_enabled
+
+# Only check the lookups are right, the timings are just printed.
+# Run eu_search_scaling without arguments for the full benchmark up
+# to 64 threads.
+testrun ${abs_builddir}/eu_search_scaling 16 20000
@@ -0,0 +1,41 @@
+#! /bin/sh
+# This file is part of elfutils.
+#
+# This file is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 3 of the License, or
+# (at your option) any later version.
+#
+# elfutils is distributed in the hope that it will be useful, but
+# WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+. $srcdir/test-subr.sh
+
+# getsrc-lazy looks up every line address with dwarf_getsrc_lazy
+# and fails if any result differs from dwarf_getsrc_die.
+
+testfiles testfile-inlines
+testrun_compare ${abs_builddir}/getsrc-lazy testfile-inlines << EOF
+1 CUs, 44 addresses, 41 with line
+EOF
+
+# One sequence goes back to a lower address half way.
+testfiles testfile-dw-form-indirect
+testrun_compare ${abs_builddir}/getsrc-lazy testfile-dw-form-indirect << EOF
+1 CUs, 160 addresses, 154 with line
+EOF
+
+# Split units get the lines from the skeleton.
+testfiles testfile-dwp-5 testfile-dwp-5.dwp
+testrun_compare ${abs_builddir}/getsrc-lazy testfile-dwp-5 << EOF
+3 CUs, 222 addresses, 215 with line
+EOF
+
+testrun_on_self_quiet ${abs_builddir}/getsrc-lazy
+
+exit 0
@@ -0,0 +1,39 @@
+#! /bin/sh
+# This file is part of elfutils.
+#
+# This file is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 3 of the License, or
+# (at your option) any later version.
+#
+# elfutils is distributed in the hope that it will be useful, but
+# WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+. $srcdir/test-subr.sh
+
+# units-parallel handles all units once with one thread and once with
+# the given number of threads and fails if the results differ.
+
+testfiles testfile-dwarf-5
+testrun_compare ${abs_builddir}/units-parallel 4 testfile-dwarf-5 << EOF
+unit type 1 [c] hello.c: 38 dies, 4 files, 32 lines
+unit type 1 [218] world.c: 36 dies, 4 files, 25 lines
+EOF
+
+# Skeleton units are handled through their split unit in the .dwp file.
+testfiles testfile-dwp-5 testfile-dwp-5.dwp
+testrun_compare ${abs_builddir}/units-parallel 4 testfile-dwp-5 << EOF
+unit type 4 [14] foo.cc: 22 dies, 4 files, 63 lines
+unit type 4 [49] bar.cc: 9 dies, 4 files, 7 lines
+unit type 4 [7e] main.cc: 40 dies, 4 files, 41 lines
+EOF
+
+# Zero threads means one per CPU.
+testrun_on_self_quiet ${abs_builddir}/units-parallel 0
+
+exit 0
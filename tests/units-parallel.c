@@ -0,0 +1,204 @@
+/* Test program for dwarf_units_parallel_foreach
+   This file is part of elfutils.
+
+   This file is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   elfutils is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <dwarf.h>
+#include ELFUTILS_HEADER(dw)
+
+/* What we found for one unit.  */
+struct unit_info
+{
+  uint8_t unit_type;
+  Dwarf_Off offset;
+  const char *name;
+  size_t ndies;
+  size_t nfiles;
+  size_t nlines;
+};
+
+struct results
+{
+  pthread_mutex_t lock;
+  struct unit_info *info;
+  size_t ninfo;
+  size_t allocated;
+};
+
+static size_t
+count_dies (Dwarf_Die *parent)
+{
+  size_t n = 1;
+  Dwarf_Die die;
+  if (dwarf_child (parent, &die) == 0)
+    do
+      n += count_dies (&die);
+    while (dwarf_siblingof (&die, &die) == 0);
+  return n;
+}
+
+static int
+handle_unit (Dwarf_CU *cu, void *arg)
+{
+  struct results *results = arg;
+  struct unit_info info = { .name = NULL };
+  Dwarf_Die cudie, subdie;
+  if (dwarf_cu_info (cu, NULL, &info.unit_type, &cudie, &subdie,
+		     NULL, NULL, NULL) != 0)
+    {
+      printf ("dwarf_cu_info: %s\n", dwarf_errmsg (-1));
+      exit (1);
+    }
+
+  info.offset = dwarf_dieoffset (&cudie);
+  if (info.unit_type == DW_UT_skeleton && dwarf_tag (&subdie) != 0)
+    cudie = subdie;
+
+  info.name = dwarf_diename (&cudie);
+  info.ndies = count_dies (&cudie);
+
+  Dwarf_Files *files;
+  if (dwarf_getsrcfiles (&cudie, &files, &info.nfiles) != 0)
+    info.nfiles = 0;
+  Dwarf_Lines *lines;
+  if (dwarf_getsrclines (&cudie, &lines, &info.nlines) != 0)
+    info.nlines = 0;
+
+  pthread_mutex_lock (&results->lock);
+  if (results->ninfo == results->allocated)
+    {
+      results->allocated = results->allocated * 2 + 16;
+      results->info = realloc (results->info,
+			       results->allocated * sizeof (info));
+      if (results->info == NULL)
+	{
+	  puts ("out of memory");
+	  exit (1);
+	}
+    }
+  results->info[results->ninfo++] = info;
+  pthread_mutex_unlock (&results->lock);
+
+  return DWARF_CB_OK;
+}
+
+static int
+compare_info (const void *p1, const void *p2)
+{
+  const struct unit_info *i1 = p1;
+  const struct unit_info *i2 = p2;
+  if (i1->unit_type != i2->unit_type)
+    return i1->unit_type < i2->unit_type ? -1 : 1;
+  if (i1->offset != i2->offset)
+    return i1->offset < i2->offset ? -1 : 1;
+  return 0;
+}
+
+static void
+collect (const char *file, unsigned int nthreads, struct results *results)
+{
+  int fd = open (file, O_RDONLY);
+  Dwarf *dbg = dwarf_begin (fd, DWARF_C_READ);
+  if (dbg == NULL)
+    {
+      printf ("%s not usable: %s\n", file, dwarf_errmsg (-1));
+      exit (1);
+    }
+
+  pthread_mutex_init (&results->lock, NULL);
+  results->info = NULL;
+  results->ninfo = 0;
+  results->allocated = 0;
+  if (dwarf_units_parallel_foreach (dbg, nthreads, handle_unit,
+				    results) != 0)
+    {
+      printf ("dwarf_units_parallel_foreach: %s\n", dwarf_errmsg (-1));
+      exit (1);
+    }
+  pthread_mutex_destroy (&results->lock);
+  qsort (results->info, results->ninfo, sizeof (results->info[0]),
+	 compare_info);
+
+  /* Keep the names around after dwarf_end.  */
+  for (size_t i = 0; i < results->ninfo; i++)
+    if (results->info[i].name != NULL)
+      results->info[i].name = strdup (results->info[i].name);
+
+  dwarf_end (dbg);
+  close (fd);
+}
+
+/* Handle all units of FILE with one thread and with NTHREADS threads
+   and check the results are the same.  */
+int
+main (int argc, char *argv[])
+{
+  if (argc != 3)
+    {
+      fprintf (stderr, "usage: %s NTHREADS FILE\n", argv[0]);
+      return -1;
+    }
+
+  unsigned int nthreads = atoi (argv[1]);
+  struct results seq, par;
+  collect (argv[2], 1, &seq);
+  collect (argv[2], nthreads, &par);
+
+  int result = 0;
+  if (seq.ninfo != par.ninfo)
+    {
+      printf ("%zu units with one thread, %zu with %u threads\n",
+	      seq.ninfo, par.ninfo, nthreads);
+      result = 1;
+    }
+
+  for (size_t i = 0; i < seq.ninfo; i++)
+    {
+      struct unit_info *s = &seq.info[i];
+      printf ("unit type %" PRIu8 " [%" PRIx64 "] %s: %zu dies, "
+	      "%zu files, %zu lines\n", s->unit_type, s->offset,
+	      s->name ?: "???", s->ndies, s->nfiles, s->nlines);
+      if (i < par.ninfo)
+	{
+	  struct unit_info *p = &par.info[i];
+	  if (s->unit_type != p->unit_type || s->offset != p->offset
+	      || s->ndies != p->ndies || s->nfiles != p->nfiles
+	      || s->nlines != p->nlines)
+	    {
+	      printf ("mismatch with %u threads\n", nthreads);
+	      result = 1;
+	    }
+	}
+    }
+
+  for (size_t i = 0; i < seq.ninfo; i++)
+    free ((char *) seq.info[i].name);
+  for (size_t i = 0; i < par.ninfo; i++)
+    free ((char *) par.info[i].name);
+  free (seq.info);
+  free (par.info);
+
+  return result;
+}